@@ -371,6 +371,7 @@ class EnergyTable {
     bool inSiteAlphabet(int siteIdx, const string& aa) { return aaIndices[siteIdx].find(aa) != aaIndices[siteIdx].end(); }
     int indexInSiteAlphabet(int siteIdx, const string& aa) { return aaIndices[siteIdx][aa]; }
     bool empty() const { return selfE.empty() && pairE.empty(); }
+    size_t memoryFootprint() const; // approximate number of bytes held by the table
 
     // -- get/set energy-table components
     mstreal selfEnergy(int s, int aa);
@@ -386,6 +387,30 @@ class EnergyTable {
     mstreal meanEnergy() const;
     mstreal energyStdEst(int n = 1000);
 
+    /* Scores many solutions at once. sols is an N x numSites() matrix stored
+     * row by row: sols[n*numSites() + si] is the index, into the alphabet of
+     * site si, of the residue that solution n has there. Returns the N energies,
+     * identical to what scoreSolution() gives. If selfDecomp is given, it is
+     * filled with the N x numSites() matrix of self energies; if pairDecomp is
+     * given, with the N x P matrix of pair energies, where column p corresponds
+     * to the p-th pair returned by interactingPairs(). The table is flattened
+     * for the occasion, and solutions are scored in blocks, site by site across
+     * the block, with blocks distributed over numThreads threads (interpreted as
+     * in MstUtils::numThreads). */
+    vector<mstreal> scoreSolutions(const vector<res_t>& sols, vector<mstreal>* selfDecomp = NULL, vector<mstreal>* pairDecomp = NULL, int numThreads = 0);
+    vector<mstreal> scoreSequences(const vector<Sequence>& seqs, int numThreads = 0) { return scoreSolutions(sequencesToSolutions(seqs), NULL, NULL, numThreads); }
+    vector<pair<int, int> > interactingPairs() const; // site pairs (i < j) with pair energies
+
+    /* Converts sequences into a solution matrix for scoreSolutions(), as
+     * sequenceToSolution() would in strict mode. */
+    vector<res_t> sequencesToSolutions(const vector<Sequence>& seqs);
+
+    /* Reads sequences (in single-letter code) from either a FASTA file or a file
+     * with one sequence per line, depending on whether the first non-empty line
+     * starts with '>', directly into a solution matrix for scoreSolutions(). If
+     * names is given, FASTA identifiers are stored in it. */
+    vector<res_t> readSolutions(const string& seqFile, vector<string>* names = NULL);
+
     // -- optimization routines
     vector<int> randomSolution() const;
     int randomResidue(int si) const;
@@ -429,6 +454,9 @@ class EnergyTable {
     int getResidueIndex(int si, const string& aa) { return aaIndices[si][aa]; }
 
   private:
+    // alphabet index at each site of each residue type (by SeqTools index), or -1
+    vector<vector<int> > residueTypeToAlphabet();
+
     /* siteIndices["A,1"] is the index corresponding to site "A,1" (or however
      * sites are designated). */
     map<string, int> siteIndices;
@@ -83,6 +83,9 @@ class ConFind {
     void cache(const vector<Residue*>& residues);
     void cache(Residue* res);
 
+    // approximate number of bytes held by cached data (not counting the rotamer library)
+    size_t memoryFootprint() const;
+
     // find those residues that are close enough to affect the passed residue(s)
     vector<Residue*> getNeighbors(Residue* residue);
     vector<Residue*> getNeighbors(vector<Residue*>& residues);
@@ -7,10 +7,15 @@
 #include <list>
 #include <chrono>
 #include <limits.h>
+#include <unordered_map>
+#include <cstdint>
+#include <bitset>
+#include <memory>
 
 using namespace MST;
 
 class fasstSolutionSet;
+class fasstMatchView;
 class fasstSolutionAddress {
   public:
     fasstSolutionAddress() { targetIndex = -1; }
@@ -34,29 +39,37 @@ class fasstSolutionAddress {
 class fasstSolution {
   friend class fasstSolutionSet;
   public:
+    /* Address of a residue within a FASST database: a 32-bit target index and a
+     * 16-bit residue index, packed into 48 bits (three shorts, so that arrays of
+     * addresses carry no alignment padding). */
     class resAddress {
       public:
         resAddress(int ti = 0, int ri = 0) {
           if ((ti < 0) || (ri < 0)) MstUtils::error("indices cannot be negative!", "fasstSolution::resAddress::resAddress(int, int)");
-          if ((ti > USHRT_MAX) || (ri > USHRT_MAX)) MstUtils::error("residue address indices (" + MstUtils::toString(ti) + ", " + MstUtils::toString(ri) + ") out of range for a short, recompile with int!", "fasstSolution::resAddress::resAddress(int, int)");
-          targIdx = ti; resIdx = ri;
+          if (ri > USHRT_MAX) MstUtils::error("residue index " + MstUtils::toString(ri) + " (in target " + MstUtils::toString(ti) + ") out of range for a residue address", "fasstSolution::resAddress::resAddress(int, int)");
+          setTargIndex(ti); resIdx = ri;
+        }
+        unsigned int targIndex() const { return (((unsigned int) targIdxHi) << 16) | targIdxLo; }
+        unsigned int resIndex() const { return resIdx; }
+        void setTargIndex(unsigned int ti) { targIdxLo = ti & 0xFFFF; targIdxHi = ti >> 16; }
+        void setResIndex(unsigned int ri) {
+          if (ri > USHRT_MAX) MstUtils::error("residue index " + MstUtils::toString(ri) + " out of range for a residue address", "fasstSolution::resAddress::setResIndex(unsigned int)");
+          resIdx = ri;
         }
-        unsigned short& targIndex() { return targIdx; }
-        unsigned short& resIndex() { return resIdx; }
         friend bool operator<(const resAddress& ai, const resAddress& aj) {
-          if (ai.targIdx != aj.targIdx) return (ai.targIdx < aj.targIdx);
+          if (ai.targIdxHi != aj.targIdxHi) return (ai.targIdxHi < aj.targIdxHi);
+          if (ai.targIdxLo != aj.targIdxLo) return (ai.targIdxLo < aj.targIdxLo);
           return (ai.resIdx < aj.resIdx);
         }
         friend bool operator>(const resAddress& ai, const resAddress& aj) {
-          if (ai.targIdx != aj.targIdx) return (ai.targIdx > aj.targIdx);
-          return (ai.resIdx > aj.resIdx);
+          return (aj < ai);
         }
         friend bool operator==(const resAddress& ai, const resAddress& aj) {
-          return (ai.targIdx == aj.targIdx) && (ai.resIdx == aj.resIdx);
+          return (ai.targIdxLo == aj.targIdxLo) && (ai.targIdxHi == aj.targIdxHi) && (ai.resIdx == aj.resIdx);
         }
 
       private:
-        unsigned short targIdx, resIdx;
+        unsigned short targIdxLo, targIdxHi, resIdx;
     };
     // typedef pair<short,short> resAddress;
 
@@ -180,7 +193,7 @@ class fasstSolutionSet {
   public:
     typedef fasstSolution::resAddress resAddress;
 
-    fasstSolutionSet() { updated = false; }
+    fasstSolutionSet() { updated = false; useRedIndex = true; }
     fasstSolutionSet(const fasstSolution& sol);
     fasstSolutionSet(const fasstSolutionSet& sols);
     fasstSolutionSet(const vector<fasstSolutionAddress>& addresses, const vector<int>& segLengths);
@@ -197,7 +210,7 @@ class fasstSolutionSet {
     fasstSolution& operator[] (int i);
     int size() const { return solsSet.size(); }
     void init(int numSegs) { clear(); solsByCenRes.resize(numSegs); algnRedBar.resize(numSegs); algnRedBarSource.resize(numSegs); }
-    void clear() { solsSet.clear(); solsByCenRes.clear(); updated = true; }
+    void clear() { solsSet.clear(); solsByCenRes.clear(); redIndex.clear(); updated = true; }
     mstreal worstRMSD() { return (solsSet.rbegin())->getRMSD(); }
     mstreal bestRMSD() { return (solsSet.begin())->getRMSD(); }
     vector<fasstSolution*> orderByDiscovery();
@@ -216,6 +229,14 @@ class fasstSolutionSet {
     void write(ostream &_os) const; // write fasstSolutionSet to a binary stream
     void read(istream &_os);  // read fasstSolutionSet from a binary stream
 
+    /* Sequence-based redundancy filtering (insert with a redundancyCut below 1)
+     * by default consults an index of the sequence contexts of accepted solutions,
+     * so that each new solution is only compared with those that could possibly be
+     * redundant with it. The outcome is the same either way; turning indexing off
+     * compares each new solution with every accepted one. */
+    void setRedundancyIndexing(bool use) { useRedIndex = use; redIndex.clear(); }
+    bool getRedundancyIndexing() const { return useRedIndex; }
+
     friend ostream& operator<<(ostream &_os, const fasstSolutionSet& _sols) {
       for (auto it = _sols.solsSet.begin(); it != _sols.solsSet.end(); ++it) {
         _os << *it;
@@ -228,7 +249,65 @@ class fasstSolutionSet {
     // meets the identity cutoff cut established for alignment length L0
     bool isWithinSeqID(int L0, mstreal cut, int numTot, int numID);
 
+    // whether the sequence contexts of segment i of the two solutions are within
+    // the identity cutoff, by a residue-by-residue comparison
+    bool contextsWithinSeqID(const fasstSolution& solA, const fasstSolution& solB, int i, mstreal cut);
+
+    void rebuildRedundancyIndex(const fasstSolution& sol, mstreal cut);
+
   private:
+    /* Packed sequence contexts of accepted solutions, for redundancy filtering.
+     * When neither of two solutions has gaps in the context of segment i, the
+     * residues compared between them are always the same L0 positions (the
+     * segment, then padding in the order in which it is consumed). Solutions
+     * with gap-free contexts are thus stored as byte strings of these windows,
+     * compared with a simple loop the compiler can vectorize. Two such solutions
+     * can only be within the identity cutoff for segment i if they differ in at
+     * most floor(L0 * (1 - cut)) window positions, so if the window is split
+     * into one more block than that, they must agree on at least one block. An
+     * inverted index from block contents to solutions thus gives all candidates
+     * for redundancy, without misses. Solutions with gaps in their contexts are
+     * always candidates and are compared residue by residue. */
+    class redundancyIndex {
+      public:
+        struct entry {
+          vector<unsigned char> win; // windows of all segments, back to back
+          vector<uint64_t> keys;     // keys of all blocks of all segments
+          bool clean;                // no gaps or unpackable residues in any window
+        };
+
+        redundancyIndex() { cut = 1; }
+        void clear() { entries.clear(); buckets.clear(); unclean.clear(); segLen.clear(); padLen.clear(); winOff.clear(); numBlocks.clear(); }
+        bool configuredFor(const fasstSolution& sol, mstreal _cut) const;
+        void configure(const fasstSolution& sol, mstreal _cut);
+        entry pack(const fasstSolution& sol) const;
+        void add(const fasstSolution* sol, const entry& e);
+        void remove(const fasstSolution* sol);
+        const entry* find(const fasstSolution* sol) const;
+        int size() const { return entries.size(); }
+        int windowLength(int i) const { return segLen[i] + padLen[i]; }
+
+        // appends to cands all solutions that may be redundant with the one
+        // packed into e; returns false if no such filtering is possible for e
+        bool candidates(const entry& e, vector<const fasstSolution*>& cands) const;
+
+        // number of identical positions in the windows of segment i of two clean entries
+        int windowIdentity(const entry& a, const entry& b, int i) const {
+          const unsigned char* x = a.win.data() + winOff[i];
+          const unsigned char* y = b.win.data() + winOff[i];
+          int L = windowLength(i), numID = 0;
+          for (int k = 0; k < L; k++) numID += (x[k] == y[k]);
+          return numID;
+        }
+
+      private:
+        mstreal cut;
+        vector<int> segLen, padLen, winOff, numBlocks; // numBlocks[i] is 0 for segments that cannot be filtered
+        unordered_map<const fasstSolution*, entry> entries;
+        unordered_map<uint64_t, vector<const fasstSolution*>> buckets;
+        set<const fasstSolution*> unclean;
+    };
+
     // An important point about std::set is that it never invalidates pointers
     // to its elements (i.e., it does not copy them upon resizing like vector).
     set<fasstSolution> solsSet;
@@ -244,6 +323,9 @@ class fasstSolutionSet {
     vector<vector<mstreal>> algnRedBar;
     vector<map<fasstSolution*, set<int>>> algnRedBarSource;
 
+    redundancyIndex redIndex;
+    bool useRedIndex;
+
     bool updated;
 };
 
@@ -255,6 +337,14 @@ class fasstSeqConst {
      * at with position i meets all sequence constraints, and false otherwise. */
     virtual void evalConstraint(int segIdx, const Sequence& target, vector<bool>& alignments) = 0;
     virtual bool isSegmentConstrained(int segIdx) = 0;
+
+    /* Optional bit-parallel version of evalConstraint. aaPositions[a] has bit k
+     * (bit k % 64 of word k / 64) set if residue k of the target is amino acid
+     * a; it may be short or empty for amino acids that do not occur. Upon exit,
+     * bit i of alignments must be cleared if the alignment starting at position
+     * i violates the constraints (set bits are left alone otherwise). Returns
+     * false if not implemented, in which case evalConstraint is used. */
+    virtual bool evalConstraintBits(int segIdx, const vector<vector<uint64_t> >& aaPositions, vector<uint64_t>& alignments) { return false; }
     virtual ~fasstSeqConst() {}
 };
 
@@ -264,6 +354,7 @@ class fasstSeqConstSimple : public fasstSeqConst {
   public:
     fasstSeqConstSimple(int numSegs) { positions.resize(numSegs); aminoAcids.resize(numSegs); }
     void evalConstraint(int segIdx, const Sequence& target, vector<bool>& alignments);
+    bool evalConstraintBits(int segIdx, const vector<vector<uint64_t> >& aaPositions, vector<uint64_t>& alignments);
     bool isSegmentConstrained(int segIdx) { return !positions[segIdx].empty(); }
     bool hasConstraints() const {
       for (int i = 0; i < positions.size(); i++) { if (!positions[i].empty()) return true; }
@@ -298,6 +389,8 @@ class fasstSearchOptions {
       redundancyCut = 1.0;
       seqConst = NULL;
       verb = false;
+      dihedralMargin = -1;
+      dihedralMismatches = 0;
     }
     ~fasstSearchOptions() { if (seqConst != NULL) delete(seqConst); }
 
@@ -312,6 +405,8 @@ class fasstSearchOptions {
     mstreal getRedundancyCut() const { return redundancyCut; }
     string getRedundancyProperty() const { return redundancyProp; }
     fasstSeqConst* getSequenceConstraints() const { return seqConst; }
+    mstreal getDihedralFilterMargin() const { return dihedralMargin; }
+    int getDihedralFilterMismatches() const { return dihedralMismatches; }
 
     /* -- setters -- */
     void setMinNumMatches(int _min);
@@ -332,6 +427,12 @@ class fasstSearchOptions {
     void setRedundancyProperty(const string& _redProp) { redundancyProp = _redProp; }
     template<class T>
     void setSequenceConstraints(const T& c) { if (seqConst != NULL) delete(seqConst); seqConst = new T(c); }
+    /* Filter segment alignments by backbone dihedral classes (see FASST::
+     * computeDihedralClasses). A target residue is compatible with a query residue
+     * if its phi and psi bins come within margin degrees of the query's phi and
+     * psi, and target windows with more than maxMismatches incompatible residues
+     * are skipped. This is empirical, not exact, so larger margins are safer. */
+    void setDihedralFilter(mstreal margin, int maxMismatches = 0) { dihedralMargin = margin; dihedralMismatches = maxMismatches; }
 
     /* -- unsetters (resetters) -- */
     void unsetMinNumMatches() { minNumMatches = -1; }
@@ -342,6 +443,7 @@ class fasstSearchOptions {
     void unsetRedundancyCut() { redundancyCut = 1; }
     void unsetRedundancyProperty() { redundancyProp = ""; }
     void unsetSequenceConstraints() { if (seqConst != NULL) delete(seqConst); seqConst = NULL; }
+    void unsetDihedralFilter() { dihedralMargin = -1; }
 
     /* -- queriers -- */
     bool isMinNumMatchesSet() const { return (minNumMatches > 0); }
@@ -356,6 +458,7 @@ class fasstSearchOptions {
     bool isRedundancyCutSet() const { return redundancyCut < 1; }
     bool isRedundancyPropertySet() const { return !redundancyProp.empty(); }
     bool sequenceConstraintsSet() const { return seqConst != NULL; }
+    bool isDihedralFilterSet() const { return dihedralMargin >= 0; }
     bool isVerbose() const { return verb; }
 
     /* -- validators -- */
@@ -374,14 +477,18 @@ class fasstSearchOptions {
     bool gapConstSet, diffChainRestSet, verb;
     int maxNumMatches, minNumMatches, suffNumMatches;
     fasstSeqConst* seqConst;
+    mstreal dihedralMargin;                  // in degrees; negative if the dihedral filter is not set
+    int dihedralMismatches;
 };
 
 /* FASST -- Fast Algorithm for Searching STructure */
 class FASST {
+  friend class fasstMatchView;
   public:
     enum matchType { REGION = 1, FULL, WITHGAPS };
     enum searchType { CA = 1, FULLBB };
     enum targetFileType { PDB = 1, BINDATABASE, STRUCTURE };
+    enum coordPrecision { DOUBLE = 1, FLOAT32, FIXED16 };
     typedef fasstSolution::resAddress resAddress;
 
     class targetInfo {
@@ -460,8 +567,29 @@ class FASST {
         int numIn;
     };
 
-    ~FASST();
+    /* Counters accumulated over the course of a search (reset at its start). */
+    struct searchStats {
+      long numWindows;   // segment alignments (query segment onto target window) considered
+      long numSigPruned; // of those, the ones ruled out by intra-distance signatures
+      long numDihedralPruned; // and the ones ruled out by the backbone dihedral filter
+      long numVerifyRejected; // candidate matches found from compact coordinates, but over the cutoff at full precision
+      long numNodes; // partial alignments visited by the branch-and-bound
+      long numSeqSkipped; // targets skipped because no alignment of some segment satisfied sequence constraints
+      searchStats() { reset(); }
+      void reset() { numWindows = numSigPruned = numDihedralPruned = numVerifyRejected = numNodes = numSeqSkipped = 0; }
+    };
+
+    virtual ~FASST();
     FASST();
+    /* Creates an object that searches the same targets as F, without copying
+     * them, e.g., to search from several threads at once. The new object starts
+     * out with F's search type, search options, filter settings, and database
+     * summary, but keeps its own query and search state thereafter. The targets
+     * live for as long as any object sharing them. Adding targets or target
+     * properties, or changing filters, through any one of the sharing objects
+     * changes them for all and must not be done while another one searches;
+     * none of them should change its search type. */
+    FASST(const FASST* F);
     void setQuery(const string& pdbFile, bool autoSplitChains = true);
     void setQuery(const Structure& Q, bool autoSplitChains = true);
     Structure getQuery() const { return queryStruct; }
@@ -539,6 +667,66 @@ class FASST {
     void setGridSpacing(mstreal _spacing) { gridSpacing = _spacing; updateGrids = true; }
     fasstSolutionSet search();
     int numMatches() { return solutions.size(); }
+    const searchStats& getSearchStats() const { return stats; }
+
+    /* Approximate number of bytes held by the database. If breakdown is given, it
+     * is filled with the share of each part: "structures" (target structures and
+     * searchable atoms), "sequences" (including amino-acid position bitsets),
+     * "properties" (residue, residue-pair, and relational properties), and
+     * "filters" (distance signatures, dihedral classes, and compact coordinates).
+     * Scratch space used during search is not counted. */
+    size_t memoryFootprint(map<string, size_t>* breakdown = NULL) const;
+
+    /* Intra-distance signatures store, for every searchable residue of a target,
+     * its CA-CA distances to the next distSigSpan residues, quantized to bins of
+     * distSigStep. Since deviations of paired atoms bound the change in their
+     * distance, these give a provable lower bound on the residual of aligning any
+     * query segment onto any target window, and search() skips windows whose
+     * bound already exceeds what the cutoff allows, without superimposing them.
+     * Signatures are used for all targets that have them, and are written into
+     * and read from databases. */
+    void computeDistanceSignatures(); // for all targets that do not already have them
+    bool hasDistanceSignatures(int ti) const { return !distSigs[ti].empty(); }
+    void setDistanceSignatureFilter(bool use) { useDistSigs = use; }
+    bool getDistanceSignatureFilter() const { return useDistSigs; }
+
+    /* Backbone dihedral classes store, for every searchable residue of a target,
+     * the 30-degree bins its phi and psi angles fall into (or that either is
+     * undefined, e.g. at chain termini). They are used by the dihedral filter of
+     * fasstSearchOptions, which removes target windows with backbone conformations
+     * incompatible with the query before superimposing them. Classes are written
+     * into and read from databases, and require full-backbone searches. */
+    void computeDihedralClasses(); // for all targets that do not already have them
+    bool hasDihedralClasses(int ti) const { return !dihedralCodes[ti].empty(); }
+
+    /* An extra filter for search, from compact copies of target coordinates kept
+     * in addition to the full-precision target atoms (so it adds 12 or 6 bytes
+     * per atom to the memory footprint, rather than saving any). With DOUBLE (the
+     * default) there is no filter. With FLOAT32 or FIXED16 (16-bit fixed point
+     * within each target's bounding box), segment and partial-alignment residuals
+     * are computed directly on the contiguous copies. The largest deviation of
+     * stored from actual atom positions is recorded for each target, and turns
+     * residuals and centroid distances computed from the copies into conservative
+     * bounds, so no match is lost; candidate matches are then re-verified against
+     * the full-precision atoms, so results are the same as with DOUBLE. */
+    void setCompactFilter(coordPrecision prec);
+    coordPrecision getCompactFilter() const { return coordPrec; }
+    size_t compactCoordinateBytes() const; // memory held by the compact copies
+
+    /* A database summary is a uniform sample of target residues. When there is
+     * one, search() estimates how many candidates each query segment would have
+     * if it were placed first (target windows whose residual is within the budget
+     * of the whole query, as the first segment can use up all of it), by
+     * superimposing the segment onto the windows that start at sampled residues,
+     * and places segments in the order of increasing estimates. This is not a
+     * ranking by how rare segment shapes are: the whole-query budget admits most
+     * windows of short segments, so the order mostly agrees with the default
+     * longest-first one, and departs from it mainly among segments of similar
+     * length. Estimates are cached until the query or cutoff change; targets
+     * added after building the summary are not sampled. */
+    void buildDatabaseSummary(int numSamples = 1000, int seed = 1);
+    bool hasDatabaseSummary() const { return !summarySample.empty(); }
+    void clearDatabaseSummary() { summarySample.clear(); summaryEstimates.clear(); }
 
     fasstSolutionSet getMatches() { return solutions; }
     string toString(const fasstSolution& sol);
@@ -549,9 +737,41 @@ class FASST {
      * the original target structure upon reading, and only keep backbone coordi-
      * nates. This is quite useful in practice, but it does mean that no reagions
      * in the original target that are skipped over (e.g., due to missing backbone
-     * atoms) can be tollerated.*/
+     * atoms) can be tollerated. dbFile can also be a segment manifest (below).*/
     void readDatabase(const string& dbFile, short memSave = 0);
 
+    /* A database can be split into segments: an immutable base database file,
+     * followed by delta database files appended over time, all listed in a text
+     * manifest together with any deleted targets. Each segment is an ordinary
+     * database (its residue relations refer to its own targets), so updating the
+     * database only requires writing the new targets. readDatabase loads a
+     * manifest as one logical database: segments in order, deleted targets
+     * skipped, and relations renumbered accordingly. Targets are deleted by their
+     * logical index, which counts the targets of all segments (deleted or not);
+     * compactDatabase merges all segments into one database file, in which targets
+     * are indexed the same way as when the manifest is loaded. Relative segment
+     * paths in a manifest are relative to the directory of the manifest. */
+    static bool isDatabaseManifest(const string& file);
+    static void appendDatabaseSegment(const string& manifestFile, const string& segmentFile); // creates the manifest if needed
+    static void deleteDatabaseTargets(const string& manifestFile, const vector<int>& logicalIndices);
+    static void compactDatabase(const string& manifestFile, const string& dbFile);
+
+    /* The contents of a segment manifest, for tools that inspect or rewrite one.
+     * write() replaces the manifest file atomically, so a manifest is never lost
+     * or seen half-written, even if the process dies while writing it. */
+    struct segmentManifest {
+      vector<string> files;   // segment database files, as listed
+      vector<int> sizes;      // number of targets in each
+      set<int> deleted;       // logical indices of deleted targets
+      string dir;             // directory of the manifest, for resolving relative paths
+      void create(const string& manifestFile); // an empty manifest, to be written to the given file
+      void read(const string& manifestFile);
+      void write(const string& manifestFile) const;
+      void addSegment(const string& segmentFile); // reads the segment to count its targets, then lists it
+      string path(int s) const;
+      int numTargets() const;
+    };
+
     // get various match properties
     void getMatchStructure(const fasstSolution& sol, Structure& match, bool detailed = false, matchType type = matchType::REGION, bool algn = true);
     Structure getMatchStructure(const fasstSolution& sol, bool detailed = false, matchType type = matchType::REGION, bool algn = true);
@@ -561,6 +781,18 @@ class FASST {
     vector<vector<mstreal> > getResidueProperties(fasstSolutionSet& sols, const string& propType, matchType type = matchType::REGION);
     vector<mstreal> getResidueProperties(const fasstSolution& sol, const string& propType, matchType type = matchType::REGION);
     vector<int> getMatchResidueIndices(const fasstSolution& sol, matchType type = matchType::REGION); // figure out the range of residues to excise from target structure
+
+    /* Match views are lightweight alternatives to match structures: each refers
+     * to the searchable atoms of the target the match came from and applies the
+     * match transform only when coordinates are requested (see fasstMatchView).
+     * getMatchCoordinates extracts the transformed coordinates of the searchable
+     * atoms of all matches into one contiguous buffer, splitting the work among
+     * threads (numThreads is interpreted as in MstUtils::numThreads); match i
+     * occupies xyz[3*offsets[i]] through xyz[3*offsets[i+1] - 1]. With FULL, a
+     * view spans all searchable residues of the target. */
+    fasstMatchView getMatchView(const fasstSolution& sol, matchType type = matchType::REGION, bool algn = true);
+    void getMatchViews(fasstSolutionSet& sols, vector<fasstMatchView>& views, matchType type = matchType::REGION, bool algn = true);
+    void getMatchCoordinates(fasstSolutionSet& sols, vector<mstreal>& xyz, vector<int>& offsets, matchType type = matchType::REGION, bool algn = true, int numThreads = 0);
     void addSequenceContext(fasstSolutionSet& sol); // decorate all solutions in the set with sequence context
 
     /* Computes the RMSD of the given match to a query that is (possibly)
@@ -595,12 +827,76 @@ class FASST {
     mstreal segCentToPrevSegCentTol(int i);
     void rebuildProximityGrids();
     void addTargetStructure(Structure* targetStruct, short memSave = 0);
+    // reads one database file, skipping targets with the given (file-local) indices; returns the number of targets in the file
+    int readDatabaseSegment(const string& dbFile, short memSave, const vector<int>& skip);
     void addSequenceContext(fasstSolution& sol); // decorate the solution with sequence context
     void fillTargetChainInfo(int ti);
+    void computeDistanceSignature(int ti);
+    void computeDihedralClass(int ti);
+    // phi and psi of each residue in a stretch of searchable atoms (NAN if not defined)
+    void backboneDihedrals(const AtomPointerVector& atoms, vector<mstreal>& phi, vector<mstreal>& psi) const;
+    void prepDihedralFilter();
+    bool dihedralsCompatible(int i, int j); // for segment i aligned starting at residue j of the current target
+    mstreal segmentResidualLowerBound(int i, int j, mstreal cap = INFINITY); // from signatures, for segment i aligned starting at residue j of the current target
+    void setQuerySegmentOrder(const vector<int>& order); // order[i] is the index of the segment to place i-th
+    vector<mstreal> estimateSegmentCandidates(mstreal rmsdCutoff); // for each query segment (in original order)
+    void orderSegmentsBySummary();
+    void buildCompactCoords(int ti);
+    void buildAminoAcidPositions(int ti);
+    // fills seqConstAlignments for target ti; returns false if some constrained
+    // segment has no alignment satisfying sequence constraints
+    bool evalSequenceConstraints(int ti);
+    /* The residual of the optimal superposition of the centered points qc (x, y, z
+     * interleaved, with inner product qG) onto atoms of the current target, read
+     * from its compact copies xyz in numRuns runs (run r has lens[r] atoms, from
+     * atom offs[r] on). If cen is not NULL, the centroid of the target atoms is
+     * stored there. */
+    template <class T>
+    mstreal compactResidual(const T* xyz, const mstreal* qc, mstreal qG, const int* offs, const int* lens, int numRuns, mstreal* cen = NULL) const;
+    // the same, from whichever compact copies the current target has
+    mstreal compactResidual(const mstreal* qc, mstreal qG, const int* offs, const int* lens, int numRuns, mstreal* cen = NULL) const;
+    // lower bound on the actual residual, given one computed from compact copies of numAtoms target atoms
+    mstreal compactResidualBound(mstreal residual, int numAtoms) const;
 
   private:
     fasstSearchOptions opts;
 
+    // compact copies of target coordinates (see setCompactFilter); for
+    // FIXED16, atom coordinate x is stored as round((x - origin[0])/step[0])
+    struct compactTarget {
+      vector<float> xyz;
+      vector<unsigned short> qxyz;
+      mstreal origin[3], step[3];
+      mstreal maxErr; // largest distance between a stored and an actual atom position
+    };
+
+    /* Everything stored per target, which searches only read. Objects created
+     * with FASST(const FASST*) share one of these, and the last of them to go
+     * deletes the targets. Members of the same names below refer to its fields
+     * (see there for what each holds), so that code can use them directly. */
+    struct targetSet {
+      ~targetSet();
+      vector<Structure*> targetStructs;
+      vector<AtomPointerVector> targets;
+      vector<Sequence> targSeqs;
+      vector<vector<vector<uint64_t> > > targAAPositions;
+      vector<targetInfo> targetSource;
+      vector<tightvector<int>> targetChainLen;
+      map<string, map<int, vector<mstreal> > > resProperties;
+      map<string, map<int, vector<string> > > resStringProperties;
+      map<string, map<int, map<int, set<int> > > > resPairBoolProperties;
+      map<string, map<int, map<int, map<int, mstreal> > > > resPairProperties;
+      map<string, simpleMap<resAddress, tightvector<resAddress>>> resRelProperties;
+      vector<Transform> tr;
+      mstreal xlo, ylo, zlo, xhi, yhi, zhi;
+      vector<vector<unsigned char> > distSigs;
+      vector<vector<unsigned char> > dihedralCodes;
+      coordPrecision coordPrec;
+      vector<compactTarget> compactCoords;
+    };
+    shared_ptr<targetSet> targetData;
+    FASST(const shared_ptr<targetSet>& data); // binds the members below to fields of data
+
     /* targetStructs[i] and targets[i] store the original i-th target structure
      * and just the part of it that will be searched over, respectively. NOTE:
      * Atoms* in targets[i] point to Atoms of targetStructs[i]. So there is only
@@ -614,12 +910,15 @@ class FASST {
      * correspondence between residues in the original full structure and atom
      * indices in targets[i] (i.e., nothing was skipped upon processing). This
      * is done for memory reasons. */
-    vector<Structure*> targetStructs;
-    vector<AtomPointerVector> targets;
-
-    vector<Sequence> targSeqs;               // target sequences (of just the parts that will be searched over)
-    vector<targetInfo> targetSource;         // from where and how each target was read (e.g., in case need to re-read it)
-    vector<tightvector<int>> targetChainLen; // chain lengths in each target, listed in the order chains appear in the corresponding Structure
+    vector<Structure*>& targetStructs;
+    vector<AtomPointerVector>& targets;
+
+    vector<Sequence>& targSeqs;              // target sequences (of just the parts that will be searched over)
+    // targAAPositions[ti][a] has bit k set if residue k of targSeqs[ti] is amino acid a (for bit-parallel sequence constraints)
+    vector<vector<vector<uint64_t> > >& targAAPositions;
+    vector<vector<uint64_t> > seqConstAlignments; // allowed alignments of each segment (in search order) onto the current target; empty if unconstrained
+    vector<targetInfo>& targetSource;        // from where and how each target was read (e.g., in case need to re-read it)
+    vector<tightvector<int>>& targetChainLen; // chain lengths in each target, listed in the order chains appear in the corresponding Structure
     vector<int> targChainBeg, targChainEnd;  // targChainBeg[i] and targChainEnd[i] contain the chain start and end indices for the chain
                                              // that contains the residue with index i (in the overal concatenated sequence). Residue indices
                                              // are based on just the portion of the structure to be searched over.
@@ -627,40 +926,75 @@ class FASST {
     /* Object for holding real-valued residue properties. Specifically,
      * resProperties["env"][ti][ri] is the value of the "env" property for
      * residue ri in target with index ti. */
-    map<string, map<int, vector<mstreal> > > resProperties;
+    map<string, map<int, vector<mstreal> > >& resProperties;
 
     /* Object for holding string residue properties. Specifically,
      * resProperties["stride"][ti][ri] is the string value of the "stride" property for
      * residue ri in target with index ti. */
-    map<string, map<int, vector<string> > > resStringProperties;
+    map<string, map<int, vector<string> > >& resStringProperties;
 
     /* Object for holding binary residue-pair properties. Specifically,
      * resPairProperties["int"][ti][ri] is the set of all rj that interact
      * with ri in a target with index ti.
      * NOTE: this property can be directional (i.e., pairs are not mirrored). */
-    map<string, map<int, map<int, set<int> > > > resPairBoolProperties;
+    map<string, map<int, map<int, set<int> > > >& resPairBoolProperties;
 
     /* Object for holding real-valued residue-pair properties. Specifically,
      * resPairProperties["cont"][ti][ri][rj] is the value of the "cont" property
      * (e.g., contact degree) between residues ri and rj in target with index ti.
      * NOTE: this property can be directional (i.e., pairs are not mirrored). */
-    map<string, map<int, map<int, map<int, mstreal> > > > resPairProperties;
+    map<string, map<int, map<int, map<int, mstreal> > > >& resPairProperties;
 
     /* Object for holding residue-pair relational graphs. Specifically,
      * resRelProperties["sim"][(ti, ri)] is the list of all residues in the data-
      * base that are related by the property "sim" to the residue with the address
      * (ti, ri) (i.e., target ti, residue ri).
      * NOTE: this property can be directional (i.e., relationships are not mirrored). */
-    map<string, simpleMap<resAddress, tightvector<resAddress>>> resRelProperties;
+    map<string, simpleMap<resAddress, tightvector<resAddress>>>& resRelProperties;
 
-    vector<Transform> tr;                    // transformations from the original frame to the common frames of reference for each target
+    vector<Transform>& tr;                   // transformations from the original frame to the common frames of reference for each target
     int currentTarget;                       // the index of the target currently being searched for
 
     Structure queryStruct;
     vector<AtomPointerVector> queryOrig;     // just the part of the query that will be sought, split by segment
     vector<AtomPointerVector> query;         // same as above, but with segments re-orderd for optimal searching
     vector<int> qSegOrd;                     // qSegOrd[i] is the index (in the original queryOrig) of the i-th segment in query
-    mstreal xlo, ylo, zlo, xhi, yhi, zhi;    // bounding box of the search database
+    mstreal &xlo, &ylo, &zlo, &xhi, &yhi, &zhi; // bounding box of the search database
+
+    // distSigs[ti][ri*distSigSpan + k-1] is the quantized distance between the CA
+    // atoms of residues ri and ri+k of target ti (empty if not computed), while
+    // queryCADists[i][ri*distSigSpan + k-1] is the same (unquantized) for query segment i
+    vector<vector<unsigned char> >& distSigs;
+    vector<vector<mstreal> > queryCADists;
+    int distSigSpan, caAtomIdx, nAtomIdx, cAtomIdx;
+    mstreal distSigStep;
+    bool useDistSigs;
+    searchStats stats;
+
+    // dihedralCodes[ti][ri] is the backbone dihedral class of residue ri of target
+    // ti (empty if not computed): phi bin * (dihedralBins + 1) + psi bin, with bin
+    // dihedralBins standing for an undefined angle. queryDihedrals[i][2*ri] and
+    // queryDihedrals[i][2*ri + 1] are phi and psi of residue ri of query segment
+    // i, and queryDihedralOK[i][ri] marks the classes compatible with them.
+    vector<vector<unsigned char> >& dihedralCodes;
+    vector<vector<mstreal> > queryDihedrals;
+    vector<vector<bitset<256> > > queryDihedralOK;
+    int dihedralBins;
+
+    // database summary (see buildDatabaseSummary), and the estimated number of
+    // candidate windows for each query segment (in original order) at summaryCut
+    vector<resAddress> summarySample;
+    vector<mstreal> summaryEstimates;
+    mstreal summaryCut;
+
+    // compact copies of target coordinates, if any (see setCompactFilter)
+    coordPrecision& coordPrec;
+    vector<compactTarget>& compactCoords;
+    // centered coordinates (x, y, z interleaved) of each query segment and of
+    // each query mask, and their inner products, for compact residuals
+    vector<vector<mstreal> > querySegCentered, queryMaskCentered;
+    vector<mstreal> querySegG, queryMaskG;
+    vector<int> compactOffsets, compactLengths; // scratch runs of target atoms
 
     // segmentResiduals[i][j] is the residual of the alignment of segment i, in which
     // its starting residue aligns with the residue index j in the target
@@ -706,6 +1040,38 @@ class FASST {
     // set of solutions, sorted by RMSD
     fasstSolutionSet solutions;
 
+    /* Bounded max-heap of flat solution records, which stands in for solutions
+     * during searches capped by a maximum number of matches (and without
+     * redundancy filtering or a minimum number of matches), where most found
+     * solutions are later evicted. Alignments (in original segment order) and
+     * transforms live in flat arrays indexed by slot, and slots of evicted
+     * records are reused, so nothing is allocated per solution once the heap is
+     * full. Records are ordered exactly as fasstSolution objects, so the set
+     * exported at the end is the same that would have been built directly. */
+    class solutionHeap {
+      public:
+        solutionHeap() { numSegs = 0; }
+        void init(int _numSegs, int capacity);
+        // alignment and segment order are in search order, as in FASST::search
+        void push(const vector<int>& alignment, const vector<int>& segOrder, mstreal rmsd, int target, const Transform& tr);
+        void popWorst();
+        int size() const { return heap.size(); }
+        mstreal worstRMSD() const { return rmsds[heap.front()]; }
+        // inserts all records into sols and frees the storage of the heap
+        void exportTo(fasstSolutionSet& sols, const vector<int>& segLen, const vector<int>& segOrder);
+
+      private:
+        bool before(int a, int b) const; // does the record in slot a sort before the one in slot b?
+        int numSegs;
+        vector<int> heap;       // slots, worst record on top
+        vector<int> freeSlots;  // slots of evicted records
+        vector<int> algn;       // numSegs entries per slot
+        vector<mstreal> rmsds;
+        vector<int> targ;
+        vector<mstreal> trans;  // 12 entries per slot: rotation row by row, then translation
+    };
+    solutionHeap solHeap;
+
     // ProximitySearch for finding nearby centroids of target segments (there
     // will be one ProximitySearch object per query segment)
     vector<ProximitySearch*> ps;
@@ -734,4 +1100,36 @@ class FASST {
     RMSDCalculator RC;
 };
 
+/* A handle onto a match found by a FASST object, obtained from FASST::getMatchView
+ * or FASST::getMatchViews. It stores only the target index, the matching residue
+ * indices and the transform to apply, so creating many views is cheap; atom k of
+ * the view is the (k % A)-th searchable atom of residue k / A, where A is the
+ * number of searchable atoms per residue (e.g., N, CA, C, O for a FULLBB search),
+ * which are also the atoms a non-detailed match structure retains when the FASST
+ * object was set up to save memory. A view is valid as long as the FASST object
+ * that created it is around and its targets are not changed. */
+class fasstMatchView {
+  friend class FASST;
+  public:
+    fasstMatchView() { F = NULL; target = -1; type = FASST::matchType::REGION; algn = true; }
+    int getTargetIndex() const { return target; }
+    int numResidues() const { return resIndices.size(); }
+    int numAtoms() const;
+    int getTargetResidueIndex(int i) const { return resIndices[i]; } // index among searchable residues of the target
+    const Transform& getTransform() const { return T; }
+    string getResidueName(int i) const;  // three-letter name, from the target sequence
+    CartesianPoint getAtomCoor(int k) const;
+    void getCoordinates(mstreal* xyz) const; // fills 3*numAtoms() values
+    Structure getStructure(bool detailed = false); // same as FASST::getMatchStructure for the match
+
+  private:
+    FASST* F;
+    int target;
+    vector<int> resIndices;
+    Transform T;
+    fasstSolution sol; // with no sequence context, just to materialize the structure if asked
+    FASST::matchType type;
+    bool algn;
+};
+
 #endif
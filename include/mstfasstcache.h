@@ -3,6 +3,7 @@
 
 #include "msttypes.h"
 #include "mstfasst.h"
+#include <mutex>
 
 // TODO:
 // 1. write a test function for the cache.
@@ -17,7 +18,7 @@
 
 class cFASST : public FASST {
   public:
-    cFASST(int max = 1000) : FASST() {
+    cFASST(int max = 1000) : FASST(), store(make_shared<cacheStore>()), cache(store->cache) {
       maxNumResults = max;
       sf = 10.0;
       maxNumPressure = (exp(1.0) - 1.0)*maxNumResults/sf; // so that max factor is 2.0 at the start
@@ -38,8 +39,17 @@ class cFASST : public FASST {
        * be desired. Setting this flag to true will have this effect. */
       strictEquiv = false;
     }
-    ~cFASST() { clear(); }
-    void clear(); // clears cache (removes all solutions)
+    /* Creates an object that searches the targets of C (see FASST(const FASST*))
+     * through the same cache, so that matches found by either are available to
+     * both. Cache accesses are synchronized, so the two can search concurrently.
+     * Settings (including cache pressures) start out as those of C, but are the
+     * object's own thereafter. */
+    cFASST(const cFASST* C) : FASST(C), store(C->store), cache(store->cache) {
+      maxNumResults = C->maxNumResults; sf = C->sf;
+      maxNumPressure = C->maxNumPressure; errTolPressure = C->errTolPressure;
+      readPerm = C->readPerm; modPerm = C->modPerm; strictEquiv = C->strictEquiv;
+    }
+    void clear(); // clears cache (removes all solutions), for all objects sharing it
     fasstSolutionSet search();
     int getMaxNumResults() const { return maxNumResults; }
     void incErrTolPressure(mstreal del = 1.0) { errTolPressure += fabs(del); }
@@ -119,8 +129,17 @@ class cFASST : public FASST {
       }
     };
 
+    // cached results, shared by all objects created from one another with
+    // cFASST(const cFASST*); the last of them to go deletes the results
+    struct cacheStore {
+      ~cacheStore() { for (auto it = cache.begin(); it != cache.end(); ++it) delete(*it); }
+      set<cachedResult*, compResults> cache;
+      mutex lock;
+    };
+    shared_ptr<cacheStore> store;
+
     int maxNumResults; // max number of searches to cache
-    set<cachedResult*, compResults> cache;
+    set<cachedResult*, compResults>& cache;
     RMSDCalculator rc;
     mstreal errTolPressure, maxNumPressure, sf;
     bool readPerm, modPerm, strictEquiv;
@@ -2,6 +2,7 @@
 #define _MSTLINALG_H
 
 #include <vector>
+#include <memory>
 #include "msttypes.h"
 #undef assert
 
@@ -9,28 +10,37 @@ using namespace std;
 
 namespace MST {
 
+/* A dense matrix of mstreal values, stored row-major in one contiguous (and
+ * cache-line aligned) buffer. A Matrix can also be a view into a rectangular
+ * block of another Matrix (see row() and column()), in which case it shares
+ * the other's buffer (keeping it alive) and addresses it via a row stride, so
+ * that modifying the view modifies the original. Copying a view (copy
+ * construction) produces an independent Matrix, whereas assigning to a view
+ * writes through to the original (and requires dimensions to agree). */
 class Matrix {
   public:
     Matrix(int rows, int cols, mstreal val = 0.0);
     Matrix(const vector<vector<mstreal> >& _M);
     Matrix(const Matrix& _M);
+    Matrix(Matrix&& _M);
     Matrix(const vector<mstreal>& p, bool col = false); // by default makes row vectors
-    ~Matrix();
+    ~Matrix() {}
 
     int size(int dim = 1) const;
     int length() const { return MstUtils::max(size(1), size(2)); }
     int numRows() const { return size(1); }
     int numCols() const { return size(2); }
-    mstreal& operator()(int i, int j) { return *(M[i][j]); }
-    mstreal operator()(int i, int j) const { return *(M[i][j]); }
+    mstreal& operator()(int i, int j) { return data[(size_t) i*stride + j]; }
+    mstreal operator()(int i, int j) const { return data[(size_t) i*stride + j]; }
 
     // single-subscript access (column-major order, as in Matlab)
-    mstreal& operator()(int i) { int n = numRows(); return *(M[i % n][i / n]); }
-    mstreal operator()(int i) const { int n = numRows(); return *(M[i % n][i / n]); }
-    mstreal& operator[](int i) { int n = numRows(); return *(M[i % n][i / n]); }
-    mstreal operator[](int i) const { int n = numRows(); return *(M[i % n][i / n]); }
+    mstreal& operator()(int i) { return (*this)(i % nr, i / nr); }
+    mstreal operator()(int i) const { return (*this)(i % nr, i / nr); }
+    mstreal& operator[](int i) { return (*this)(i % nr, i / nr); }
+    mstreal operator[](int i) const { return (*this)(i % nr, i / nr); }
 
     Matrix& operator=(const Matrix& _M);
+    Matrix& operator=(Matrix&& _M);
     Matrix& operator/=(const mstreal& s);
     Matrix& operator*=(const mstreal& s);
     const Matrix operator/(const mstreal& s) const;
@@ -47,13 +57,35 @@ class Matrix {
 
     Matrix row(int i); // sub-matrix corresponding to the i-th row
     Matrix column(int i); // sub-matrix corresponding to the i-th column
+    // sub-matrix spanning rows [rowBeg, rowEnd] and columns [colBeg, colEnd]
+    Matrix block(int rowBeg, int rowEnd, int colBeg, int colEnd);
+    bool isView() const { return view; }
 
     // when typecast as a vector<real>, appends all rows together
     operator vector<mstreal>() const;
     // TODO: typecast as a Vector (fail if neither dimension is 1)
 
-    Matrix inverse();
-    Matrix transpose();
+    Matrix inverse() const;
+    Matrix transpose() const;
+    mstreal determinant() const;
+
+    /* Solves this * X = B for X via LU decomposition with partial pivoting (the
+     * matrix must be square, and B can have any number of columns). */
+    Matrix solve(const Matrix& B) const;
+
+    /* Computes the LU decomposition with partial pivoting, P * this = L * U,
+     * storing L (below the diagonal, with an implied unit diagonal) and U (on
+     * and above the diagonal) together in LU, and the permutation as the
+     * original row index of each row in perm. Returns the sign of the
+     * permutation, or 0 if the matrix is singular to working precision. */
+    int luDecompose(Matrix& LU, vector<int>& perm) const;
+
+    /* Eigen-decomposition of a symmetric matrix by the cyclic Jacobi method.
+     * Eigenvalues are returned in ascending order, with the corresponding
+     * (unit) eigenvectors in the columns of vecs. Only the upper triangle of
+     * the matrix is referenced. */
+    void eigenSymmetric(vector<mstreal>& vals, Matrix& vecs, mstreal tol = 10E-14, int maxSweeps = 100) const;
+
     Matrix sum(int dim = -1, bool norm = false) const;
     Matrix mean(int dim = -1) const { return sum(dim, true); }
     mstreal norm() const;   // Euclidean norm of the matrix
@@ -75,12 +107,15 @@ class Matrix {
     }
 
   protected:
-    Matrix(const vector<vector<mstreal*> >& _M, int rowBeg = 0, int rowEnd = -1, int colBeg = 0, int colEnd = -1);
-    void setOwnFlag(bool _own) { own = _own; }
-    bool getOwnFlag() { return own; }
-    void clear();
-    vector<vector<mstreal*> > M;
-    bool own;                  // do I own the data in the matrix, or is my matrix a sub-matrix from some other matrix?
+    Matrix(const Matrix& parent, int rowBeg, int rowEnd, int colBeg, int colEnd); // view constructor
+    void allocate(int rows, int cols); // (re)allocates own storage (contents are undefined)
+    void copyElements(const Matrix& _M);
+    bool sameSize(const Matrix& P) const { return (nr == P.nr) && (nc == P.nc); }
+
+    shared_ptr<mstreal> buffer; // storage, shared with any views into this matrix
+    mstreal* data;              // address of element (0, 0) within the buffer
+    int nr, nc, stride;         // dimensions and the distance (in elements) between consecutive rows
+    bool view;                  // am I a view into (a sub-block of) another matrix's storage?
 };
 
 // A convenience class. A Vector is really just a Matrix, with one of the
@@ -90,6 +125,9 @@ class Vector : public Matrix {
     Vector(int numel = 0, mstreal val = 0.0, bool col = false) : Matrix(vector<mstreal>(numel, val), col) {}
     Vector(const vector<mstreal>& p, bool col = false) : Matrix(p, col) {}
     Vector(const Vector& V) : Matrix(V) {}
+    Vector(Vector&& V) : Matrix(std::move(V)) {}
+    Vector& operator=(const Vector& V) { Matrix::operator=(V); return *this; }
+    Vector& operator=(Vector&& V) { Matrix::operator=(std::move(V)); return *this; }
     Vector(const Matrix& _M) : Matrix(_M) { MstUtils::assertCond((_M.numRows() == 1) || (_M.numCols() == 1), "cannot construct a vector from a matrix with non-unitary dimensions", "Vector::Vector(const Matrix& _M)"); }
     int size() const { return length(); }
     mstreal dot(const Vector& v) const;
@@ -3,7 +3,75 @@
 
 #include "msttypes.h"
 #include "mstsystem.h"
+#include <condition_variable>
 
+/* Named locks, shared among the threads of a process and among processes. Each
+ * lock is backed by a lock file (see lockFilePath()) that is locked with POSIX
+ * advisory record locks (fcntl), so it works across processes on one machine and,
+ * if the lock directory is on a shared file system that supports locking (e.g.,
+ * NFS with lockd), across machines. The lock directory is taken from environment
+ * variable MST_LOCK_DIR, if set, or is /tmp otherwise; it can also be changed
+ * with setLockDirectory().
+ *
+ * Locks can be held in exclusive or shared mode: any number of shared holders
+ * may coexist, while an exclusive holder excludes everybody else. Within the
+ * process, holders are counted, so the same lock can be acquired in shared mode
+ * by several threads at once; however, locks are not re-entrant, and a thread
+ * waiting for a lock it already holds exclusively will wait until the timeout.
+ * Locks are held by the process, so any thread can release them.
+ *
+ * Because record locks are dropped by the operating system when the process that
+ * holds them exits, locks held by processes that crashed or were killed are
+ * recovered automatically. Lock files are never deleted, and a lock file that
+ * gets replaced while somebody waits on it (e.g., by a /tmp cleaner) is detected
+ * and re-opened, so that two processes never hold the "same" lock via different
+ * files. */
+class MstLockManager {
+  public:
+    /* Waits for the lock with the given tag for up to timeout seconds (forever
+     * if timeout is negative). Returns true if the lock was acquired, and false
+     * if the time ran out. */
+    static bool acquire(const string& tag, bool shared = false, mstreal timeout = -1);
 
+    /* Releases one hold on the lock. Returns false if the lock was not held. */
+    static bool release(const string& tag);
+
+    static bool isHeld(const string& tag); // by this process, in either mode
+
+    static void setLockDirectory(const string& dir);
+    static string getLockDirectory();
+    static string lockFilePath(const string& tag);
+
+  private:
+    struct lockState {
+      lockState() { readers = 0; writer = false; pending = false; fd = -1; }
+      int readers;  // number of shared holders in this process
+      bool writer;  // whether this process holds the lock exclusively
+      bool pending; // whether some thread is currently acquiring the lock file
+      int fd;       // descriptor of the locked lock file, while held
+    };
+
+    // locks the lock file in the given mode, returning its descriptor or -1 on timeout
+    static int lockFile(const string& path, bool shared, bool wait, const chrono::steady_clock::time_point& deadline);
+
+    static mutex stateLock;
+    static condition_variable stateChange;
+    static map<string, lockState> states;
+    static string lockDir;
+};
+
+/* Holds a lock for the lifetime of the object. */
+class MstLockGuard {
+  public:
+    MstLockGuard(const string& _tag, bool shared = false, mstreal timeout = -1) : tag(_tag) { locked = MstLockManager::acquire(tag, shared, timeout); }
+    ~MstLockGuard() { if (locked) MstLockManager::release(tag); }
+    bool isLocked() const { return locked; } // false if the timeout ran out
+
+  private:
+    MstLockGuard(const MstLockGuard&);
+    MstLockGuard& operator=(const MstLockGuard&);
+    string tag;
+    bool locked;
+};
 
 #endif
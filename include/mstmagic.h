@@ -9,7 +9,12 @@ using namespace MST;
 
 class TERMUtils {
   public:
-    static vector<AtomPointerVector> mostDesignableFragments(Structure& C, vector<Structure*>& TERMs, int n = 10, CartesianPoint* cen = NULL, CartesianPoint* ext = NULL, string outBase = "", bool verb = false);
+    /* Finds up to n regions, among TERMs[1], TERMs[2], ... (superimposed onto the
+     * central TERM C), where the backbones of many TERMs run together in register
+     * outside of C. Candidate regions are grown from the points (C-alpha atoms)
+     * with the most close neighbors, in parallel over numThreads threads (see
+     * MstUtils::numThreads); the result does not depend on the number of threads. */
+    static vector<AtomPointerVector> mostDesignableFragments(Structure& C, vector<Structure*>& TERMs, int n = 10, CartesianPoint* cen = NULL, CartesianPoint* ext = NULL, string outBase = "", bool verb = false, int numThreads = 0);
 
     /* These functions excise a TERM from a given structure. A TERM is always
      * defined as consisting of some number of central residues, all residues
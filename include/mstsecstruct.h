@@ -0,0 +1,45 @@
+#ifndef _MSTSECSTRUCT_H
+#define _MSTSECSTRUCT_H
+
+#include "msttypes.h"
+
+using namespace std;
+using namespace MST;
+
+/* Native secondary structure assignment from backbone coordinates, following
+ * DSSP (Kabsch W, Sander C. Dictionary of protein secondary structure: pattern
+ * recognition of hydrogen-bonded and geometrical features. Biopolymers 22:2577-
+ * 2637, 1983). Backbone hydrogen bonds are scored with the DSSP electrostatic
+ * energy, considering only residues with C-alpha atoms within 9 Angstrom (found
+ * with ProximitySearch), and helices, bridges/ladders and turns are derived from
+ * them as in DSSP. Classes are reported with the single-letter codes of STRIDE
+ * (see strideInterface in mstexternal.h), so that the two are interchangeable:
+ *
+ * H      Alpha helix
+ * G      3-10 helix
+ * I      PI-helix
+ * E      Extended conformation (ladder of at least two bridges)
+ * B      Isolated bridge
+ * T      Turn
+ * C      Coil (none of the above, including residues with incomplete backbones)
+ *
+ * DSSP bends are reported as coil, since STRIDE has no such class. */
+class SecStructTools {
+  public:
+    /* One class per residue, in the order of S.getResidues(). Consecutive
+     * residues are considered connected if they are in the same chain and the
+     * peptide bond between them is no longer than 2.5 Angstrom. */
+    static vector<string> assign(const Structure& S);
+
+    /* Same as above for each of the given structures, spreading them among
+     * threads (numThreads is interpreted as in MstUtils::numThreads). */
+    static vector<vector<string> > assign(const vector<Structure*>& structs, int numThreads = 0);
+
+    /* DSSP energy (kcal/mol) of the hydrogen bond between the amide N-H of a
+     * donor residue and the carbonyl C=O of an acceptor residue. */
+    static mstreal hbondEnergy(const CartesianPoint& N, const CartesianPoint& H, const CartesianPoint& C, const CartesianPoint& O);
+
+    static const mstreal maxHBondEnergy; // bonds with energies below this count as H-bonds (-0.5 kcal/mol)
+};
+
+#endif
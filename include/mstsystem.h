@@ -4,6 +4,7 @@
 #include "msttypes.h"
 #include <unistd.h>
 #include <limits.h>
+#include <sys/resource.h>
 
 
 /* A bunch of static routines to perform various OS-related operations */
@@ -25,11 +26,25 @@ class MstSys {
     static void cmkdir(const string& dirPath, bool makeParents = false);
     static void crmdir(const string& dirPath, bool recursive = false);
     static void crm(const string& filePath);
+
+    /* Renames a file, replacing any file at the destination. Within one file
+     * system this is atomic, so a file written under a temporary name and then
+     * moved into place is seen by readers (or by a resumed run) either in full
+     * or not at all. */
+    static void cmv(const string& from, const string& to);
     static string getMachineName();
     static string getUserName();
-    static bool getNetLock(const string& tag, bool shared = false, const string& linuxHost = "anthill.cs.dartmouth.edu");
-    static bool releaseNetLock(const string& tag, const string& linuxHost = "anthill.cs.dartmouth.edu");
-    static int memUsage(); // total memory used in Kbytes
+
+    /* Acquire/release a named lock shared with other processes, waiting for up to
+     * timeout seconds, or forever if timeout is negative (see MstLockManager, which
+     * these wrap). To coordinate jobs across machines, point MST_LOCK_DIR to a
+     * directory on a shared file system. Returns false if the lock could not be
+     * acquired in time (or was not held). */
+    static bool getNetLock(const string& tag, bool shared = false, int timeout = 60*5);
+    static bool releaseNetLock(const string& tag);
+
+    static int memUsage(); // total memory used (resident set size) in Kbytes
+    static int peakMemUsage(); // largest resident set size of the process so far, in Kbytes
 
   private:
 };
@@ -12,7 +12,7 @@ using namespace MST;
 class TERMANAL {
   public:
     TERMANAL(FASST* _F = NULL) { F = _F; cdCut = 0.1; pad = 2; pseudoCount = 0.01; matchCount = 50; rmsdCut = 2.0; compatMode = false; compatSearchLimit = 1000; }
-    void setFASST(FASST* _F) { F = _F; }
+    void setFASST(FASST* _F) { F = _F; clearMatchCache(); }
 
     /* Computes the structure score for the given TERM, following roughly the
      * definition and procedure defined in Zheng, Zhang, and Grigoryan, Structure,
@@ -23,6 +23,12 @@ class TERMANAL {
      * account for amino acids is given as the second optional parameter. */
     mstreal structureScore(const Structure& term, const vector<Residue*>& central = vector<Residue*>(), bool verbose = false);
     pair<mstreal, mstreal> structureScoreParts(const Structure& term, const vector<Residue*>& central = vector<Residue*>(), bool verbose = false);
+    /* Same as calling structureScoreParts() on each terms[i], with central
+     * residues centrals[i], but with all TERM searches resolved up front and run
+     * in parallel: one thread searches with the main FASST object and one with
+     * each worker (see setWorkerFASSTs()). Identical TERMs are searched for only
+     * once. Results and verbose output do not depend on the number of threads. */
+    vector<pair<mstreal, mstreal>> structureScoreParts(const vector<Structure*>& terms, const vector<vector<Residue*>>& centrals, bool verbose = false);
     mstreal combineScoreParts(const pair<mstreal, mstreal>& parts);
     // Scores an entire structure or a subregion thereof, optionally storing the design and abundance scores in the provided scoreParts vector
     vector<mstreal> scoreStructure(const Structure& S, const vector<Residue*>& subregion, vector<pair<mstreal, mstreal>>* scoreParts = NULL, bool verbose = false);
@@ -30,7 +36,24 @@ class TERMANAL {
       return scoreStructure(S, S.getResidues(), scoreParts, verbose);
     }
     FASST* getFasstDB() { return F; }
-    void setFasstDB(FASST* _F) { F = _F; }
+    void setFasstDB(FASST* _F) { F = _F; clearMatchCache(); }
+
+    /* Additional FASST objects for searching TERMs in parallel. Each must have
+     * the same database, read in the same way, as the main one: FASST keeps all
+     * per-target data inside the object, so concurrent searches need separate
+     * objects, each holding its own copy of the database. Their search options
+     * are set by TERMANAL; they are not owned by it and are not deleted. */
+    void setWorkerFASSTs(const vector<FASST*>& _workers) { workers = _workers; }
+    vector<FASST*> getWorkerFASSTs() { return workers; }
+
+    /* Matches of every TERM searched for are kept (as match sequences and the
+     * structure frequency), keyed by the exact backbone coordinates of the TERM,
+     * so that identical TERMs, within one structure or across structures that
+     * share a backbone (e.g., sequence variants), are searched for only once. The
+     * cache is cleared whenever a setting that affects searches is changed via
+     * this object; call clearMatchCache() after changing the FASST object itself. */
+    void clearMatchCache() { matchCache.clear(); }
+    int matchCacheSize() { return matchCache.size(); }
     RotamerLibrary& getRotamerLibrary() { return RL; }
     void readRotamerLibrary(const string& rotLibFile) { RL.readRotamerLibrary(rotLibFile); }
     mstreal getCDCut() { return cdCut; }
@@ -40,25 +63,37 @@ class TERMANAL {
     mstreal getPseudocount() { return pseudoCount; }
     void setPseudocount(mstreal _pseudoCount) { pseudoCount = _pseudoCount; }
     int getMatchCount() { return matchCount; }
-    void setMatchCount(int _matchCount) { matchCount = _matchCount; }
+    void setMatchCount(int _matchCount) { matchCount = _matchCount; clearMatchCache(); }
     mstreal getRMSDCut() { return rmsdCut; }
-    void setRMSDCut(mstreal _rmsdCut) { rmsdCut = _rmsdCut; }
+    void setRMSDCut(mstreal _rmsdCut) { rmsdCut = _rmsdCut; clearMatchCache(); }
     bool getCompatMode() { return compatMode; }
-    void setCompatMode(bool _compatMode) { compatMode = _compatMode; }
+    void setCompatMode(bool _compatMode) { compatMode = _compatMode; clearMatchCache(); }
     int getCompatSearchLimit() { return compatSearchLimit; }
-    void setCompatSearchLimit(int _compatSearchLimit) { compatSearchLimit = _compatSearchLimit; }
+    void setCompatSearchLimit(int _compatSearchLimit) { compatSearchLimit = _compatSearchLimit; clearMatchCache(); }
 
   protected:
-    fasstSearchOptions setupSearch(const Structure& S);
+    // what is remembered about the matches of a TERM
+    struct termMatches {
+      vector<Sequence> seqs; // sequences of the top matches
+      mstreal structFreq;    // structure frequency
+    };
+
+    fasstSearchOptions setupSearch(FASST* S, const Structure& term);
+    termMatches searchTERM(FASST* S, const Structure& term);
+    pair<mstreal, mstreal> scoreParts(const termMatches& tm, const Structure& term, const vector<Residue*>& central, bool verbose, ostream& log);
+    void scoreTERMs(const vector<const Structure*>& terms, const vector<vector<Residue*>>& centrals, vector<pair<mstreal, mstreal>>& parts, vector<string>* logs);
+    static vector<mstreal> termKey(const Structure& term);
     vector<fasstSolution*> getTopMatches(FASST* F, fasstSolutionSet& matches, vector<Atom*>& queryA, vector<mstreal>* topRmsds = NULL);
-    mstreal calcSeqLikelihood(vector<fasstSolution*>& matches, const vector<Residue*>& central, bool verbose);
-    mstreal calcSeqFreq(Residue* res, vector<Sequence>& matchSeqs);
-    mstreal calcStructFreq(vector<fasstSolution*>& matches, vector<mstreal>& rmsds, bool verbose);
+    mstreal calcSeqLikelihood(const vector<Sequence>& matchSeqs, const vector<Residue*>& central, bool verbose, ostream& log);
+    mstreal calcSeqFreq(Residue* res, const vector<Sequence>& matchSeqs);
+    mstreal calcStructFreq(FASST* S, vector<fasstSolution*>& matches, vector<mstreal>& rmsds);
     vector<Structure> collectTERMs(ConFind& C, const vector<Residue*>& subregion, vector<Residue*>& centrals, vector<vector<int>>& resOverlaps);
     pair<mstreal, mstreal> smoothScores(map<int, pair<mstreal, mstreal>>& structScoreParts, vector<int>& overlapResInds);
 
   private:
     FASST* F;
+    vector<FASST*> workers; // additional searchers for parallel TERM searches
+    map<vector<mstreal>, termMatches> matchCache; // see clearMatchCache()
     RotamerLibrary RL;
     mstreal cdCut; // CD cutoff for creating TERMs
     int pad; // TERM padding
@@ -23,6 +23,10 @@
 #include <execinfo.h>
 #include <signal.h>
 #include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
 #undef assert
 
 using namespace std;
@@ -80,6 +84,8 @@ class Structure {
     vector<Residue*> getResidues() const;
     void setName(const string& _name) { name = _name; }
     string getName() const { return name; }
+    // approximate number of bytes the Structure occupies, including all of its chains, residues, and atoms
+    size_t memoryFootprint() const;
     void renumber(int startResNum=1, int startAtomIndex=1); // make residue numbering consequitive in each chain and atom index consequitive throughout
     // looks at the length of the peptide bond between adjacent residues to figure out where chains break
     void reassignChainsByConnectivity(Structure& dest, mstreal maxPeptideBond = 2.0);
@@ -392,6 +398,9 @@ class Atom {
      * whether the information exists or has been stripepd is not performed. */
     void stripInfo();
 
+    // approximate number of bytes the Atom occupies, including its additional information (unless stripped)
+    size_t memoryFootprint() const;
+
   protected:
     void setParent(Residue* _parent) { info->parent = _parent; } // will not itself update residue/atom counts in parents
 
@@ -713,6 +722,12 @@ class RMSDCalculator {
     template <class T>
     mstreal qcpRMSDGrad(const T& A, const T& B, vector<mstreal>& grad);
 
+    /* The largest eigenvalue of the QCP key matrix for the covariance S (S[i][j]
+     * is the sum over points of b_i * a_j, for centered point sets a and b) and
+     * E0 = (GA + GB)/2 (half the sum of their inner products), by Newton-Raphson
+     * from E0. The residual upon optimal superposition is GA + GB minus twice it. */
+    static mstreal qcpLargestEigenvalue(const mstreal S[3][3], mstreal E0);
+
     /* Tests QCP implementation for RMSD and RMSD gradient calculation. */
     static bool testQCP(bool testGrad = false);
 
@@ -729,6 +744,69 @@ class RMSDCalculator {
 
 };
 
+/* Computes many optimal-superposition RMSDs at once, between coordinate sets
+ * that all have the same number of points (e.g., for all-by-all distance
+ * matrices in clustering or landscape analysis). Each set is centered and its
+ * inner product computed only once, upon addition. Sets are stored in groups
+ * of laneWidth, with coordinates interleaved across the sets of a group, so
+ * that the 3x3 covariance matrices between one set and a whole group can be
+ * accumulated in vectorizable loops, and the QCP characteristic polynomial is
+ * then solved for all pairs of the group in lock step. All-by-all work is
+ * split into tiles that are processed in parallel. Results agree with
+ * RMSDCalculator::bestRMSD to within numerical precision. */
+class RMSDMatrixCalculator {
+  public:
+    static const int laneWidth = 8;
+
+    RMSDMatrixCalculator(int _numThreads = 0) { N = L = 0; numThreads = _numThreads; }
+
+    /* Adds a coordinate set, returning its index. All sets must be of the same
+     * length (the first set added determines this length). */
+    int addSet(const vector<Atom*>& atoms);
+    int addSet(const vector<CartesianPoint>& points);
+    void addSets(const vector<vector<Atom*> >& sets);
+    void clear() { N = L = 0; coords.clear(); G.clear(); }
+
+    int size() const { return N; }
+    int setLength() const { return L; }
+    void setNumThreads(int _numThreads) { numThreads = _numThreads; }
+    int getNumThreads() const { return numThreads; }
+
+    // RMSD between sets i and j upon optimal superposition
+    mstreal rmsd(int i, int j) const;
+
+    // RMSDs between the given external set and every stored set (in order)
+    vector<mstreal> rmsds(const vector<Atom*>& ref) const;
+
+    /* The full symmetric N x N matrix of RMSDs between all stored sets. */
+    vector<vector<mstreal> > rmsdMatrix() const { vector<vector<mstreal> > M; rmsdMatrix(M); return M; }
+    void rmsdMatrix(vector<vector<mstreal> >& M) const;
+
+    /* A sparse thresholded version of the matrix: for each set, a list of
+     * (index, RMSD) pairs for every other set within rmsdCut of it, in order of
+     * increasing index. Pairs that cannot be within the cutoff based on their
+     * radii of gyration are skipped without computing covariance matrices. */
+    vector<vector<pair<int, mstreal> > > neighborLists(mstreal rmsdCut) const;
+
+  protected:
+    /* Computes RMSDs between the given centered coordinates (stored as x, y, z
+     * arrays of length L each, with inner product g) and all sets in group gi,
+     * storing them in out[0 .. laneWidth-1]. */
+    void groupRMSDs(const mstreal* x, const mstreal* y, const mstreal* z, mstreal g, int gi, mstreal* out) const;
+    // extracts the centered coordinates of set i into xyz (as x, y, then z arrays)
+    void getSet(int i, vector<mstreal>& xyz) const;
+    int numGroups() const { return (N + laneWidth - 1)/laneWidth; }
+    template <class T>
+    int addCentered(const T& x, const T& y, const T& z);
+
+  private:
+    int N, L, numThreads;
+    /* For group gi, the coordinate c (0, 1, 2 for x, y, z) of point k in the
+     * set with lane l within the group is at coords[((gi*L + k)*3 + c)*laneWidth + l]. */
+    vector<mstreal> coords;
+    vector<mstreal> G; // inner products of centered coordinate sets (zero-padded to a whole group)
+};
+
 class ProximitySearch {
   public:
     ProximitySearch() { xlo = ylo = zlo = xhi = yhi = zhi = xbw = ybw = zbw = 0.0; N = 0;}
@@ -746,7 +824,7 @@ class ProximitySearch {
     mstreal getXHigh() { return xhi; }
     mstreal getYHigh() { return yhi; }
     mstreal getZHigh() { return zhi; }
-    int pointSize() { return pointList.size(); }
+    int pointSize() const { return pointList.size(); }
     CartesianPoint& getPoint(int i) { return *(pointList[i]); }
     int getPointTag(int i) { return pointTags[i]; }
     mstreal distance(int i, int j) { return pointList[i]->distance(pointList[j]); }
@@ -777,6 +855,9 @@ class ProximitySearch {
       vector<int> closeOnes; pointsWithin(c, dmin, dmax, &closeOnes); return closeOnes.size();
     }
 
+    // approximate number of bytes held by the object (its grid and points)
+    size_t memoryFootprint() const;
+
     // Returns true if the grid of the current ProximitySearch object overlaps
     // that of the ProximitySearch specified by more than the padding given
     bool overlaps(ProximitySearch& other, mstreal pad = 0);
@@ -857,9 +938,12 @@ class DecoratedProximitySearch : public ProximitySearch {
 
 class Clusterer {
   public:
-    Clusterer(bool _flag = true) { optimAlign = _flag; }
+    Clusterer(bool _flag = true) { optimAlign = _flag; numThreads = 0; }
     void optimizeAlignments(bool _flag) { optimAlign = _flag; }
     bool getOptimizeAlignments() { return optimAlign; }
+    // number of threads for parallel work (non-positive means MstUtils::numThreads())
+    void setNumThreads(int _numThreads) { numThreads = _numThreads; }
+    int getNumThreads() { return numThreads; }
 
     /* Will greedy cluster the given set of units (must all have the same number of atoms),
      * using the given RMSD cutoff, while making sure that no more than ~Nmax x Nmax RMSD
@@ -873,8 +957,15 @@ class Clusterer {
 
     /* Perform k-means clustering of a point cloud in arbitrary dimension, using
      * Euclidean distance as the metric. Returns a list of clusters of size k,
-     * where each cluster is represented by a vector point indices. */
-    vector<vector<int> > kmeans(const vector<CartesianPoint>& points, int k, int Ntrials = 1, int Niter = 10);
+     * where each cluster is represented by a vector point indices. Each of the
+     * Ntrials restarts is initialized by k-means++ seeding and runs at most Niter
+     * Lloyd iterations, stopping early once the sum of squared displacements of
+     * the means drops below tol; the trial with the smallest within-cluster sum
+     * of squares is returned. Trials are seeded from MstUtils::randEngine(), so
+     * the result is reproducible given its seed. Assignment uses Hamerly's
+     * bounds to skip most distance evaluations, and trials and assignment run
+     * in parallel (see setNumThreads). */
+    vector<vector<int> > kmeans(const vector<CartesianPoint>& points, int k, int Ntrials = 1, int Niter = 10, mstreal tol = 10E-8);
 
   protected:
     // these functions are protected because they assume that the cache of pre-
@@ -883,11 +974,20 @@ class Clusterer {
     vector<int> elementsWithin(const vector<vector<Atom*> >& units, set<int>& remIndices, const vector<Atom*>& fromUnit, mstreal rmsdCut);
     set<int> randomSubsample(set<int>& indices, int N);
 
+    // k-means++ seeding of k means (row-major in C) for n points of dimension d stored row-major in X
+    void kmeansSeed(const vector<mstreal>& X, int n, int d, int k, mt19937& rng, vector<mstreal>& C, int nThreads);
+
+    /* One k-means trial over n points of dimension d stored row-major in X.
+     * Fills the assignment of each point to a cluster and returns the within-
+     * cluster sum of squares. */
+    mstreal kmeansTrial(const vector<mstreal>& X, int n, int d, int k, int Niter, mstreal tol, unsigned seed, vector<int>& assign, int nThreads);
+
   private:
     // won't cache for now (need careful memory management)
     map<int, map<int, mstreal > > coputedRMSDs;
     bool optimAlign;
     RMSDCalculator rCalc;
+    int numThreads;
 };
 
 /* A simple map data structure based on storing a sorted list of keys (sorted by
@@ -906,6 +1006,7 @@ class simpleMap {
     valType at(const keyType& key);
     valType& operator[](const keyType& key); // will create entry if key missing, setting the value to the default value
     valType& value(int idx) { return vals[idx]; } // get value by index
+    const valType& value(int idx) const { return vals[idx]; }
     keyType key(int idx) const { return keys[idx]; } // get key by index
     int find(const keyType& key); // returns a negative index if key is not found
     void insert(const keyType& key, const valType& val);
@@ -1080,12 +1181,55 @@ class MstUtils {
     static string readNullTerminatedString(fstream& ifs);
     static string getDate();
     static vector<pair<int, int> > splitTasks(int numTasks, int numJobs);
+
+    /* Number of worker threads to use for parallel work. If the requested number
+     * is positive, it is returned as is. Otherwise, the value of environment
+     * variable MST_NUM_THREADS is used, if set, or else the number of hardware
+     * threads available. */
+    static int numThreads(int requested = 0);
+
+    /* Calls f(i, t) for every i in [beg, end), distributing calls over up to
+     * numThreads threads (resolved via numThreads(int)), where t in [0, numThreads)
+     * is the index of the thread making the call, so that callers can keep per-
+     * thread state. Indices are handed out dynamically in chunks of the given
+     * size, so no ordering among calls should be assumed. If any call throws,
+     * the first exception is re-thrown in the calling thread after all workers
+     * are done. With one thread (or one chunk) everything runs in the caller. */
+    template <class F>
+    static void parallelFor(int beg, int end, const F& f, int numThreads = 0, int chunk = 1);
+
+    /* Approximate number of bytes held on the heap by a container: its allocated
+     * capacity plus, recursively, whatever its elements hold. Nodes of ordered
+     * containers are charged for their payload plus typical tree and allocator
+     * overhead. Objects that are not containers hold nothing by this account
+     * (pointed-to data is never followed). Meant for memory accounting, e.g.,
+     * FASST::memoryFootprint(). */
+    template <class T>
+    static size_t heapBytes(const T& obj) { return 0; }
+    static size_t heapBytes(const string& str) { return (str.capacity() > 15) ? str.capacity() + 1 : 0; } // short strings are stored in place
+    static size_t heapBytes(const vector<bool>& vec) { return (vec.capacity() + 7)/8; }
+    template <class T>
+    static size_t heapBytes(const vector<T>& vec);
+    template <class T>
+    static size_t heapBytes(const set<T>& s);
+    template <class K, class V>
+    static size_t heapBytes(const map<K, V>& m);
+    template <class T>
+    static size_t heapBytes(const MST::tightvector<T>& vec);
+    template <class K, class V>
+    static size_t heapBytes(const MST::simpleMap<K, V>& m);
     static void setSignalHandlers();
     static void errorHandler(int sig);
 
-    // random numbers
-    static unsigned seedRandEngine(unsigned seed = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch().count()) { mt.seed(seed); return seed; }
-    static mt19937& randEngine() { return mt; }
+    /* Random numbers. All functions below draw from randEngine(), which is
+     * normally one engine shared by the whole process (and so is not safe to use
+     * from several threads at once). A thread can install its own engine with
+     * setThreadRandEngine(), so that parallel workers draw independent streams
+     * that are reproducible regardless of how the workers are scheduled;
+     * seedRandEngine() then seeds the installed engine. */
+    static unsigned seedRandEngine(unsigned seed = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch().count()) { randEngine().seed(seed); return seed; }
+    static mt19937& randEngine() { return (threadEngine != NULL) ? *threadEngine : mt; }
+    static void setThreadRandEngine(mt19937* engine) { threadEngine = engine; } // NULL reverts to the shared engine
 
     // returns a random number in the range [lower, upper]
     static int randInt(int lower, int upper);
@@ -1182,6 +1326,23 @@ class MstUtils {
 
     private:
       static mt19937 mt; // A Mersenne Twister pseudo-random generator of 32-bit numbers with a state size of 19937 bits.
+      static thread_local mt19937* threadEngine; // engine installed by the calling thread, if any
+};
+
+/* Installs an engine of its own, with the given seed(s), as the random number
+ * engine of the calling thread for the lifetime of the object (see MstUtils::
+ * setThreadRandEngine), e.g., to give each of several parallel tasks its own
+ * reproducible stream. */
+class MstThreadRandEngine {
+  public:
+    MstThreadRandEngine(unsigned seed) : engine(seed) { MstUtils::setThreadRandEngine(&engine); }
+    MstThreadRandEngine(seed_seq& seeds) : engine(seeds) { MstUtils::setThreadRandEngine(&engine); }
+    ~MstThreadRandEngine() { MstUtils::setThreadRandEngine(NULL); }
+
+  private:
+    MstThreadRandEngine(const MstThreadRandEngine&);
+    MstThreadRandEngine& operator=(const MstThreadRandEngine&);
+    mt19937 engine;
 };
 
 template <class F>
@@ -1437,6 +1598,75 @@ vector<T> MstUtils::range(const T& from, const T& to, const T& step) {
   return r;
 }
 
+template <class F>
+void MstUtils::parallelFor(int beg, int end, const F& f, int numThreads, int chunk) {
+  if (end <= beg) return;
+  if (chunk < 1) chunk = 1;
+  int numChunks = (end - beg + chunk - 1) / chunk;
+  int nt = MstUtils::min(MstUtils::numThreads(numThreads), numChunks);
+  if (nt <= 1) {
+    for (int i = beg; i < end; i++) f(i, 0);
+    return;
+  }
+  atomic<int> next(beg);
+  exception_ptr firstError = nullptr;
+  mutex errorLock;
+  auto worker = [&](int t) {
+    try {
+      while (true) {
+        int b = next.fetch_add(chunk);
+        if (b >= end) break;
+        int e = MstUtils::min(b + chunk, end);
+        for (int i = b; i < e; i++) f(i, t);
+      }
+    } catch (...) {
+      lock_guard<mutex> guard(errorLock);
+      if (firstError == nullptr) firstError = current_exception();
+      next = end; // stop handing out work
+    }
+  };
+  vector<thread> threads;
+  for (int t = 1; t < nt; t++) threads.push_back(thread(worker, t));
+  worker(0);
+  for (int t = 0; t < threads.size(); t++) threads[t].join();
+  if (firstError != nullptr) rethrow_exception(firstError);
+}
+
+template <class T>
+size_t MstUtils::heapBytes(const vector<T>& vec) {
+  size_t bytes = vec.capacity() * sizeof(T);
+  for (int i = 0; i < vec.size(); i++) bytes += heapBytes(vec[i]);
+  return bytes;
+}
+
+template <class T>
+size_t MstUtils::heapBytes(const set<T>& s) {
+  size_t bytes = s.size() * (sizeof(T) + 48);
+  for (auto it = s.begin(); it != s.end(); ++it) bytes += heapBytes(*it);
+  return bytes;
+}
+
+template <class K, class V>
+size_t MstUtils::heapBytes(const map<K, V>& m) {
+  size_t bytes = m.size() * (sizeof(pair<const K, V>) + 48);
+  for (auto it = m.begin(); it != m.end(); ++it) bytes += heapBytes(it->first) + heapBytes(it->second);
+  return bytes;
+}
+
+template <class T>
+size_t MstUtils::heapBytes(const MST::tightvector<T>& vec) {
+  size_t bytes = vec.size() * sizeof(T);
+  for (int i = 0; i < vec.size(); i++) bytes += heapBytes(vec[i]);
+  return bytes;
+}
+
+template <class K, class V>
+size_t MstUtils::heapBytes(const MST::simpleMap<K, V>& m) {
+  size_t bytes = m.size() * (sizeof(K) + sizeof(V));
+  for (int i = 0; i < m.size(); i++) bytes += heapBytes(m.key(i)) + heapBytes(m.value(i));
+  return bytes;
+}
+
 using namespace MST;
 
 /* --------- simpleMap --------- */
@@ -47,7 +47,7 @@ void numberResidues(Structure& S, const vector<int>& resIdx) {
   for (int k = 0; k < S.residueSize(); k++) S.getResidue(k).setNum(resIdx[k]);
 }
 
-vector<Structure*> getMatches(FASST& C, Structure& frag, const vector<int>& fragResIdx, int need = 5, const vector<int>& centIdx = vector<int>()) {
+vector<Structure*> getMatches(FASST& C, Structure& frag, const vector<int>& fragResIdx, int need = 5, const vector<int>& centIdx = vector<int>(), ostream& log = cout) {
   vector<Structure*> matchStructures;
   if (need == 0) return matchStructures;
   C.setQuery(frag, false);
@@ -82,10 +82,10 @@ vector<Structure*> getMatches(FASST& C, Structure& frag, const vector<int>& frag
       MstUtils::assertCond(match.residueSize() == fragResIdx.size(), "unexpected match size");
       numberResidues(match, fragResIdx); // make residue numbers store indices into the original structure
     }
-    if (C.isVerbose()) cout << "\tfound " << matchStructures.size() << " matches" << endl;
+    if (C.isVerbose()) log << "\tfound " << matchStructures.size() << " matches" << endl;
     if (matchStructures.size() == need) break;
 
-    cout << "\t\tneed to search again..." << endl;
+    log << "\t\tneed to search again..." << endl;
     for (Structure* m : matchStructures) delete(m);
     matchStructures.clear();
     int newNeeded = (int) ceil(1.5 * C.options().getMaxNumMatches());
@@ -96,6 +96,28 @@ vector<Structure*> getMatches(FASST& C, Structure& frag, const vector<int>& frag
   return matchStructures;
 }
 
+// one TERM to find matches for; a cycle's TERMs are searched for independently
+// of each other, possibly by several threads, but are reported and added to the
+// fuser topology in the order in which they were defined
+struct termSearch {
+  string label;
+  Structure frag;
+  vector<int> fragResIdx, centIdx;
+  mstreal rmsdCut;
+  vector<Structure*> matches;
+  stringstream log;
+};
+
+// searchers[t] is used by the t-th thread; all of them share the same targets
+void searchTERMs(vector<termSearch*>& terms, vector<FASST*>& searchers, int need, bool useSeq) {
+  MstUtils::parallelFor(0, terms.size(), [&](int i, int t) {
+    termSearch& term = *(terms[i]);
+    FASST& search = *(searchers[t]);
+    search.setRMSDCutoff(term.rmsdCut);
+    term.matches = getMatches(search, term.frag, term.fragResIdx, need, useSeq ? term.centIdx : vector<int>(), term.log);
+  }, searchers.size());
+}
+
 bool mc(mstreal oldScore, mstreal newScore, mstreal kT) {
   return ((newScore < oldScore) || (MstUtils::randUnit() < exp((oldScore - newScore)/kT)));
 }
@@ -203,6 +225,7 @@ int main(int argc, char** argv) {
   op.addOption("alt", "alternative conformation PDB file (must have the same length/topology as the starting conformation file). If given, for each TERM the corresponding segment of structure will be added as a \"match\".");
   op.addOption("orig", "If given, each TERM's original conformation (from the starting structure) will be explicitly added as a \"match\".");
   op.addOption("v", "set verbose output flag.");
+  op.addOption("nt", "number of threads to search for TERMs with (1 by default). Threads share one copy of the database and one cache. Results do not depend on the number of threads.");
   op.addOption("cycCheck","flag; if given, will check whether the fused structure has converged and will potentially quick early. Convergence is established by comparing the RMSD resultant from the current cycle to the average RMSD from the first 10 cycles. If the latter is less than a third of the former, the cycling is said to have converged.");
   if (op.isGiven("f") && op.isGiven("fs")) MstUtils::error("only one of --f or --fs can be given!");
 
@@ -244,14 +267,18 @@ int main(int argc, char** argv) {
     withCache.setStrictEquivalence(true);
     withCache.setVerbose(op.isGiven("v"));
     if (op.isGiven("c") && op.getString("c").empty()) MstUtils::error("--c must be a valid file path");
-    // read initial cache
+    // read initial cache (with --w, a cache file that does not exist yet is started)
     if (op.isGiven("c")) {
       if (op.getString("c").empty()) MstUtils::error("--c must be a valid file path");
-      if (MstSys::fileExists(op.getString("c"))) MstUtils::error("--c is not an existing file");
-      MstSys::getNetLock(tag, true);
-      cout << "reading cache from " << op.getString("c") << "... " << endl;
-      withCache.read(op.getString("c"));
-      MstSys::releaseNetLock(tag);
+      if (MstSys::fileExists(op.getString("c"))) {
+        // stale locks of dead processes are recovered, so it is safe to wait for as long as it takes
+        MstUtils::assertCond(MstSys::getNetLock(tag, true, -1), "could not lock the cache for reading");
+        cout << "reading cache from " << op.getString("c") << "... " << endl;
+        withCache.read(op.getString("c"));
+        MstSys::releaseNetLock(tag);
+      } else if (!op.isGiven("w")) {
+        MstUtils::error("--c is not an existing file");
+      }
     }
   }
   if (op.isGiven("d")) {
@@ -279,6 +306,18 @@ int main(int argc, char** argv) {
 
   if (search.isResidueRelationshipPopulated("sim")) search.setRedundancyProperty("sim");
   else search.setRedundancyCut(0.5);
+
+  // additional searchers for parallel TERM searches, set up like the main one
+  // and sharing its targets (and cache, if any); since the cache is strictly
+  // equivalent to plain FASST, which of them handles a given TERM does not
+  // affect the matches
+  int numThreads = op.getInt("nt", 1);
+  if (numThreads < 1) MstUtils::error("--nt must be a positive integer");
+  vector<FASST*> searchers(1, &search);
+  for (int t = 1; t < numThreads; t++) {
+    if (useCache) searchers.push_back(new cFASST(&withCache));
+    else searchers.push_back(new FASST(&woCache));
+  }
   RotamerLibrary RL(op.getString("rLib"));
   int pmSelf = 2, pmPair = 1;
   int Ni = 1000, lastWriteTime;
@@ -341,7 +380,7 @@ int main(int argc, char** argv) {
     if (op.isGiven("c") && op.isGiven("w")) {
       if ((c == 0) || (time(NULL) - lastWriteTime > 5*60)) { // write every five minutes or so
         cout << "dumping cache to " << op.getString("c") << "... " << endl;
-        MstSys::getNetLock(tag);
+        MstUtils::assertCond(MstSys::getNetLock(tag, false, -1), "could not lock the cache for writing");
         withCache.write(op.getString("c"));
         MstSys::releaseNetLock(tag);
         lastWriteTime = time(NULL);
@@ -352,29 +391,39 @@ int main(int argc, char** argv) {
     // first self TERMs
     cout << "Searching for self TERMs..." << endl;
     vector<vector<Structure*>> allMatches;
+    vector<termSearch*> terms;
+    vector<vector<Residue*>> termCentral; // central residues of each TERM
     for (int ci = 0; ci < S.chainSize(); ci++) {
       Chain& C = S[ci];
       for (int ri = 0; ri < C.residueSize(); ri++) {
-        Structure frag; vector<int> fragResIdx;
-        vector<int> centIdx = TERMUtils::selectTERM({&C[ri]}, frag, pmSelf, &fragResIdx, false);
-        if (MstUtils::setdiff(fragResIdx, fixed).empty()) continue; // TERMs composed entirely of fixed residues have no impact
-        cout << "TERM around " << C[ri] << endl;
-        search.setRMSDCutoff(RMSDCalculator::rmsdCutoff(fragResIdx, S)); // account for spacing between residues from the same chain
-        vector<Structure*> matches = getMatches(search, frag, fragResIdx, numPerTERM, op.isGiven("s") ? centIdx : vector<int>());
-        for (int ii = 0; ii < O.size(); ii++) {
-          if (O[ii] == NULL) continue;
-          Structure* altFrag = new Structure();
-          TERMUtils::selectTERM({&(O[ii]->getResidue(C[ri].getResidueIndex()))}, *altFrag, pmSelf, NULL, false);
-          numberResidues(*altFrag, fragResIdx);
-          matches.push_back(altFrag);
-        }
-        if (!matches.empty()) {
-          allMatches.push_back(matches);
-          int lastIdx = MstUtils::min(MstUtils::max(numPerTERM, 1), (int) matches.size());
-          Structure* last = matches[lastIdx - 1];
-          if (op.isGiven("v")) cout << "\tRMSD of match " << lastIdx << " is " << rc.bestRMSD(RotamerLibrary::getBackbone(*last), RotamerLibrary::getBackbone(frag)) << endl;
-        }
+        termSearch* term = new termSearch();
+        term->centIdx = TERMUtils::selectTERM({&C[ri]}, term->frag, pmSelf, &(term->fragResIdx), false);
+        if (MstUtils::setdiff(term->fragResIdx, fixed).empty()) { delete term; continue; } // TERMs composed entirely of fixed residues have no impact
+        stringstream label; label << C[ri]; term->label = label.str();
+        term->rmsdCut = RMSDCalculator::rmsdCutoff(term->fragResIdx, S); // account for spacing between residues from the same chain
+        terms.push_back(term);
+        termCentral.push_back({&C[ri]});
+      }
+    }
+    searchTERMs(terms, searchers, numPerTERM, op.isGiven("s"));
+    for (int k = 0; k < terms.size(); k++) {
+      termSearch& term = *(terms[k]);
+      cout << "TERM around " << term.label << endl << term.log.str();
+      vector<Structure*>& matches = term.matches;
+      for (int ii = 0; ii < O.size(); ii++) {
+        if (O[ii] == NULL) continue;
+        Structure* altFrag = new Structure();
+        TERMUtils::selectTERM({&(O[ii]->getResidue(termCentral[k][0]->getResidueIndex()))}, *altFrag, pmSelf, NULL, false);
+        numberResidues(*altFrag, term.fragResIdx);
+        matches.push_back(altFrag);
+      }
+      if (!matches.empty()) {
+        allMatches.push_back(matches);
+        int lastIdx = MstUtils::min(MstUtils::max(numPerTERM, 1), (int) matches.size());
+        Structure* last = matches[lastIdx - 1];
+        if (op.isGiven("v")) cout << "\tRMSD of match " << lastIdx << " is " << rc.bestRMSD(RotamerLibrary::getBackbone(*last), RotamerLibrary::getBackbone(term.frag)) << endl;
       }
+      delete terms[k];
     }
 
     // then pair TERMs
@@ -388,28 +437,39 @@ int main(int argc, char** argv) {
       L = cfd.getContacts(residues, 0.01);
     }
     vector<pair<Residue*, Residue*> > contactList = L.getOrderedContacts();
+    terms.clear(); termCentral.clear();
     for (int k = 0; k < contactList.size(); k++) {
       Residue* resA = contactList[k].first;
       Residue* resB = contactList[k].second;
-      Structure frag; vector<int> fragResIdx;
-      vector<int> centIdx = TERMUtils::selectTERM({resA, resB}, frag, pmPair, &fragResIdx, false);
-      if (MstUtils::setdiff(fragResIdx, fixed).empty()) continue; // TERMs composed entirely of fixed residues have no impact
-      cout << "TERM around " << *resA << " x " << *resB << endl;
-      search.setRMSDCutoff(RMSDCalculator::rmsdCutoff(fragResIdx, S)); // account for spacing between residues from the same chain
-      vector<Structure*> matches = getMatches(search, frag, fragResIdx, numPerTERM, op.isGiven("s") ? centIdx : vector<int>());
+      termSearch* term = new termSearch();
+      term->centIdx = TERMUtils::selectTERM({resA, resB}, term->frag, pmPair, &(term->fragResIdx), false);
+      if (MstUtils::setdiff(term->fragResIdx, fixed).empty()) { delete term; continue; } // TERMs composed entirely of fixed residues have no impact
+      stringstream label; label << *resA << " x " << *resB; term->label = label.str();
+      term->rmsdCut = RMSDCalculator::rmsdCutoff(term->fragResIdx, S); // account for spacing between residues from the same chain
+      terms.push_back(term);
+      termCentral.push_back({resA, resB});
+    }
+    searchTERMs(terms, searchers, numPerTERM, op.isGiven("s"));
+    for (int k = 0; k < terms.size(); k++) {
+      termSearch& term = *(terms[k]);
+      Residue* resA = termCentral[k][0];
+      Residue* resB = termCentral[k][1];
+      cout << "TERM around " << term.label << endl << term.log.str();
+      vector<Structure*>& matches = term.matches;
       for (int ii = 0; ii < O.size(); ii++) {
         if (O[ii] == NULL) continue;
         Structure* altFrag = new Structure();
         TERMUtils::selectTERM({&(O[ii]->getResidue(resA->getResidueIndex())), &(O[ii]->getResidue(resB->getResidueIndex()))}, *altFrag, pmPair, NULL, false);
-        numberResidues(*altFrag, fragResIdx);
+        numberResidues(*altFrag, term.fragResIdx);
         matches.push_back(altFrag);
       }
       if (!matches.empty()) {
         allMatches.push_back(matches);
         int lastIdx = MstUtils::min(MstUtils::max(numPerTERM, 1), (int) matches.size());
         Structure* last = matches[lastIdx - 1];
-        if (op.isGiven("v")) cout << "\tRMSD of match " << lastIdx << " is " << rc.bestRMSD(RotamerLibrary::getBackbone(*last), RotamerLibrary::getBackbone(frag)) << endl;
+        if (op.isGiven("v")) cout << "\tRMSD of match " << lastIdx << " is " << rc.bestRMSD(RotamerLibrary::getBackbone(*last), RotamerLibrary::getBackbone(term.frag)) << endl;
       }
+      delete terms[k];
     }
     // fuser options
     fusionParams opts; opts.setNumIters(Ni); opts.setVerbose(false);
@@ -534,4 +594,5 @@ int main(int argc, char** argv) {
   }
   out.close();
   Structure::combine(S, I).writePDB(op.getString("o") + ".fin.pdb");
+  for (int t = 1; t < searchers.size(); t++) delete searchers[t];
 }
@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <typeinfo>
 #include <stdio.h>
+#include <unordered_set>
+#include <numeric>
+#include <tuple>
 
 #include "msttypes.h"
 #include "mstoptions.h"
@@ -13,7 +16,9 @@ using namespace std;
 using namespace MST;
 
 class Landscape {
-  typedef vector<int> sol_t;
+  /* solutions are stored packed, one byte per site (see packSolution), which
+   * keeps large landscapes compact and makes them cheap to hash */
+  typedef string sol_t;
   public:
     Landscape(mstreal _lowE = -20, mstreal _dE = 1, int _N = 40, int _maxPerBin = -1) {
       lowE = _lowE; dE = _dE; N = _N;
@@ -26,8 +31,7 @@ class Landscape {
     void resetMeans() { runN = 0; meanEner = 0; }
     int getNumLevels() const { return N; }
     int getNumSeqsInLevel(int i) const { return seqsByEnergy[i].size(); }
-    vector<pair<sol_t, mstreal> > getSeqsInLevel(int i) const { return seqsByEnergy[i]; }
-    vector<vector<pair<sol_t, mstreal> > > getSeqsInAllLevels() const { return seqsByEnergy; }
+    const vector<pair<sol_t, mstreal> >& getSeqsInLevel(int i) const { return seqsByEnergy[i]; }
     vector<int> getNumHits() const { return numHits; }
     int getTotalNeed(int cap) const {
       int need = 0;
@@ -66,16 +70,17 @@ class Landscape {
     mstreal getMeanEnergy() const { return meanEner; }
     int energyLevelIndex(mstreal ener) const { return (ener - lowE)/dE; }
 
+    // accounts for n visited solutions (unique or not), of the given total energy
+    void addVisits(long n, mstreal sumEner) {
+      if (n == 0) return;
+      meanEner = (meanEner*runN + sumEner)/(runN + n); runN += n;
+    }
+
     void addSequence(const sol_t& seq, mstreal ener) {
-      meanEner = (meanEner*runN + ener)/(runN + 1); runN++;
       int levelIdx = energyLevelIndex(ener);
-      if (levelIdx < 0) {
-        cerr << "\tin Landscape::addSequence -> lowest energy is " << lowE << ", but trying to add a sequence with energy " << ener << ". Will ignore..." << endl;
-        return;
-      }
-      if (levelIdx >= N) return;
+      if ((levelIdx < 0) || (levelIdx >= N)) return;
 
-      set<sol_t >& visitedInLevel = visitedByEnergy[levelIdx];
+      unordered_set<sol_t>& visitedInLevel = visitedByEnergy[levelIdx];
       if (visitedInLevel.find(seq) == visitedInLevel.end()) {
         numHits[levelIdx]++;
         vector<pair<sol_t, mstreal> >& seqsInLevel = seqsByEnergy[levelIdx];
@@ -101,8 +106,11 @@ class Landscape {
       return nums;
     }
 
-    static void recordSolution(void* land, const sol_t& sol, mstreal ener) {
-      ((Landscape*) land)->addSequence(sol, ener);
+    static sol_t packSolution(const vector<int>& sol) { return sol_t(sol.begin(), sol.end()); }
+    static vector<int> unpackSolution(const sol_t& seq) {
+      vector<int> sol(seq.size());
+      for (int i = 0; i < seq.size(); i++) sol[i] = (unsigned char) seq[i];
+      return sol;
     }
 
   private:
@@ -112,50 +120,260 @@ class Landscape {
                          // replace an existing solution in the bin if this limit
                          // is reached and a new unique solution is added
     vector<vector<pair<sol_t, mstreal> > > seqsByEnergy;
-    vector<set<sol_t> > visitedByEnergy;
+    vector<unordered_set<sol_t> > visitedByEnergy;
     vector<int> numHits; // total number of unique solutions that was added to the bin
 
     // counters for computing mean properties (over all solutions, no matter whether unique)
-    int runN;            // running total number of solutions added
+    long runN;           // running total number of solutions added
     mstreal meanEner;    // the running mean energy
 };
 
-int distance(const vector<int>& seqi, const vector<int>& seqj) {
-  int d = 0;
-  for (int i = 0; i < seqi.size(); i++) {
-    d += (seqi[i] != seqj[i]);
+/* What one sampling chain visited: each solution within the landscape's energy
+ * levels once, in the order in which it was first visited, along with energy
+ * statistics over all visits. Chains run in parallel, each filling its own
+ * record, and records are merged into the landscape one chain after another, so
+ * that the outcome does not depend on how chains were scheduled. Note that each
+ * record holds all distinct solutions its chain visited in a round. */
+class chainRecord {
+  public:
+    chainRecord(const Landscape* _land = NULL) { land = _land; numVisits = numBelow = 0; sumEner = lowestBelow = 0; }
+
+    void add(const vector<int>& sol, mstreal ener) {
+      numVisits++; sumEner += ener;
+      int levelIdx = land->energyLevelIndex(ener);
+      if (levelIdx < 0) {
+        if ((numBelow == 0) || (ener < lowestBelow)) lowestBelow = ener;
+        numBelow++;
+        return;
+      }
+      if (levelIdx >= land->getNumLevels()) return;
+      buff.assign(sol.begin(), sol.end());
+      auto ins = seen.insert(buff);
+      if (ins.second) visits.push_back(pair<const string*, mstreal>(&(*(ins.first)), ener));
+    }
+
+    void mergeInto(Landscape& L) const {
+      L.addVisits(numVisits, sumEner);
+      for (int i = 0; i < visits.size(); i++) L.addSequence(*(visits[i].first), visits[i].second);
+    }
+    long getNumBelow() const { return numBelow; }     // visits below the lowest level
+    mstreal getLowestBelow() const { return lowestBelow; }
+
+    static void recordSolution(void* rec, const vector<int>& sol, mstreal ener) {
+      ((chainRecord*) rec)->add(sol, ener);
+    }
+
+  private:
+    const Landscape* land;
+    unordered_set<string> seen;
+    vector<pair<const string*, mstreal> > visits; // point into seen
+    string buff;
+    long numVisits, numBelow;
+    mstreal sumEner, lowestBelow;
+};
+
+/* Runs f(c) for chains c in [0, numChains) over numThreads threads. Each chain
+ * draws random numbers from its own engine, seeded in turn from the shared
+ * engine before any chain starts, so results depend on the state of the shared
+ * engine and on the number of chains, but not on the number of threads. */
+template <class F>
+void runChains(int numChains, int numThreads, const F& f) {
+  vector<unsigned> seeds(numChains);
+  for (int c = 0; c < numChains; c++) seeds[c] = MstUtils::randEngine()();
+  MstUtils::parallelFor(0, numChains, [&](int c, int t) {
+    MstThreadRandEngine engine(seeds[c]);
+    f(c);
+  }, numThreads);
+}
+
+/* Sequences (solutions) packed into 64-bit words, with just enough bits per
+ * residue for the largest site alphabet (e.g., 5 bits, or 12 residues per word,
+ * for 20 amino acids) and no residue straddling two words. The distance between
+ * two sequences is then computed a word at a time: XOR-ing leaves non-zero lanes
+ * where residues differ, and a lane is non-zero if either its top bit is set or
+ * adding all ones to its remaining bits carries into the top bit (which cannot
+ * overflow into the next lane), so differences are counted with a few integer
+ * operations and a popcount per word. */
+class packedSequences {
+  public:
+    packedSequences(const vector<string>& seqs, int alphabetSize) {
+      bits = 1;
+      while ((1 << bits) < alphabetSize) bits++;
+      MstUtils::assertCond(bits <= 8, "alphabet too large to pack", "packedSequences::packedSequences");
+      int perWord = 64/bits;
+      N = seqs.size();
+      L = seqs.empty() ? 0 : seqs[0].size();
+      W = (L + perWord - 1)/perWord;
+      lowBits = topBits = 0;
+      for (int k = 0; k < perWord; k++) {
+        lowBits |= ((((uint64_t) 1) << (bits - 1)) - 1) << (k*bits);
+        topBits |= ((uint64_t) 1) << (k*bits + bits - 1);
+      }
+      words.resize((size_t) N*W, 0);
+      for (int i = 0; i < N; i++) {
+        MstUtils::assertCond(seqs[i].size() == L, "sequences of different lengths", "packedSequences::packedSequences");
+        for (int p = 0; p < L; p++) words[(size_t) i*W + p/perWord] |= ((uint64_t) (unsigned char) seqs[i][p]) << ((p % perWord)*bits);
+      }
+    }
+    int size() const { return N; }
+    int length() const { return L; }
+
+    int distance(int i, int j) const {
+      const uint64_t* a = row(i); const uint64_t* b = row(j);
+      int d = 0;
+      for (int w = 0; w < W; w++) {
+        uint64_t x = a[w] ^ b[w];
+        d += __builtin_popcountll((((x & lowBits) + lowBits) | x) & topBits);
+      }
+      return d;
+    }
+
+    // adds to hist the distances between all pairs i < j with i in [ib, ie) and j in [jb, je)
+    void addToHistogram(int ib, int ie, int jb, int je, vector<long>& hist) const {
+      for (int i = ib; i < ie; i++) {
+        for (int j = MstUtils::max(jb, i + 1); j < je; j++) hist[distance(i, j)]++;
+      }
+    }
+
+  private:
+    const uint64_t* row(int i) const { return &(words[(size_t) i*W]); }
+
+    int N, L, W, bits;
+    uint64_t lowBits, topBits; // all but the top bit of every lane, and the top bits
+    vector<uint64_t> words;
+};
+
+/* Writes all pairs of sequences within Hamming distance maxDist of each other,
+ * as lines "i j d" (1-based indices, i < j). Pairs are found exactly via the
+ * pigeonhole principle: with positions split into maxDist + 1 blocks, any two
+ * such sequences agree over at least one whole block. So, for each block in
+ * turn, sequences are grouped by their residues over it, and only pairs within
+ * a group are compared, in parallel; a pair is reported only for the first block
+ * it agrees over. Pairs are written block by block, sorted within each block.
+ * Returns the number of pairs written. */
+long writeNeighborGraph(const vector<string>& seqs, const packedSequences& P, int maxDist, const string& outFile, int numThreads) {
+  typedef tuple<int, int, int> edge_t;
+  int N = seqs.size(), L = P.length();
+  int B = MstUtils::min(maxDist + 1, L + 1); // with more blocks than positions, some are empty and group everything
+  vector<int> blockBeg(B + 1);
+  for (int b = 0; b <= B; b++) blockBeg[b] = b*L/B;
+  auto sameInBlock = [&](int i, int j, int b) { return seqs[i].compare(blockBeg[b], blockBeg[b+1] - blockBeg[b], seqs[j], blockBeg[b], blockBeg[b+1] - blockBeg[b]) == 0; };
+
+  fstream of; MstUtils::openFile(of, outFile, ios::out);
+  long numEdges = 0;
+  vector<int> order(N);
+  for (int b = 0; b < B; b++) {
+    // group sequences by their residues in this block (by index within groups)
+    iota(order.begin(), order.end(), 0);
+    int beg = blockBeg[b], len = blockBeg[b+1] - beg;
+    sort(order.begin(), order.end(), [&](int i, int j) {
+      int c = seqs[i].compare(beg, len, seqs[j], beg, len);
+      return (c < 0) || ((c == 0) && (i < j));
+    });
+    vector<pair<int, int> > groups;
+    for (int gb = 0, ge; gb < N; gb = ge) {
+      for (ge = gb + 1; (ge < N) && sameInBlock(order[gb], order[ge], b); ge++);
+      if (ge - gb > 1) groups.push_back(pair<int, int>(gb, ge));
+    }
+
+    vector<vector<edge_t> > edges(numThreads);
+    MstUtils::parallelFor(0, groups.size(), [&](int g, int t) {
+      for (int x = groups[g].first; x < groups[g].second; x++) {
+        for (int y = x + 1; y < groups[g].second; y++) {
+          int i = order[x], j = order[y];
+          int d = P.distance(i, j);
+          if (d > maxDist) continue;
+          bool reported = false;
+          for (int pb = 0; (pb < b) && !reported; pb++) reported = sameInBlock(i, j, pb);
+          if (!reported) edges[t].push_back(edge_t(i, j, d));
+        }
+      }
+    }, numThreads);
+
+    vector<edge_t> blockEdges;
+    for (int t = 0; t < edges.size(); t++) {
+      blockEdges.insert(blockEdges.end(), edges[t].begin(), edges[t].end());
+      vector<edge_t>().swap(edges[t]);
+    }
+    sort(blockEdges.begin(), blockEdges.end());
+    for (int k = 0; k < blockEdges.size(); k++) of << get<0>(blockEdges[k]) + 1 << " " << get<1>(blockEdges[k]) + 1 << " " << get<2>(blockEdges[k]) << "\n";
+    numEdges += blockEdges.size();
   }
-  return d;
+  of.close();
+  return numEdges;
+}
+
+// histogram of distances over all pairs, computed in tiles of the all-by-all matrix distributed over threads
+vector<long> distanceHistogram(const packedSequences& P, int numThreads) {
+  const int T = 256;
+  int N = P.size(), numTiles = (N + T - 1)/T;
+  vector<vector<long> > hists(numThreads, vector<long>(P.length() + 1, 0));
+  MstUtils::parallelFor(0, numTiles, [&](int ti, int t) {
+    for (int tj = ti; tj < numTiles; tj++) P.addToHistogram(ti*T, MstUtils::min((ti + 1)*T, N), tj*T, MstUtils::min((tj + 1)*T, N), hists[t]);
+  }, numThreads);
+  vector<long> hist(P.length() + 1, 0);
+  for (int t = 0; t < hists.size(); t++) {
+    for (int d = 0; d < hist.size(); d++) hist[d] += hists[t][d];
+  }
+  return hist;
 }
 
 int main(int argc, char** argv) {
   MstOptions op;
   op.setTitle("Analyzes the sequence landscape encoded by a given sequence-level pseudo-energy table. Options:");
   op.addOption("e", "energy table file.", true);
-  op.addOption("o", "output base for Matlab analysis.", true);
+  op.addOption("o", "output base for Matlab analysis. Energies and sequences of the sampled sequences are written to files with suffixes _ener.dat and _seq.dat, respectively, and the graph of sequences within distance --dmax of each other to _nbr.dat, with lines \"i j d\" (1-based indices into the other files, i < j, and their distance).", true);
   op.addOption("s", "step in energy units for building \"contour lines\" in the energy landscape. Default is 1.0.");
   op.addOption("n", "number of intervals of this size to track. Default is 40.");
   op.addOption("k", "number of sequences to sub-sample in each interval at the end to compute an embedding. Default is 1000.");
   op.addOption("nat", "native sequence, single-letter.");
+  op.addOption("dmax", "maximum Hamming distance between sequences linked in the neighbor graph. Default is 3.");
+  op.addOption("hist", "if given, also write a histogram of distances over all pairs of sampled sequences to a file with suffix _hist.dat (lines \"d count\").");
+  op.addOption("mat", "if given, also write the full all-by-all distance matrix to a file with suffix _mat.dat. Only feasible for modest numbers of sequences.");
+  op.addOption("nc", "number of Monte Carlo chains to run in each round of sampling. Default is the number of threads. Results are reproducible for a given seed and number of chains.");
+  op.addOption("nt", "number of threads; defaults to MST_NUM_THREADS if set, or else the number of hardware threads.");
+  op.addOption("seed", "random seed. By default, a seed is picked based on time.");
   op.setOptions(argc, argv);
   MstUtils::setSignalHandlers();
 
   mstreal dE = op.getReal("s", 1.0);
   int N = op.getInt("n", 40);
+  int maxDist = op.getInt("dmax", 3);
+  int numThreads = MstUtils::numThreads(op.getInt("nt", 0));
+  int numChains = op.getInt("nc", numThreads);
   MstUtils::assertCond(dE > 0, "energy step must be positive!");
   MstUtils::assertCond(N > 0, "number of energy intervals must be positive integer!");
-  srand(time(NULL) + (int) getpid());
+  MstUtils::assertCond(maxDist >= 0, "maximum neighbor distance must be non-negative!");
+  MstUtils::assertCond(numChains > 0, "number of chains must be positive!");
+  unsigned seed = op.isGiven("seed") ? MstUtils::seedRandEngine(op.getInt("seed")) : MstUtils::seedRandEngine();
+  cout << "random seed is " << seed << ", sampling with " << numChains << " chain(s) over " << numThreads << " thread(s)" << endl;
 
   EnergyTable Etab(op.getString("e"));
+  int alphabetSize = 0;
+  for (int si = 0; si < Etab.numSites(); si++) alphabetSize = MstUtils::max(alphabetSize, (int) Etab.getSiteAlphabet(si).size());
+  MstUtils::assertCond(alphabetSize <= 256, "site alphabets larger than 256 are not supported!");
 
-  // first, run a long-ish MC to try to get the best energy
+  // first, run a long-ish MC to try to get the best energy (cycles split among chains)
   Sequence natSeq;
   if (op.isGiven("nat")) {
     natSeq = Sequence(op.getString("nat"));
     cout << "native sequence energy is " << Etab.scoreSequence(natSeq) << endl;
   }
-  vector<int> bestSol = Etab.mc(100, 1000000, 1.0, 0.01);
-  mstreal lowE = Etab.scoreSolution(bestSol);
+  int numCycles = 100;
+  vector<vector<int> > chainBest(numChains);
+  vector<mstreal> chainBestE(numChains, 0);
+  runChains(numChains, numThreads, [&](int c) {
+    int n = (c + 1)*numCycles/numChains - c*numCycles/numChains;
+    if (n == 0) return;
+    chainBest[c] = Etab.mc(n, 1000000, 1.0, 0.01);
+    chainBestE[c] = Etab.scoreSolution(chainBest[c]);
+  });
+  int bestChain = -1;
+  for (int c = 0; c < numChains; c++) {
+    if (!chainBest[c].empty() && ((bestChain < 0) || (chainBestE[c] < chainBestE[bestChain]))) bestChain = c;
+  }
+  vector<int> bestSol = chainBest[bestChain];
+  mstreal lowE = chainBestE[bestChain];
   cout << "lowest energy found is " << lowE << endl;
   cout << "lowest-energy sequence: " << (Etab.solutionToSequence(bestSol)).toString() << endl;
   cout << "mean energy is " << Etab.meanEnergy() << endl;
@@ -171,7 +389,21 @@ int main(int argc, char** argv) {
   int stuck = 0;       // for how many cycles have we been stuck? (no improvement)
   int prevNeed = L.getTotalNeed(cap); int need = prevNeed;
   while ((MstUtils::min(L.getNumHits()) < cap) || (stuck > 100)) {
-    Etab.mc(1, Ni, kT, kT, 1, &L, &Landscape::recordSolution, Ne);
+    vector<chainRecord> records(numChains, chainRecord(&L));
+    runChains(numChains, numThreads, [&](int c) {
+      Etab.mc(1, Ni, kT, kT, 1, &(records[c]), &chainRecord::recordSolution, Ne);
+    });
+    long numBelow = 0; mstreal lowestBelow = 0;
+    for (int c = 0; c < numChains; c++) {
+      records[c].mergeInto(L);
+      if ((records[c].getNumBelow() > 0) && ((numBelow == 0) || (records[c].getLowestBelow() < lowestBelow))) lowestBelow = records[c].getLowestBelow();
+      numBelow += records[c].getNumBelow();
+    }
+    if (numBelow > 0) {
+      cerr << "\tlowest energy is " << lowE << ", but " << numBelow << " visited sequence(s) had lower energies (down to " << lowestBelow << "). Will ignore..." << endl;
+    }
+    vector<chainRecord>().swap(records);
+
     mstreal Ed = L.getMeanDefitiency(cap);
     mstreal Es = L.getMeanEnergy();
     int need = L.getTotalNeed(cap);
@@ -188,41 +420,57 @@ int main(int argc, char** argv) {
     if (stuck > 100) break;
   }
 
-  // get all sequences sampled
-  vector<vector<int> > allSeqs;
+  // get all sequences sampled (the native first, if given), each once
+  vector<string> allSeqs;
   vector<mstreal> allEnergies;
+  unordered_set<string> collected;
+  if (op.isGiven("nat")) {
+    allSeqs.push_back(Landscape::packSolution(Etab.sequenceToSolution(natSeq)));
+    allEnergies.push_back(Etab.scoreSequence(natSeq));
+    collected.insert(allSeqs.back());
+  }
   for (int i = 0; i < L.getNumLevels(); i++) {
-    vector<pair<vector<int>, mstreal> > seqsInLevel = L.getSeqsInLevel(i);
+    const vector<pair<string, mstreal> >& seqsInLevel = L.getSeqsInLevel(i);
     for (int j = 0; j < seqsInLevel.size(); j++) {
+      if (!collected.insert(seqsInLevel[j].first).second) continue;
       allSeqs.push_back(seqsInLevel[j].first);
       allEnergies.push_back(seqsInLevel[j].second);
     }
   }
-
-  // add the native
-  if (op.isGiven("nat")) {
-    allSeqs.insert(allSeqs.begin(), Etab.sequenceToSolution(natSeq));
-    allEnergies.insert(allEnergies.begin(), Etab.scoreSequence(natSeq));
-  }
-
-  // output distances for Matlab analysis
-  cout << "calculating all-by-all for a subset of " << allSeqs.size() << " sequences..." << endl;
-  fstream of; MstUtils::openFile(of, op.getString("o") + "_mat.dat", ios::out);
-  for (int i = 0; i < allSeqs.size(); i++) {
-    for (int j = 0; j < allSeqs.size(); j++) {
-      of << distance(allSeqs[i], allSeqs[j]) << " ";
-    }
-    of << endl;
-  }
-  of.close();
+  unordered_set<string>().swap(collected);
 
   // output energies
+  fstream of;
   MstUtils::openFile(of, op.getString("o") + "_ener.dat", ios::out);
   for (int i = 0; i < allEnergies.size(); i++) of << allEnergies[i] << endl;
   of.close();
 
   // output sequences
   MstUtils::openFile(of, op.getString("o") + "_seq.dat", ios::out);
-  for (int i = 0; i < allSeqs.size(); i++) of << (Etab.solutionToSequence(allSeqs[i])).toString() << endl;
+  for (int i = 0; i < allSeqs.size(); i++) of << (Etab.solutionToSequence(Landscape::unpackSolution(allSeqs[i]))).toString() << endl;
   of.close();
+
+  // output distances for Matlab analysis
+  packedSequences P(allSeqs, alphabetSize);
+  cout << "finding neighbors within distance " << maxDist << " among " << allSeqs.size() << " sequences..." << endl;
+  long numEdges = writeNeighborGraph(allSeqs, P, maxDist, op.getString("o") + "_nbr.dat", numThreads);
+  cout << "found " << numEdges << " neighbor pair(s)" << endl;
+  if (op.isGiven("hist")) {
+    cout << "calculating the distance histogram over all pairs..." << endl;
+    vector<long> hist = distanceHistogram(P, numThreads);
+    MstUtils::openFile(of, op.getString("o") + "_hist.dat", ios::out);
+    for (int d = 0; d < hist.size(); d++) of << d << " " << hist[d] << endl;
+    of.close();
+  }
+  if (op.isGiven("mat")) {
+    cout << "calculating all-by-all for a subset of " << allSeqs.size() << " sequences..." << endl;
+    MstUtils::openFile(of, op.getString("o") + "_mat.dat", ios::out);
+    for (int i = 0; i < allSeqs.size(); i++) {
+      for (int j = 0; j < allSeqs.size(); j++) {
+        of << P.distance(i, j) << " ";
+      }
+      of << endl;
+    }
+    of.close();
+  }
 }
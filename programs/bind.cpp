@@ -12,6 +12,7 @@
 #include "mstoptions.h"
 #include "mstmagic.h"
 #include "mstrotlib.h"
+#include "mstsystem.h"
 
 using namespace std;
 using namespace MST;
@@ -21,11 +22,13 @@ class bindOptions {
     bindOptions(FASST* _F = NULL, RotamerLibrary* _RL = NULL) {
       F = _F;
       RL = _RL;
+      out = &cout;
       pm = 1;
       pcut = 0.0;
       setDefaultRMSDCutoffs();
     }
     FASST* getFASST() { return F; }
+    ostream& log() { return *out; }
     RotamerLibrary* getRotamerLibrary() { return RL; }
     int contextLen() { return pm; }
     mstreal getRMSDCut() { return rmsdCut; }
@@ -39,6 +42,7 @@ class bindOptions {
     }
     void setContextLen(int _pm) { pm = _pm; }
     void setFASST(FASST* _F) { F = _F; }
+    void setLog(ostream* _out) { out = _out; }
     void setRotamerLibrary(RotamerLibrary* _RL) { RL = _RL; }
     void setMinProb(mstreal _pcut) { pcut = _pcut; }
     void setContSectName(const string& _contSec) { contSec = _contSec; }
@@ -46,6 +50,7 @@ class bindOptions {
   private:
     FASST* F;
     RotamerLibrary* RL;
+    ostream* out;
     int pm;
     mstreal pcut, rmsdCut, rmsdCut2;
     RMSDCalculator rc;
@@ -101,18 +106,59 @@ mstreal scoreAttachment(Residue* sR, Structure& contactTERM, bindOptions& opts);
 vector<vector<int> > clusterContactTERMs(const vector<Structure>& contactTERMs, bindOptions& opts);
 int mineAttachments(Residue* sR, bindOptions& opts, vector<Structure>& contactTERMs);
 
+// a label for the residue, for naming its output files
+string siteLabel(Residue* sR) {
+  string label = sR->getChainID() + MstUtils::toString(sR->getNum());
+  if (sR->getIcode() != ' ') label += sR->getIcode();
+  return label;
+}
+
+/* Finds and scores attachments for one surface site, writing the best attachment
+ * (if any) to pdbFile and everything reported along the way to logFile. Both are
+ * written under temporary names and then moved into place, the log last, so an
+ * existing log file means that the site was processed in full. Returns the log. */
+string processSite(Residue* sR, bindOptions& opts, const string& pdbFile, const string& logFile) {
+  stringstream log;
+  opts.setLog(&log);
+  log << "visiting residue " << *sR << endl;
+
+  vector<attachment> A = getAttachments(sR, opts);
+  log << "found " << A.size() << " attachments" << endl;
+  vector<mstreal> scores;
+  for (int i = 0; i < MstUtils::min((int) A.size(), 8); i++) {
+    scores.push_back(scoreAttachment(A[i], opts));
+    log << "\tscore of attachment " << i << " --> " << scores[i] << endl;
+  }
+  if (scores.size() > 0) {
+    int bi = 0;
+    MstUtils::min(scores, 0, scores.size() - 1, &bi);
+    log << "best attachment has score " << scores[bi] << ", writing to " << pdbFile << endl;
+    A[bi].getStructure().writePDB(pdbFile + ".tmp");
+    MstSys::cmv(pdbFile + ".tmp", pdbFile);
+  }
+  opts.setLog(&cout);
+
+  fstream ofs;
+  MstUtils::openFile(ofs, logFile + ".tmp", ios::out);
+  ofs << log.str();
+  ofs.close();
+  MstSys::cmv(logFile + ".tmp", logFile);
+  return log.str();
+}
+
 int main(int argc, char** argv) {
   MstOptions op;
-  op.setTitle("Given some specific surface site(s) on a structure, binds the best binding poses. Options:");
+  op.setTitle("Given some specific surface site(s) on a structure, binds the best binding poses. Sites are processed in parallel, and for each site S the best attachment is written to OUT.S.pdb and the site's log to OUT.S.log, where OUT is the output base and S is the site's chain ID and residue number. Options:");
   op.addOption("p", "target PDB structure.", true);
   op.addOption("s", "surface site selection (procedure will be repeated for each residue in the selection).", true);
   op.addOption("db", "a binary FASST database file. This database needs to have the \"conts\" residue property section populated with contacts.", true);
   op.addOption("rLib", "rotamer library file path.", true);
   op.addOption("o", "output base name.", true);
+  op.addOption("nt", "number of threads; defaults to MST_NUM_THREADS if set, or else the number of hardware threads. All threads search one shared copy of the database.");
+  op.addOption("resume", "skip sites already processed in a previous (e.g., interrupted) run with the same output base, i.e., sites whose log files exist.");
   op.setOptions(argc, argv);
   string contSec = "conts";
   RMSDCalculator rc;
-  bindOptions opts;
   RotamerLibrary RL;
   RL.readRotamerLibrary(op.getString("rLib"));
 
@@ -120,32 +166,46 @@ int main(int argc, char** argv) {
   Structure T(op.getString("p"));
   selector sel(T);
   vector<Residue*> surf = sel.selectRes(op.getString("s"));
-  FASST F;
-  F.readDatabase(op.getString("db"), 2);
-  if (!F.isResiduePairPropertyPopulated(contSec)) MstUtils::error("the FASST database does not appear to have a contact section");
-  F.setRedundancyCut(0.5);
-  F.setMaxNumMatches(1000);
-  opts.setFASST(&F);
-  opts.setContSectName(contSec);
-
+  vector<int> todo;
   for (int i = 0; i < surf.size(); i++) {
-    Residue* sR = surf[i];
-    cout << "visiting residue " << *sR << endl;
-
-    vector<attachment> A = getAttachments(sR, opts);
-    cout << "found " << A.size() << " attachments" << endl;
-    vector<mstreal> scores;
-    for (int i = 0; i < MstUtils::min((int) A.size(), 8); i++) {
-      scores.push_back(scoreAttachment(A[i], opts));
-      cout << "\tscore of attachment " << i << " --> " << scores[i] << endl;
-    }
-    if (scores.size() > 0) {
-      int bi = 0;
-      MstUtils::min(scores, 0, scores.size() - 1, &bi);
-      cout << "best attachment has score " << scores[bi] << ", writing..." << endl;
-      A[bi].getStructure().writePDB("/tmp/att.pdb");
-    }
+    if (op.isGiven("resume") && MstSys::fileExists(op.getString("o") + "." + siteLabel(surf[i]) + ".log")) continue;
+    todo.push_back(i);
   }
+  cout << surf.size() << " site(s) selected";
+  if (todo.size() < surf.size()) cout << ", " << surf.size() - todo.size() << " of which were already processed";
+  cout << endl;
+  if (todo.empty()) return 0;
+
+  /* target structures (without side chains, as only backbone is needed) come
+   * from one copy of the database, which every thread searches through its
+   * own FASST object sharing the targets of that copy */
+  int numThreads = MstUtils::min(MstUtils::numThreads(op.getInt("nt", 0)), (int) todo.size());
+  FASST source;
+  source.readDatabase(op.getString("db"), 1);
+  if (!source.isResiduePairPropertyPopulated(contSec)) MstUtils::error("the FASST database does not appear to have a contact section");
+  vector<FASST*> searchers(numThreads);
+  vector<bindOptions> opts(numThreads);
+  for (int t = 0; t < numThreads; t++) {
+    searchers[t] = new FASST(&source);
+    searchers[t]->setRedundancyCut(0.5);
+    searchers[t]->setMaxNumMatches(1000);
+    opts[t].setFASST(searchers[t]);
+    opts[t].setRotamerLibrary(&RL);
+    opts[t].setContSectName(contSec);
+  }
+
+  // process sites, reporting each as it is done
+  mutex outLock;
+  MstUtils::parallelFor(0, todo.size(), [&](int k, int t) {
+    Residue* sR = surf[todo[k]];
+    string base = op.getString("o") + "." + siteLabel(sR);
+    seed_seq seeds = {(unsigned) todo[k]}; // for reproducible clustering of large TERM sets
+    MstThreadRandEngine engine(seeds);
+    string log = processSite(sR, opts[t], base + ".pdb", base + ".log");
+    lock_guard<mutex> guard(outLock);
+    cout << log << flush;
+  }, numThreads);
+  for (int t = 0; t < numThreads; t++) delete searchers[t];
 }
 
 mstreal scoreAttachment(attachment& A, bindOptions& opts) {
@@ -164,25 +224,24 @@ mstreal scoreAttachment(Structure& pose, bindOptions& opts) {
 }
 
 int mineAttachments(Residue* sR, bindOptions& opts, vector<Structure>& contactTERMs) {
-  cout << "mining attachments for residue " << *sR << "..." << endl;
+  opts.log() << "mining attachments for residue " << *sR << "..." << endl;
   Structure anchor;
   TERMUtils::selectTERM(vector<Residue*>(1, sR), anchor, opts.contextLen());
   FASST& F = *(opts.getFASST());
   F.setRMSDCutoff(opts.getRMSDCut());
   F.setQuery(anchor);
-  cout << "\tsearching for a local " << anchor.chainSize() << "-segment TERM..." << endl;
+  opts.log() << "\tsearching for a local " << anchor.chainSize() << "-segment TERM..." << endl;
   fasstSolutionSet sols = F.search();
-  vector<Structure> matches; F.getMatchStructures(sols, matches);
+  vector<fasstMatchView> matches; F.getMatchViews(sols, matches);
   int Ne = 0, Nc = 0;
-  cout << "\tfound " << matches.size() << " matches, excising local context..." << endl;
+  opts.log() << "\tfound " << matches.size() << " matches, excising local context..." << endl;
   for (int k = 0; k < matches.size(); k++) {
-    Residue cR = matches[k].getResidue(opts.contextLen());
-    if (!cR.isNamed(sR->getName())) continue;
+    if (matches[k].getResidueName(opts.contextLen()) != sR->getName()) continue;
 
     // iterate over all contacts
     int ti = sols[k].getTargetIndex();
     int ri = (sols[k].getAlignment())[0] + opts.contextLen();
-    Structure* mT = F.getTarget(ti);
+    Structure* mT = opts.getFASST()->getTarget(ti);
     if (F.hasResiduePairProperties(ti, opts.getContSectName(), ri)) {
       map<int, mstreal> C = F.getResiduePairProperties(ti, opts.getContSectName(), ri);
       for (auto rj = C.begin(); rj != C.end(); ++rj) {
@@ -204,8 +263,8 @@ vector<vector<int> > clusterContactTERMs(const vector<Structure>& contactTERMs,
   Clusterer clust(true);
   vector<vector<Atom*> > contactTERMatoms(contactTERMs.size());
   for (int i = 0; i < contactTERMs.size(); i++) contactTERMatoms[i] = contactTERMs[i].getAtoms();
-  cout << "\tclustering " << contactTERMs.size() << " TERMs..." << endl;
-  return clust.greedyCluster(contactTERMatoms, opts.getRMSDCut2(), 10000);
+  opts.log() << "\tclustering " << contactTERMs.size() << " TERMs..." << endl;
+  return clust.greedyCluster(contactTERMatoms, opts.getRMSDCut2(), 10000, 1.0, -1, false);
 }
 
 vector<attachment> getAttachments(Residue* sR, bindOptions& opts) {
@@ -221,7 +280,9 @@ vector<attachment> getAttachments(Residue* sR, bindOptions& opts) {
   RMSDCalculator rc;
   vector<attachment> A;
   for (int ci = 0; ci < cIs.size(); ci++) {
-    printf("\t\tcluster %02d: %d out of %d + %d = %f\n", ci, (int) cIs[ci].size(), Nc, Ne, (cIs[ci].size()*1.0)/(Nc + Ne));
+    char line[256];
+    snprintf(line, sizeof(line), "\t\tcluster %02d: %d out of %d + %d = %f\n", ci, (int) cIs[ci].size(), Nc, Ne, (cIs[ci].size()*1.0)/(Nc + Ne));
+    opts.log() << line;
     mstreal p = (cIs[ci].size()*1.0)/(Nc + Ne);
     if (p > opts.minProb()) {
       Structure cent(contactTERMs[cIs[ci][0]]);
@@ -34,6 +34,9 @@ int main(int argc, char *argv[]) {
   op.addOption("e", "Energy table file.", true);
   op.addOption("p", "PDB file. If provided, will score the sequence of the structure. Note: must have the same number of residues as the energy table.");
   op.addOption("s", "Single-letter amino-acid sequence. If provided, will score. Must have the same number of residues as the energy table");
+  op.addOption("sf", "a file with single-letter amino-acid sequences to score, either in FASTA format or one per line. Sequences are scored in batch, and their energies are written one per line (followed by the FASTA identifier, if any) to the file given by --so, or to standard output.");
+  op.addOption("so", "output file for energies of sequences in --sf.");
+  op.addOption("nt", "number of threads for scoring sequences in --sf; defaults to MST_NUM_THREADS if set, or else the number of hardware threads.");
   op.addOption("opt", "If provided, will perform MCMC simulated annealing to find the optimal sequence with default parameters. If an integer is specified, will use this many iterations per cycle (otherwise 1E6 by default).");
   op.addOption("kTi", "if --opt is given, this will set the initial sampling temperature (default is 1.0).");
   op.addOption("kTf", "if --opt is given, this will set the final annealed temperature (default is 0.1).");
@@ -72,6 +75,25 @@ int main(int argc, char *argv[]) {
     cout << score << " " << seq.toString() << endl;
   }
 
+  // score sequences from a file in batch
+  if (op.isGiven("sf")) {
+    vector<string> names;
+    vector<res_t> sols = E.readSolutions(op.getString("sf"), &names);
+    MstTimer timer; timer.start();
+    vector<mstreal> energies = E.scoreSolutions(sols, NULL, NULL, op.getInt("nt", 0));
+    timer.stop();
+    cerr << "scored " << energies.size() << " sequences in " << timer.getDuration(MstTimer::msec) << " ms" << endl;
+    fstream ofs;
+    if (op.isGiven("so")) MstUtils::openFile(ofs, op.getString("so"), ios::out);
+    ostream& out = op.isGiven("so") ? ofs : cout;
+    for (int i = 0; i < energies.size(); i++) {
+      out << energies[i];
+      if (i < names.size()) out << " " << names[i];
+      out << "\n";
+    }
+    if (op.isGiven("so")) ofs.close();
+  }
+
   // print mean and standard deviation
   if (op.isGiven("m")) cout << "mean " << E.meanEnergy() << endl;
   if (op.isGiven("std")) cout << "stdev " << E.energyStdEst(op.isInt("std") ? op.getInt("std") : 1000) << endl;
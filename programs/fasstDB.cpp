@@ -6,13 +6,14 @@
 #include "mstcondeg.h"
 #include "mstsequence.h"
 #include "mstexternal.h"
+#include "mstsecstruct.h"
 #include <chrono>
 
 int main(int argc, char *argv[]) {
   MstOptions op;
   op.setTitle("Creates a FASST database from input PDB files. Options:");
   op.addOption("pL", "a file with a list of PDB files.");
-  op.addOption("db", "a previously-written FASST database.");
+  op.addOption("db", "a previously-written FASST database (or a segment manifest, see fasstSegments).");
   op.addOption("dL", "a file with a list of FASST databases (will consolidate into one).");
   op.addOption("o", "output database file name.", true);
   op.addOption("m", "memory save flag (will store backbone only).");
@@ -25,8 +26,12 @@ int main(int argc, char *argv[]) {
   op.addOption("int", "store residue to backbone contact information (for all residue pairs with contact degrees above the specified threshold). If this is given, --rLib must also be given.");
   op.addOption("bb", "store the minimum distance between backbone atoms of two residues (for all residue pairs below the specified cutoff).");
   op.addOption("stride", "store residue secondary structure classifications computed by STRIDE (external program). Argument must be the path to a STRIDE binary file.");
+  op.addOption("ss", "store residue secondary structure classifications computed natively (DSSP-style, using the same single-letter codes as STRIDE) as residue string property \"ss\". Unlike --stride, this needs no external program.");
+  op.addOption("nt", "number of threads to use with --ss; defaults to MST_NUM_THREADS if set, or else the number of hardware threads");
   op.addOption("sim", "percent sequence identity cutoff. If specified, will store local-window sequence similarity between all pairs of positions in the database, using this cutoff.");
   op.addOption("win", "window size to use with the similarity searching with --sim; must be an odd integer. Default is 31 (i.e., +/- 15 from the residue in question).");
+  op.addOption("dsig", "store per-residue intra-distance signatures, which allow search to skip target windows that provably cannot match a query segment.");
+  op.addOption("dcls", "store per-residue backbone (phi/psi) dihedral classes, which allow search to skip target windows whose backbone conformation is far from that of a query segment (see --dih in search).");
   op.addOption("rLib", "path to an MST rotamer library file.");
   op.addOption("batch", "an integer. If specified, instead of building the database will spread all the work across this many "
                         "jobs, writing corresponding batch files for submission to the cluster. Will also produce a file called "
@@ -89,6 +94,7 @@ int main(int argc, char *argv[]) {
       for (string prop : res_prop) cout << "Residue property: " << prop << " = " << S.isResiduePropertyDefined(prop) << endl;
       
       cout << "Residue string property: " << "stride" << " = " << S.isResidueStringPropertyDefined("stride") << endl;
+      cout << "Residue string property: " << "ss" << " = " << S.isResidueStringPropertyDefined("ss") << endl;
       
       // Residue pair properties
       vector<string> res_pair_prop = {"cont","interfering","interfered","bb"};
@@ -104,6 +110,23 @@ int main(int argc, char *argv[]) {
         S.readDatabase(dbFiles[i], memSave);
       }
     }
+    cout << "Read " << S.numTargets() << " targets, database holds " << S.memoryFootprint()/1024 << " KB (process memory " << MstSys::memUsage() << " KB)" << endl;
+    if (op.isGiven("ss")) {
+      cout << "Assigning secondary structure..." << endl;
+      // copies are made serially and in chunks, to bound memory use; assignment runs in parallel
+      int numThreads = MstUtils::numThreads(op.getInt("nt", 0));
+      const int chunk = 1000;
+      for (int beg = 0; beg < S.numTargets(); beg += chunk) {
+        int end = min(beg + chunk, S.numTargets());
+        vector<Structure*> targs(end - beg);
+        for (int ti = beg; ti < end; ti++) targs[ti - beg] = new Structure(S.getTargetCopy(ti));
+        vector<vector<string> > ss = SecStructTools::assign(targs, numThreads);
+        for (int ti = beg; ti < end; ti++) {
+          S.addResidueStringProperties(ti, "ss", ss[ti - beg]);
+          delete targs[ti - beg];
+        }
+      }
+    }
     if (op.isGiven("pp") || op.isGiven("env") || op.isGiven("cont") || op.isGiven("contSeq") || op.isGiven("int") || op.isGiven("bb") || op.isGiven("stride")) {
       cout << "Computing per-target residue properties..." << endl;
       // compute and add some properties
@@ -273,6 +296,15 @@ int main(int argc, char *argv[]) {
       }
       cout << "\trecorded " << symN << " similar windows, from a total of " << Nr << " residues" << endl;
     }
+    if (op.isGiven("dsig")) {
+      cout << "Computing intra-distance signatures..." << endl;
+      S.computeDistanceSignatures();
+    }
+    if (op.isGiven("dcls")) {
+      cout << "Computing backbone dihedral classes..." << endl;
+      S.computeDihedralClasses();
+    }
+    cout << "Writing database, which holds " << S.memoryFootprint()/1024 << " KB (peak process memory " << MstSys::peakMemUsage() << " KB)..." << endl;
     S.writeDatabase(op.getString("o"));
   } else {
     if (!op.isGiven("pL")) MstUtils::error("--pL must be given with --batch");
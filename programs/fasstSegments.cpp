@@ -0,0 +1,52 @@
+#include "msttypes.h"
+#include "mstoptions.h"
+#include "mstfasst.h"
+
+using namespace MST;
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Maintains a FASST database split into segments (a base database plus appended delta databases), as listed in a manifest file. "
+              "The manifest can be given wherever a database is expected (e.g., to search or fasstDB --db). Options:");
+  op.addOption("man", "the manifest file (created upon the first --add, if it does not exist).", true);
+  op.addOption("add", "a database file to append to the manifest as a new segment (e.g., one written by fasstDB with new structures).");
+  op.addOption("del", "a file with logical indices of targets to mark as deleted (one per line). Logical indices count the targets of all segments, in order, including deleted ones.");
+  op.addOption("compact", "merge all segments, dropping deleted targets, into this database file.");
+  op.addOption("reset", "together with --compact, replace the manifest with one listing just the compacted database.");
+  op.addOption("info", "print the segments, their target counts, and the number of deleted targets.");
+  op.setOptions(argc, argv);
+  string man = op.getString("man");
+  if (op.isGiven("reset") && !op.isGiven("compact")) MstUtils::error("--reset requires --compact");
+
+  if (op.isGiven("add")) {
+    FASST::appendDatabaseSegment(man, op.getString("add"));
+    cout << "appended segment " << op.getString("add") << endl;
+  }
+  if (op.isGiven("del")) {
+    vector<string> lines = MstUtils::fileToArray(op.getString("del"));
+    vector<int> indices;
+    for (int i = 0; i < lines.size(); i++) {
+      if (!MstUtils::trim(lines[i]).empty()) indices.push_back(MstUtils::toInt(MstUtils::trim(lines[i])));
+    }
+    FASST::deleteDatabaseTargets(man, indices);
+    cout << "marked " << indices.size() << " targets as deleted" << endl;
+  }
+  if (op.isGiven("compact")) {
+    FASST::compactDatabase(man, op.getString("compact"));
+    cout << "compacted " << man << " into " << op.getString("compact") << endl;
+    if (op.isGiven("reset")) {
+      // the new manifest is complete and checked before it replaces the old one
+      FASST::segmentManifest M;
+      M.create(man);
+      M.addSegment(op.getString("compact"));
+      M.write(man);
+      cout << "reset " << man << " to list just " << op.getString("compact") << endl;
+    }
+  }
+  if (op.isGiven("info")) {
+    FASST::segmentManifest M;
+    M.read(man);
+    for (int s = 0; s < M.files.size(); s++) cout << "segment " << s << ": " << M.files[s] << ", " << M.sizes[s] << " targets" << endl;
+    cout << M.numTargets() << " targets in " << M.files.size() << " segments, of which " << M.deleted.size() << " deleted" << endl;
+  }
+}
@@ -7,6 +7,9 @@
 #include <sstream>
 #include <random>
 #include <cmath>
+#include <climits>
+#include <limits>
+#include <set>
 #include <iostream>
 #include "mstcondeg.h"
 #include "mstoptions.h"
@@ -71,6 +74,7 @@ vector<vector<int>> getABindexes(AtomPointerVector aAtoms,AtomPointerVector bAto
   ProximitySearch psA(aAtoms, 15);
   vector<int> aIdx = {};
   vector<int> bIdx = {};
+  vector<bool> aSeen(aAtoms.size(), false); // bitset of A atoms already in aIdx
 
   for (int i = 0; i < bAtoms.size(); i++) {
     vector <int> abContactPts = psA.getPointsWithin(bAtoms[i], 0.0, conDist, false); // checks if the given atom in B is w/in [conDist] Angstroms from any in A
@@ -78,7 +82,8 @@ vector<vector<int>> getABindexes(AtomPointerVector aAtoms,AtomPointerVector bAto
       bIdx.push_back(i);
       for (int ii = 0; ii < abContactPts.size(); ii++) {
         int aPoint = abContactPts[ii];
-        if (std::find(aIdx.begin(), aIdx.end(), aPoint) == aIdx.end()) {
+        if (!aSeen[aPoint]) {
+          aSeen[aPoint] = true;
           aIdx.push_back(aPoint);
         }
       }
@@ -89,11 +94,12 @@ vector<vector<int>> getABindexes(AtomPointerVector aAtoms,AtomPointerVector bAto
 }
 
 // gets all the residue contacts between a & b as a dict, with the B indexes as keys and A indexes as a list of values
-tuple<AtomPointerVector,AtomPointerVector,vector<int>> getABcontactDict(AtomPointerVector aAtoms,AtomPointerVector bAtoms,mstreal conDist, ProximitySearch psA) {
+tuple<AtomPointerVector,AtomPointerVector,vector<int>> getABcontactDict(AtomPointerVector aAtoms,AtomPointerVector bAtoms,mstreal conDist, ProximitySearch& psA) {
 
   AtomPointerVector aCons;
   AtomPointerVector bCons;
   vector<int> bBindxes;
+  vector<bool> aSeen(aAtoms.size(), false); // bitset of A atoms already in aCons
 
   for (int i = 0; i < bAtoms.size(); i++) {
 
@@ -105,33 +111,298 @@ tuple<AtomPointerVector,AtomPointerVector,vector<int>> getABcontactDict(AtomPoin
 
     vector <int> abContactPts = psA.getPointsWithin(bAtom, 0.0, conDist, false); // checks if the given atom in B is w/in X Angstroms from any in A
 
-    if (abContactPts.size() > 0) {
-      for (int ii = 0; ii < abContactPts.size(); ii++) {
+    // each B atom is visited once, so it only needs to be recorded the first time it makes a CA-CA contact
+    bool bInContact = false;
+    for (int ii = 0; ii < abContactPts.size(); ii++) {
+      int aIdx = abContactPts[ii];
+      if (aAtoms[aIdx]->getName() != "CA") {
+        continue;
+      }
+      if (!aSeen[aIdx]) {
+        aSeen[aIdx] = true;
+        aCons.push_back(aAtoms[aIdx]);
+      }
+      bInContact = true;
+    }
+    if (bInContact) {
+      bCons.push_back(bAtom);
+      bBindxes.push_back(i);
+    }
+  }
+  tuple<AtomPointerVector,AtomPointerVector,vector<int>> abConTuple = make_tuple(aCons,bCons,bBindxes);
+  return abConTuple;
+}
 
-        Atom* aAtom = aAtoms[abContactPts[ii]];
-        string conNameA = aAtom->getName();
-        if (conNameA != "CA") {
-          continue;
-        }
-        //int currResB = bAtom->getResidue()->getResidueIndex();
-        //int currResA = aAtom->getResidue()->getResidueIndex();
+// a persistent grid over a fixed set of points (partner A, which stays put while all poses
+// are expressed as motions of partner B relative to it). Points are stored cell-by-cell in
+// contiguous x/y/z arrays (CSR layout), so the distance loop over a cell vectorizes
+class pointGrid {
+  public:
+    pointGrid() { nx = ny = nz = 0; }
+    pointGrid(const vector<CartesianPoint>& points, mstreal cellSize) { init(points, cellSize); }
+    void init(const vector<CartesianPoint>& points, mstreal cellSize);
+
+    // number of points within distance d (inclusive) of (x, y, z); stops once the count exceeds limit
+    int countWithin(mstreal x, mstreal y, mstreal z, mstreal d, int limit = INT_MAX) const;
+
+  private:
+    int cell(mstreal v, mstreal lo, int n) const { return max(0, min(n - 1, (int) floor((v - lo)/cs))); }
+
+    mstreal xlo, ylo, zlo, xhi, yhi, zhi, cs;
+    int nx, ny, nz;
+    vector<int> cellStart;       // points in cell c are at [cellStart[c], cellStart[c+1])
+    vector<mstreal> X, Y, Z;
+};
+
+void pointGrid::init(const vector<CartesianPoint>& points, mstreal cellSize) {
+  cs = cellSize;
+  X.clear(); Y.clear(); Z.clear(); cellStart.clear();
+  if (points.empty()) { nx = ny = nz = 0; return; }
+  xlo = xhi = points[0][0]; ylo = yhi = points[0][1]; zlo = zhi = points[0][2];
+  for (int i = 1; i < points.size(); i++) {
+    xlo = min(xlo, points[i][0]); xhi = max(xhi, points[i][0]);
+    ylo = min(ylo, points[i][1]); yhi = max(yhi, points[i][1]);
+    zlo = min(zlo, points[i][2]); zhi = max(zhi, points[i][2]);
+  }
+  nx = (int) floor((xhi - xlo)/cs) + 1;
+  ny = (int) floor((yhi - ylo)/cs) + 1;
+  nz = (int) floor((zhi - zlo)/cs) + 1;
+
+  // counting sort of points into cells
+  vector<int> cellOf(points.size());
+  cellStart.assign(nx*ny*nz + 1, 0);
+  for (int i = 0; i < points.size(); i++) {
+    cellOf[i] = (cell(points[i][0], xlo, nx)*ny + cell(points[i][1], ylo, ny))*nz + cell(points[i][2], zlo, nz);
+    cellStart[cellOf[i] + 1]++;
+  }
+  for (int c = 0; c < nx*ny*nz; c++) cellStart[c + 1] += cellStart[c];
+  vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+  X.resize(points.size()); Y.resize(points.size()); Z.resize(points.size());
+  for (int i = 0; i < points.size(); i++) {
+    int k = fill[cellOf[i]]++;
+    X[k] = points[i][0]; Y[k] = points[i][1]; Z[k] = points[i][2];
+  }
+}
 
-        if (find(aCons.begin(), aCons.end(), aAtom) == aCons.end()) {
-          aCons.push_back(aAtom);
-        }
-        if (find(bCons.begin(), bCons.end(), bAtom) == bCons.end()) {
-          bCons.push_back(bAtom);
-        }
-        if (find(bBindxes.begin(), bBindxes.end(), i) == bBindxes.end()) {
-          bBindxes.push_back(i);
+int pointGrid::countWithin(mstreal x, mstreal y, mstreal z, mstreal d, int limit) const {
+  if ((nx == 0) || (x < xlo - d) || (y < ylo - d) || (z < zlo - d) || (x > xhi + d) || (y > yhi + d) || (z > zhi + d)) return 0;
+  int iLo = cell(x - d, xlo, nx), iHi = cell(x + d, xlo, nx);
+  int jLo = cell(y - d, ylo, ny), jHi = cell(y + d, ylo, ny);
+  int kLo = cell(z - d, zlo, nz), kHi = cell(z + d, zlo, nz);
+  mstreal d2 = d*d;
+  int count = 0;
+  for (int i = iLo; i <= iHi; i++) {
+    for (int j = jLo; j <= jHi; j++) {
+      // cells kLo..kHi of a given (i, j) are adjacent, so scan them as one contiguous range
+      int beg = cellStart[(i*ny + j)*nz + kLo], end = cellStart[(i*ny + j)*nz + kHi + 1];
+      const mstreal* px = X.data(); const mstreal* py = Y.data(); const mstreal* pz = Z.data();
+      for (int p = beg; p < end; p++) {
+        mstreal dx = px[p] - x, dy = py[p] - y, dz = pz[p] - z;
+        count += (dx*dx + dy*dy + dz*dz <= d2);
+      }
+      if (count > limit) return count;
+    }
+  }
+  return count;
+}
+
+// everything about the docking problem that stays fixed from pose to pose. Coordinates are
+// those of the reference (randomly rotated, centered) partners A and B, with A's fixed frame
+// also being the frame in which clashes and contacts are evaluated
+struct dockingSetup {
+  vector<CartesianPoint> bAtoms;       // heavy atoms of B (clash checks)
+  vector<CartesianPoint> bAllAtoms;    // all atoms of B (extent checks)
+  vector<CartesianPoint> bContacts;    // atoms of B that may take part in contacts
+  vector<CartesianPoint> bBinders;     // binding atoms of B (quick mode)
+  vector<CartesianPoint> bDisallowed;  // atoms of B that may not be in contact (nnc mode)
+  vector<CartesianPoint> aAllAtoms;    // all atoms of A (extent checks)
+  pointGrid aClashGrid, aContactGrid, aDisallowedGrid;
+  mstreal axLow, axHigh, ayLow, ayHigh, azLow, azHigh; // extent of A's binding atoms (quick mode)
+
+  bool quick, aBinders, bBindersGiven, disallow;
+  int clashesAllowed, contactsRequired;
+  mstreal clashDistance, contactDistance, pullSD;
+};
+
+// outcome of one attempt at generating a pose. Poses are given by the transforms that take the
+// reference coordinates of each partner to their docked positions
+struct dockedPose {
+  enum poseStatus { SKIPPED = 0, FAILED, ACCEPTED };
+  poseStatus status;
+  int contacts;
+  Transform TA, TB;
+};
+
+// per-thread scratch space for pose generation
+struct poseWorkspace {
+  vector<mstreal> bx, by, bz;          // B heavy atoms, rotated and expressed in A's frame
+  vector<int> recentClashes, currClashes;
+  vector<bool> isRecent;               // bitset over B heavy atoms, mirrors recentClashes
+};
+
+static Transform randomRotation(mt19937& rng) {
+  uniform_real_distribution<mstreal> angle(0, 360);
+  mstreal x = angle(rng), y = angle(rng), z = angle(rng);
+  return TransformFactory::rotateAroundZ(z) * TransformFactory::rotateAroundY(y) * TransformFactory::rotateAroundX(x);
+}
+
+static void rotatedExtent(const vector<CartesianPoint>& pts, const Transform& R, mstreal ty, mstreal tz, mstreal& xLow, mstreal& xHigh, mstreal& yLow, mstreal& yHigh, mstreal& zLow, mstreal& zHigh) {
+  xLow = yLow = zLow = numeric_limits<mstreal>::max();
+  xHigh = yHigh = zHigh = -numeric_limits<mstreal>::max();
+  for (int i = 0; i < pts.size(); i++) {
+    mstreal x = R(0, 0)*pts[i][0] + R(0, 1)*pts[i][1] + R(0, 2)*pts[i][2];
+    mstreal y = R(1, 0)*pts[i][0] + R(1, 1)*pts[i][1] + R(1, 2)*pts[i][2] + ty;
+    mstreal z = R(2, 0)*pts[i][0] + R(2, 1)*pts[i][1] + R(2, 2)*pts[i][2] + tz;
+    xLow = min(xLow, x); xHigh = max(xHigh, x);
+    yLow = min(yLow, y); yHigh = max(yHigh, y);
+    zLow = min(zLow, z); zHigh = max(zHigh, z);
+  }
+}
+
+/* Generates one random pose: partner A is randomly rotated (unless in quick mode), partner B is
+ * randomly rotated (and, in quick mode, shifted in Y/Z to line up binding sites), and then B is
+ * pulled away from A along the X axis in random steps until either there are few enough clashes
+ * and enough contacts (accepted), or the partners can no longer meet (failed). Quick-mode
+ * geometric pre-checks can reject a pose before pulling starts (skipped). All randomness comes
+ * from the given engine, so the pose depends only on the engine's seed. */
+dockedPose generatePose(const dockingSetup& S, mt19937& rng, poseWorkspace& W) {
+  dockedPose pose;
+  pose.contacts = 0;
+  pose.status = dockedPose::FAILED;
+  normal_distribution<mstreal> pull(0, S.pullSD);
+
+  Transform RA; // identity
+  if (!S.quick) RA = randomRotation(rng);
+  Transform RB = randomRotation(rng);
+  mstreal t[3] = {0, 0, 0}; // lab-frame translation of B
+
+  if (S.aBinders && S.quick) {
+    mstreal bxLow, bxHigh, byLow, byHigh, bzLow, bzHigh;
+    rotatedExtent(S.bAtoms, RB, 0, 0, bxLow, bxHigh, byLow, byHigh, bzLow, bzHigh);
+    uniform_real_distribution<mstreal> yShift(0, (1.0 / 2.0) * ((S.ayHigh - S.ayLow) + (byHigh - byLow)));
+    uniform_real_distribution<mstreal> zShift(0, (1.0 / 2.0) * ((S.azHigh - S.azLow) + (bzHigh - bzLow)));
+    t[1] = yShift(rng);
+    t[2] = zShift(rng);
+
+    // if B's binding atoms are outside the Y or Z ranges of A's binding atoms, or point away from A,
+    // the partners could never meet; otherwise, make a single big pull apart to save small steps
+    if (S.bBindersGiven) {
+      mstreal bbxLow, bbxHigh, bbyLow, bbyHigh, bbzLow, bbzHigh;
+      rotatedExtent(S.bBinders, RB, t[1], t[2], bbxLow, bbxHigh, bbyLow, bbyHigh, bbzLow, bbzHigh);
+      if ((bbyLow > S.ayHigh) || (bbyHigh < S.ayLow) || (bbzLow > S.azHigh) || (bbzHigh < S.azLow)) {
+        pose.status = dockedPose::SKIPPED;
+        return pose;
+      }
+      mstreal cx = 0;
+      for (int i = 0; i < S.bBinders.size(); i++) cx += RB(0, 0)*S.bBinders[i][0] + RB(0, 1)*S.bBinders[i][1] + RB(0, 2)*S.bBinders[i][2];
+      if (cx / S.bBinders.size() > 0) {
+        pose.status = dockedPose::SKIPPED;
+        return pose;
+      }
+      t[0] += 0.75 * min(S.axHigh - S.axLow, bbxHigh - bbxLow);
+    }
+  }
+
+  // express B in A's frame: p = RA^T (RB b + t), so that A's grids never need rebuilding
+  mstreal M[3][3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      M[i][j] = RA(0, i)*RB(0, j) + RA(1, i)*RB(1, j) + RA(2, i)*RB(2, j);
+    }
+  }
+  int nB = S.bAtoms.size();
+  W.bx.resize(nB); W.by.resize(nB); W.bz.resize(nB);
+  for (int i = 0; i < nB; i++) {
+    const CartesianPoint& b = S.bAtoms[i];
+    W.bx[i] = M[0][0]*b[0] + M[0][1]*b[1] + M[0][2]*b[2];
+    W.by[i] = M[1][0]*b[0] + M[1][1]*b[1] + M[1][2]*b[2];
+    W.bz[i] = M[2][0]*b[0] + M[2][1]*b[1] + M[2][2]*b[2];
+  }
+
+  // the extremes along the pulling direction (lab X) only shift by the pull, so compute them once
+  mstreal aX = -numeric_limits<mstreal>::max(), bX0 = numeric_limits<mstreal>::max();
+  for (int i = 0; i < S.aAllAtoms.size(); i++) aX = max(aX, RA(0, 0)*S.aAllAtoms[i][0] + RA(0, 1)*S.aAllAtoms[i][1] + RA(0, 2)*S.aAllAtoms[i][2]);
+  for (int i = 0; i < S.bAllAtoms.size(); i++) bX0 = min(bX0, RB(0, 0)*S.bAllAtoms[i][0] + RB(0, 1)*S.bAllAtoms[i][1] + RB(0, 2)*S.bAllAtoms[i][2]);
+
+  W.recentClashes.resize(0);
+  W.isRecent.assign(nB, false);
+  bool absoluteSuccess = false, absoluteFailure = false;
+  mstreal w[3];
+  while (!absoluteSuccess && !absoluteFailure) {
+    t[0] += fabs(pull(rng));
+    for (int i = 0; i < 3; i++) w[i] = RA(0, i)*t[0] + RA(1, i)*t[1] + RA(2, i)*t[2];
+
+    // count clashes, checking positions in B that clashed on the previous step first
+    int clashCount = 0;
+    W.currClashes.resize(0);
+    for (int k = 0; (k < W.recentClashes.size()) && (clashCount <= S.clashesAllowed); k++) {
+      int a = W.recentClashes[k];
+      int n = S.aClashGrid.countWithin(W.bx[a] + w[0], W.by[a] + w[1], W.bz[a] + w[2], S.clashDistance, S.clashesAllowed - clashCount);
+      if (n > 0) { W.currClashes.push_back(a); clashCount += n; }
+    }
+    for (int a = 0; (a < nB) && (clashCount <= S.clashesAllowed); a++) {
+      if (W.isRecent[a]) continue;
+      int n = S.aClashGrid.countWithin(W.bx[a] + w[0], W.by[a] + w[1], W.bz[a] + w[2], S.clashDistance, S.clashesAllowed - clashCount);
+      if (n > 0) { W.currClashes.push_back(a); clashCount += n; }
+    }
+    if (clashCount > S.clashesAllowed) {
+      for (int k = 0; k < W.recentClashes.size(); k++) W.isRecent[W.recentClashes[k]] = false;
+      W.recentClashes.swap(W.currClashes);
+      for (int k = 0; k < W.recentClashes.size(); k++) W.isRecent[W.recentClashes[k]] = true;
+      continue;
+    }
+
+    // transform a B-side point from its reference coordinates into A's frame at the current step
+    auto inAFrame = [&](const CartesianPoint& b, mstreal& x, mstreal& y, mstreal& z) {
+      x = M[0][0]*b[0] + M[0][1]*b[1] + M[0][2]*b[2] + w[0];
+      y = M[1][0]*b[0] + M[1][1]*b[1] + M[1][2]*b[2] + w[1];
+      z = M[2][0]*b[0] + M[2][1]*b[1] + M[2][2]*b[2] + w[2];
+    };
+    mstreal x, y, z;
+
+    if (S.disallow) {
+      for (int a = 0; a < S.bDisallowed.size(); a++) {
+        inAFrame(S.bDisallowed[a], x, y, z);
+        if (S.aDisallowedGrid.countWithin(x, y, z, S.contactDistance, 0) > 0) {
+          absoluteFailure = true;
+          break;
         }
-        
+      }
+      if (absoluteFailure) break;
+    }
 
+    int contactsCount = 0;
+    for (int a = 0; a < S.bContacts.size(); a++) {
+      inAFrame(S.bContacts[a], x, y, z);
+      contactsCount += S.aContactGrid.countWithin(x, y, z, S.contactDistance, S.contactsRequired - contactsCount - 1);
+      if (contactsCount >= S.contactsRequired) {
+        absoluteSuccess = true;
+        break;
       }
     }
+    pose.contacts = contactsCount;
+
+    // if all atoms in B are further positive than all atoms in A by over 8 angstroms, the docking is irrecoverable
+    if (bX0 + t[0] - aX > 8.0) {
+      absoluteFailure = true;
+    }
   }
-  tuple<AtomPointerVector,AtomPointerVector,vector<int>> abConTuple = make_tuple(aCons,bCons,bBindxes);
-  return abConTuple;
+
+  if (!absoluteFailure) pose.status = dockedPose::ACCEPTED;
+  pose.TA = RA;
+  pose.TB = TransformFactory::translate(t[0], t[1], t[2]) * RB;
+  return pose;
+}
+
+vector<CartesianPoint> coordinatesOf(const AtomPointerVector& atoms) {
+  vector<CartesianPoint> coords(atoms.size());
+  for (int i = 0; i < atoms.size(); i++) coords[i] = atoms[i]->getCoor();
+  return coords;
+}
+
+Transform bestFitTransform(RMSDCalculator& rc, const AtomPointerVector& from, const AtomPointerVector& to) {
+  rc.bestRMSD(from, to, true);
+  return Transform(rc.lastRotation(), rc.lastTranslation());
 }
 
 int main(int argc, char** argv) {
@@ -157,8 +428,12 @@ int main(int argc, char** argv) {
   op.addOption("q", "an optional quick mode for the --al or --abm flags, wherein the docking distribution is skewed towards conformations involving the binding residues given on the A side, to make the calculation faster");
   op.addOption("o", "the output file name base: will be used to save the distribution of LRDPs and rotation matrixes to the randomly rotated reference structure, as a .csv, then the first randomly rotated binding partner, as [base]_A.pdb, and the second randomly rotated binding partner as [base]_B.pdb", true);
   op.addOption("t", "create testing files; provide the output directory to save the testing files. This also sets the number of dockings to just 10 so you aren't inundated with files on accident :)");
+  op.addOption("seed", "random seed; the same seed and inputs give the same ensemble regardless of the number of threads. By default, seeded from the clock");
+  op.addOption("nt", "number of threads to generate poses with; defaults to MST_NUM_THREADS if set, or else the number of hardware threads");
   op.setOptions(argc, argv);
-  MstUtils::seedRandEngine();
+  if (op.isGiven("seed")) MstUtils::seedRandEngine(op.getInt("seed"));
+  else MstUtils::seedRandEngine();
+  int numThreads = MstUtils::numThreads(op.getInt("nt", 0));
 
   if (!op.isGiven("al") && !op.isGiven("abm") && op.isGiven("bl")) {
     cout << "you cannot give bl without giving al or abm";
@@ -443,6 +718,7 @@ int main(int argc, char** argv) {
     }
   }
 
+  Transform TZ; // identity, unless A's binding residues get pointed along the X axis in quick mode
   if (op.isGiven("q")) {
 
       if (op.isGiven("t")) {
@@ -454,7 +730,7 @@ int main(int argc, char** argv) {
       
 
       CartesianPoint geoCenterA = CAbinderAtoms.getGeometricCenter();
-      Transform TZ = TransformFactory::alignVectorWithXAxis(geoCenterA);
+      TZ = TransformFactory::alignVectorWithXAxis(geoCenterA);
       TZ.apply(CA);
 
       if (op.isGiven("t")) {
@@ -530,48 +806,23 @@ int main(int argc, char** argv) {
     }
   }*/
 
-  // let's get started on the random docking now! Set up variables (d = number of random dockings required, t = a variable used to count the initial 10 structures to be saved for testing mode)
+  // let's get started on the random docking now! Set up variables (d = number of random dockings accepted, t = a variable used to count the initial 10 structures to be saved for testing mode)
 
   int d = 0;
   int t = 0;
-  int t2 = 0;
-  //int t3 = 0;
-  int fails = 0;
+  long long fails = 0;
 
-  // set up important vectors...
+  // fill out which indexes in B are possible to make contacts (CA atoms, unless binding atoms were given), and get their atoms
 
-  // keep a list of indexes of previous clashes
-  vector <int> recentClashes;
-  // and have a list of current clashes
-  vector <int> currClashes;
-  // as well as a list of indexes possible to be involved in contacts (CA atoms)
   vector <int> bPossibleContacts;
-
-  // set the curr coords of CA to be alt cords, so that they can be reset every new random docking
-
-  for (int a = 0; a < CAatoms.size(); a++) {
-    Atom* currAtom = CAatoms[a];
-    currAtom->clearAlternatives();
-    currAtom->addAlternative(currAtom);
-  }
-
-  // set the current coords of CB to be alternate coords, so that they can be reset every new random docking - also fill out which indexes are possible to make contacts in B, and get their atoms
-
+  set<Atom*> bBinderSet(CBbinderAtoms.begin(), CBbinderAtoms.end());
   for (int a = 0; a < CBatoms.size(); a++) {
     Atom* currAtom = CBatoms[a];
-    currAtom->clearAlternatives();
-    currAtom->addAlternative(currAtom);
-    // as well as get indexes for the potential contact residues, if not already gotten from abm / al / bl flags being given
-    /*if (op.isGiven("bl")) {
-      continue;
-    }*/
-
     if (op.isGiven("nc") || op.isGiven("bl")) {
-      if (std::find(CBbinderAtoms.begin(), CBbinderAtoms.end(), currAtom) != CBbinderAtoms.end()) {
+      if (bBinderSet.count(currAtom) > 0) {
         bPossibleContacts.push_back(a);
       }
     }
-
     else {
       string currName = currAtom->getName();
       if (currName == "CA") {
@@ -597,43 +848,6 @@ int main(int argc, char** argv) {
     }
   }
 
-  /*if (op.isGiven("bl")) {
-    bPossibleContacts = bBinderIndexes;
-  }*/
-
-  // set up xyz high & low values to be used later in the loop, for checking xLow & xHigh when pulling out proteins
-
-  mstreal xLow;
-  mstreal xHigh;
-  mstreal yLow;
-  mstreal yHigh;
-  mstreal zLow;
-  mstreal zHigh;
-
-  // and variables for calculating the Y & Z extents for the Y & Z translations
-
-  mstreal ayExtent;
-  mstreal azExtent;
-  mstreal axLow;
-  mstreal axHigh;
-  mstreal ayLow;
-  mstreal ayHigh;
-  mstreal azLow;
-  mstreal azHigh;
-  mstreal ayLen;
-  mstreal azLen;
-
-  mstreal byExtent;
-  mstreal bzExtent;
-  mstreal bxLow;
-  mstreal bxHigh;
-  mstreal byLow;
-  mstreal byHigh;
-  mstreal bzLow;
-  mstreal bzHigh;
-  mstreal byLen;
-  mstreal bzLen;
-
   //& docking requirements
 
   mstreal clashDistance = 3.0;
@@ -645,373 +859,128 @@ int main(int argc, char** argv) {
     cout << "# of partner A's binding CAs:" << endl;
     cout << CAbinderAtoms.size() << endl;
   }
-  
-  
-
-  while (d < numberDockingsRequired) { // while the number of docked structures is still insufficient...
-
-    // reset to alt coors
-
-    for (int i = 0; i < CAreses.size(); i++) {
-      CAreses[i]->makeAlternativeMain(0); // reset to origin position
-    }
-
-    for (int i = 0; i < CBreses.size(); i++) {
-      CBreses[i]->makeAlternativeMain(0); // reset to origin position
-    }
-
-    //position 4
-
-    if ((op.isGiven("t")) && (t == 0)) {
-      C.writePDB(op.getString("t") + "position4" + ".pdb");
-    }
-
-    // rotate CA randomly along the x, y, and z axes, if no binding residues given for A, or limited to prevent A's binding residues from facing too far away from B if binding residues specified
-
-    if (!op.isGiven("q")) {
-      mstreal xaAngle = MstUtils::randUnit(0,360);
-      Transform TXA = TransformFactory::rotateAroundX(xaAngle);
-      TXA.apply(CA);
-      mstreal yaAngle = MstUtils::randUnit(0,360);
-      Transform TYA = TransformFactory::rotateAroundY(yaAngle);
-      TYA.apply(CA);
-      mstreal zaAngle = MstUtils::randUnit(0,360);
-      Transform TZA = TransformFactory::rotateAroundZ(zaAngle);
-      TZA.apply(CA);
-
-      //position 5
-      if ((op.isGiven("t")) && (t == 0)) {
-        C.writePDB(op.getString("t") + "position5" + ".pdb");
-      }
-    }
-
-    // rotate CB randomly along the x, y, and z axes
-
-    mstreal xbAngle = MstUtils::randUnit(0,360);
-    Transform TXB = TransformFactory::rotateAroundX(xbAngle);
-    TXB.apply(CB);
-    mstreal ybAngle = MstUtils::randUnit(0,360);
-    Transform TYB = TransformFactory::rotateAroundY(ybAngle);
-    TYB.apply(CB);
-    mstreal zbAngle = MstUtils::randUnit(0,360);
-    Transform TZB = TransformFactory::rotateAroundZ(zbAngle);
-    TZB.apply(CB);
-
-    //position 6
-    if ((op.isGiven("t")) && (t == 0)) {
-      C.writePDB(op.getString("t") + "position6" + ".pdb");
-    }
-
-    // make standard deviations for random translations in the Y & Z directions, based on the Y & Z lengths of CB - if binding residues are given for a
-
-    if ((op.isGiven("al") || op.isGiven("abm") || op.isGiven("nc")) && op.isGiven("q")) {
-
-      ProximitySearch::calculateExtent(CAbinderAtoms,axLow,ayLow,azLow,axHigh,ayHigh,azHigh);
-      ayExtent = ayHigh - ayLow;
-      azExtent = azHigh - azLow;
-
-      ProximitySearch::calculateExtent(CBatoms,bxLow,byLow,bzLow,bxHigh,byHigh,bzHigh);
-      byExtent = byHigh - byLow;
-      bzExtent = bzHigh - bzLow;
-      
-      mstreal yRand = MstUtils::randUnit(0,(1.0 / 2.0) * (ayExtent + byExtent));
-      mstreal zRand = MstUtils::randUnit(0,(1.0 / 2.0) * (azExtent + bzExtent));
-
-
-      // use those to randomly translate CB in the Y & Z axes so that the angle of binding can vary, with a normal distribution with standard deviation of 1/6 the distance between the furthest Y points / Z points (so 1/3 the distance from the middle and furthest Y / Z point, which means 0.13% will be beyond the range of being able to connect, which is fine)
-
-      for (int a = 0; a < CBatoms.size(); a++) {
-        mstreal yStart = CBatoms[a]->getY();
-        CBatoms[a]->setY(yStart + yRand);
-        mstreal zStart = CBatoms[a]->getZ();
-        CBatoms[a]->setZ(zStart + zRand);
-      }
-
-      //position 7
-      if ((op.isGiven("t")) && (t == 0)) {
-        C.writePDB(op.getString("t") + "position7" + ".pdb");
-      }
-
-      // if there are B binder atoms, check if they're outside the Y or Z ranges of the A binder atoms, and so could never meet; go back to start without attempting to dock if so
-
-      if (op.isGiven("bl") || op.isGiven("nc")) {
-
-        ProximitySearch::calculateExtent(CBbinderAtoms,bxLow,byLow,bzLow,bxHigh,byHigh,bzHigh);
-        
-        if ((byLow > ayHigh) || (byHigh < ayLow) || (bzLow > azHigh) || (bzHigh < azLow)) {
-          continue;
-        }
 
-        // the binding residues for A point positive; if those for B also point positive then pulling it in the + direction will never cause them to meet
+  // the current coordinates of CA & CB are the reference from which every pose starts; poses are
+  // generated relative to A, so A's proximity grids are built once and shared by all threads
 
-        if (CBbinderAtoms.getGeometricCenter().getX() > 0) {
-          continue;
-        }
-
-        // speed up by making a single big pull of the partners apart, equal to 3/4 the smaller x extent
-
-        mstreal xJump = 0.75 * min(axHigh - axLow, bxHigh - bxLow);
-        for (int a = 0; a < CBatoms.size(); a++) {
-          mstreal xStart = CBatoms[a]->getX();
-          CBatoms[a]->setX(xStart + xJump);
-        }
-
-        if ((op.isGiven("t")) && (t == 0)) {
-          C.writePDB(op.getString("t") + "position7.5" + ".pdb");
-        }
-      }
-    }
-
-    // set up proximity search with A, since B will be the partner moving (if you move an object you need to re-make a prox-search or it won't work / will segfault)
-
-    ProximitySearch ps;
-    ps = ProximitySearch(CAatoms, 15);
-
-    // and a proximity search with just A's CA binding residues - this is a ProximitySearch*
-
-    ProximitySearch ps2(CAbinderAtoms, 15); // for valid contacts
-    ProximitySearch ps3;
-    if (op.isGiven("nnc")) {
-      ps3 = ProximitySearch(CAdisallowed, 15); // for invalid contacts
+  dockingSetup S;
+  S.bAtoms = coordinatesOf(CBatoms);
+  S.bAllAtoms = coordinatesOf(CB.getAtoms());
+  for (int a = 0; a < bPossibleContacts.size(); a++) {
+    S.bContacts.push_back(CBatoms[bPossibleContacts[a]]->getCoor());
+  }
+  S.bBinders = coordinatesOf(CBbinderAtoms);
+  for (int a = 0; a < CBindexDisallowed.size(); a++) {
+    S.bDisallowed.push_back(CBatoms[CBindexDisallowed[a]]->getCoor());
+  }
+  S.aAllAtoms = coordinatesOf(CA.getAtoms());
+  S.aClashGrid.init(coordinatesOf(CAatoms), clashDistance);
+  S.aContactGrid.init(coordinatesOf(CAbinderAtoms), contactDistance);
+  S.aDisallowedGrid.init(coordinatesOf(CAdisallowed), contactDistance);
+  S.quick = op.isGiven("q");
+  S.aBinders = op.isGiven("al") || op.isGiven("abm") || op.isGiven("nc");
+  S.bBindersGiven = op.isGiven("bl") || op.isGiven("nc");
+  S.disallow = op.isGiven("nnc");
+  if (S.quick && S.aBinders) {
+    if (CAbinderAtoms.empty()) MstUtils::error("none of the binding residues given for partner A were found");
+    if (S.bBindersGiven && CBbinderAtoms.empty()) MstUtils::error("none of the binding residues given for partner B were found");
+    ProximitySearch::calculateExtent(CAbinderAtoms, S.axLow, S.ayLow, S.azLow, S.axHigh, S.ayHigh, S.azHigh);
+  }
+  S.clashesAllowed = clashesAllowed;
+  S.contactsRequired = contactsRequired;
+  S.clashDistance = clashDistance;
+  S.contactDistance = contactDistance;
+  S.pullSD = normalDistBase;
+
+  // an accepted pose is scored by superimposing its B onto the correct B and computing the RMSD of
+  // its A to the correct A. Since both partners are rigid, the superposition is QB * TB^-1, where
+  // QB takes the reference B onto the correct B, so the aligned A is X * (reference A) with
+  // X = QB * TB^-1 * TA. When A is the crystal partner, the correct A is itself QA * (reference A),
+  // and the RMSD follows from the two transforms alone (reference A is centered at the origin)
+
+  Transform QB = bestFitTransform(rc, CBatoms, realAtomsCB);
+  Transform QA = bestFitTransform(rc, CAatoms, realAtomsCA);
+  TransformRMSD trA(CAatoms);
+  vector<CartesianPoint> refA = coordinatesOf(CAatoms), realA = coordinatesOf(realAtomsCA);
+  auto poseRMSD = [&](dockedPose& pose) {
+    Transform X = QB * pose.TB.inverse() * pose.TA;
+    if (!op.isGiven("m")) return trA.getRMSD(X, QA);
+    // model partners are not rigid copies of the correct ones, so compare coordinates
+    mstreal ss = 0;
+    for (int i = 0; i < refA.size(); i++) {
+      CartesianPoint p = X * refA[i];
+      ss += p.distance2(realA[i]);
     }
-    
-
-    // while a proper docked stage has not been reached, but there are still opporunitites for success
-
-    bool absoluteSuccess = false;
-    bool absoluteFailure = false;
-
-    /// reset recent clashes, if left-over from the last round
-    recentClashes.resize(0);
-
-    mstreal contactsCount;
-    mstreal xRand;
-
-    while ((absoluteSuccess == false) && (absoluteFailure == false)) {
-
-      // reset current clashes to be empty
-      currClashes.resize(0);
-
-      // pull B atoms out along the X axis, in small steps with a normal distrubtion of ~1.0 angstrom and mew of 0, except always positive so it's pulling away from A - can try variations on the 1.0 and adjust
-
-      xRand = fabs(MstUtils::randNormal(0,normalDistBase));
-
-      for (int a = 0; a < CBatoms.size(); a++) {
-        mstreal xStart = CBatoms[a]->getX();
-        CBatoms[a]->setX(xStart + xRand);
-      }
-
-      //position 8
-      if (op.isGiven("t") && (t == 0)) {
-        C.writePDB(op.getString("t") + "position8" + ".pdb");
-      }
-
-      // reject / continue depending on if there are too many clashes or not
+    return sqrt(ss / refA.size());
+  };
 
-      int clashCount = 0;
-      currClashes.resize(0);
+  // attempts are generated in parallel batches, each with its own random stream seeded from the
+  // base seed and the attempt's index, and then taken in order of attempt; so a seed determines
+  // the ensemble no matter how many threads there are or how attempts got scheduled
 
-      // first check positions in B that previously had clashes...
-
-      for (int a = 0; a < recentClashes.size(); a++) {
-        int currBcheck = recentClashes[a];
-        Atom* currBatom = CBatoms[currBcheck];
-        CartesianPoint currBcoor = currBatom->getCoor();
-        vector <int> currClashPts = ps.getPointsWithin(currBcoor, 0, clashDistance, false);
-        int currBsize = currClashPts.size();
-        if (currBsize > 0) {
-          currClashes.push_back(currBcheck);
-          clashCount+=currBsize;
-        }
-        if (clashCount > clashesAllowed) {
-          break;
-        }
-      }
+  unsigned int baseSeed = MstUtils::randEngine()();
+  vector<poseWorkspace> workspaces(numThreads);
+  vector<dockedPose> batch;
+  long long attempts = 0;
 
-      if (clashCount > clashesAllowed) {
-        recentClashes = currClashes;
+  while (d < numberDockingsRequired) { // while the number of docked structures is still insufficient...
+    // size batches to about what is still needed, at the acceptance rate seen so far
+    mstreal rate = (d + 1.0) / (attempts + 1.0);
+    int batchSize = (int) min(65536.0, max(16.0 * numThreads, ceil(1.1 * (numberDockingsRequired - d) / rate)));
+    batch.resize(batchSize);
+    MstUtils::parallelFor(0, batchSize, [&](int i, int th) {
+      long long k = attempts + i;
+      seed_seq seq = {baseSeed, (unsigned int) (k & 0xFFFFFFFF), (unsigned int) (k >> 32)};
+      mt19937 rng(seq);
+      batch[i] = generatePose(S, rng, workspaces[th]);
+    }, numThreads);
+    attempts += batchSize;
+
+    for (int i = 0; (i < batchSize) && (d < numberDockingsRequired); i++) {
+      dockedPose& pose = batch[i];
+      if (pose.status == dockedPose::SKIPPED) continue;
+      if (pose.status == dockedPose::FAILED) {
+        fails++;
         continue;
       }
+      d++; // accepted! :D
 
-      // then if you're not over the clash limit, check the rest of the valid residues
-
-      for (int a = 0; a < CBatoms.size(); a++) {
-        int currBcheck = a;
-        if (std::find(recentClashes.begin(), recentClashes.end(), currBcheck) != recentClashes.end()) {
-          continue; // don't double-count if already checked as part of recent clashesf
-        }
-
-        Atom* currBatom = CBatoms[currBcheck];
-        CartesianPoint currBcoor = currBatom->getCoor();
-        vector <int> currClashPts = ps.getPointsWithin(currBcoor, 0, clashDistance, false);
-        int currBsize = currClashPts.size();
-        if (currBsize > 0) {
-          currClashes.push_back(currBcheck);
-          clashCount+=currBsize;
-        }
-        if (clashCount > clashesAllowed) {
-          break;
-        }
+      if (d%10000 == 0) {
+        cout << d << " total docks accepted..." << endl;
       }
 
-      if (clashCount > clashesAllowed) {
-        recentClashes = currClashes;
-        continue;
-      }
+      // for those accepted, compare to the correct structure to calculate the RMSD; also get the
+      // transform that takes the centered random structure A to the random dock on A, with the
+      // dock aligned to the centered random structure by partner B (which is just B's reference)
 
-      //position 9
-      if (op.isGiven("t") && (t == 0)) {
-        C.writePDB(op.getString("t") + "position9" + ".pdb");
-        //exit(0);
-      }
+      mstreal simulatedRealRMSDorDOCKQ = poseRMSD(pose);
+      Transform TRA = pose.TB.inverse() * pose.TA * TZ;
 
-      // we've only reached this point if there are an aceeptable number of clashes, so accept if there are at least the required number of contacts - possibly limited by antibody binding mode, a binding residues, and/or b binding residues
-
-      if (op.isGiven("nnc")) {
-        for (int a = 0; a < CBindexDisallowed.size(); a++) { // go over all CA atoms in B possible to be part of contacts
-          int currBcheck = CBindexDisallowed[a];
-          //Residue* currBres = CBatoms[currBcheck]->getParent();
-          CartesianPoint currBcoor = CBatoms[currBcheck]->getCoor();
-          vector <int> currContactPts = ps3.getPointsWithin(currBcoor, 0.0, contactDistance, false); // ps3 is made from the disallowed A atoms
-          if (currContactPts.size() > 0) {
-            absoluteFailure = true;
-            break;
-          }
-        }
+      if (op.isGiven("t")) {
+        cout << TRA(0, 3) << " " << TRA(1, 3) << " " << TRA(2, 3) << " " << TRA(0, 0) << endl;
       }
 
-      if (absoluteFailure == true) {
-        break;
-      }
+      // if in testing mode, save the pdb files of the first 10 random things accepted, with their scores in their titles
 
-      contactsCount = 0;
-      vector<pair<Residue*,Residue*>> pastContacts = {};
-
-      for (int a = 0; a < bPossibleContacts.size(); a++) { // go over all CA atoms in B possible to be part of contacts
-        int currBcheck = bPossibleContacts[a];
-        //Residue* currBres = CBatoms[currBcheck]->getParent();
-        CartesianPoint currBcoor = CBatoms[currBcheck]->getCoor();
-        vector <int> currContactPts = ps2.getPointsWithin(currBcoor, 0.0, contactDistance, false); // ps2 is only checking for CA atoms in A possible to be part of contacts
-        contactsCount += currContactPts.size();
-        if (contactsCount >= contactsRequired) {
-          absoluteSuccess = true;
-          break;
+      if (op.isGiven("t") && (t < 10)) {
+        Structure PA(CA), PB(CB);
+        pose.TA.apply(PA);
+        pose.TB.apply(PB);
+        for (int i = 0; i < PB.chainSize(); i++) {
+          PA.appendChain(new Chain(PB.getChain(i)));
         }
-      }
-
-      //check if all atoms in CB are further positive than all atoms in CA by over 8 angstroms... b/c if so the docking is irrecoverable
-
-      ProximitySearch::calculateExtent(CB,xLow,yLow,zLow,xHigh,yHigh,zHigh);
-      mstreal bX = xLow;
-      ProximitySearch::calculateExtent(CA,xLow,yLow,zLow,xHigh,yHigh,zHigh);
-      mstreal aX = xHigh;
-
-      if (bX - aX > 8.0) {
-        absoluteFailure = true;
-      }
-    }
-
-    if (absoluteFailure) {
-      fails++;
-      if (op.isGiven("t") && (t2 == 0)) {
-        C.writePDB(op.getString("t") + "position11_failedWithContacts" + to_string(contactsCount) + ".pdb");
-        t2++;
-      }
-      continue;
-    }
-    else {
-      d++; // accepted! :D
-      if (op.isGiven("t") && (t2 == 0)) {
-        C.writePDB(op.getString("t") + "position11_succeededWithContacts" + to_string(contactsCount) + ".pdb");
-        t2++;
-      }
-    }
-
-    if (d%10000 == 0) {
-      cout << d << " total docks accepted..." << endl;
-    }
-
-    // for those accepted, compare to the correct structure to calculate the RMSD
-
-    mstreal simulatedRealRMSDorDOCKQ;
-    vector <mstreal> translationA;
-    //vector <mstreal> translationB;
-    vector <vector <mstreal>> rotationsA;
-    //vector <vector <mstreal>> rotationsB;
-
-    /*rc.align(CA.getAtoms(),realAtomsCA,C);
-    if (op.isGiven("t") && (t == 0)) {
-      C.writePDB(op.getString("t") + "Cposition12.pdb");
-      CAC.writePDB(op.getString("t") + "CACposition12.pdb");
-    }
-    mstreal bRMSD = rc.rmsd(CB.getAtoms(),realAtomsCB); */// gets RMSD without alignment
-
-    rc.align(CB.getAtoms(),realAtomsCB,C); // aligns CB with the original location of CB, but transforms the whole structure C
-
-    if (op.isGiven("t") && (d == 10)) {
-      C.writePDB(op.getString("t") + "RandDockForComp.pdb");
-      CBC.writePDB(op.getString("t") + "CBCposition13.pdb");
-    }
-    mstreal aRMSD = rc.rmsd(CA.getAtoms(),realAtomsCA); // gets RMSD without alignment
-
-    simulatedRealRMSDorDOCKQ = aRMSD;
-
-    if (op.isGiven("t") && (d == 10)) {
-      CenteredRandomB.writePDB(op.getString("t") + "CRB_before.pdb");
-    }
-
-    rc.align(CB.getAtoms(),CenteredRandomB.getAtoms(),C); // align the randomly docked structure to the centered random structure by parnter B
-
-    if (op.isGiven("t")) {
-      CenteredRandomB.writePDB(op.getString("t") + "CRB_after.pdb");
-    }
-
-    if (op.isGiven("t")) {
-      C.writePDB(op.getString("t") + "C_B_aligned");
-    }
-
-    if (op.isGiven("t")) {
-      CenteredRandomA.writePDB(op.getString("t") + "CRA_before.pdb");
-    }
-
-    rc.align(CRAatoms,CA.getAtoms(),CenteredRandomA); // align the centered random structure A to the random dock on A, so you can get the translation partner A needs to go to make that random dock
-
-    if (op.isGiven("t")) {
-      CenteredRandomA.writePDB(op.getString("t") + "CRA_after.pdb");
-    }
-
-    translationA =rc.lastTranslation();
-    rotationsA = rc.lastRotation();
-
-
-    if (op.isGiven("t")) {
-      cout << translationA[0] << " " << translationA[1] << " " << translationA[2] << " " << rotationsA[0][0] << endl;
-    }
-
-    for (int i = 0; i < CRAatoms.size(); i++) {
-      CRAatoms[i]->makeAlternativeMain(0); // reset CRA to origin position
-    }
-
-    if (op.isGiven("t") && (d == 10)) {
-      Transform RH = Transform(rotationsA,translationA);
-      RH.apply(CenteredRandomA);
-      CenteredRandomA.writePDB(op.getString("t") + "CRA_rehydrated.pdb");
-      cout << "rmsd was:" << endl;
-      cout << simulatedRealRMSDorDOCKQ << endl;
-      exit(0);
-    }
-
-    rmsdList.push_back(make_tuple(simulatedRealRMSDorDOCKQ,translationA[0],translationA[1],translationA[2],rotationsA[0][0],rotationsA[0][1],rotationsA[0][2],rotationsA[1][0],rotationsA[1][1],rotationsA[1][2],rotationsA[2][0],rotationsA[2][1],rotationsA[2][2]));
-    
-    // if in testing mode, save the pdb files of the first 10 random things accepted, with their scores in their titles
-
-    if (op.isGiven("t")) {
-      if (t < 10) {
-        C.writePDB(op.getString("t") + "position11_succeededWithContacts" + to_string(contactsCount) + to_string(t) + ".pdb");
-        //cout << "angleOff was: " << endl;
-        //cout << angleOff << endl;
+        PA.writePDB(op.getString("t") + "position11_succeededWithContacts" + to_string(pose.contacts) + to_string(t) + ".pdb");
         t++;
+        if (t == 10) {
+          Structure RH(CenteredRandomA);
+          TRA.apply(RH);
+          RH.writePDB(op.getString("t") + "CRA_rehydrated.pdb");
+          cout << "rmsd was:" << endl;
+          cout << simulatedRealRMSDorDOCKQ << endl;
+        }
       }
+
+      rmsdList.push_back(make_tuple(simulatedRealRMSDorDOCKQ,TRA(0, 3),TRA(1, 3),TRA(2, 3),TRA(0, 0),TRA(0, 1),TRA(0, 2),TRA(1, 0),TRA(1, 1),TRA(1, 2),TRA(2, 0),TRA(2, 1),TRA(2, 2)));
     }
   }
 
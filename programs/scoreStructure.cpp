@@ -19,6 +19,7 @@ int main(int argc, char** argv) {
   op.addOption("rmsd", "RMSD cutoff when searching for matches (default=2.0).");
   op.addOption("count", "maximum number of matches to search for within the specified RMSD cutoff (default=50).");
   op.addOption("ps", "pseudocount to add to the smoothed scores before computing their logs (default=0.01).");
+  op.addOption("nt", "number of threads to search for TERMs with (1 by default). Each additional thread reads its own copy of the database, so memory use grows accordingly. Scores do not depend on the number of threads.");
   op.setOptions(argc, argv);
 
   // Read in the structure, FASST database, and rotamer library
@@ -33,6 +34,14 @@ int main(int argc, char** argv) {
   if (op.isGiven("rmsd")) T.setRMSDCut(op.getReal("rmsd"));
   if (op.isGiven("count")) T.setMatchCount(op.getInt("count"));
   if (op.isGiven("ps")) T.setPseudocount(op.getReal("ps"));
+  int numThreads = op.getInt("nt", 1);
+  if (numThreads < 1) MstUtils::error("--nt must be a positive integer");
+  vector<FASST*> workers;
+  for (int t = 1; t < numThreads; t++) {
+    workers.push_back(new FASST());
+    workers.back()->readDatabase(op.getString("db"));
+  }
+  T.setWorkerFASSTs(workers);
 
   // Score each residue in the structure
   vector<pair<mstreal, mstreal>> scoreParts;
@@ -69,6 +78,7 @@ int main(int argc, char** argv) {
     }
     outputFS.close();
   }
+  for (FASST* worker : workers) delete worker;
 
   return 0;
 }
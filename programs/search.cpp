@@ -9,7 +9,7 @@ int main(int argc, char *argv[]) {
   op.setTitle("Command-line acceess to the FASST (FAst Structure Search Algorithm) method. Options:");
   op.addOption("q", "query PDB file.", true);
   op.addOption("d", "a database file with a list of PDB files.");
-  op.addOption("b", "a binary database file. If both --d and --b are given, the combined database will be searched.");
+  op.addOption("b", "a binary database file (or a segment manifest, see fasstSegments). If both --d and --b are given, the combined database will be searched.");
   op.addOption("r", "RMSD cutoff (takes the size-dependent cutoff by default).");
   op.addOption("red", "set redundancy cutoff level in percent (default is 100, so no redundancy filtering).");
   op.addOption("redProp", "set redundancy property name. If defined, will assume the FASST database encodes this relational property and will define redundancy via it.");
@@ -23,6 +23,10 @@ int main(int argc, char *argv[]) {
   op.addOption("matchOut", "match output file.");
   op.addOption("m", "memory saving mode: 0 means does not do any memory savings; 1 means strip the side-chains; 2 (default) means destroy the original target structure upon reading, and only keep backbone coordinates.");
   op.addOption("sc", "dump sidechains (not only the backbone).");
+  op.addOption("dsig", "compute intra-distance signatures for targets that do not have them stored in the database (they let the search skip windows that provably cannot match).");
+  op.addOption("cfilter", "an extra filter from compact copies of target coordinates: 'float32' or 'fixed16' (16-bit fixed point). Residuals are first computed from the contiguous copies, and matches are re-verified at full precision, so results do not change. The copies are kept in addition to the full-precision targets, adding 12 or 6 bytes per atom.");
+  op.addOption("order", "an integer. If given, sample this many database residues, and use the sample to search first the query segments estimated to have the fewest candidates when searched first (by default, segments are searched longest first; the two orders mostly agree, and differ mainly among segments of similar length).");
+  op.addOption("dih", "a margin in degrees. If given, target windows with any residue whose phi or psi angle is further than this from the class of the corresponding query angle are skipped. This is a heuristic prefilter (matches within the RMSD cutoff can be lost if the margin is too tight); dihedral classes are computed for targets that do not have them stored in the database.");
   op.setOptions(argc, argv);
   int memInit = MstSys::memUsage();
   if (op.isGiven("redProp")) MstUtils::assertCond(!op.getString("redProp").empty(), "--redProp must specify a property name");
@@ -55,6 +59,23 @@ int main(int argc, char *argv[]) {
       S.addTarget(P);
     }
   }
+  if (op.isGiven("dsig")) S.computeDistanceSignatures();
+  if (op.isGiven("cfilter")) {
+    string prec = op.getString("cfilter");
+    if (prec.compare("float32") == 0) S.setCompactFilter(FASST::coordPrecision::FLOAT32);
+    else if (prec.compare("fixed16") == 0) S.setCompactFilter(FASST::coordPrecision::FIXED16);
+    else MstUtils::error("unknown compact filter precision '" + prec + "'");
+    cout << "compact target coordinates take an extra " << S.compactCoordinateBytes()/1024 << " KB" << endl;
+  }
+  if (op.isGiven("order")) {
+    if (!op.isInt("order") || (op.getInt("order") <= 0)) MstUtils::error("--order must be a positive integer");
+    S.buildDatabaseSummary(op.getInt("order"));
+  }
+  if (op.isGiven("dih")) {
+    if (!op.isReal("dih") || (op.getReal("dih") < 0)) MstUtils::error("--dih must be a non-negative number");
+    S.computeDihedralClasses();
+    S.options().setDihedralFilter(op.getReal("dih"));
+  }
   if (op.isGiven("r")) { S.setRMSDCutoff(op.getReal("r")); }
   else {
     cout << "setting RMSD cutoff to " << RMSDCalculator::rmsdCutoff(query) << endl;
@@ -93,13 +114,25 @@ int main(int argc, char *argv[]) {
   auto end = chrono::high_resolution_clock::now();
   cout << "DB reading took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
   cout << "memory usage: " << MstSys::memUsage() - memInit << " KB" << endl;
+  map<string, size_t> dbMem;
+  size_t dbBytes = S.memoryFootprint(&dbMem);
+  cout << "database holds " << dbBytes/1024 << " KB:";
+  for (auto it = dbMem.begin(); it != dbMem.end(); ++it) cout << " " << it->first << " " << it->second/1024 << " KB" << (next(it) == dbMem.end() ? "" : ",");
+  cout << endl;
   cout << "Searching..." << endl;
   begin = chrono::high_resolution_clock::now();
   S.search();
   end = chrono::high_resolution_clock::now();
   cout << "Search took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+  const FASST::searchStats& stats = S.getSearchStats();
+  cout << "visited " << stats.numNodes << " partial alignments" << endl;
+  cout << "considered " << stats.numWindows << " segment alignments, " << stats.numSigPruned << " of them ruled out by distance signatures";
+  if (S.options().isDihedralFilterSet()) cout << " and " << stats.numDihedralPruned << " by backbone dihedrals";
+  cout << endl;
+  if (S.options().sequenceConstraintsSet()) cout << stats.numSeqSkipped << " targets were skipped for having no alignment allowed by sequence constraints" << endl;
+  if (S.getCompactFilter() != FASST::coordPrecision::DOUBLE) cout << stats.numVerifyRejected << " candidate matches were rejected upon full-precision verification" << endl;
   cout << "found " << S.numMatches() << " matches:" << endl;
-  cout << "memory usage: " << MstSys::memUsage() << " KB" << endl;
+  cout << "memory usage: " << MstSys::memUsage() << " KB (peak " << MstSys::peakMemUsage() << " KB)" << endl;
   fasstSolutionSet matches = S.getMatches(); int i = 0;
   vector<vector<mstreal> > phi, psi;
   for (auto it = matches.begin(); it != matches.end(); ++it, ++i) {
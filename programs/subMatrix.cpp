@@ -4,13 +4,17 @@
 #include "mstsequence.h"
 #include "mstoptions.h"
 #include "mstfasst.h"
+#include "mstsystem.h"
 #include <unistd.h>
 
 using namespace MST;
 
-void writeMatrix(const string& fileName, const vector<vector<int> >& subMatrix, bool echo = true) {
+typedef vector<vector<long> > subCounts; // substitution counts among the 20 standard amino acids
+
+// writes the matrix under a temporary name first, so that the file is always complete
+void writeMatrix(const string& fileName, const subCounts& subMatrix, bool echo = true) {
   fstream ofs;
-  MstUtils::openFile(ofs, fileName, ios::out);
+  MstUtils::openFile(ofs, fileName + ".tmp", ios::out);
   for (int i = 0; i < subMatrix.size(); i++) {
     ofs << SeqTools::idxToSingle(i) << "\t";
     if (echo) cout << SeqTools::idxToSingle(i) << "\t";
@@ -26,6 +30,7 @@ void writeMatrix(const string& fileName, const vector<vector<int> >& subMatrix,
     if (echo) cout << endl;
   }
   ofs.close();
+  MstSys::cmv(fileName + ".tmp", fileName);
 }
 
 void selectAround(const vector<Residue*>& cenRes, int pm, Structure& frag, bool ignoreGaps = false, vector<int>* fragResIdx = NULL, vector<int>* fragCenResIdx = NULL) {
@@ -62,18 +67,17 @@ void selectAround(const vector<Residue*>& cenRes, int pm, Structure& frag, bool
   }
 }
 
-Structure getTERM(Residue& res, RotamerLibrary& RL, vector<int>& keyResidues, vector<vector<int> >& resSpacing, mstreal cdcut = 0.0, bool verbose = false) {
-  Structure& S = *(res.getStructure());
-  ConFind C(&RL, S);
+// C is a ConFind object for the structure of the residue
+Structure getTERM(Residue& res, ConFind& C, vector<int>& keyResidues, vector<vector<int> >& resSpacing, mstreal cdcut = 0.0, bool verbose = false, ostream& out = cout) {
   contactList list = C.getContacts(&res, cdcut);
-  // cout << "found " << list.size() << " contacts for residue " << res << " with CD cutoff " << cdcut << endl;
+  // out << "found " << list.size() << " contacts for residue " << res << " with CD cutoff " << cdcut << endl;
   vector<Residue*> residues(1, &res);
   for (int i = 0; i < list.size(); i++) {
     residues.push_back(list.residueB(i));
   }
   Structure frag, fragNoGaps; // the latter will not break chains due to selection gaps
   selectAround(residues, 1, frag, false, NULL, &keyResidues);
-  if (verbose) frag.writePDB(cout);
+  if (verbose) frag.writePDB(out);
   selectAround(residues, 1, fragNoGaps, true);
 
   // for each chain in the TERM, identify
@@ -81,116 +85,252 @@ Structure getTERM(Residue& res, RotamerLibrary& RL, vector<int>& keyResidues, ve
   for (int i = 0; i < fragNoGaps.chainSize(); i++) {
     Chain& C = fragNoGaps[i];
     for (int ri = 0; ri < C.residueSize(); ri++) resSpacing[i].push_back(C[ri].getNum());
-    if (verbose) cout << MstUtils::vecToString(resSpacing[i]) << endl;
+    if (verbose) out << MstUtils::vecToString(resSpacing[i]) << endl;
   }
   return frag;
 }
 
+// settings shared by all draws
+struct samplingParams {
+  unsigned seed;
+  int numRes;     // residues to visit in each structure
+  mstreal cdcut;  // contact degree cutoff
+  bool verbose;
+};
+
+/* One draw: picks a random structure from the database, visits random residues
+ * in it, and adds substitutions seen between each residue and its TERM's matches
+ * to subMatrix. Every draw has its own random number stream, seeded by the
+ * sampling seed and the draw number, so that what a draw finds depends neither
+ * on the thread that runs it nor on the order of draws. F does the searching,
+ * while target structures come from source, whose targets F shares. The log line of each residue
+ * goes to logfs and verbose output to out. */
+void sampleStructure(long draw, FASST& F, const FASST& source, RotamerLibrary& RL, const samplingParams& p, subCounts& subMatrix, ostream& logfs, ostream& out) {
+  seed_seq seeds = {p.seed, (unsigned) draw, (unsigned) (draw >> 32)};
+  MstThreadRandEngine engine(seeds);
+  bool verbose = p.verbose;
+
+  // pick a random structure from the database
+  int ti = MstUtils::randInt(0, F.numTargets() - 1);
+  Structure S(source.getTargetCopy(ti));
+  ConFind CS(&RL, S);
+
+  for (int r = 0; r < p.numRes; r++) {
+    // pick a random residue
+    int ri = MstUtils::randInt(0, S.residueSize() - 1);
+    Residue& res = S.getResidue(ri);
+    int aai = SeqTools::aaToIdx(SeqTools::toSingle(res.getName()));
+    if (aai >= subMatrix.size()) continue;
+    /* Will contain indices of the residues defining the TERM (first the
+     * central residue, and then residues it is in contact with, if any).
+     * Indices are into the TERM structure, not the original structure. */
+    vector<int> keyResidues;
+    vector<vector<int> > resSpacing; // will store the spacing between residues, in the original structure
+    Structure term = getTERM(res, CS, keyResidues, resSpacing, p.cdcut, verbose, out);
+    F.setQuery(term);
+    F.setRMSDCutoff(RMSDCalculator::rmsdCutoff(resSpacing));
+    if (verbose) out << "term.ressidueSize() = " << term.residueSize() << ", term.chainSize() = " << term.chainSize() << ", RMSD cutoff = " << RMSDCalculator::rmsdCutoff(resSpacing) << endl;
+    fasstSolutionSet matches = F.search();
+    if (verbose) out << "found " << matches.size() << " matches" << endl;
+    logfs << S.getName() << " " << ti << " " << ri << " " << res << " " << keyResidues.size() << " "
+          << term.residueSize() << " " << term.chainSize() << " " << matches.size();
+    int Na = 0; // number of accepted matches
+    // split matches by target
+    map<int, vector<fasstSolution> > matchesByTarget;
+    for (int i = 0; i < matches.size(); i++) {
+      int idx = matches[i].getTargetIndex();
+      if (idx == ti) continue; // don't count matches from the same structure as the query
+      matchesByTarget[idx].push_back(matches[i]);
+    }
+
+    for (auto it = matchesByTarget.begin(); it != matchesByTarget.end(); ++it) {
+      int idx = it->first;
+      vector<fasstSolution>& sols = it->second;
+      Structure target = source.getTargetCopy(idx);
+      ConFind C(&RL, target);
+      for (int i = 0; i < sols.size(); i++) {
+        vector<int> residues = F.getMatchResidueIndices(sols[i], FASST::matchType::REGION);
+
+        // make sure that the central residue within this match does not have
+        // any additional contacts within its structure
+        Residue& subRes = target.getResidue(residues[keyResidues[0]]);
+        vector<Residue*> conts = C.getContactingResidues(&subRes, p.cdcut);
+        set<int> keyResidueSet;
+        for (int ri = 0; ri < keyResidues.size(); ri++) keyResidueSet.insert(residues[keyResidues[ri]]);
+        bool reject = false;
+        for (int ci = 0; ci < conts.size(); ci++) {
+          int ind = conts[ci]->getResidueIndex();
+          if (keyResidueSet.find(ind) == keyResidueSet.end()) {
+            reject = true; // reject this match, because it has an extra contact with the central residue
+          }
+        }
+        if (reject) {
+          if (verbose) out << "\tmatch " << i+1 << " from target " << idx << " rejected due to extra contacts..." << endl;
+          continue;
+        }
+        if (verbose) out << "\tmatch " << i+1 << " accepted!" << endl;
+
+        // match is accepted, so count the substitution
+        int aaj = SeqTools::aaToIdx(SeqTools::toSingle(subRes.getName()));
+        if (aaj >= subMatrix.size()) continue;
+        if (verbose) out << "\t\tcounting substitution between " << res.getName() << " and " << subRes.getName() << endl;
+        subMatrix[aai][aaj]++;
+        Na++;
+      }
+    }
+    logfs << " " << Na << endl;
+  }
+}
+
+/* Largest change in any substitution frequency (counts normalized by row)
+ * between two matrices. */
+mstreal maxFrequencyChange(const subCounts& A, const subCounts& B) {
+  mstreal delta = 0;
+  for (int i = 0; i < A.size(); i++) {
+    long na = 0, nb = 0;
+    for (int j = 0; j < A[i].size(); j++) { na += A[i][j]; nb += B[i][j]; }
+    for (int j = 0; j < A[i].size(); j++) {
+      mstreal fa = (na > 0) ? A[i][j]/(mstreal) na : 0;
+      mstreal fb = (nb > 0) ? B[i][j]/(mstreal) nb : 0;
+      delta = MstUtils::max(delta, fabs(fa - fb));
+    }
+  }
+  return delta;
+}
+
+// sampling state saved at checkpoints
+struct samplingState {
+  samplingState() : total(20, vector<long>(20, 0)), prev(total) { seed = 0; numDraws = logSize = 0; numStable = 0; }
+  unsigned seed;
+  long numDraws;  // draws done
+  long logSize;   // size of the log file as of the last checkpoint
+  int numStable;  // consecutive checkpoints at which the matrix had converged
+  subCounts total, prev; // counts now and at the previous checkpoint
+};
+
+void writeState(const string& fileName, const samplingState& st) {
+  fstream ofs;
+  MstUtils::openFile(ofs, fileName + ".tmp", ios::out);
+  ofs << "seed " << st.seed << endl << "draws " << st.numDraws << endl << "log " << st.logSize << endl << "stable " << st.numStable << endl;
+  for (const subCounts* M : {&st.total, &st.prev}) {
+    for (int i = 0; i < M->size(); i++) ofs << MstUtils::vecToString((*M)[i], " ") << endl;
+  }
+  ofs.close();
+  MstSys::cmv(fileName + ".tmp", fileName);
+}
+
+samplingState readState(const string& fileName) {
+  samplingState st;
+  fstream ifs;
+  MstUtils::openFile(ifs, fileName, ios::in);
+  string key[4];
+  ifs >> key[0] >> st.seed >> key[1] >> st.numDraws >> key[2] >> st.logSize >> key[3] >> st.numStable;
+  for (subCounts* M : {&st.total, &st.prev}) {
+    for (int i = 0; i < M->size(); i++) {
+      for (int j = 0; j < (*M)[i].size(); j++) ifs >> (*M)[i][j];
+    }
+  }
+  if (ifs.fail() || (key[0] != "seed") || (key[1] != "draws") || (key[2] != "log") || (key[3] != "stable")) MstUtils::error("could not parse sampling state file '" + fileName + "'", "readState");
+  return st;
+}
+
 int main(int argc, char *argv[]) {
   MstOptions op;
-  op.setTitle("Compute the TERM-induced amino-acid substitution matrix. Options:");
+  op.setTitle("Compute the TERM-induced amino-acid substitution matrix. Structures are drawn in batches, sampled in parallel, and after each batch the matrix is written out and a checkpoint is saved. Options:");
   op.addOption("d", "a FASST database.", true);
-  op.addOption("N", "number of structures to randomly sample from the database.", true);
+  op.addOption("N", "number of structures to randomly sample from the database. If not given, sampling goes on until the matrix converges (see --tol).");
   op.addOption("n", "number of residues to randomly visit for each structure.", true);
   op.addOption("r", "path to rotamer library file.", true);
-  op.addOption("o", "output base for the substitution table and the log file.", true);
+  op.addOption("o", "output base for the substitution table (.mat), the log file (.log), and the checkpoint state (.ckp).", true);
   op.addOption("c", "contact degree cutoff for defining contacts.");
+  op.addOption("tol", "convergence tolerance: stop once no substitution frequency (i.e., count normalized by the total of its row) has changed by more than this much between checkpoints, at three checkpoints in a row (not counting checkpoints after batches that added no substitutions). Default is 0.001 if --N is not given; otherwise, convergence is not tested unless --tol is given.");
+  op.addOption("ck", "number of structures to sample between checkpoints. Default is 100.");
+  op.addOption("resume", "resume an interrupted run with the same output base from its last checkpoint. Other options should be the same as in the original run.");
+  op.addOption("seed", "random seed. Each structure draw gets its own random number stream, derived from the seed and the draw number, so results do not depend on the number of threads. By default, a seed is picked based on time.");
+  op.addOption("nt", "number of threads; defaults to MST_NUM_THREADS if set, or else the number of hardware threads. All threads search one shared copy of the database.");
   op.addOption("v", "verbose output.");
   op.setOptions(argc, argv);
+  MstUtils::setSignalHandlers();
   RotamerLibrary RL(op.getString("r"));
-  RMSDCalculator rc;
-  FASST F;
-  int N = 1000; // number of structures to randomly sample
-  int n = 1;    // number
-  int centResIdx;
-  mstreal cdcut = op.getReal("c", 0.05);
+  long maxDraws = op.isGiven("N") ? op.getInt("N") : -1;
+  mstreal tol = op.getReal("tol", op.isGiven("N") ? -1 : 0.001);
+  int batchSize = op.getInt("ck", 100);
+  int numStableNeeded = 3;
+  int numThreads = MstUtils::numThreads(op.getInt("nt", 0));
+  samplingParams params;
+  params.numRes = op.getInt("n");
+  params.cdcut = op.getReal("c", 0.05);
+  params.verbose = op.isGiven("v");
+  MstUtils::assertCond(op.isGiven("N") || (tol > 0), "either --N or a positive --tol must be given!");
+  MstUtils::assertCond(batchSize > 0, "--ck must be a positive integer!");
   string matFile = op.getString("o") + ".mat";
   string logFile = op.getString("o") + ".log";
-  bool verbose = op.isGiven("v");
-  // srand(123456789);
-  srand(time(NULL) + (int) getpid());
-  fstream logfs; MstUtils::openFile(logfs, logFile, ios::out);
-
-  // prepare substitution counts matrix
-  vector<vector<int> > subMatrix(20, vector<int>(20, 0));
-
-  // prepare FASST object
-  F.readDatabase(op.getString("d"), 2);
-  F.options().setRedundancyCut(0.5);
-  // F.setMaxNumMatches(1000); // these many matches are enough to compute reasonable frequencies
-  // F.setMinNumMatches(20);   // need at least this many to compute anything reasonable
-
-  for (int c = 0; c < op.getInt("N"); c++) {
-    // pick a random structure from the database
-    int ti = MstUtils::randInt(0, F.numTargets() - 1);
-    Structure S(F.getTargetCopy(ti));
-
-    for (int r = 0; r < op.getInt("n"); c++) {
-      // pick a random residue
-      int ri = MstUtils::randInt(0, S.residueSize() - 1);
-      Residue& res = S.getResidue(ri);
-      int aai = SeqTools::aaToIdx(SeqTools::toSingle(res.getName()));
-      if (aai >= subMatrix.size()) continue;
-      /* Will contain indices of the residues defining the TERM (first the
-       * central residue, and then residues it is in contact with, if any).
-       * Indices are into the TERM structure, not the original structure. */
-      vector<int> keyResidues;
-      vector<vector<int> > resSpacing; // will store the spacing between residues, in the original structure
-      Structure term = getTERM(res, RL, keyResidues, resSpacing, cdcut, verbose);
-      F.setQuery(term);
-      F.setRMSDCutoff(rc.rmsdCutoff(resSpacing));
-      if (verbose) cout << "term.ressidueSize() = " << term.residueSize() << ", term.chainSize() = " << term.chainSize() << ", RMSD cutoff = " << rc.rmsdCutoff(resSpacing) << endl;
-      fasstSolutionSet matches = F.search();
-      if (verbose) cout << "found " << matches.size() << " matches" << endl;
-      logfs << S.getName() << " " << ti << " " << ri << " " << res << " " << keyResidues.size() << " "
-            << term.residueSize() << " " << term.chainSize() << " " << matches.size();
-      int Na = 0; // number of accepted matches
-      // split matches by target
-      map<int, vector<fasstSolution> > matchesByTarget;
-      for (int i = 0; i < matches.size(); i++) {
-        int idx = matches[i].getTargetIndex();
-        if (idx == ti) continue; // don't count matches from the same structure as the query
-        matchesByTarget[idx].push_back(matches[i]);
-      }
+  string stateFile = op.getString("o") + ".ckp";
 
-      for (auto it = matchesByTarget.begin(); it != matchesByTarget.end(); ++it) {
-        int idx = it->first;
-        vector<fasstSolution>& sols = it->second;
-        Structure target = F.getTargetCopy(idx);
-        ConFind C(&RL, target);
-        for (int i = 0; i < sols.size(); i++) {
-          vector<int> residues = F.getMatchResidueIndices(sols[i], FASST::matchType::REGION);
-
-          // make sure that the central residue within this match does not have
-          // any additional contacts within its structure
-          Residue& subRes = target.getResidue(residues[keyResidues[0]]);
-          vector<Residue*> conts = C.getContactingResidues(&subRes, cdcut);
-          set<int> keyResidueSet;
-          for (int ri = 0; ri < keyResidues.size(); ri++) keyResidueSet.insert(residues[keyResidues[ri]]);
-          bool reject = false;
-          for (int ci = 0; ci < conts.size(); ci++) {
-            int ind = conts[ci]->getResidueIndex();
-            if (keyResidueSet.find(ind) == keyResidueSet.end()) {
-              reject = true; // reject this match, because it has an extra contact with the central residue
-            }
-          }
-          if (reject) {
-            if (verbose) cout << "\tmatch " << i+1 << " from target " << idx << " rejected due to extra contacts..." << endl;
-            continue;
-          }
-          if (verbose) cout << "\tmatch " << i+1 << " accepted!" << endl;
-
-          // match is accepted, so count the substitution
-          int aaj = SeqTools::aaToIdx(SeqTools::toSingle(subRes.getName()));
-          if (aaj >= subMatrix.size()) continue;
-          if (verbose) cout << "\t\tcounting substitution between " << res.getName() << " and " << subRes.getName() << endl;
-          subMatrix[aai][aaj]++;
-          Na++;
-          writeMatrix(matFile, subMatrix, verbose);
-        }
+  // start afresh or pick up where the last checkpoint left off
+  samplingState st;
+  fstream logfs;
+  if (op.isGiven("resume") && MstSys::fileExists(stateFile)) {
+    st = readState(stateFile);
+    if (op.isGiven("seed") && ((unsigned) op.getInt("seed") != st.seed)) MstUtils::error("--seed differs from the seed of the run being resumed");
+    MstUtils::assertCond(truncate(logFile.c_str(), st.logSize) == 0, "could not truncate log file '" + logFile + "' to its size at the last checkpoint");
+    MstUtils::openFile(logfs, logFile, ios::out | ios::app);
+    cout << "resuming after " << st.numDraws << " structures sampled, with seed " << st.seed << endl;
+  } else {
+    st.seed = op.isGiven("seed") ? op.getInt("seed") : MstUtils::seedRandEngine();
+    MstUtils::openFile(logfs, logFile, ios::out);
+    cout << "random seed is " << st.seed << endl;
+  }
+  params.seed = st.seed;
+
+  /* read the database once, with target structures (side chains are not needed,
+   * as contacts come from rotamers), and search it from one FASST object per
+   * thread, all sharing its targets */
+  FASST source;
+  source.readDatabase(op.getString("d"), 1);
+  vector<FASST*> searchers(numThreads);
+  for (int t = 0; t < numThreads; t++) {
+    searchers[t] = new FASST(&source);
+    searchers[t]->options().setRedundancyCut(0.5);
+    // searchers[t]->setMaxNumMatches(1000); // these many matches are enough to compute reasonable frequencies
+    // searchers[t]->setMinNumMatches(20);   // need at least this many to compute anything reasonable
+  }
+
+  bool converged = (tol > 0) && (st.numStable >= numStableNeeded);
+  while (!converged && ((maxDraws < 0) || (st.numDraws < maxDraws))) {
+    // sample a batch of draws, each thread counting into its own matrix
+    int n = (maxDraws < 0) ? batchSize : MstUtils::min((long) batchSize, maxDraws - st.numDraws);
+    vector<subCounts> counts(numThreads, subCounts(20, vector<long>(20, 0)));
+    vector<string> logs(n), outs(n);
+    MstUtils::parallelFor(0, n, [&](int k, int t) {
+      stringstream log, out;
+      sampleStructure(st.numDraws + k, *(searchers[t]), source, RL, params, counts[t], log, out);
+      logs[k] = log.str(); outs[k] = out.str();
+    }, numThreads);
+    for (int k = 0; k < n; k++) { logfs << logs[k]; cout << outs[k]; }
+    logfs.flush();
+
+    // merge and checkpoint
+    st.prev = st.total;
+    long numSubs = 0, numNew = 0;
+    for (int i = 0; i < 20; i++) {
+      for (int j = 0; j < 20; j++) {
+        for (int t = 0; t < numThreads; t++) { st.total[i][j] += counts[t][i][j]; numNew += counts[t][i][j]; }
+        numSubs += st.total[i][j];
       }
-      logfs << " " << Na << endl;
     }
+    st.numDraws += n;
+    st.logSize = MstSys::fileSize(logFile);
+    mstreal delta = maxFrequencyChange(st.prev, st.total);
+    if (delta > tol) st.numStable = 0;
+    else if (numNew > 0) st.numStable++; // a batch that added nothing is no evidence either way
+    converged = (tol > 0) && (st.numStable >= numStableNeeded);
+    writeMatrix(matFile, st.total, params.verbose);
+    writeState(stateFile, st);
+    cout << "sampled " << st.numDraws << " structures, " << numSubs << " substitutions; largest frequency change since the last checkpoint is " << delta << endl;
   }
+  if (converged) cout << "substitution frequencies converged to within " << tol << endl;
+  writeMatrix(matFile, st.total, false);
   logfs.close();
+  for (int t = 0; t < numThreads; t++) delete searchers[t];
 }
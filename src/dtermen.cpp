@@ -1570,6 +1570,11 @@ void EnergyTable::clear() {
   pairE.clear();
 }
 
+size_t EnergyTable::memoryFootprint() const {
+  return sizeof(EnergyTable) + MstUtils::heapBytes(siteIndices) + MstUtils::heapBytes(sites) + MstUtils::heapBytes(aaIndices) +
+         MstUtils::heapBytes(aaAlpha) + MstUtils::heapBytes(selfE) + MstUtils::heapBytes(pairMaps) + MstUtils::heapBytes(pairE);
+}
+
 void EnergyTable::readFromFile(const string& tabFile) {
   clear();
   vector<string> lines = MstUtils::fileToArray(tabFile);
@@ -1715,6 +1720,169 @@ mstreal EnergyTable::scoreSequence(const Sequence& seq) {
   return scoreSolution(sequenceToSolution(seq));
 }
 
+vector<mstreal> EnergyTable::scoreSolutions(const vector<res_t>& sols, vector<mstreal>* selfDecomp, vector<mstreal>* pairDecomp, int numThreads) {
+  int L = numSites();
+  if (L == 0) MstUtils::error("empty table", "EnergyTable::scoreSolutions");
+  if (sols.size() % L != 0) MstUtils::error("solution matrix size is not a multiple of the number of sites", "EnergyTable::scoreSolutions");
+  int N = sols.size() / L;
+
+  // flatten the table: self energies of site si start at selfOff[si], and the
+  // energies of the p-th interacting pair (i, pairJ[p]) at pairOff[p], as a row-
+  // major block with one row per residue at site i; the pairs of site i are
+  // pairBeg[i] through pairBeg[i+1]-1, in the order scoreSolution() adds them
+  vector<int> alphaSize(L), selfOff(L), pairBeg(L + 1), pairJ;
+  vector<size_t> pairOff;
+  vector<mstreal> selfFlat, pairFlat;
+  for (int si = 0; si < L; si++) {
+    alphaSize[si] = selfE[si].size();
+    selfOff[si] = selfFlat.size();
+    selfFlat.insert(selfFlat.end(), selfE[si].begin(), selfE[si].end());
+  }
+  for (int si = 0; si < L; si++) {
+    pairBeg[si] = pairJ.size();
+    for (auto it = pairMaps[si].begin(); it != pairMaps[si].end(); ++it) {
+      int sj = it->first;
+      if (sj < si) continue;
+      vector<vector<mstreal> >& E = pairE[si][it->second];
+      if (E.size() != alphaSize[si]) MstUtils::error("pair energies of sites " + sites[si] + " and " + sites[sj] + " do not match their alphabets", "EnergyTable::scoreSolutions");
+      pairJ.push_back(sj);
+      pairOff.push_back(pairFlat.size());
+      for (int ai = 0; ai < E.size(); ai++) {
+        if (E[ai].size() != alphaSize[sj]) MstUtils::error("pair energies of sites " + sites[si] + " and " + sites[sj] + " do not match their alphabets", "EnergyTable::scoreSolutions");
+        pairFlat.insert(pairFlat.end(), E[ai].begin(), E[ai].end());
+      }
+    }
+  }
+  pairBeg[L] = pairJ.size();
+  int P = pairJ.size();
+
+  vector<mstreal> energies(N, 0);
+  if (selfDecomp != NULL) selfDecomp->assign((size_t) N * L, 0);
+  if (pairDecomp != NULL) pairDecomp->assign((size_t) N * P, 0);
+  const int blockSize = 256;
+  int numBlocks = (N + blockSize - 1) / blockSize;
+  int nt = MstUtils::min(MstUtils::numThreads(numThreads), MstUtils::max(numBlocks, 1));
+  vector<vector<int> > columns(nt, vector<int>(L * blockSize)); // per-thread transposed block
+  MstUtils::parallelFor(0, numBlocks, [&](int bi, int t) {
+    int beg = bi * blockSize, n = MstUtils::min(blockSize, N - beg);
+
+    // transpose the block, so that the residues at each site are contiguous
+    int* cols = columns[t].data();
+    for (int k = 0; k < n; k++) {
+      const res_t* row = &sols[(size_t) (beg + k) * L];
+      for (int si = 0; si < L; si++) {
+        int aa = row[si];
+        if ((aa < 0) || (aa >= alphaSize[si])) MstUtils::error("residue index " + MstUtils::toString(aa) + " out of range for site " + sites[si] + " in solution " + MstUtils::toString(beg + k), "EnergyTable::scoreSolutions");
+        cols[si*blockSize + k] = aa;
+      }
+    }
+
+    // accumulate energies site by site, each across the whole block
+    mstreal* E = &energies[beg];
+    for (int si = 0; si < L; si++) {
+      const int* ci = cols + si*blockSize;
+      const mstreal* self = &selfFlat[selfOff[si]];
+      for (int k = 0; k < n; k++) E[k] += self[ci[k]];
+      if (selfDecomp != NULL) {
+        mstreal* D = &(*selfDecomp)[(size_t) beg * L + si];
+        for (int k = 0; k < n; k++) D[(size_t) k * L] = self[ci[k]];
+      }
+      for (int p = pairBeg[si]; p < pairBeg[si + 1]; p++) {
+        const int* cj = cols + pairJ[p]*blockSize;
+        const mstreal* pe = &pairFlat[pairOff[p]];
+        int nj = alphaSize[pairJ[p]];
+        for (int k = 0; k < n; k++) E[k] += pe[ci[k]*nj + cj[k]];
+        if (pairDecomp != NULL) {
+          mstreal* D = &(*pairDecomp)[(size_t) beg * P + p];
+          for (int k = 0; k < n; k++) D[(size_t) k * P] = pe[ci[k]*nj + cj[k]];
+        }
+      }
+    }
+  }, nt);
+  return energies;
+}
+
+vector<pair<int, int> > EnergyTable::interactingPairs() const {
+  vector<pair<int, int> > pairs;
+  for (int si = 0; si < pairMaps.size(); si++) {
+    for (auto it = pairMaps[si].begin(); it != pairMaps[si].end(); ++it) {
+      if (it->first > si) pairs.push_back(make_pair(si, it->first));
+    }
+  }
+  return pairs;
+}
+
+vector<vector<int> > EnergyTable::residueTypeToAlphabet() {
+  vector<vector<int> > alphaIdx(numSites(), vector<int>(SeqTools::maxIndex() + 1, -1));
+  for (int si = 0; si < numSites(); si++) {
+    for (res_t r = 0; r <= SeqTools::maxIndex(); r++) {
+      auto it = aaIndices[si].find(SeqTools::idxToTriple(r));
+      if (it != aaIndices[si].end()) alphaIdx[si][r] = it->second;
+    }
+  }
+  return alphaIdx;
+}
+
+vector<res_t> EnergyTable::sequencesToSolutions(const vector<Sequence>& seqs) {
+  int L = numSites();
+  vector<vector<int> > alphaIdx = residueTypeToAlphabet();
+  vector<res_t> sols((size_t) seqs.size() * L);
+  for (int n = 0; n < seqs.size(); n++) {
+    const Sequence& seq = seqs[n];
+    if (seq.size() != L) MstUtils::error("sequence " + MstUtils::toString(n) + " is of wrong length for table", "EnergyTable::sequencesToSolutions");
+    for (int si = 0; si < L; si++) {
+      int a = ((seq[si] >= 0) && (seq[si] < alphaIdx[si].size())) ? alphaIdx[si][seq[si]] : -1;
+      if (a < 0) MstUtils::error("sequence " + MstUtils::toString(n) + " is not from table alphabet", "EnergyTable::sequencesToSolutions");
+      sols[(size_t) n * L + si] = a;
+    }
+  }
+  return sols;
+}
+
+vector<res_t> EnergyTable::readSolutions(const string& seqFile, vector<string>* names) {
+  int L = numSites();
+  vector<vector<int> > alphaIdx = residueTypeToAlphabet();
+  vector<res_t> letterIdx(256);
+  for (int c = 0; c < 256; c++) letterIdx[c] = SeqTools::aaToIdx(string(1, (char) c));
+
+  vector<res_t> sols;
+  int numSeqs = 0;
+  auto addSequence = [&](const string& seq) {
+    if (seq.size() != L) MstUtils::error("sequence " + MstUtils::toString(numSeqs + 1) + " in " + seqFile + " has " + MstUtils::toString(seq.size()) + " residues, but the table has " + MstUtils::toString(L) + " sites", "EnergyTable::readSolutions");
+    for (int si = 0; si < L; si++) {
+      res_t r = letterIdx[(unsigned char) seq[si]];
+      int a = ((r >= 0) && (r < alphaIdx[si].size())) ? alphaIdx[si][r] : -1;
+      if (a < 0) MstUtils::error("residue '" + seq.substr(si, 1) + "' of sequence " + MstUtils::toString(numSeqs + 1) + " in " + seqFile + " is not in the alphabet of site " + sites[si], "EnergyTable::readSolutions");
+      sols.push_back(a);
+    }
+    numSeqs++;
+  };
+
+  fstream file;
+  MstUtils::openFile(file, seqFile, fstream::in, "EnergyTable::readSolutions");
+  string line, seq;
+  bool fasta = false, first = true;
+  int numHeaders = 0;
+  while (getline(file, line)) {
+    line = MstUtils::trim(line);
+    if (line.empty()) continue;
+    if (first) { fasta = (line[0] == '>'); first = false; }
+    if (!fasta) {
+      addSequence(line);
+    } else if (line[0] == '>') {
+      if (numHeaders > 0) addSequence(seq);
+      seq.clear();
+      numHeaders++;
+      if (names != NULL) names->push_back(MstUtils::trim(line.substr(1)));
+    } else {
+      seq += line; // sequences can span multiple lines
+    }
+  }
+  if (numHeaders > 0) addSequence(seq);
+  file.close();
+  return sols;
+}
+
 mstreal EnergyTable::scoreMutation(const vector<int>& sol, int mutSite, int mutAA) {
   if (sol.size() != selfE.size()) MstUtils::error("wild-type solution of wrong length for table", "EnergyTable::scoreMutation(const vector<int>&, int, const string&)");
   if ((mutSite < 0) || (mutSite >= selfE.size())) MstUtils::error("mutation site index out of range for table", "EnergyTable::scoreMutation(const vector<int>&, int, const string&)");
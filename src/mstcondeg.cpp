@@ -84,6 +84,22 @@ ConFind::~ConFind() {
   }
 }
 
+size_t ConFind::memoryFootprint() const {
+  size_t bytes = sizeof(ConFind) + backbone.capacity() * sizeof(Atom*) + ca.capacity() * sizeof(Atom*);
+  if (bbNN != NULL) bytes += bbNN->memoryFootprint();
+  if (caNN != NULL) bytes += caNN->memoryFootprint();
+  bytes += MstUtils::heapBytes(permanentContacts) + MstUtils::heapBytes(fractionPruned) + MstUtils::heapBytes(freedom) +
+           MstUtils::heapBytes(numLibraryRotamers) + MstUtils::heapBytes(survivingRotamers) + MstUtils::heapBytes(collProb) +
+           MstUtils::heapBytes(rotamerHeavySC) + MstUtils::heapBytes(interference) + MstUtils::heapBytes(updateCollProb);
+  for (auto it = survivingRotamers.begin(); it != survivingRotamers.end(); ++it) bytes += it->second.size() * sizeof(rotamerID);
+  for (auto res_it = rotamerHeavySC.begin(); res_it != rotamerHeavySC.end(); ++res_it) {
+    for (auto aa_it = res_it->second.begin(); aa_it != res_it->second.end(); ++aa_it) {
+      if (aa_it->second != NULL) bytes += aa_it->second->memoryFootprint() + aa_it->second->pointSize() * sizeof(rotamerID*);
+    }
+  }
+  return bytes;
+}
+
 void ConFind::init(const Structure& S) {
   AtomPointerVector atoms = S.getAtoms();
   for (int i = 0; i < atoms.size(); i++) {
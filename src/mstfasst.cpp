@@ -189,24 +189,54 @@ bool fasstSearchOptions::validateSearchRequest(int numQuerySegs) const {
 }
 
 /* --------- FASST --------- */
-FASST::FASST() {
+FASST::FASST(const shared_ptr<targetSet>& data) : targetData(data), targetStructs(data->targetStructs), targets(data->targets),
+  targSeqs(data->targSeqs), targAAPositions(data->targAAPositions), targetSource(data->targetSource), targetChainLen(data->targetChainLen),
+  resProperties(data->resProperties), resStringProperties(data->resStringProperties), resPairBoolProperties(data->resPairBoolProperties),
+  resPairProperties(data->resPairProperties), resRelProperties(data->resRelProperties), tr(data->tr), xlo(data->xlo), ylo(data->ylo),
+  zlo(data->zlo), xhi(data->xhi), yhi(data->yhi), zhi(data->zhi), distSigs(data->distSigs), dihedralCodes(data->dihedralCodes),
+  coordPrec(data->coordPrec), compactCoords(data->compactCoords) {
+}
+
+FASST::FASST() : FASST(make_shared<targetSet>()) {
   recLevel = 0;
   opts.setRMSDCutoff(1.0);
   setSearchType(searchType::FULLBB);
   querySize = 0;
   updateGrids = false;
   gridSpacing = 15.0;
+  distSigSpan = 12;
+  distSigStep = 0.2;
+  useDistSigs = true;
+  dihedralBins = 12;
+  coordPrec = coordPrecision::DOUBLE;
+}
+
+FASST::FASST(const FASST* F) : FASST(F->targetData) {
+  recLevel = 0;
+  opts = F->opts;
+  setSearchType(F->type);
+  querySize = 0;
+  updateGrids = true;
+  gridSpacing = F->gridSpacing;
+  distSigSpan = F->distSigSpan;
+  distSigStep = F->distSigStep;
+  useDistSigs = F->useDistSigs;
+  dihedralBins = F->dihedralBins;
+  summarySample = F->summarySample;
 }
 
 FASST::~FASST() {
   // need to delete atoms only on the lowest level of recursion, because at
   // higher levels we point to the same atoms
   if (targetMasks.size()) targetMasks.back().deletePointers();
+  for (int i = 0; i < ps.size(); i++) delete ps[i];
+}
+
+FASST::targetSet::~targetSet() {
   for (int i = 0; i < targetStructs.size(); i++) {
     if (targetStructs[i]) delete targetStructs[i];
     else targets[i].deletePointers();
   }
-  for (int i = 0; i < ps.size(); i++) delete ps[i];
 }
 
 void FASST::setCurrentRMSDCutoff(mstreal cut, int p) {
@@ -269,13 +299,50 @@ void FASST::processQuery() {
   }
   currAlignment.resize(query.size(), -1);
 
-  // re-order query segments by length (longest first)
+  // re-order query segments by length (longest first); search() may re-order
+  // them again based on the database summary, if there is one
   queryOrig = query;
-  qSegOrd.resize(query.size());
-  for (int i = 0; i < qSegOrd.size(); i++) qSegOrd[i] = i;
-  sort(qSegOrd.begin(), qSegOrd.end(), [this](size_t i, size_t j) {return query[i].size() > query[j].size();});
+  vector<int> order(query.size());
+  for (int i = 0; i < order.size(); i++) order[i] = i;
+  sort(order.begin(), order.end(), [this](size_t i, size_t j) {return query[i].size() > query[j].size();});
+  setQuerySegmentOrder(order);
+  summaryEstimates.clear();
+  updateGrids = true;
+
+  // set gap constraints structure
+  opts.resetGapConstraints(query.size());
+  opts.resetDiffChainConstraints(query.size());
+}
+
+void FASST::setQuerySegmentOrder(const vector<int>& order) {
+  qSegOrd = order;
   for (int i = 0; i < qSegOrd.size(); i++) query[i] = queryOrig[qSegOrd[i]];
 
+  // CA-CA distances within each segment, for comparing with target signatures
+  queryCADists.resize(query.size());
+  for (int i = 0; i < query.size(); i++) {
+    int n = atomToResIdx(query[i].size());
+    queryCADists[i].assign(n*distSigSpan, 0);
+    if (caAtomIdx < 0) continue;
+    for (int ri = 0; ri < n; ri++) {
+      for (int k = 1; (k <= distSigSpan) && (ri + k < n); k++) {
+        queryCADists[i][ri*distSigSpan + k - 1] = query[i][resToAtomIdx(ri) + caAtomIdx]->distance(query[i][resToAtomIdx(ri + k) + caAtomIdx]);
+      }
+    }
+  }
+
+  // backbone dihedrals of each segment, for the dihedral filter
+  queryDihedrals.resize(query.size());
+  for (int i = 0; i < query.size(); i++) {
+    vector<mstreal> phi, psi;
+    backboneDihedrals(query[i], phi, psi);
+    queryDihedrals[i].resize(2*phi.size());
+    for (int ri = 0; ri < phi.size(); ri++) {
+      queryDihedrals[i][2*ri] = phi[ri];
+      queryDihedrals[i][2*ri + 1] = psi[ri];
+    }
+  }
+
   // the distance from the centroid of each segment and the centroid of the
   // previous segments considered together
   centToCentDist.resize(query.size());
@@ -285,7 +352,7 @@ void FASST::processQuery() {
     CartesianPoint ci = query[L].getGeometricCenter();
     int n = query[L].size();
     C = (C*N + ci*n)/(N + n);
-    centToCentDist[L].resize(n);
+    centToCentDist[L].resize(query.size());
     for (int i = L + 1; i < query.size(); i++) {
       centToCentDist[L][i] = C.distance(query[i].getGeometricCenter());
     }
@@ -301,11 +368,25 @@ void FASST::processQuery() {
       }
     }
   }
-  updateGrids = true;
 
-  // set gap constraints structure
-  opts.resetGapConstraints(query.size());
-  opts.resetDiffChainConstraints(query.size());
+  // centered coordinates of segments and masks, for residuals from compact copies
+  auto center = [](AtomPointerVector& atoms, vector<mstreal>& xyz, mstreal& G) {
+    CartesianPoint c = atoms.getGeometricCenter();
+    xyz.resize(3*atoms.size());
+    G = 0;
+    for (int k = 0; k < atoms.size(); k++) {
+      for (int d = 0; d < 3; d++) {
+        xyz[3*k + d] = (*atoms[k])[d] - c[d];
+        G += xyz[3*k + d]*xyz[3*k + d];
+      }
+    }
+  };
+  querySegCentered.resize(query.size()); querySegG.resize(query.size());
+  queryMaskCentered.resize(query.size()); queryMaskG.resize(query.size());
+  for (int i = 0; i < query.size(); i++) {
+    center(query[i], querySegCentered[i], querySegG[i]);
+    center(queryMasks[i], queryMaskCentered[i], queryMaskG[i]);
+  }
 }
 
 AtomPointerVector FASST::getQuerySearchedAtoms() const {
@@ -337,6 +418,10 @@ void FASST::addTargetStructure(Structure* targetStruct, short memSave) {
   targetStructs.push_back(targetStruct);
   targets.push_back(AtomPointerVector());
   targSeqs.push_back(Sequence());
+  distSigs.push_back(vector<unsigned char>());
+  dihedralCodes.push_back(vector<unsigned char>());
+  compactCoords.push_back(compactTarget());
+  targAAPositions.push_back(vector<vector<uint64_t> >());
   AtomPointerVector& target = targets.back();
   Sequence& seq = targSeqs.back();
   // we don't care about the chain topology of the target, so append all residues
@@ -375,6 +460,48 @@ void FASST::addTargetStructure(Structure* targetStruct, short memSave) {
     targetStructs.back() = NULL;
     delete targetStruct;
   }
+  buildCompactCoords(targets.size() - 1);
+  buildAminoAcidPositions(targets.size() - 1);
+}
+
+void FASST::buildAminoAcidPositions(int ti) {
+  const Sequence& seq = targSeqs[ti];
+  vector<vector<uint64_t> >& pos = targAAPositions[ti];
+  pos.clear();
+  int W = (seq.length() + 63)/64;
+  for (int k = 0; k < seq.length(); k++) {
+    res_t a = seq[k];
+    if (a < 0) continue;
+    if (a >= pos.size()) pos.resize(a + 1);
+    if (pos[a].empty()) pos[a].resize(W, 0);
+    pos[a][k/64] |= uint64_t(1) << (k % 64);
+  }
+}
+
+bool FASST::evalSequenceConstraints(int ti) {
+  fasstSeqConst* seqConst = opts.getSequenceConstraints();
+  int numRes = targSeqs[ti].length();
+  seqConstAlignments.resize(query.size());
+  for (int i = 0; i < query.size(); i++) {
+    vector<uint64_t>& allowed = seqConstAlignments[i];
+    allowed.clear();
+    if (!seqConst->isSegmentConstrained(qSegOrd[i])) continue;
+    int Na = numRes - atomToResIdx(query[i].size()) + 1;
+    if (Na <= 0) return false;
+    allowed.resize((Na + 63)/64, ~uint64_t(0));
+    if (Na % 64) allowed.back() = (uint64_t(1) << (Na % 64)) - 1;
+    if (!seqConst->evalConstraintBits(qSegOrd[i], targAAPositions[ti], allowed)) {
+      vector<bool> ok(Na);
+      seqConst->evalConstraint(qSegOrd[i], targSeqs[ti], ok);
+      for (int j = 0; j < Na; j++) {
+        if (!ok[j]) allowed[j/64] &= ~(uint64_t(1) << (j % 64));
+      }
+    }
+    bool any = false;
+    for (int w = 0; w < allowed.size(); w++) any = any || allowed[w];
+    if (!any) return false;
+  }
+  return true;
 }
 
 void FASST::addTargets(const vector<string>& pdbFiles, short memSave) {
@@ -433,7 +560,7 @@ map<int, vector<FASST::resAddress>> FASST::getResidueRelationships(int ti, const
   int beg = relMap.getLowerBound(resAddress(ti, 0));
   for (int i = beg; i < relMap.size(); i++) {
     resAddress ri = relMap.key(i);
-    if (ri.targIndex() != ti) break;
+    if (ri.targIndex() != (unsigned int) ti) break;
     ret[ri.resIndex()] = relMap.value(i);
   }
   return ret;
@@ -494,7 +621,7 @@ map<int, mstreal> FASST::getResiduePairProperties(int ti, const string& propType
 
 void FASST::writeDatabase(const string& dbFile) {
   fstream ofs; MstUtils::openFile(ofs, dbFile, fstream::out | fstream::binary, "FASST::writeDatabase");
-  MstUtils::writeBin(ofs, 'V'); MstUtils::writeBin(ofs, (int) 1); // format version
+  MstUtils::writeBin(ofs, 'V'); MstUtils::writeBin(ofs, (int) 2); // format version
   for (int ti = 0; ti < targetStructs.size(); ti++) {
     if (targetStructs[ti] == NULL) MstUtils::error("cannot write a database, in which full structures are not populated", "FASST::writeDatabase");
     MstUtils::writeBin(ofs, 'S'); // marks the start of a structure section
@@ -522,7 +649,7 @@ void FASST::writeDatabase(const string& dbFile) {
         map<int, set<int>> &vals = (p->second)[ti];
         MstUtils::writeBin(ofs, 'B'); // marks the start of a residue pair bool property section
         MstUtils::writeBin(ofs, (string)p->first);
-        MstUtils::assert(targetStructs[ti]->residueSize() == vals.size(), "the number of residue pair bool properties and residues does not agree for database entry", "FASST::writeDatabase(const string&)");
+        MstUtils::assertCond(targetStructs[ti]->residueSize() == vals.size(), "the number of residue pair bool properties and residues does not agree for database entry", "FASST::writeDatabase(const string&)");
         MstUtils::writeBin(ofs, (int)vals.size());
         for (auto i = vals.begin(); i != vals.end(); ++i) {
           MstUtils::writeBin(ofs, (int)i->first);
@@ -549,6 +676,17 @@ void FASST::writeDatabase(const string& dbFile) {
         }
       }
     }
+    if (!distSigs[ti].empty()) {
+      MstUtils::writeBin(ofs, 'D'); // marks the start of an intra-distance signature section
+      MstUtils::writeBin(ofs, (int) distSigSpan);
+      MstUtils::writeBin(ofs, (mstreal) distSigStep);
+      MstUtils::writeBin(ofs, distSigs[ti]);
+    }
+    if (!dihedralCodes[ti].empty()) {
+      MstUtils::writeBin(ofs, 'A'); // marks the start of a backbone dihedral class section
+      MstUtils::writeBin(ofs, (int) dihedralBins);
+      MstUtils::writeBin(ofs, dihedralCodes[ti]);
+    }
   }
 
   // in the new version, we write all pair relation properties at the end
@@ -558,13 +696,14 @@ void FASST::writeDatabase(const string& dbFile) {
     MstUtils::writeBin(ofs, (string) p->first);
     MstUtils::writeBin(ofs, (int) resRelProperty.size());
     for (int i = 0; i < resRelProperty.size(); i++) {
-      MstUtils::writeBin(ofs, resRelProperty.key(i).targIndex());  // ti
-      MstUtils::writeBin(ofs, resRelProperty.key(i).resIndex()); // ri
+      // since version 2, target indices are 32 bit (residue indices remain 16 bit)
+      MstUtils::writeBin(ofs, (unsigned int) resRelProperty.key(i).targIndex());  // ti
+      MstUtils::writeBin(ofs, (unsigned short) resRelProperty.key(i).resIndex()); // ri
       tightvector<resAddress>& relatedList = resRelProperty.value(i);
       MstUtils::writeBin(ofs, (int) relatedList.size());
       for (int j = 0; j < relatedList.size(); j++) {
-        MstUtils::writeBin(ofs, relatedList[j].targIndex());  // tj
-        MstUtils::writeBin(ofs, relatedList[j].resIndex()); // rj
+        MstUtils::writeBin(ofs, (unsigned int) relatedList[j].targIndex());  // tj
+        MstUtils::writeBin(ofs, (unsigned short) relatedList[j].resIndex()); // rj
       }
     }
   }
@@ -572,10 +711,32 @@ void FASST::writeDatabase(const string& dbFile) {
 }
 
 void FASST::readDatabase(const string& dbFile, short memSave) {
+  if (!isDatabaseManifest(dbFile)) {
+    readDatabaseSegment(dbFile, memSave, vector<int>());
+    return;
+  }
+  segmentManifest M; M.read(dbFile);
+  int off = 0; // logical index of the first target in the current segment
+  for (int s = 0; s < M.files.size(); s++) {
+    vector<int> skip;
+    for (auto it = M.deleted.lower_bound(off); (it != M.deleted.end()) && (*it < off + M.sizes[s]); ++it) skip.push_back(*it - off);
+    int n = readDatabaseSegment(M.path(s), memSave, skip);
+    if (n != M.sizes[s]) MstUtils::error("segment " + M.path(s) + " has " + MstUtils::toString(n) + " targets, but manifest " + dbFile + " lists " + MstUtils::toString(M.sizes[s]), "FASST::readDatabase(const string&)");
+    off += n;
+  }
+}
+
+int FASST::readDatabaseSegment(const string& dbFile, short memSave, const vector<int>& skip) {
   fstream ifs; MstUtils::openFile(ifs, dbFile, fstream::in | fstream::binary, "FASST::readDatabase");
   char sect; string name; mstreal val; string sval;
   int ver = 0;
-  int ti = numTargets();
+  int t0 = numTargets(), ti = t0, tl = 0; // ti is the index of the current target once read, tl its index within this file
+  // maps indices within the file onto indices of read targets (-1 for skipped ones)
+  auto readIndex = [&](int l) {
+    auto it = lower_bound(skip.begin(), skip.end(), l);
+    if ((it != skip.end()) && (*it == l)) return -1;
+    return t0 + l - (int) (it - skip.begin());
+  };
   MstUtils::readBin(ifs, sect);
   if (sect == 'V') {
     MstUtils::readBin(ifs, ver);
@@ -586,32 +747,37 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
     Structure* targetStruct = new Structure();
     streampos loc = ifs.tellg();
     targetStruct->readData(ifs);
-    targetSource.push_back(targetInfo(dbFile, targetFileType::BINDATABASE, loc, memSave));
     int L = targetStruct->residueSize();
-    addTargetStructure(targetStruct, memSave);
+    bool keep = (readIndex(tl) >= 0);
+    if (keep) {
+      targetSource.push_back(targetInfo(dbFile, targetFileType::BINDATABASE, loc, memSave));
+      addTargetStructure(targetStruct, memSave);
+    } else {
+      delete targetStruct;
+    }
+    // sections of skipped targets are read all the same, to get past them
     while (ifs.peek() != EOF) {
       MstUtils::readBin(ifs, sect);
       if (sect == 'P') {
         MstUtils::readBin(ifs, name);
-        vector<mstreal>& vals = resProperties[name][ti];
-        vals.resize(L, 0);
+        vector<mstreal> vals(L, 0);
         for (int i = 0; i < L; i++) {
           MstUtils::readBin(ifs, val);
           vals[i] = val;
         }
+        if (keep) resProperties[name][ti] = vals;
       } else if (sect == 'N') {
         MstUtils::readBin(ifs, name);
-        vector<string>& vals = resStringProperties[name][ti];
-        vals.resize(L);
+        vector<string> vals(L);
         for (int i = 0; i < L; i++) {
           MstUtils::readBin(ifs, sval);
           vals[i] = sval;
         }
+        if (keep) resStringProperties[name][ti] = vals;
       } else if (sect == 'B') {
         MstUtils::readBin(ifs, name);
-        map<int, set<int>> &vals = resPairBoolProperties[name][ti];
+        map<int, set<int>> vals;
         int ri, rj, N, n;
-        mstreal cd;
         MstUtils::readBin(ifs, N);
         for (int i = 0; i < N; i++) {
           MstUtils::readBin(ifs, ri);
@@ -621,9 +787,10 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
             vals[ri].insert(rj);
           }
         }
+        if (keep) resPairBoolProperties[name][ti] = vals;
       } else if (sect == 'I') {
         MstUtils::readBin(ifs, name);
-        map<int, map<int, mstreal> >& vals = resPairProperties[name][ti];
+        map<int, map<int, mstreal> > vals;
         int ri, rj, N, n; mstreal cd;
         MstUtils::readBin(ifs, N);
         for (int i = 0; i < N; i++) {
@@ -635,7 +802,26 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
             vals[ri][rj] = cd;
           }
         }
+        if (keep) resPairProperties[name][ti] = vals;
+      } else if (sect == 'D') {
+        int span; mstreal step; vector<unsigned char> sig;
+        MstUtils::readBin(ifs, span);
+        MstUtils::readBin(ifs, step);
+        MstUtils::readBin(ifs, sig);
+        // signatures computed with different parameters, or over a different set
+        // of searchable residues (e.g., for another search type), are not usable
+        if (keep && (span == distSigSpan) && (step == distSigStep) && (sig.size() == atomToResIdx(targets[ti].size())*distSigSpan)) {
+          distSigs[ti] = sig;
+        }
+      } else if (sect == 'A') {
+        int bins; vector<unsigned char> codes;
+        MstUtils::readBin(ifs, bins);
+        MstUtils::readBin(ifs, codes);
+        if (keep && (bins == dihedralBins) && (codes.size() == atomToResIdx(targets[ti].size()))) dihedralCodes[ti] = codes;
       } else if (sect == 'R') {
+        // target indices in relations refer to targets of this file, so are
+        // renumbered as targets are read; relations involving skipped targets
+        // are dropped
         MstUtils::readBin(ifs, name);
         simpleMap<resAddress, tightvector<resAddress>>& resRelProperty = resRelProperties[name];
         switch (ver) {
@@ -644,37 +830,54 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
             MstUtils::readBin(ifs, N);
             for (int i = 0; i < N; i++) {
               MstUtils::readBin(ifs, tj);
+              tj = readIndex(tj);
               MstUtils::readBin(ifs, n1);
               for (int j = 0; j < n1; j++) {
                 MstUtils::readBin(ifs, ri);
                 MstUtils::readBin(ifs, n2);
-                tightvector<resAddress>& relatedList = resRelProperty[resAddress(ti, ri)];
-                int off = relatedList.size();
-                relatedList.resize(off + n2);
+                bool use = keep && (tj >= 0);
+                tightvector<resAddress>* relatedList = use ? &(resRelProperty[resAddress(ti, ri)]) : NULL;
+                int off = use ? relatedList->size() : 0;
+                if (use) relatedList->resize(off + n2);
                 for (int k = 0; k < n2; k++) {
                   MstUtils::readBin(ifs, rj);
-                  relatedList[off + k] = resAddress(tj, rj);
+                  if (use) (*relatedList)[off + k] = resAddress(tj, rj);
                 }
               }
             }
             break;
           }
-          case 1: {
-            // in the new version, we read them all at once
+          case 1:
+          case 2: {
+            // in the new version, we read them all at once; version 1 databases
+            // store 16-bit target indices, and are converted upon reading (writing
+            // the database back out upgrades it to the current version)
             resAddress ri, rj; int N, n;
+            unsigned short t16, r16; unsigned int t32;
+            auto readAddress = [&](resAddress& addr) {
+              int t;
+              if (ver == 1) { MstUtils::readBin(ifs, t16); t = t16; }
+              else { MstUtils::readBin(ifs, t32); t = t32; }
+              MstUtils::readBin(ifs, r16);
+              t = readIndex(t);
+              if (t < 0) return false;
+              addr.setTargIndex(t); addr.setResIndex(r16);
+              return true;
+            };
+            vector<resAddress> related;
             MstUtils::readBin(ifs, N);
             for (int i = 0; i < N; i++) {
-              MstUtils::readBin(ifs, ri.targIndex());
-              MstUtils::readBin(ifs, ri.resIndex());
-              tightvector<resAddress>& relatedList = resRelProperty[ri];
+              bool use = readAddress(ri);
               MstUtils::readBin(ifs, n);
-              int off = relatedList.size();
-              relatedList.resize(off + n);
+              related.resize(0);
               for (int j = 0; j < n; j++) {
-                MstUtils::readBin(ifs, rj.targIndex());
-                MstUtils::readBin(ifs, rj.resIndex());
-                relatedList[off + j] = rj;
+                if (readAddress(rj)) related.push_back(rj);
               }
+              if (!use) continue;
+              tightvector<resAddress>& relatedList = resRelProperty[ri];
+              int off = relatedList.size();
+              relatedList.resize(off + related.size());
+              for (int j = 0; j < related.size(); j++) relatedList[off + j] = related[j];
             }
             break;
           }
@@ -687,9 +890,104 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
         MstUtils::error("unknown section type" + MstUtils::toString(sect) + ", while reading database file " + dbFile, "FASST::readDatabase(const string&)");
       }
     }
-    ti++;
+    if (keep) ti++;
+    tl++;
   }
   ifs.close();
+  return tl;
+}
+
+bool FASST::isDatabaseManifest(const string& file) {
+  fstream ifs; MstUtils::openFile(ifs, file, fstream::in | fstream::binary, "FASST::isDatabaseManifest");
+  string header = "FASST database manifest", line(header.size(), ' ');
+  ifs.read(&line[0], header.size());
+  return ifs && (line == header);
+}
+
+void FASST::appendDatabaseSegment(const string& manifestFile, const string& segmentFile) {
+  segmentManifest M;
+  ifstream test(manifestFile.c_str());
+  if (test.good()) M.read(manifestFile);
+  else M.create(manifestFile);
+  test.close();
+  M.addSegment(segmentFile);
+  M.write(manifestFile);
+}
+
+void FASST::deleteDatabaseTargets(const string& manifestFile, const vector<int>& logicalIndices) {
+  segmentManifest M; M.read(manifestFile);
+  for (int i = 0; i < logicalIndices.size(); i++) {
+    if ((logicalIndices[i] < 0) || (logicalIndices[i] >= M.numTargets())) MstUtils::error("target index " + MstUtils::toString(logicalIndices[i]) + " out of range for manifest " + manifestFile, "FASST::deleteDatabaseTargets");
+    M.deleted.insert(logicalIndices[i]);
+  }
+  M.write(manifestFile);
+}
+
+void FASST::compactDatabase(const string& manifestFile, const string& dbFile) {
+  FASST S;
+  S.readDatabase(manifestFile);
+  S.writeDatabase(dbFile);
+}
+
+/* --------- FASST::segmentManifest --------- */
+void FASST::segmentManifest::create(const string& manifestFile) {
+  dir = manifestFile.substr(0, manifestFile.rfind('/') + 1);
+  files.clear(); sizes.clear(); deleted.clear();
+}
+
+void FASST::segmentManifest::read(const string& manifestFile) {
+  dir = manifestFile.substr(0, manifestFile.rfind('/') + 1);
+  files.clear(); sizes.clear(); deleted.clear();
+  vector<string> lines = MstUtils::fileToArray(manifestFile);
+  if (lines.empty() || (MstUtils::trim(lines[0]) != "FASST database manifest")) MstUtils::error("not a database manifest: " + manifestFile, "FASST::segmentManifest::read");
+  for (int i = 1; i < lines.size(); i++) {
+    vector<string> toks = MstUtils::split(MstUtils::trim(lines[i]));
+    if (toks.empty() || toks[0].empty() || (toks[0][0] == '#')) continue;
+    if ((toks[0] == "segment") && (toks.size() == 3)) {
+      files.push_back(toks[1]);
+      sizes.push_back(MstUtils::toInt(toks[2]));
+    } else if ((toks[0] == "delete") && (toks.size() == 2)) {
+      deleted.insert(MstUtils::toInt(toks[1]));
+    } else {
+      MstUtils::error("could not parse line '" + lines[i] + "' of manifest " + manifestFile, "FASST::segmentManifest::read");
+    }
+  }
+}
+
+void FASST::segmentManifest::write(const string& manifestFile) const {
+  // write a new copy and then replace the old one, so readers never see a partial manifest
+  string tmpFile = manifestFile + ".tmp";
+  fstream ofs; MstUtils::openFile(ofs, tmpFile, fstream::out, "FASST::segmentManifest::write");
+  ofs << "FASST database manifest" << endl;
+  for (int s = 0; s < files.size(); s++) ofs << "segment " << files[s] << " " << sizes[s] << endl;
+  for (int t : deleted) ofs << "delete " << t << endl;
+  ofs.close();
+  if (rename(tmpFile.c_str(), manifestFile.c_str()) != 0) MstUtils::error("could not replace manifest " + manifestFile, "FASST::segmentManifest::write");
+}
+
+void FASST::segmentManifest::addSegment(const string& segmentFile) {
+  // store the path relative to the manifest, if it is inside the manifest's directory
+  string path = segmentFile;
+  if (!dir.empty() && (path.compare(0, dir.size(), dir) == 0)) {
+    path = path.substr(dir.size());
+  } else if ((path[0] != '/') && !dir.empty()) {
+    MstUtils::error("relative segment paths must be within the directory of the manifest, or be given as absolute paths: " + segmentFile, "FASST::segmentManifest::addSegment");
+  }
+  // the segment is counted by reading it, which costs as much as the segment (not the database)
+  FASST S; S.setSearchType(searchType::CA);
+  S.readDatabase(segmentFile, 1);
+  files.push_back(path);
+  sizes.push_back(S.numTargets());
+}
+
+string FASST::segmentManifest::path(int s) const {
+  return (files[s][0] == '/') ? files[s] : dir + files[s];
+}
+
+int FASST::segmentManifest::numTargets() const {
+  int n = 0;
+  for (int s = 0; s < sizes.size(); s++) n += sizes[s];
+  return n;
 }
 
 void FASST::setSearchType(searchType _searchType) {
@@ -705,6 +1003,13 @@ void FASST::setSearchType(searchType _searchType) {
       MstUtils::error("uknown search type '" + MstUtils::toString(type) + "' specified", "FASST::setSearchType");
   }
   atomsPerRes = searchableAtomTypes.size();
+  caAtomIdx = nAtomIdx = cAtomIdx = -1;
+  for (int k = 0; k < searchableAtomTypes.size(); k++) {
+    const vector<string>& names = searchableAtomTypes[k];
+    if (find(names.begin(), names.end(), "CA") != names.end()) caAtomIdx = k;
+    if (find(names.begin(), names.end(), "N") != names.end()) nAtomIdx = k;
+    if (find(names.begin(), names.end(), "C") != names.end()) cAtomIdx = k;
+  }
 }
 
 void FASST::stripSidechains(Structure& S) {
@@ -714,14 +1019,16 @@ void FASST::stripSidechains(Structure& S) {
 }
 
 void FASST::rebuildProximityGrids() {
-  if (xlo == xhi) { xlo -= gridSpacing/2; xhi += gridSpacing/2; }
-  if (ylo == yhi) { ylo -= gridSpacing/2; yhi += gridSpacing/2; }
-  if (zlo == zhi) { zlo -= gridSpacing/2; zhi += gridSpacing/2; }
-  int N = int(ceil(max(max((xhi - xlo), (yhi - ylo)), (zhi - zlo))/gridSpacing));
+  // the bounding box may be shared with other objects, so pad a local copy
+  mstreal _xlo = xlo, _ylo = ylo, _zlo = zlo, _xhi = xhi, _yhi = yhi, _zhi = zhi;
+  if (_xlo == _xhi) { _xlo -= gridSpacing/2; _xhi += gridSpacing/2; }
+  if (_ylo == _yhi) { _ylo -= gridSpacing/2; _yhi += gridSpacing/2; }
+  if (_zlo == _zhi) { _zlo -= gridSpacing/2; _zhi += gridSpacing/2; }
+  int N = int(ceil(max(max((_xhi - _xlo), (_yhi - _ylo)), (_zhi - _zlo))/gridSpacing));
   for (int i = 0; i < ps.size(); i++) delete(ps[i]);
   ps.clear(); ps.resize(query.size(), NULL);
   for (int i = 0; i < query.size(); i++) {
-    ps[i] = new ProximitySearch(xlo, ylo, zlo, xhi, yhi, zhi, N);
+    ps[i] = new ProximitySearch(_xlo, _ylo, _zlo, _xhi, _yhi, _zhi, N);
   }
   updateGrids = false;
 }
@@ -740,6 +1047,14 @@ void FASST::prepForSearch(int ti) {
   mstreal xc, yc, zc;
   segmentResiduals.resize(query.size());
   vector<vector<bool> > okAlignments(query.size());
+  // no full solution can have a residual below the sum of the best residuals of
+  // its individual segments, so any alignment of segment i whose residual (or
+  // a lower bound on it) is above the cutoff minus the best residuals of other
+  // segments can never be part of a solution
+  bool useSigs = useDistSigs && !distSigs[ti].empty() && (residualCut < INFINITY);
+  bool useDihedrals = opts.isDihedralFilterSet() && !dihedralCodes[ti].empty();
+  bool compact = (coordPrec != coordPrecision::DOUBLE);
+  mstreal minResidualSum = 0;
   for (int i = 0; i < query.size(); i++) {
     bool seqConst = options().sequenceConstraintsSet() && options().getSequenceConstraints()->isSegmentConstrained(qSegOrd[i]);
     ps[i]->dropAllPoints();
@@ -749,28 +1064,55 @@ void FASST::prepForSearch(int ti) {
     // get sorted to the bottom of the options list before they are removed
     segmentResiduals[i].resize(MstUtils::max(Na, 0), 9999.0);
     if (seqConst) {
+      // evaluated by evalSequenceConstraints before getting here
       okAlignments[i].resize(segmentResiduals[i].size());
-      options().getSequenceConstraints()->evalConstraint(qSegOrd[i], targSeqs[ti], okAlignments[i]);
+      const vector<uint64_t>& allowed = seqConstAlignments[i];
+      for (int j = 0; j < Na; j++) okAlignments[i][j] = (allowed[j/64] >> (j % 64)) & 1;
     }
+    bool filter = useSigs || useDihedrals;
+    if (filter && okAlignments[i].empty()) okAlignments[i].resize(segmentResiduals[i].size(), true);
+    mstreal budget = residualCut - minResidualSum, minResidual = INFINITY;
     AtomPointerVector targSeg(query[i].size(), NULL);
+    int segLen = seg.size();
+    mstreal cen[3];
     for (int j = 0; j < Na; j++) {
-      if (seqConst && !okAlignments[i][j]) { // save on calculating RMSDs for disallowed segment alignments
+      if ((seqConst || filter) && !okAlignments[i][j]) { // save on calculating RMSDs for disallowed segment alignments
         if (query.size() > 1) ps[i]->addPoint(0, 0, 0, j); // add a dummy point, so point indexing is preserved
         continue;
       }
+      stats.numWindows++;
+      if (filter) {
+        if (useDihedrals && !dihedralsCompatible(i, j)) {
+          stats.numDihedralPruned++;
+          okAlignments[i][j] = false;
+        } else if (useSigs && (segmentResidualLowerBound(i, j, budget) > budget)) {
+          stats.numSigPruned++;
+          okAlignments[i][j] = false;
+        }
+        if (!okAlignments[i][j]) {
+          if (query.size() > 1) ps[i]->addPoint(0, 0, 0, j);
+          continue;
+        }
+      }
       // NOTE: can save on this in several ways:
       // 1. the centroid calculation is effectively already done inside RMSDCalculator::bestRMSD
       // 2. updating just one atom involves a simple centroid adjustment, rather than recalculation
       // 3. is there a speedup to be gained from re-calculating RMSD with one atom updated only?
       int off = resToAtomIdx(j);
-      for (int k = 0; k < query[i].size(); k++) targSeg[k] = target[off + k];
-      // AtomPointerVector targSeg = target.subvector(resToAtomIdx(j), resToAtomIdx(j) + query[i].size());
-      segmentResiduals[i][j] = RC.bestResidual(query[i], targSeg);
-      if (query.size() > 1) {
-        targSeg.getGeometricCenter(xc, yc, zc);
-        ps[i]->addPoint(xc, yc, zc, j);
+      if (compact) {
+        segmentResiduals[i][j] = compactResidualBound(compactResidual(querySegCentered[i].data(), querySegG[i], &off, &segLen, 1, cen), segLen);
+        xc = cen[0]; yc = cen[1]; zc = cen[2];
+      } else {
+        for (int k = 0; k < query[i].size(); k++) targSeg[k] = target[off + k];
+        // AtomPointerVector targSeg = target.subvector(resToAtomIdx(j), resToAtomIdx(j) + query[i].size());
+        segmentResiduals[i][j] = RC.bestResidual(query[i], targSeg);
+        if (query.size() > 1) targSeg.getGeometricCenter(xc, yc, zc);
       }
+      minResidual = MstUtils::min(minResidual, segmentResiduals[i][j]);
+      if (query.size() > 1) ps[i]->addPoint(xc, yc, zc, j);
     }
+    // skipped alignments will not be options, so cannot contribute to solutions
+    minResidualSum += minResidual;
   }
 
   // initialize remOptions; all options are available at top level
@@ -837,6 +1179,328 @@ void FASST::fillTargetChainInfo(int ti) {
   }
 }
 
+void FASST::computeDistanceSignatures() {
+  if (caAtomIdx < 0) MstUtils::error("distance signatures require CA atoms to be searchable", "FASST::computeDistanceSignatures");
+  for (int ti = 0; ti < targets.size(); ti++) {
+    if (distSigs[ti].empty()) computeDistanceSignature(ti);
+  }
+}
+
+void FASST::computeDistanceSignature(int ti) {
+  AtomPointerVector& target = targets[ti];
+  int N = atomToResIdx(target.size());
+  vector<unsigned char>& sig = distSigs[ti];
+  sig.assign(N*distSigSpan, 0);
+  for (int ri = 0; ri < N; ri++) {
+    Atom* ai = target[resToAtomIdx(ri) + caAtomIdx];
+    for (int k = 1; (k <= distSigSpan) && (ri + k < N); k++) {
+      int bin = (int) floor(ai->distance(target[resToAtomIdx(ri + k) + caAtomIdx]) / distSigStep);
+      sig[ri*distSigSpan + k - 1] = (unsigned char) MstUtils::min(bin, 255);
+    }
+  }
+}
+
+void FASST::computeDihedralClasses() {
+  if ((nAtomIdx < 0) || (caAtomIdx < 0) || (cAtomIdx < 0)) MstUtils::error("dihedral classes require N, CA, and C atoms to be searchable", "FASST::computeDihedralClasses");
+  for (int ti = 0; ti < targets.size(); ti++) {
+    if (dihedralCodes[ti].empty()) computeDihedralClass(ti);
+  }
+}
+
+void FASST::computeDihedralClass(int ti) {
+  vector<mstreal> phi, psi;
+  backboneDihedrals(targets[ti], phi, psi);
+  vector<unsigned char>& codes = dihedralCodes[ti];
+  codes.resize(phi.size());
+  mstreal binWidth = 360.0/dihedralBins;
+  auto bin = [&](mstreal ang) { return isnan(ang) ? dihedralBins : ((int) floor((ang + 180)/binWidth)) % dihedralBins; };
+  for (int ri = 0; ri < phi.size(); ri++) codes[ri] = bin(phi[ri])*(dihedralBins + 1) + bin(psi[ri]);
+}
+
+void FASST::backboneDihedrals(const AtomPointerVector& atoms, vector<mstreal>& phi, vector<mstreal>& psi) const {
+  int N = atomToResIdx(atoms.size());
+  phi.assign(N, NAN); psi.assign(N, NAN);
+  if ((nAtomIdx < 0) || (caAtomIdx < 0) || (cAtomIdx < 0)) return;
+  mstreal maxPeptideBond = 2.0; // beyond this, consecutive residues are not bonded
+  for (int ri = 0; ri < N; ri++) {
+    Atom* n = atoms[resToAtomIdx(ri) + nAtomIdx];
+    Atom* ca = atoms[resToAtomIdx(ri) + caAtomIdx];
+    Atom* c = atoms[resToAtomIdx(ri) + cAtomIdx];
+    if (ri > 0) {
+      Atom* cPrev = atoms[resToAtomIdx(ri - 1) + cAtomIdx];
+      if (cPrev->distance(n) <= maxPeptideBond) phi[ri] = cPrev->dihedral(n, ca, c);
+    }
+    if (ri < N - 1) {
+      Atom* nNext = atoms[resToAtomIdx(ri + 1) + nAtomIdx];
+      if (c->distance(nNext) <= maxPeptideBond) psi[ri] = n->dihedral(ca, c, nNext);
+    }
+  }
+}
+
+void FASST::prepDihedralFilter() {
+  mstreal margin = opts.getDihedralFilterMargin(), binWidth = 360.0/dihedralBins;
+  // is the angle within margin of the given bin? (undefined angles and bins are always compatible)
+  auto compatible = [&](mstreal ang, int b) {
+    if (isnan(ang) || (b == dihedralBins)) return true;
+    mstreal off = fmod(ang - (-180 + b*binWidth) + 720, 360); // how far past the start of the bin
+    if (off < binWidth) return true;
+    return MstUtils::min(off - binWidth, 360 - off) <= margin;
+  };
+  queryDihedralOK.resize(query.size());
+  for (int i = 0; i < query.size(); i++) {
+    int n = atomToResIdx(query[i].size());
+    queryDihedralOK[i].assign(n, bitset<256>());
+    for (int ri = 0; ri < n; ri++) {
+      for (int pb = 0; pb <= dihedralBins; pb++) {
+        if (!compatible(queryDihedrals[i][2*ri], pb)) continue;
+        for (int sb = 0; sb <= dihedralBins; sb++) {
+          if (compatible(queryDihedrals[i][2*ri + 1], sb)) queryDihedralOK[i][ri].set(pb*(dihedralBins + 1) + sb);
+        }
+      }
+    }
+  }
+}
+
+bool FASST::dihedralsCompatible(int i, int j) {
+  const unsigned char* codes = dihedralCodes[currentTarget].data() + j;
+  const vector<bitset<256> >& ok = queryDihedralOK[i];
+  int numBad = 0, maxBad = opts.getDihedralFilterMismatches();
+  for (int ri = 0; ri < ok.size(); ri++) {
+    if (!ok[ri][codes[ri]] && (++numBad > maxBad)) return false;
+  }
+  return true;
+}
+
+void FASST::setCompactFilter(coordPrecision prec) {
+  if (prec == coordPrec) return;
+  coordPrec = prec;
+  for (int ti = 0; ti < targets.size(); ti++) buildCompactCoords(ti);
+}
+
+size_t FASST::memoryFootprint(map<string, size_t>* breakdown) const {
+  size_t structs = MstUtils::heapBytes(targetStructs) + MstUtils::heapBytes(targets) + MstUtils::heapBytes(tr) + MstUtils::heapBytes(targetSource);
+  size_t seqs = MstUtils::heapBytes(targAAPositions) + MstUtils::heapBytes(targetChainLen) + MstUtils::heapBytes(targChainBeg) + MstUtils::heapBytes(targChainEnd);
+  for (int ti = 0; ti < targetStructs.size(); ti++) {
+    structs += targets[ti].capacity() * sizeof(Atom*) + MstUtils::heapBytes(targetSource[ti].file);
+    if (targetStructs[ti] != NULL) {
+      structs += targetStructs[ti]->memoryFootprint();
+    } else {
+      // atoms of targets not retained in full are owned by targets[ti]
+      for (int ai = 0; ai < targets[ti].size(); ai++) structs += targets[ti][ai]->memoryFootprint();
+    }
+    seqs += sizeof(Sequence) + targSeqs[ti].length() * sizeof(res_t);
+  }
+  size_t props = MstUtils::heapBytes(resProperties) + MstUtils::heapBytes(resStringProperties) + MstUtils::heapBytes(resPairBoolProperties) +
+                 MstUtils::heapBytes(resPairProperties) + MstUtils::heapBytes(resRelProperties);
+  size_t filters = MstUtils::heapBytes(distSigs) + MstUtils::heapBytes(dihedralCodes) + MstUtils::heapBytes(compactCoords) + compactCoordinateBytes();
+  if (breakdown != NULL) {
+    (*breakdown)["structures"] = structs;
+    (*breakdown)["sequences"] = seqs;
+    (*breakdown)["properties"] = props;
+    (*breakdown)["filters"] = filters;
+  }
+  return structs + seqs + props + filters;
+}
+
+size_t FASST::compactCoordinateBytes() const {
+  size_t bytes = 0;
+  for (int ti = 0; ti < compactCoords.size(); ti++) {
+    bytes += compactCoords[ti].xyz.capacity()*sizeof(float) + compactCoords[ti].qxyz.capacity()*sizeof(unsigned short);
+  }
+  return bytes;
+}
+
+void FASST::buildCompactCoords(int ti) {
+  compactTarget& C = compactCoords[ti];
+  C = compactTarget();
+  C.maxErr = 0;
+  if (coordPrec == coordPrecision::DOUBLE) return;
+  AtomPointerVector& target = targets[ti];
+  int N = target.size();
+  vector<mstreal> xyz(3*N);
+  for (int k = 0; k < N; k++) {
+    xyz[3*k] = target[k]->getX(); xyz[3*k + 1] = target[k]->getY(); xyz[3*k + 2] = target[k]->getZ();
+  }
+  vector<mstreal> stored(3*N);
+  if (coordPrec == coordPrecision::FLOAT32) {
+    C.xyz.resize(3*N);
+    for (int k = 0; k < 3*N; k++) { C.xyz[k] = xyz[k]; stored[k] = C.xyz[k]; }
+  } else {
+    const mstreal maxq = 65535;
+    C.qxyz.resize(3*N);
+    for (int d = 0; d < 3; d++) {
+      mstreal lo = INFINITY, hi = -INFINITY;
+      for (int k = 0; k < N; k++) { lo = MstUtils::min(lo, xyz[3*k + d]); hi = MstUtils::max(hi, xyz[3*k + d]); }
+      C.origin[d] = lo;
+      C.step[d] = (hi > lo) ? (hi - lo)/maxq : 1.0;
+    }
+    for (int k = 0; k < 3*N; k++) {
+      int d = k % 3;
+      mstreal q = MstUtils::max(MstUtils::min(round((xyz[k] - C.origin[d])/C.step[d]), maxq), 0.0);
+      C.qxyz[k] = (unsigned short) q;
+      stored[k] = C.origin[d] + C.qxyz[k]*C.step[d];
+    }
+  }
+  // the error is measured rather than derived, so it is exact for the data
+  for (int k = 0; k < N; k++) {
+    mstreal dx = stored[3*k] - xyz[3*k], dy = stored[3*k + 1] - xyz[3*k + 1], dz = stored[3*k + 2] - xyz[3*k + 2];
+    C.maxErr = MstUtils::max(C.maxErr, sqrt(dx*dx + dy*dy + dz*dz));
+  }
+}
+
+template <class T>
+mstreal FASST::compactResidual(const T* xyz, const mstreal* qc, mstreal qG, const int* offs, const int* lens, int numRuns, mstreal* cen) const {
+  // stored values relate to coordinates by x = origin + value * scale, so centered
+  // coordinates are scaled differences of stored values
+  const compactTarget& C = compactCoords[currentTarget];
+  bool fixed = (coordPrec == coordPrecision::FIXED16);
+  mstreal origin[3], scale[3], mean[3] = {0, 0, 0};
+  for (int d = 0; d < 3; d++) { origin[d] = fixed ? C.origin[d] : 0; scale[d] = fixed ? C.step[d] : 1; }
+  int n = 0;
+  for (int r = 0; r < numRuns; r++) {
+    const T* p = xyz + 3*offs[r];
+    for (int k = 0; k < 3*lens[r]; k += 3) { mean[0] += p[k]; mean[1] += p[k + 1]; mean[2] += p[k + 2]; }
+    n += lens[r];
+  }
+  for (int d = 0; d < 3; d++) mean[d] /= n;
+  if (cen != NULL) {
+    for (int d = 0; d < 3; d++) cen[d] = origin[d] + mean[d]*scale[d];
+  }
+
+  // covariance with the query points (see RMSDCalculator::qcpRMSD)
+  mstreal S[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}}, tG = 0;
+  const mstreal* q = qc;
+  for (int r = 0; r < numRuns; r++) {
+    const T* p = xyz + 3*offs[r];
+    for (int k = 0; k < 3*lens[r]; k += 3, q += 3) {
+      mstreal bx = (p[k] - mean[0])*scale[0], by = (p[k + 1] - mean[1])*scale[1], bz = (p[k + 2] - mean[2])*scale[2];
+      tG += bx*bx + by*by + bz*bz;
+      S[0][0] += bx*q[0]; S[0][1] += bx*q[1]; S[0][2] += bx*q[2];
+      S[1][0] += by*q[0]; S[1][1] += by*q[1]; S[1][2] += by*q[2];
+      S[2][0] += bz*q[0]; S[2][1] += bz*q[1]; S[2][2] += bz*q[2];
+    }
+  }
+  // Newton-Raphson approaches the eigenvalue from above, so any error in it
+  // only makes the residual smaller
+  return MstUtils::max(qG + tG - 2*RMSDCalculator::qcpLargestEigenvalue(S, (qG + tG)/2), 0.0);
+}
+
+mstreal FASST::compactResidual(const mstreal* qc, mstreal qG, const int* offs, const int* lens, int numRuns, mstreal* cen) const {
+  const compactTarget& C = compactCoords[currentTarget];
+  if (coordPrec == coordPrecision::FLOAT32) return compactResidual(C.xyz.data(), qc, qG, offs, lens, numRuns, cen);
+  return compactResidual(C.qxyz.data(), qc, qG, offs, lens, numRuns, cen);
+}
+
+/* The root of the residual of the optimal superposition is a minimum, over all
+ * rigid-body transforms, of the Frobenius norm of the difference of the two
+ * coordinate sets, so moving each of numAtoms target atoms by at most maxErr can
+ * change it by at most sqrt(numAtoms)*maxErr. A small relative slack absorbs
+ * round-off in the superposition itself. */
+mstreal FASST::compactResidualBound(mstreal residual, int numAtoms) const {
+  mstreal r = sqrt(MstUtils::max(residual, 0.0))*(1 - 10E-10) - sqrt(numAtoms)*compactCoords[currentTarget].maxErr;
+  return (r > 0) ? r*r : 0;
+}
+
+void FASST::buildDatabaseSummary(int numSamples, int seed) {
+  summarySample.clear();
+  summaryEstimates.clear();
+  vector<long> cumRes(targets.size() + 1, 0);
+  for (int ti = 0; ti < targets.size(); ti++) cumRes[ti + 1] = cumRes[ti] + atomToResIdx(targets[ti].size());
+  if (cumRes.back() == 0) return;
+  mt19937 rng(seed);
+  uniform_int_distribution<long> dist(0, cumRes.back() - 1);
+  summarySample.resize(numSamples);
+  for (int k = 0; k < numSamples; k++) {
+    long r = dist(rng);
+    int ti = upper_bound(cumRes.begin(), cumRes.end(), r) - cumRes.begin() - 1;
+    summarySample[k] = resAddress(ti, r - cumRes[ti]);
+  }
+  sort(summarySample.begin(), summarySample.end()); // visits targets in order when estimating
+}
+
+vector<mstreal> FASST::estimateSegmentCandidates(mstreal rmsdCutoff) {
+  // a segment placed first can use up the residual budget of the whole query,
+  // so its candidates are the windows with a residual below that budget
+  vector<mstreal> est(queryOrig.size(), 0);
+  mstreal budget = rmsdCutoff*rmsdCutoff*querySize;
+  RMSDCalculator rc;
+  for (int i = 0; i < queryOrig.size(); i++) {
+    const AtomPointerVector& seg = queryOrig[i];
+    int L = atomToResIdx(seg.size());
+    long numWindows = 0;
+    for (int ti = 0; ti < targets.size(); ti++) numWindows += MstUtils::max(atomToResIdx(targets[ti].size()) - L + 1, 0);
+    // fraction of sampled windows within the budget (with a pseudocount, so
+    // that segments with no sampled hits are still ordered among themselves)
+    int numTried = 0, numHits = 0;
+    AtomPointerVector win(seg.size(), NULL);
+    for (int k = 0; k < summarySample.size(); k++) {
+      int ti = summarySample[k].targIndex(), ri = summarySample[k].resIndex();
+      AtomPointerVector& target = targets[ti];
+      if (resToAtomIdx(ri) + seg.size() > target.size()) continue;
+      for (int a = 0; a < seg.size(); a++) win[a] = target[resToAtomIdx(ri) + a];
+      numTried++;
+      if (rc.bestResidual(seg, win) <= budget) numHits++;
+    }
+    est[i] = numWindows * (numHits + 0.5)/(numTried + 1.0);
+  }
+  return est;
+}
+
+void FASST::orderSegmentsBySummary() {
+  mstreal cut = opts.getRMSDCutoff();
+  if (summaryEstimates.empty() || (summaryCut != cut)) {
+    summaryEstimates = estimateSegmentCandidates(cut);
+    summaryCut = cut;
+  }
+  // the segment placed first determines the width of the first level of the
+  // tree, so segments with fewer first-level candidates go first. Estimates
+  // within a factor of two are considered equal (given sampling noise), and
+  // then the longer segment goes first, as its residual grows the bound faster.
+  // A segment longer than every target has no windows (an estimate of zero),
+  // and goes first of all, as the search then ends right away.
+  vector<int> order(queryOrig.size()), estClass(queryOrig.size());
+  for (int i = 0; i < order.size(); i++) {
+    order[i] = i;
+    estClass[i] = (summaryEstimates[i] > 0) ? (int) floor(log2(summaryEstimates[i])) : numeric_limits<int>::min();
+  }
+  stable_sort(order.begin(), order.end(), [&](int i, int j) {
+    if (estClass[i] != estClass[j]) return estClass[i] < estClass[j];
+    return queryOrig[i].size() > queryOrig[j].size();
+  });
+  if (order != qSegOrd) setQuerySegmentOrder(order);
+}
+
+/* Under the optimal superposition of segment i onto the target window starting
+ * at residue j, let e_x be the deviation of the CA atom of residue x. For any two
+ * residues x and y, the triangle inequality gives e_x + e_y >= |dq(x, y) - dt(x, y)|
+ * (the difference between the CA-CA distances in the query and the target), so
+ * e_x^2 + e_y^2 >= (dq(x, y) - dt(x, y))^2 / 2. Summing over a set of disjoint
+ * pairs bounds the residual of CA atoms, and thus of the whole segment. For each
+ * sequence separation k, the pairs (x, x + k) form two such sets (alternating
+ * along each chain x, x + k, x + 2k, ...), and the best of all is taken. Target
+ * distances are only known up to their quantization bin, which is accounted for.
+ * Larger separations tend to be more discriminating, so they are tried first and
+ * the calculation stops as soon as the bound exceeds the given cap. */
+mstreal FASST::segmentResidualLowerBound(int i, int j, mstreal cap) {
+  const unsigned char* sig = distSigs[currentTarget].data() + j*distSigSpan;
+  const mstreal* qd = queryCADists[i].data();
+  int n = atomToResIdx(query[i].size());
+  mstreal bound = 0, tol = 10E-6;
+  for (int k = MstUtils::min(distSigSpan, n - 1); k > 0; k--) {
+    mstreal sums[2] = {0, 0};
+    for (int x = 0; x + k < n; x++) {
+      int idx = x*distSigSpan + k - 1;
+      mstreal lo = sig[idx]*distSigStep - tol;
+      mstreal hi = (sig[idx] == 255) ? INFINITY : (sig[idx] + 1)*distSigStep + tol;
+      mstreal dev = (qd[idx] < lo) ? lo - qd[idx] : ((qd[idx] > hi) ? qd[idx] - hi : 0);
+      sums[(x/k) % 2] += dev*dev;
+    }
+    bound = MstUtils::max(bound, MstUtils::max(sums[0], sums[1])/2);
+    if (bound > cap) break;
+  }
+  return bound;
+}
+
 mstreal FASST::boundOnRemainder(bool compute) {
   if (compute) {
     currRemBound = 0;
@@ -848,7 +1512,10 @@ mstreal FASST::boundOnRemainder(bool compute) {
 mstreal FASST::centToCentTol(int i) {
   mstreal remRes = residualCut - currResidual - currRemBound;
   if (remRes < 0) return -1.0;
-  return sqrt((remRes * (queryMasks[recLevel].size() + query[i].size())) / (queryMasks[recLevel].size() * query[i].size()));
+  mstreal tol = sqrt((remRes * (queryMasks[recLevel].size() + query[i].size())) / (queryMasks[recLevel].size() * query[i].size()));
+  // centroids from compact coordinates can each be off by as much as the atoms
+  if (coordPrec != coordPrecision::DOUBLE) tol += 2*compactCoords[currentTarget].maxErr;
+  return tol;
 }
 
 fasstSolutionSet FASST::search() {
@@ -856,16 +1523,26 @@ fasstSolutionSet FASST::search() {
   // int prepTime = 0;
   int numSegs = query.size();
   opts.validateSearchRequest(numSegs);
+  if (hasDatabaseSummary() && (numSegs > 1)) orderSegmentsBySummary();
   if (opts.isMinNumMatchesSet()) setCurrentRMSDCutoff(INFINITY);
   else setCurrentRMSDCutoff(opts.getRMSDCutoff());
   solutions.init(numSegs);
   bool redSet = opts.isRedundancyCutSet() || opts.isRedundancyPropertySet();
+  bool useHeap = opts.isMaxNumMatchesSet() && !redSet && !opts.isMinNumMatchesSet();
+  if (useHeap) solHeap.init(numSegs, opts.getMaxNumMatches());
   bool doRedBar = redSet && (numSegs > 1); // should we apply special "barrier" RMSD cutoffs to partial matches that are
                                            // already known to be redundant to something in the current list of solutions?
   vector<int> segLen(numSegs); // number of residues in each query segment
   for (int i = 0; i < numSegs; i++) segLen[i] = atomToResIdx(query[i].size());
   vector<mstreal> ccTol(numSegs, -1.0);
+  stats.reset();
+  if (opts.isDihedralFilterSet()) prepDihedralFilter();
   for (currentTarget = 0; currentTarget < targets.size(); currentTarget++) {
+    // targets where some segment has nowhere to go by sequence are not worth preparing
+    if (opts.sequenceConstraintsSet() && !evalSequenceConstraints(currentTarget)) {
+      stats.numSeqSkipped++;
+      continue;
+    }
     // auto beginPrep = chrono::high_resolution_clock::now();
     if (doRedBar) {
       resetCurrentRMSDCutoff(); // if it was previously temporarily set
@@ -891,6 +1568,7 @@ fasstSolutionSet FASST::search() {
       }
       currAlignment[recLevel] = remOptions[recLevel][recLevel].bestChoice();
       remOptions[recLevel][recLevel].removeOption(currAlignment[recLevel]);
+      stats.numNodes++;
 
       // if redundancy removal is set, and there are matches in the current list
       // of solutions that are redundant with the current partial solution, any
@@ -927,7 +1605,10 @@ fasstSolutionSet FASST::search() {
           // all alignments that overlap with the segments that was just placed
           remOptions[nextLevel][i].removeOptions(currAlignment[recLevel] - segLen[i] + 1,
                                                  currAlignment[recLevel] + segLen[recLevel] - 1);
+          // bestCost() of an empty list is 0, so it would not show up in bounds
+          if (remOptions[nextLevel][i].empty()) levelExhausted = true;
         }
+        if (levelExhausted) continue;
         if (opts.gapConstraintsExist() || opts.diffChainsConstsExist()) {
           for (int j = 0; j < nextLevel; j++) {
             for (int i = nextLevel; i < numSegs; i++) {
@@ -1008,6 +1689,23 @@ fasstSolutionSet FASST::search() {
         recLevel = nextLevel;
       } else {
         // if at the lowest recursion level already, then record the solution
+        // (residuals from compact coordinates are only bounds, so verify first)
+        if ((coordPrec != coordPrecision::DOUBLE) && (currentAlignmentResidual(true, true) > residualCut)) {
+          stats.numVerifyRejected++;
+          continue;
+        }
+        if (useHeap) {
+          solHeap.push(currAlignment, qSegOrd, sqrt(currResidual/querySize), currentTarget, currentTransform());
+          if (opts.isSufficientNumMatchesSet() && (solHeap.size() == opts.getSufficientNumMatches())) {
+            solHeap.exportTo(solutions, segLen, qSegOrd);
+            return solutions;
+          }
+          if (solHeap.size() > opts.getMaxNumMatches()) {
+            solHeap.popWorst();
+            setCurrentRMSDCutoff(solHeap.worstRMSD());
+          }
+          continue;
+        }
         fasstSolution sol(currAlignment, sqrt(currResidual/querySize), currentTarget, currentTransform(), segLen, qSegOrd);
         bool inserted = false;
         if (opts.isRedundancyCutSet()) {
@@ -1044,10 +1742,75 @@ fasstSolutionSet FASST::search() {
   // cout << "total time " << searchTime << " ms" << std::endl;
   // cout << "prep time was " << (100.0*prepTime/searchTime) << " % of the total" << std::endl;
 
+  if (useHeap) solHeap.exportTo(solutions, segLen, qSegOrd);
   solutions.clearTempData();
   return solutions;
 }
 
+void FASST::solutionHeap::init(int _numSegs, int capacity) {
+  numSegs = _numSegs;
+  heap.clear(); freeSlots.clear();
+  algn.clear(); rmsds.clear(); targ.clear(); trans.clear();
+  // one more than capacity, as a record is pushed before the worst is evicted
+  heap.reserve(capacity + 1);
+}
+
+bool FASST::solutionHeap::before(int a, int b) const {
+  if (rmsds[a] != rmsds[b]) return rmsds[a] < rmsds[b];
+  if (targ[a] != targ[b]) return targ[a] < targ[b];
+  const int* aa = &algn[a*numSegs];
+  const int* ab = &algn[b*numSegs];
+  for (int k = 0; k < numSegs; k++) {
+    if (aa[k] != ab[k]) return aa[k] < ab[k];
+  }
+  return false;
+}
+
+void FASST::solutionHeap::push(const vector<int>& alignment, const vector<int>& segOrder, mstreal rmsd, int target, const Transform& tr) {
+  int slot;
+  if (!freeSlots.empty()) {
+    slot = freeSlots.back(); freeSlots.pop_back();
+  } else {
+    slot = rmsds.size();
+    rmsds.push_back(0); targ.push_back(0);
+    algn.resize(algn.size() + numSegs);
+    trans.resize(trans.size() + 12);
+  }
+  rmsds[slot] = rmsd; targ[slot] = target;
+  for (int i = 0; i < numSegs; i++) algn[slot*numSegs + segOrder[i]] = alignment[i];
+  mstreal* t = &trans[slot*12];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) t[3*i + j] = tr(i, j);
+    t[9 + i] = tr(i, 3);
+  }
+  heap.push_back(slot);
+  push_heap(heap.begin(), heap.end(), [this](int a, int b) { return before(a, b); });
+}
+
+void FASST::solutionHeap::popWorst() {
+  pop_heap(heap.begin(), heap.end(), [this](int a, int b) { return before(a, b); });
+  freeSlots.push_back(heap.back());
+  heap.pop_back();
+}
+
+void FASST::solutionHeap::exportTo(fasstSolutionSet& sols, const vector<int>& segLen, const vector<int>& segOrder) {
+  vector<int> origLen(numSegs), alignment(numSegs);
+  for (int i = 0; i < numSegs; i++) origLen[segOrder[i]] = segLen[i];
+  for (int h = 0; h < heap.size(); h++) {
+    int slot = heap[h];
+    const mstreal* t = &trans[slot*12];
+    Transform tr;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) tr(i, j) = t[3*i + j];
+      tr(i, 3) = t[9 + i];
+    }
+    for (int i = 0; i < numSegs; i++) alignment[i] = algn[slot*numSegs + i];
+    sols.insert(fasstSolution(alignment, rmsds[slot], targ[slot], tr, origLen));
+  }
+  vector<int>().swap(heap); vector<int>().swap(freeSlots); vector<int>().swap(algn);
+  vector<mstreal>().swap(rmsds); vector<int>().swap(targ); vector<mstreal>().swap(trans);
+}
+
 mstreal FASST::currentAlignmentResidual(bool compute, bool setTransform) {
   if (compute) {
     if ((query.size() == 1) && !setTransform) {
@@ -1062,12 +1825,28 @@ mstreal FASST::currentAlignmentResidual(bool compute, bool setTransform) {
       int n = query[recLevel].size();
       int dN = N - n;
       int currPos = currAlignment[recLevel];
-      int si = resToAtomIdx(currPos);
-      AtomPointerVector& target = targets[currentTarget];
-      for (int i = 0; i < n; i++) {
-        targetMask[dN + i]->setCoor(target[si + i]->getX(), target[si + i]->getY(), target[si + i]->getZ());
+      // transforms are always computed from full-precision coordinates
+      bool compact = (coordPrec != coordPrecision::DOUBLE) && !setTransform;
+      if (compact) {
+        // the target atoms of the mask are not needed
+        vector<int>& offs = compactOffsets; vector<int>& lens = compactLengths;
+        offs.resize(recLevel + 1); lens.resize(recLevel + 1);
+        for (int L = 0; L <= recLevel; L++) { offs[L] = resToAtomIdx(currAlignment[L]); lens[L] = query[L].size(); }
+        currResidual = compactResidual(queryMaskCentered[recLevel].data(), queryMaskG[recLevel], offs.data(), lens.data(), recLevel + 1);
+      } else {
+        // after searching with compact coordinates, the earlier segments of the
+        // mask need to be refilled at full precision as well
+        AtomPointerVector& target = targets[currentTarget];
+        int L0 = (coordPrec == coordPrecision::DOUBLE) ? recLevel : 0;
+        for (int L = L0, k = (L0 == recLevel) ? dN : 0; L <= recLevel; k += query[L].size(), L++) {
+          int sL = resToAtomIdx(currAlignment[L]);
+          for (int i = 0; i < query[L].size(); i++) {
+            targetMask[k + i]->setCoor(target[sL + i]->getX(), target[sL + i]->getY(), target[sL + i]->getZ());
+          }
+        }
+        currResidual = RC.bestResidual(targetMask, queryMask, setTransform);
       }
-      currResidual = RC.bestResidual(targetMask, queryMask, setTransform);
+      if (compact) currResidual = compactResidualBound(currResidual, N);
       currResiduals[recLevel] = currResidual;
       if (query.size() > 1) {
         if (recLevel == 0) {
@@ -1180,6 +1959,84 @@ void FASST::getMatchStructures(fasstSolutionSet& sols, vector<Structure>& matche
   }
 }
 
+fasstMatchView FASST::getMatchView(const fasstSolution& sol, matchType type, bool algn) {
+  int idx = sol.getTargetIndex();
+  if ((idx < 0) || (idx >= targets.size())) {
+    MstUtils::error("supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchView");
+  }
+  fasstMatchView view;
+  view.F = this; view.target = idx; view.type = type; view.algn = algn;
+  view.sol = fasstSolution(sol.getAlignment(), sol.getRMSD(), idx, sol.getTransform(), sol.getSegLengths());
+  if (type == matchType::FULL) {
+    // residue indices in a view are among searchable residues, which may be
+    // fewer than the residues of the full target structure
+    view.resIndices.resize(atomToResIdx(targets[idx].size()));
+    for (int i = 0; i < view.resIndices.size(); i++) view.resIndices[i] = i;
+  } else {
+    view.resIndices = getMatchResidueIndices(sol, type);
+  }
+  // target atoms are stored in the frame of the target's transform (see tr)
+  view.T = algn ? sol.getTransform() : tr[idx].inverse();
+  return view;
+}
+
+void FASST::getMatchViews(fasstSolutionSet& sols, vector<fasstMatchView>& views, matchType type, bool algn) {
+  views.resize(sols.size());
+  for (int i = 0; i < sols.size(); i++) views[i] = getMatchView(sols[i], type, algn);
+}
+
+void FASST::getMatchCoordinates(fasstSolutionSet& sols, vector<mstreal>& xyz, vector<int>& offsets, matchType type, bool algn, int numThreads) {
+  // views are made serially, since indexing into the solution set is not thread safe
+  vector<fasstMatchView> views;
+  getMatchViews(sols, views, type, algn);
+  offsets.resize(views.size() + 1);
+  offsets[0] = 0;
+  for (int i = 0; i < views.size(); i++) offsets[i + 1] = offsets[i] + views[i].numAtoms();
+  xyz.resize(3*offsets.back());
+  MstUtils::parallelFor(0, views.size(), [&](int i, int t) {
+    views[i].getCoordinates(xyz.data() + 3*offsets[i]);
+  }, numThreads, 64);
+}
+
+int fasstMatchView::numAtoms() const {
+  return (F == NULL) ? 0 : resIndices.size() * F->atomsPerRes;
+}
+
+string fasstMatchView::getResidueName(int i) const {
+  return F->targSeqs[target].getResidue(resIndices[i], true);
+}
+
+CartesianPoint fasstMatchView::getAtomCoor(int k) const {
+  int A = F->atomsPerRes;
+  const Atom* a = F->targets[target][F->resToAtomIdx(resIndices[k / A]) + k % A];
+  CartesianPoint p(3, 0.0);
+  for (int d = 0; d < 3; d++) p[d] = T(d, 0) * a->getX() + T(d, 1) * a->getY() + T(d, 2) * a->getZ() + T(d, 3);
+  return p;
+}
+
+void fasstMatchView::getCoordinates(mstreal* xyz) const {
+  if (F == NULL) return;
+  int A = F->atomsPerRes;
+  const AtomPointerVector& atoms = F->targets[target];
+  mstreal R[3][4];
+  for (int d = 0; d < 3; d++) {
+    for (int e = 0; e < 4; e++) R[d][e] = T(d, e);
+  }
+  for (int i = 0; i < resIndices.size(); i++) {
+    int ai = F->resToAtomIdx(resIndices[i]);
+    for (int k = 0; k < A; k++, xyz += 3) {
+      const Atom* a = atoms[ai + k];
+      mstreal x = a->getX(), y = a->getY(), z = a->getZ();
+      for (int d = 0; d < 3; d++) xyz[d] = R[d][0] * x + R[d][1] * y + R[d][2] * z + R[d][3];
+    }
+  }
+}
+
+Structure fasstMatchView::getStructure(bool detailed) {
+  if (F == NULL) MstUtils::error("view does not refer to a match", "fasstMatchView::getStructure");
+  return F->getMatchStructure(sol, detailed, type, algn);
+}
+
 vector<Sequence> FASST::getMatchSequences(fasstSolutionSet& sols, matchType type) {
   vector<Sequence> seqs(sols.size());
   for (int i = 0; i < sols.size(); i++) {
@@ -1478,22 +2335,24 @@ void fasstSolutionAddress::read(istream& _is) {
 
 /* --------- fasstSolutionSet --------- */
 fasstSolutionSet::fasstSolutionSet(const fasstSolutionSet& sols) {
+  useRedIndex = true;
   *this = sols;
 }
 
 fasstSolutionSet::fasstSolutionSet(const fasstSolution& sol) {
-  updated = false;
+  updated = false; useRedIndex = true;
   insert(sol);
 }
 
 fasstSolutionSet::fasstSolutionSet(const vector<fasstSolutionAddress>& addresses, const vector<int>& segLengths) {
-  updated = false;
+  updated = false; useRedIndex = true;
   for (int i = 0; i < addresses.size(); i++) insert(fasstSolution(addresses[i], segLengths));
 }
 
 fasstSolutionSet& fasstSolutionSet::operator=(const fasstSolutionSet& sols) {
   updated = false;
-  solsSet.clear(); solsVec.clear();
+  solsSet.clear(); solsVec.clear(); redIndex.clear();
+  useRedIndex = sols.useRedIndex;
   // NOTE: I currently do not believe that solsByCenRes should be returned to the user,
   // but if I change my mind later, this will need to be uncommented; also see fasstSolutionSet::insert(const fasstSolution&, mstreal)
   // solsByCenRes.resize(sols.solsByCenRes.size());
@@ -1505,51 +2364,42 @@ bool fasstSolutionSet::insert(const fasstSolution& sol, mstreal redundancyCut) {
   // apply a redudancy filter, if needed
   fasstSolution* toRemove = NULL;
   bool algnBarInfoSet = isAlignRedBarrierDataSet();
+  bool indexed = false;
+  redundancyIndex::entry solEntry;
   if ((redundancyCut < 1) && sol.seqContextDefined()) {
-    const vector<Sequence>& segSeqs = sol.segmentSeqs();
-    const vector<Sequence>& nTermPad = sol.nTermContext();
-    const vector<Sequence>& cTermPad = sol.cTermContext();
-    // compare this solution to each previously accepted solution
-    for (auto it = solsSet.begin(); it != solsSet.end(); ++it) {
-      fasstSolution* psol = (fasstSolution*) &(*it);
-      const vector<Sequence>& segSeqsPrev = psol->segmentSeqs();
-      const vector<Sequence>& nTermPadPrev = psol->nTermContext();
-      const vector<Sequence>& cTermPadPrev = psol->cTermContext();
+    // previously accepted solutions to compare against, in the order of the set
+    // (i.e., best RMSD first), which is important for deciding which one trumps
+    vector<const fasstSolution*> cands;
+    bool filtered = false;
+    if (useRedIndex) {
+      if (!redIndex.configuredFor(sol, redundancyCut) || (redIndex.size() != solsSet.size())) rebuildRedundancyIndex(sol, redundancyCut);
+      solEntry = redIndex.pack(sol);
+      filtered = redIndex.candidates(solEntry, cands);
+      indexed = true;
+    }
+    if (filtered) {
+      sort(cands.begin(), cands.end(), [](const fasstSolution* a, const fasstSolution* b) { return *a < *b; });
+      cands.erase(unique(cands.begin(), cands.end()), cands.end());
+    } else {
+      cands.clear(); cands.reserve(solsSet.size());
+      for (auto it = solsSet.begin(); it != solsSet.end(); ++it) cands.push_back(&(*it));
+    }
+
+    // compare this solution to each candidate previously accepted solution
+    for (int ci = 0; ci < cands.size(); ci++) {
+      fasstSolution* psol = (fasstSolution*) cands[ci];
+      const redundancyIndex::entry* pe = indexed ? redIndex.find(psol) : NULL;
+      bool bothClean = solEntry.clean && (pe != NULL) && pe->clean;
       // compare the contexts of each segment:
       for (int i = 0; i < sol.numSegments(); i++) {
-        int numID = 0, numTot = 0;
-        /* The total length of the alignment we want to have, at least some L,
-         * is the length the segment itself, Li, plus whatever extra context
-         * (from either end), if needed, to get to at least L. Since both N- and
-         * C-terminal paddings are of the same length, equal to max(0, L - Li),
-         * by constructoin, we can deduce max(L, Li) as Li + max(0, L - Li). */
-        int contextLength = segSeqs[i].size() + nTermPad[i].size();
-
-        // first the segment itself
-        for (int k = 0; k < segSeqs[i].size(); k++) {
-          numTot++;
-          if (segSeqs[i][k] == segSeqsPrev[i][k]) numID++;
-        }
-
-        // then alternate expanding in C- and N-terminal directions
-        bool nEnd = false, cEnd = false;
-        for (int k = 0; k < nTermPad[i].size(); k++) {
-          cEnd = cEnd || (cTermPad[i][k] == SeqTools::gapIdx()) || (cTermPadPrev[i][k] == SeqTools::gapIdx());
-          if (!cEnd && (cTermPad[i][k] != SeqTools::gapIdx())) {
-            numTot++;
-            if (cTermPad[i][k] == cTermPadPrev[i][k]) numID++;
-          }
-          if (numTot >= contextLength) break;
-          int kn = nTermPad[i].size() - k - 1;
-          nEnd = nEnd || (nTermPad[i][kn] == SeqTools::gapIdx()) || (nTermPadPrev[i][kn] == SeqTools::gapIdx());
-          if ((!nEnd) && (nTermPad[i][kn] != SeqTools::gapIdx())) {
-            numTot++;
-            if (nTermPad[i][kn] == nTermPadPrev[i][kn]) numID++;
-          }
-          if (numTot >= contextLength) break;
-          if (cEnd && nEnd) break;
+        bool redundant;
+        if (bothClean) {
+          int L0 = redIndex.windowLength(i);
+          redundant = isWithinSeqID(L0, redundancyCut, L0, redIndex.windowIdentity(solEntry, *pe, i));
+        } else {
+          redundant = contextsWithinSeqID(sol, *psol, i, redundancyCut);
         }
-        if (isWithinSeqID(contextLength, redundancyCut, numTot, numID)) {
+        if (redundant) {
           // psol and sol are redundant. Which should go?
           if (psol->getRMSD() <= sol.getRMSD()) { // sol got trumped by a better previous solution
             if (algnBarInfoSet && (algnRedBar[i][sol[i]] > psol->getRMSD())) {
@@ -1582,6 +2432,7 @@ bool fasstSolutionSet::insert(const fasstSolution& sol, mstreal redundancyCut) {
     erase(*toRemove);
   }
   pair<set<fasstSolution>::iterator, bool> ins = solsSet.insert(sol);
+  if (indexed && ins.second) redIndex.add(&(*(ins.first)), solEntry);
   // NOTE: I currently do not believe that solsByCenRes should be returned to the user,
   // but if I change my mind later, this will need to be uncommented; also see fasstSolutionSet::operator=
   // fasstSolution* inserted = (fasstSolution*) &(*(ins.first));
@@ -1590,6 +2441,165 @@ bool fasstSolutionSet::insert(const fasstSolution& sol, mstreal redundancyCut) {
   return true;
 }
 
+bool fasstSolutionSet::contextsWithinSeqID(const fasstSolution& sol, const fasstSolution& psol, int i, mstreal cut) {
+  const vector<Sequence>& segSeqs = sol.segmentSeqs();
+  const vector<Sequence>& nTermPad = sol.nTermContext();
+  const vector<Sequence>& cTermPad = sol.cTermContext();
+  const vector<Sequence>& segSeqsPrev = psol.segmentSeqs();
+  const vector<Sequence>& nTermPadPrev = psol.nTermContext();
+  const vector<Sequence>& cTermPadPrev = psol.cTermContext();
+  int numID = 0, numTot = 0;
+  /* The total length of the alignment we want to have, at least some L,
+   * is the length the segment itself, Li, plus whatever extra context
+   * (from either end), if needed, to get to at least L. Since both N- and
+   * C-terminal paddings are of the same length, equal to max(0, L - Li),
+   * by constructoin, we can deduce max(L, Li) as Li + max(0, L - Li). */
+  int contextLength = segSeqs[i].size() + nTermPad[i].size();
+
+  // first the segment itself
+  for (int k = 0; k < segSeqs[i].size(); k++) {
+    numTot++;
+    if (segSeqs[i][k] == segSeqsPrev[i][k]) numID++;
+  }
+
+  // then alternate expanding in C- and N-terminal directions
+  bool nEnd = false, cEnd = false;
+  for (int k = 0; k < nTermPad[i].size(); k++) {
+    cEnd = cEnd || (cTermPad[i][k] == SeqTools::gapIdx()) || (cTermPadPrev[i][k] == SeqTools::gapIdx());
+    if (!cEnd && (cTermPad[i][k] != SeqTools::gapIdx())) {
+      numTot++;
+      if (cTermPad[i][k] == cTermPadPrev[i][k]) numID++;
+    }
+    if (numTot >= contextLength) break;
+    int kn = nTermPad[i].size() - k - 1;
+    nEnd = nEnd || (nTermPad[i][kn] == SeqTools::gapIdx()) || (nTermPadPrev[i][kn] == SeqTools::gapIdx());
+    if ((!nEnd) && (nTermPad[i][kn] != SeqTools::gapIdx())) {
+      numTot++;
+      if (nTermPad[i][kn] == nTermPadPrev[i][kn]) numID++;
+    }
+    if (numTot >= contextLength) break;
+    if (cEnd && nEnd) break;
+  }
+  return isWithinSeqID(contextLength, cut, numTot, numID);
+}
+
+void fasstSolutionSet::rebuildRedundancyIndex(const fasstSolution& sol, mstreal cut) {
+  redIndex.clear();
+  redIndex.configure(sol, cut);
+  for (auto it = solsSet.begin(); it != solsSet.end(); ++it) redIndex.add(&(*it), redIndex.pack(*it));
+}
+
+bool fasstSolutionSet::redundancyIndex::configuredFor(const fasstSolution& sol, mstreal _cut) const {
+  if ((_cut != cut) || (segLen.size() != sol.numSegments())) return false;
+  const vector<Sequence>& segSeqs = sol.segmentSeqs();
+  const vector<Sequence>& nTermPad = sol.nTermContext();
+  for (int i = 0; i < segLen.size(); i++) {
+    if ((segSeqs[i].size() != segLen[i]) || (nTermPad[i].size() != padLen[i])) return false;
+  }
+  return true;
+}
+
+void fasstSolutionSet::redundancyIndex::configure(const fasstSolution& sol, mstreal _cut) {
+  cut = _cut;
+  int n = sol.numSegments();
+  segLen.resize(n); padLen.resize(n); winOff.resize(n); numBlocks.resize(n);
+  int off = 0;
+  for (int i = 0; i < n; i++) {
+    segLen[i] = sol.segmentSeqs()[i].size();
+    padLen[i] = sol.nTermContext()[i].size();
+    winOff[i] = off;
+    int L0 = windowLength(i);
+    off += L0;
+    // two gap-free contexts within the cutoff differ in at most maxMis window
+    // positions (the small tolerance only makes the index more permissive)
+    int maxMis = (int) floor(L0*(1 - cut) + 1E-6);
+    numBlocks[i] = (maxMis + 1 <= L0) ? maxMis + 1 : 0;
+  }
+}
+
+fasstSolutionSet::redundancyIndex::entry fasstSolutionSet::redundancyIndex::pack(const fasstSolution& sol) const {
+  entry e;
+  e.clean = sol.seqContextDefined() && (sol.numSegments() == segLen.size());
+  if (!e.clean) return e;
+  const vector<Sequence>& segSeqs = sol.segmentSeqs();
+  const vector<Sequence>& nTermPad = sol.nTermContext();
+  const vector<Sequence>& cTermPad = sol.cTermContext();
+  int n = segLen.size();
+  if (n > 0) e.win.resize(winOff[n-1] + windowLength(n-1));
+  for (int i = 0; (i < n) && e.clean; i++) {
+    if ((segSeqs[i].size() != segLen[i]) || (nTermPad[i].size() != padLen[i]) || (cTermPad[i].size() != padLen[i])) { e.clean = false; break; }
+    unsigned char* w = e.win.data() + winOff[i];
+    int k = 0;
+    for (int j = 0; j < segLen[i]; j++, k++) {
+      res_t aa = segSeqs[i][j];
+      if ((aa < -1) || (aa > 254)) { e.clean = false; break; }
+      w[k] = (unsigned char) (aa + 1);
+    }
+    // padding in the order in which it is consumed: C0, N(P-1), C1, N(P-2), ...
+    for (int j = 0; (j < padLen[i]) && e.clean; j++, k++) {
+      res_t aa = (j % 2 == 0) ? cTermPad[i][j/2] : nTermPad[i][padLen[i] - j/2 - 1];
+      if ((aa == SeqTools::gapIdx()) || (aa < -1) || (aa > 254)) { e.clean = false; break; }
+      w[k] = (unsigned char) (aa + 1);
+    }
+  }
+  if (!e.clean) { e.win.clear(); return e; }
+
+  // FNV-1a hash of each block, along with which segment and block it is
+  for (int i = 0; i < n; i++) {
+    int L0 = windowLength(i);
+    for (int b = 0; b < numBlocks[i]; b++) {
+      uint64_t h = 14695981039346656037ULL;
+      auto mix = [&h](uint64_t byte) { h ^= byte; h *= 1099511628211ULL; };
+      mix(i & 0xFF); mix((i >> 8) & 0xFF); mix(b & 0xFF); mix((b >> 8) & 0xFF);
+      for (int k = b*L0/numBlocks[i]; k < (b+1)*L0/numBlocks[i]; k++) mix(e.win[winOff[i] + k]);
+      e.keys.push_back(h);
+    }
+  }
+  return e;
+}
+
+void fasstSolutionSet::redundancyIndex::add(const fasstSolution* sol, const entry& e) {
+  if (entries.find(sol) != entries.end()) remove(sol);
+  entries[sol] = e;
+  if (!e.clean) { unclean.insert(sol); return; }
+  for (int k = 0; k < e.keys.size(); k++) buckets[e.keys[k]].push_back(sol);
+}
+
+void fasstSolutionSet::redundancyIndex::remove(const fasstSolution* sol) {
+  auto it = entries.find(sol);
+  if (it == entries.end()) return;
+  const entry& e = it->second;
+  if (!e.clean) unclean.erase(sol);
+  for (int k = 0; k < e.keys.size(); k++) {
+    auto bit = buckets.find(e.keys[k]);
+    if (bit == buckets.end()) continue;
+    vector<const fasstSolution*>& bucket = bit->second;
+    for (int j = 0; j < bucket.size(); j++) {
+      if (bucket[j] == sol) { bucket[j] = bucket.back(); bucket.pop_back(); break; }
+    }
+    if (bucket.empty()) buckets.erase(bit);
+  }
+  entries.erase(it);
+}
+
+const fasstSolutionSet::redundancyIndex::entry* fasstSolutionSet::redundancyIndex::find(const fasstSolution* sol) const {
+  auto it = entries.find(sol);
+  return (it == entries.end()) ? NULL : &(it->second);
+}
+
+bool fasstSolutionSet::redundancyIndex::candidates(const entry& e, vector<const fasstSolution*>& cands) const {
+  if (!e.clean) return false;
+  for (int i = 0; i < numBlocks.size(); i++) {
+    if (numBlocks[i] == 0) return false;
+  }
+  for (int k = 0; k < e.keys.size(); k++) {
+    auto bit = buckets.find(e.keys[k]);
+    if (bit != buckets.end()) cands.insert(cands.end(), bit->second.begin(), bit->second.end());
+  }
+  cands.insert(cands.end(), unclean.begin(), unclean.end());
+  return true;
+}
+
 bool fasstSolutionSet::insert(const fasstSolution& sol, simpleMap<resAddress, tightvector<resAddress>>& relMap) {
   // apply a redudancy filter based on a pre-computed map of inter-residue relationships
   fasstSolution* toRemove = NULL;
@@ -1651,6 +2661,10 @@ void fasstSolutionSet::erase(fasstSolution& sol) {
       if (solsByCenRes[i][sol.segCentralResidue(i)].empty()) solsByCenRes[i].erase(sol.segCentralResidue(i));
     }
   }
+  if (redIndex.size() > 0) {
+    auto it = solsSet.find(sol);
+    if (it != solsSet.end()) redIndex.remove(&(*it));
+  }
   solsSet.erase(sol);
   updated = true;
 }
@@ -1663,6 +2677,7 @@ set<fasstSolution>::iterator fasstSolutionSet::erase(const set<fasstSolution>::i
     solsByCenRes[i][sol.segCentralResidue(i)].erase(&sol);
     if (solsByCenRes[i][sol.segCentralResidue(i)].empty()) solsByCenRes[i].erase(sol.segCentralResidue(i));
   }
+  redIndex.remove(solPtr);
   updated = true;
   return solsSet.erase(it);
 }
@@ -1714,7 +2729,7 @@ void fasstSolutionSet::write(ostream &_os) const {
 void fasstSolutionSet::read(istream &_is) {
   updated = true;
   int len; MstUtils::readBin(_is, len);
-  solsSet.clear();
+  solsSet.clear(); redIndex.clear();
   for (int i = 0; i < len; i++) {
     fasstSolution sol;
     sol.read(_is);
@@ -1740,3 +2755,28 @@ void fasstSeqConstSimple::evalConstraint(int segIdx, const Sequence& target, vec
     alignments[i] = ok;
   }
 }
+
+bool fasstSeqConstSimple::evalConstraintBits(int segIdx, const vector<vector<uint64_t> >& aaPositions, vector<uint64_t>& alignments) {
+  vector<int>& segPositions = positions[segIdx];
+  int W = alignments.size();
+  vector<uint64_t> ok(W);
+  for (int j = 0; j < segPositions.size(); j++) {
+    // alignment i is fine by this position if residue i + p is allowed, so
+    // OR together positions of allowed amino acids, shifted down by p
+    int p = segPositions[j], ws = p / 64, bs = p % 64;
+    fill(ok.begin(), ok.end(), 0);
+    for (auto a = aminoAcids[segIdx][j].begin(); a != aminoAcids[segIdx][j].end(); ++a) {
+      if ((*a < 0) || (*a >= aaPositions.size())) continue;
+      const vector<uint64_t>& pos = aaPositions[*a];
+      for (int w = 0; (w < W) && (w + ws < pos.size()); w++) {
+        uint64_t v = pos[w + ws] >> bs;
+        if (bs && (w + ws + 1 < pos.size())) v |= pos[w + ws + 1] << (64 - bs);
+        ok[w] |= v;
+      }
+    }
+    bool any = false;
+    for (int w = 0; w < W; w++) { alignments[w] &= ok[w]; any = any || alignments[w]; }
+    if (!any) break;
+  }
+  return true;
+}
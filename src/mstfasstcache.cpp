@@ -9,6 +9,7 @@ void cFASST::write(const string& filename) const {
 }
 
 void cFASST::write(ostream &_os) const {
+  lock_guard<mutex> guard(store->lock);
   MstUtils::writeBin(_os, maxNumResults);
   MstUtils::writeBin(_os, errTolPressure);
   MstUtils::writeBin(_os, maxNumPressure);
@@ -26,6 +27,7 @@ void cFASST::read(const string& filename) {
 
 void cFASST::read(istream &_is) { // read object from a binary stream
   clear();
+  lock_guard<mutex> guard(store->lock);
   MstUtils::readBin(_is, maxNumResults);
   MstUtils::readBin(_is, errTolPressure);
   MstUtils::readBin(_is, maxNumPressure);
@@ -45,6 +47,7 @@ vector<int> cFASST::getStructureTopology(const Structure& S) {
 }
 
 void cFASST::clear() {
+  lock_guard<mutex> guard(store->lock);
   for (auto it = cache.begin(); it != cache.end(); ++it) delete(*it);
   cache.clear();
 }
@@ -67,6 +70,10 @@ fasstSolutionSet cFASST::search() {
   string redProp = getRedundancyProperty();
   AtomPointerVector queryAtoms = getQuerySearchedAtoms();
 
+  // the cache may be shared with other objects searching concurrently, so hold
+  // its lock while using it, but not while doing an actual search
+  unique_lock<mutex> guard(store->lock);
+
   /* Old cached results should eventually "expire", so uniformly lower priority
    * slightly first. This way, cached results that have not been used in a while
    * will eventually have a lower priority than brand new searches and these
@@ -177,6 +184,7 @@ fasstSolutionSet cFASST::search() {
       cout << endl << "\tnew pressures/tollerance factors for maxN and RMSD are: " << getMaxNumPressure() << " and " << getErrTolPressure() << " / " << maxNumFactor() << " and " << errTolFactor() << endl;
       begin = chrono::high_resolution_clock::now();
     }
+    guard.unlock();
     // -- loosen search criteria a bit to extract maximal value from search
     if (maxSet) {
       setMaxNumMatches(MstUtils::max(int(maxN*maxNumFactor()), maxN + 1000));
@@ -189,6 +197,7 @@ fasstSolutionSet cFASST::search() {
     matches = ((FASST*) this)->search();
     if (modifyPermission()) {
       if (matches.size() > 0) {
+        guard.lock();
         cachedResult* result = new cachedResult(queryAtoms, matches, getRMSDCutoff(), getMaxNumMatches(), topo);
         cache.insert(result);
         if (isVerbose()) {
@@ -201,6 +210,7 @@ fasstSolutionSet cFASST::search() {
           delete(*leastUseful);
           cache.erase(leastUseful); // bump off the least used cached result if reached limit
         }
+        guard.unlock();
       }
     }
 
@@ -249,6 +259,7 @@ fasstSolutionSet cFASST::search() {
     cache.erase(bestComp);
     result->upPriority();
     cache.insert(result);
+    guard.unlock();
     if (isVerbose()) {
       cout << "\tdone upping priority" << std::endl;
       cout << "\tSUCCEEDED, NO need to search!!!" << endl;
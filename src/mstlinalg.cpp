@@ -1,87 +1,82 @@
 #include "mstlinalg.h"
+#include <stdlib.h>
 
 using namespace MST;
 
 /* --------- Matrix --------- */
 
-Matrix::~Matrix() {
-  if (own) clear();
+void Matrix::allocate(int rows, int cols) {
+  if ((rows < 0) || (cols < 0)) MstUtils::error("invalid dimensions specified: " + MstUtils::toString(rows) + " x " + MstUtils::toString(cols), "Matrix::allocate");
+  nr = rows; nc = cols; stride = cols; view = false;
+  size_t n = MstUtils::max((size_t) rows * cols, (size_t) 1);
+  void* mem = NULL;
+  if (posix_memalign(&mem, 64, n * sizeof(mstreal)) != 0) MstUtils::error("could not allocate a " + MstUtils::toString(rows) + " x " + MstUtils::toString(cols) + " matrix", "Matrix::allocate");
+  buffer = shared_ptr<mstreal>((mstreal*) mem, free);
+  data = buffer.get();
 }
 
 Matrix::Matrix(int rows, int cols, mstreal val) {
-  if ((rows < 0) || (cols < 0)) MstUtils::error("invalid dimensions specified: " + MstUtils::toString(rows) + " x " + MstUtils::toString(cols), "Matrix::Matrix");
-  M.resize(rows, vector<mstreal*>(cols, NULL));
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      M[i][j] = new mstreal(val);
-    }
-  }
-  own = true;
+  allocate(rows, cols);
+  fill(data, data + (size_t) rows*cols, val);
 }
 
 Matrix::Matrix(const vector<vector<mstreal> >& _M) {
   int rows = _M.size();
   int cols = (_M.size() > 0) ? _M[0].size() : 0;
-  M.resize(rows, vector<mstreal*>(cols, NULL));
+  allocate(rows, cols);
   for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      M[i][j] = new mstreal(_M[i][j]);
-    }
+    if (_M[i].size() != cols) MstUtils::error("rows of different lengths given", "Matrix::Matrix(const vector<vector<mstreal> >&)");
+    copy(_M[i].begin(), _M[i].end(), data + (size_t) i*stride);
   }
-  own = true;
 }
 
-Matrix::Matrix(const vector<vector<mstreal*> >& _M, int rowBeg, int rowEnd, int colBeg, int colEnd) {
-  if (rowEnd < 0) rowEnd = _M.size() - 1;
-  if (colEnd < 0) colEnd = ((_M.size() > 0) ? _M[0].size() : 0) - 1;
-  int rows = rowEnd - rowBeg + 1;
-  int cols = colEnd - colBeg + 1;
-  M.resize(rows, vector<mstreal*>(cols, NULL));
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      M[i][j] = _M[i + rowBeg][j + colBeg];
-    }
+Matrix::Matrix(const Matrix& parent, int rowBeg, int rowEnd, int colBeg, int colEnd) {
+  if (rowEnd < 0) rowEnd = parent.nr - 1;
+  if (colEnd < 0) colEnd = parent.nc - 1;
+  if ((rowBeg < 0) || (colBeg < 0) || (rowEnd >= parent.nr) || (colEnd >= parent.nc) || (rowEnd < rowBeg - 1) || (colEnd < colBeg - 1)) {
+    MstUtils::error("sub-matrix range out of bounds", "Matrix::Matrix(const Matrix&, int, int, int, int)");
   }
-  own = false;
+  buffer = parent.buffer;
+  data = parent.data + (size_t) rowBeg*parent.stride + colBeg;
+  nr = rowEnd - rowBeg + 1;
+  nc = colEnd - colBeg + 1;
+  stride = parent.stride;
+  view = true;
 }
 
-void Matrix::clear() {
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      delete(M[i][j]);
-    }
-  }
-  M.clear();
+Matrix::Matrix(const Matrix& _M) {
+  allocate(_M.nr, _M.nc);
+  copyElements(_M);
 }
 
-Matrix::Matrix(const Matrix& _M) {
-  M.resize(_M.numRows(), vector<mstreal*>(_M.numCols(), NULL));
-  for (int i = 0; i < _M.numRows(); i++) {
-    for (int j = 0; j < _M.numCols(); j++) {
-      M[i][j] = new mstreal(_M(i,j));
-    }
-  }
-  own = true;
+Matrix::Matrix(Matrix&& _M) {
+  // moving preserves view-ness, so that functions returning views (e.g., row)
+  // hand back a view regardless of copy elision
+  buffer = std::move(_M.buffer);
+  data = _M.data; nr = _M.nr; nc = _M.nc; stride = _M.stride; view = _M.view;
+  _M.data = NULL; _M.nr = _M.nc = _M.stride = 0; _M.view = false;
 }
 
 Matrix::Matrix(const vector<mstreal>& p, bool col) {
-  if (col) {
-    M.resize(p.size(), vector<mstreal*>(1));
-    for (int i = 0; i < p.size(); i++) M[i][0] = new mstreal(p[i]);
-  } else {
-    M.resize(1, vector<mstreal*>(p.size()));
-    for (int i = 0; i < p.size(); i++) M[0][i] = new mstreal(p[i]);
+  if (col) allocate(p.size(), 1);
+  else allocate(1, p.size());
+  copy(p.begin(), p.end(), data);
+}
+
+void Matrix::copyElements(const Matrix& _M) {
+  for (int i = 0; i < nr; i++) {
+    const mstreal* src = _M.data + (size_t) i*_M.stride;
+    copy(src, src + nc, data + (size_t) i*stride);
   }
-  own = true;
 }
 
 int Matrix::size(int dim) const {
   switch(dim) {
     case 1:
-      return M.size();
+      return nr;
     case 2:
-      if (M.size() == 0) return 0;
-      return M[0].size();
+      if (nr == 0) return 0;
+      return nc;
     default:
       MstUtils::error("out of range dimension " + MstUtils::toString(dim), "Matrix::size");
       return 0; // to make the compiler happy
@@ -89,42 +84,43 @@ int Matrix::size(int dim) const {
 }
 
 Matrix& Matrix::operator=(const Matrix& _M) {
+  if (this == &_M) return *this;
   if ((numRows() != _M.numRows()) || (numCols() != _M.numCols())) {
-    if (!getOwnFlag()) {
+    if (view) {
       MstUtils::error("dimensions must agree when assigning to a sub-Matrix", "Matrix::operator=");
     } else {
-      clear();
-      M.resize(_M.numRows(), vector<mstreal*>(_M.numCols(), NULL));
-      for (int i = 0; i < _M.numRows(); i++) {
-        for (int j = 0; j < _M.numCols(); j++) {
-          M[i][j] = new mstreal(_M(i, j));
-        }
-      }
-    }
-  } else {
-    for (int i = 0; i < this->numRows(); i++) {
-      for (int j = 0; j < this->numCols(); j++) {
-        *(M[i][j]) = _M(i, j);
-      }
+      allocate(_M.nr, _M.nc);
     }
+  } else if ((buffer == _M.buffer) && (data != _M.data)) {
+    // overlapping storage (e.g., one row of a matrix into another) is safest via a copy
+    Matrix tmp(_M);
+    copyElements(tmp);
+    return *this;
   }
+  copyElements(_M);
+  return *this;
+}
+
+Matrix& Matrix::operator=(Matrix&& _M) {
+  if (view || _M.view) return operator=((const Matrix&) _M); // views are written through
+  buffer = std::move(_M.buffer);
+  data = _M.data; nr = _M.nr; nc = _M.nc; stride = _M.stride;
+  _M.data = NULL; _M.nr = _M.nc = _M.stride = 0;
   return *this;
 }
 
 Matrix& Matrix::operator/=(const mstreal& s) {
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) /= s;
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = data + (size_t) i*stride;
+    for (int j = 0; j < nc; j++) r[j] /= s;
   }
   return *this;
 }
 
 Matrix& Matrix::operator*=(const mstreal& s) {
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) *= s;
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = data + (size_t) i*stride;
+    for (int j = 0; j < nc; j++) r[j] *= s;
   }
   return *this;
 }
@@ -154,24 +150,42 @@ const Matrix Matrix::operator*(const Matrix& P) const {
   int p = this->size(2);
   Matrix R(n, m, 0);
 
-  for (int i = 0; i < n; i++) {
-    for (int j = 0; j < m; j++) {
-      for (int k = 0; k < p; k++) {
-        R(i,j) += (*this)(i,k) * P(k,j);
+  /* i-k-j order, blocked over k and j, so that the innermost loop streams
+   * through contiguous rows of P and R (and vectorizes), while the block of P
+   * being used stays in cache across rows of this matrix. Large products are
+   * split by row blocks across threads (each thread writes its own rows). */
+  const int bs = 64;
+  int numRowBlocks = (n + bs - 1)/bs;
+  int nt = ((double) n * m * p >= 8E6) ? 0 : 1;
+  MstUtils::parallelFor(0, numRowBlocks, [&](int rb, int t) {
+    int ie = MstUtils::min(n, (rb + 1)*bs);
+    for (int kk = 0; kk < p; kk += bs) {
+      int ke = MstUtils::min(p, kk + bs);
+      for (int jj = 0; jj < m; jj += bs) {
+        int je = MstUtils::min(m, jj + bs);
+        for (int i = rb*bs; i < ie; i++) {
+          mstreal* r = R.data + (size_t) i*R.stride;
+          const mstreal* a = data + (size_t) i*stride;
+          for (int k = kk; k < ke; k++) {
+            const mstreal aik = a[k];
+            const mstreal* b = P.data + (size_t) k*P.stride;
+            for (int j = jj; j < je; j++) r[j] += aik * b[j];
+          }
+        }
       }
     }
-  }
+  }, nt);
   return R;
 }
 
 Matrix& Matrix::operator+=(const Matrix& P) {
-  if ((this->size(1) != P.size(1)) || (this->size(2) != P.size(2))) {
+  if (!sameSize(P)) {
     MstUtils::error("matrix dimensions do not agree", "Matrix::operator+=(Matrix&)");
   }
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) += *(P.M[i][j]);
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = data + (size_t) i*stride;
+    const mstreal* q = P.data + (size_t) i*P.stride;
+    for (int j = 0; j < nc; j++) r[j] += q[j];
   }
   return *this;
 }
@@ -183,13 +197,13 @@ const Matrix Matrix::operator+(const Matrix& P) const {
 }
 
 Matrix& Matrix::operator-=(const Matrix& P) {
-  if ((this->size(1) != P.size(1)) || (this->size(2) != P.size(2))) {
+  if (!sameSize(P)) {
     MstUtils::error("matrix dimensions do not agree", "Matrix::operator-=(Matrix&)");
   }
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) -= *(P.M[i][j]);
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = data + (size_t) i*stride;
+    const mstreal* q = P.data + (size_t) i*P.stride;
+    for (int j = 0; j < nc; j++) r[j] -= q[j];
   }
   return *this;
 }
@@ -207,18 +221,23 @@ const Matrix Matrix::operator-() const {
 }
 
 Matrix Matrix::row(int i) {
-  Matrix subMat(M, i, i);
+  Matrix subMat(*this, i, i, 0, -1);
   return subMat;
 }
 
 Matrix Matrix::column(int i) {
-  Matrix subMat(M, 0, -1, i, i);
+  Matrix subMat(*this, 0, -1, i, i);
+  return subMat;
+}
+
+Matrix Matrix::block(int rowBeg, int rowEnd, int colBeg, int colEnd) {
+  Matrix subMat(*this, rowBeg, rowEnd, colBeg, colEnd);
   return subMat;
 }
 
 Matrix::operator vector<mstreal>() const {
-  vector<mstreal> cat(numRows() * numCols());
-  int k = 0;
+  vector<mstreal> cat((size_t) numRows() * numCols());
+  size_t k = 0;
   for (int i = 0; i < numRows(); i++) {
     for (int j = 0; j < numCols(); j++) {
       cat[k] = (*this)(i, j);
@@ -228,78 +247,161 @@ Matrix::operator vector<mstreal>() const {
   return cat;
 }
 
-Matrix Matrix::inverse() {
-  if (size(1) != size(2)) MstUtils::error("inverse of non-square matrix requested", "Matrix::inverse()");
+int Matrix::luDecompose(Matrix& LU, vector<int>& perm) const {
+  if (size(1) != size(2)) MstUtils::error("LU decomposition of non-square matrix requested", "Matrix::luDecompose");
   int N = size(1);
-  Matrix Mi = *this;
-  Matrix& Mo = *this;
-  mstreal det;
-
-  switch(N) {
-    case 0:
-      MstUtils::error("inverse of an empty matrix requested", "Matrix::inverse()");
-      break;
+  LU = *this;
+  perm.resize(N);
+  for (int i = 0; i < N; i++) perm[i] = i;
+  int sign = 1;
+  mstreal scale = 0;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) scale = MstUtils::max(scale, fabs(LU(i, j)));
+  }
+  for (int k = 0; k < N; k++) {
+    // partial pivoting: bring the largest remaining element of column k up
+    int p = k;
+    for (int i = k + 1; i < N; i++) {
+      if (fabs(LU(i, k)) > fabs(LU(p, k))) p = i;
+    }
+    if (fabs(LU(p, k)) <= scale * N * numeric_limits<mstreal>::epsilon()) sign = 0;
+    if (p != k) {
+      swap_ranges(LU.data + (size_t) p*LU.stride, LU.data + (size_t) p*LU.stride + N, LU.data + (size_t) k*LU.stride);
+      swap(perm[p], perm[k]);
+      if (sign != 0) sign = -sign;
+    }
+    mstreal piv = LU(k, k);
+    if (piv == 0) continue;
+    const mstreal* rk = LU.data + (size_t) k*LU.stride;
+    for (int i = k + 1; i < N; i++) {
+      mstreal* ri = LU.data + (size_t) i*LU.stride;
+      mstreal f = (ri[k] /= piv);
+      for (int j = k + 1; j < N; j++) ri[j] -= f * rk[j];
+    }
+  }
+  return sign;
+}
+
+Matrix Matrix::solve(const Matrix& B) const {
+  if (size(1) != size(2)) MstUtils::error("linear solve with non-square matrix requested", "Matrix::solve");
+  if (B.size(1) != size(1)) MstUtils::error("matrix dimensions do not agree", "Matrix::solve");
+  int N = size(1), m = B.numCols();
+  Matrix LU(0, 0); vector<int> perm;
+  if (luDecompose(LU, perm) == 0) MstUtils::warn("matrix too close to singular", "Matrix::solve");
+
+  // permute right-hand side, then forward and backward substitution, all
+  // columns of the right-hand side at once (rows are contiguous)
+  Matrix X(N, m);
+  for (int i = 0; i < N; i++) {
+    const mstreal* src = B.data + (size_t) perm[i]*B.stride;
+    copy(src, src + m, X.data + (size_t) i*X.stride);
+  }
+  for (int i = 0; i < N; i++) {
+    mstreal* xi = X.data + (size_t) i*X.stride;
+    for (int k = 0; k < i; k++) {
+      const mstreal f = LU(i, k);
+      const mstreal* xk = X.data + (size_t) k*X.stride;
+      for (int j = 0; j < m; j++) xi[j] -= f * xk[j];
+    }
+  }
+  for (int i = N - 1; i >= 0; i--) {
+    mstreal* xi = X.data + (size_t) i*X.stride;
+    for (int k = i + 1; k < N; k++) {
+      const mstreal f = LU(i, k);
+      const mstreal* xk = X.data + (size_t) k*X.stride;
+      for (int j = 0; j < m; j++) xi[j] -= f * xk[j];
+    }
+    const mstreal d = LU(i, i);
+    for (int j = 0; j < m; j++) xi[j] /= d;
+  }
+  return X;
+}
 
-    case 1:
-      Mi(0,0) = 1/Mo(0,0);
-      break;
+Matrix Matrix::inverse() const {
+  if (size(1) != size(2)) MstUtils::error("inverse of non-square matrix requested", "Matrix::inverse()");
+  int N = size(1);
+  if (N == 0) MstUtils::error("inverse of an empty matrix requested", "Matrix::inverse()");
+  Matrix I(N, N, 0.0);
+  for (int i = 0; i < N; i++) I(i, i) = 1;
+  return solve(I);
+}
 
-    case 2:
-      det = (Mo(0,0)*Mo(1,1) - Mo(0,1)*Mo(1,0));
-      if (fabs(det) < 10E-15) MstUtils::warn("matrix too close to singular, determinant near zero", "Matrix::inverse()");
-      Mi(0,0) =  Mo(1,1)/det;
-      Mi(0,1) = -Mo(0,1)/det;
-      Mi(1,0) = -Mo(1,0)/det;
-      Mi(1,1) =  Mo(0,0)/det;
-      break;
-
-    case 3:
-      det = (Mo(0,0)*Mo(1,1)*Mo(2,2) - Mo(0,0)*Mo(1,2)*Mo(2,1) - Mo(0,1)*Mo(1,0)*Mo(2,2) + Mo(0,1)*Mo(1,2)*Mo(2,0) + Mo(0,2)*Mo(1,0)*Mo(2,1) - Mo(0,2)*Mo(1,1)*Mo(2,0));
-      if (fabs(det) < 10E-15) MstUtils::warn("matrix too close to singular, determinant near zero", "Matrix::inverse()");
-      Mi(0,0) =  (Mo(1,1)*Mo(2,2) - Mo(1,2)*Mo(2,1))/det;
-      Mi(0,1) = -(Mo(0,1)*Mo(2,2) - Mo(0,2)*Mo(2,1))/det;
-      Mi(0,2) =  (Mo(0,1)*Mo(1,2) - Mo(0,2)*Mo(1,1))/det;
-      Mi(1,0) = -(Mo(1,0)*Mo(2,2) - Mo(1,2)*Mo(2,0))/det;
-      Mi(1,1) =  (Mo(0,0)*Mo(2,2) - Mo(0,2)*Mo(2,0))/det;
-      Mi(1,2) = -(Mo(0,0)*Mo(1,2) - Mo(0,2)*Mo(1,0))/det;
-      Mi(2,0) =  (Mo(1,0)*Mo(2,1) - Mo(1,1)*Mo(2,0))/det;
-      Mi(2,1) = -(Mo(0,0)*Mo(2,1) - Mo(0,1)*Mo(2,0))/det;
-      Mi(2,2) =  (Mo(0,0)*Mo(1,1) - Mo(0,1)*Mo(1,0))/det;
-      break;
-
-    case 4:
-      det = (Mo(0,0)*Mo(1,1)*Mo(2,2)*Mo(3,3) - Mo(0,0)*Mo(1,1)*Mo(2,3)*Mo(3,2) - Mo(0,0)*Mo(1,2)*Mo(2,1)*Mo(3,3) + Mo(0,0)*Mo(1,2)*Mo(2,3)*Mo(3,1) + Mo(0,0)*Mo(1,3)*Mo(2,1)*Mo(3,2) - Mo(0,0)*Mo(1,3)*Mo(2,2)*Mo(3,1) - Mo(0,1)*Mo(1,0)*Mo(2,2)*Mo(3,3) + Mo(0,1)*Mo(1,0)*Mo(2,3)*Mo(3,2) + Mo(0,1)*Mo(1,2)*Mo(2,0)*Mo(3,3) - Mo(0,1)*Mo(1,2)*Mo(2,3)*Mo(3,0) - Mo(0,1)*Mo(1,3)*Mo(2,0)*Mo(3,2) + Mo(0,1)*Mo(1,3)*Mo(2,2)*Mo(3,0) + Mo(0,2)*Mo(1,0)*Mo(2,1)*Mo(3,3) - Mo(0,2)*Mo(1,0)*Mo(2,3)*Mo(3,1) - Mo(0,2)*Mo(1,1)*Mo(2,0)*Mo(3,3) + Mo(0,2)*Mo(1,1)*Mo(2,3)*Mo(3,0) + Mo(0,2)*Mo(1,3)*Mo(2,0)*Mo(3,1) - Mo(0,2)*Mo(1,3)*Mo(2,1)*Mo(3,0) - Mo(0,3)*Mo(1,0)*Mo(2,1)*Mo(3,2) + Mo(0,3)*Mo(1,0)*Mo(2,2)*Mo(3,1) + Mo(0,3)*Mo(1,1)*Mo(2,0)*Mo(3,2) - Mo(0,3)*Mo(1,1)*Mo(2,2)*Mo(3,0) - Mo(0,3)*Mo(1,2)*Mo(2,0)*Mo(3,1) + Mo(0,3)*Mo(1,2)*Mo(2,1)*Mo(3,0));
-      if (fabs(det) < 10E-15) MstUtils::warn("matrix too close to singular, determinant near zero", "Matrix::inverse()");
-      Mi(0,0) =  (Mo(1,1)*Mo(2,2)*Mo(3,3) - Mo(1,1)*Mo(2,3)*Mo(3,2) - Mo(1,2)*Mo(2,1)*Mo(3,3) + Mo(1,2)*Mo(2,3)*Mo(3,1) + Mo(1,3)*Mo(2,1)*Mo(3,2) - Mo(1,3)*Mo(2,2)*Mo(3,1))/det;
-      Mi(0,1) = -(Mo(0,1)*Mo(2,2)*Mo(3,3) - Mo(0,1)*Mo(2,3)*Mo(3,2) - Mo(0,2)*Mo(2,1)*Mo(3,3) + Mo(0,2)*Mo(2,3)*Mo(3,1) + Mo(0,3)*Mo(2,1)*Mo(3,2) - Mo(0,3)*Mo(2,2)*Mo(3,1))/det;
-      Mi(0,2) =  (Mo(0,1)*Mo(1,2)*Mo(3,3) - Mo(0,1)*Mo(1,3)*Mo(3,2) - Mo(0,2)*Mo(1,1)*Mo(3,3) + Mo(0,2)*Mo(1,3)*Mo(3,1) + Mo(0,3)*Mo(1,1)*Mo(3,2) - Mo(0,3)*Mo(1,2)*Mo(3,1))/det;
-      Mi(0,3) = -(Mo(0,1)*Mo(1,2)*Mo(2,3) - Mo(0,1)*Mo(1,3)*Mo(2,2) - Mo(0,2)*Mo(1,1)*Mo(2,3) + Mo(0,2)*Mo(1,3)*Mo(2,1) + Mo(0,3)*Mo(1,1)*Mo(2,2) - Mo(0,3)*Mo(1,2)*Mo(2,1))/det;
-      Mi(1,0) = -(Mo(1,0)*Mo(2,2)*Mo(3,3) - Mo(1,0)*Mo(2,3)*Mo(3,2) - Mo(1,2)*Mo(2,0)*Mo(3,3) + Mo(1,2)*Mo(2,3)*Mo(3,0) + Mo(1,3)*Mo(2,0)*Mo(3,2) - Mo(1,3)*Mo(2,2)*Mo(3,0))/det;
-      Mi(1,1) =  (Mo(0,0)*Mo(2,2)*Mo(3,3) - Mo(0,0)*Mo(2,3)*Mo(3,2) - Mo(0,2)*Mo(2,0)*Mo(3,3) + Mo(0,2)*Mo(2,3)*Mo(3,0) + Mo(0,3)*Mo(2,0)*Mo(3,2) - Mo(0,3)*Mo(2,2)*Mo(3,0))/det;
-      Mi(1,2) = -(Mo(0,0)*Mo(1,2)*Mo(3,3) - Mo(0,0)*Mo(1,3)*Mo(3,2) - Mo(0,2)*Mo(1,0)*Mo(3,3) + Mo(0,2)*Mo(1,3)*Mo(3,0) + Mo(0,3)*Mo(1,0)*Mo(3,2) - Mo(0,3)*Mo(1,2)*Mo(3,0))/det;
-      Mi(1,3) =  (Mo(0,0)*Mo(1,2)*Mo(2,3) - Mo(0,0)*Mo(1,3)*Mo(2,2) - Mo(0,2)*Mo(1,0)*Mo(2,3) + Mo(0,2)*Mo(1,3)*Mo(2,0) + Mo(0,3)*Mo(1,0)*Mo(2,2) - Mo(0,3)*Mo(1,2)*Mo(2,0))/det;
-      Mi(2,0) =  (Mo(1,0)*Mo(2,1)*Mo(3,3) - Mo(1,0)*Mo(2,3)*Mo(3,1) - Mo(1,1)*Mo(2,0)*Mo(3,3) + Mo(1,1)*Mo(2,3)*Mo(3,0) + Mo(1,3)*Mo(2,0)*Mo(3,1) - Mo(1,3)*Mo(2,1)*Mo(3,0))/det;
-      Mi(2,1) = -(Mo(0,0)*Mo(2,1)*Mo(3,3) - Mo(0,0)*Mo(2,3)*Mo(3,1) - Mo(0,1)*Mo(2,0)*Mo(3,3) + Mo(0,1)*Mo(2,3)*Mo(3,0) + Mo(0,3)*Mo(2,0)*Mo(3,1) - Mo(0,3)*Mo(2,1)*Mo(3,0))/det;
-      Mi(2,2) =  (Mo(0,0)*Mo(1,1)*Mo(3,3) - Mo(0,0)*Mo(1,3)*Mo(3,1) - Mo(0,1)*Mo(1,0)*Mo(3,3) + Mo(0,1)*Mo(1,3)*Mo(3,0) + Mo(0,3)*Mo(1,0)*Mo(3,1) - Mo(0,3)*Mo(1,1)*Mo(3,0))/det;
-      Mi(2,3) = -(Mo(0,0)*Mo(1,1)*Mo(2,3) - Mo(0,0)*Mo(1,3)*Mo(2,1) - Mo(0,1)*Mo(1,0)*Mo(2,3) + Mo(0,1)*Mo(1,3)*Mo(2,0) + Mo(0,3)*Mo(1,0)*Mo(2,1) - Mo(0,3)*Mo(1,1)*Mo(2,0))/det;
-      Mi(3,0) = -(Mo(1,0)*Mo(2,1)*Mo(3,2) - Mo(1,0)*Mo(2,2)*Mo(3,1) - Mo(1,1)*Mo(2,0)*Mo(3,2) + Mo(1,1)*Mo(2,2)*Mo(3,0) + Mo(1,2)*Mo(2,0)*Mo(3,1) - Mo(1,2)*Mo(2,1)*Mo(3,0))/det;
-      Mi(3,1) =  (Mo(0,0)*Mo(2,1)*Mo(3,2) - Mo(0,0)*Mo(2,2)*Mo(3,1) - Mo(0,1)*Mo(2,0)*Mo(3,2) + Mo(0,1)*Mo(2,2)*Mo(3,0) + Mo(0,2)*Mo(2,0)*Mo(3,1) - Mo(0,2)*Mo(2,1)*Mo(3,0))/det;
-      Mi(3,2) = -(Mo(0,0)*Mo(1,1)*Mo(3,2) - Mo(0,0)*Mo(1,2)*Mo(3,1) - Mo(0,1)*Mo(1,0)*Mo(3,2) + Mo(0,1)*Mo(1,2)*Mo(3,0) + Mo(0,2)*Mo(1,0)*Mo(3,1) - Mo(0,2)*Mo(1,1)*Mo(3,0))/det;
-      Mi(3,3) =  (Mo(0,0)*Mo(1,1)*Mo(2,2) - Mo(0,0)*Mo(1,2)*Mo(2,1) - Mo(0,1)*Mo(1,0)*Mo(2,2) + Mo(0,1)*Mo(1,2)*Mo(2,0) + Mo(0,2)*Mo(1,0)*Mo(2,1) - Mo(0,2)*Mo(1,1)*Mo(2,0))/det;
-      break;
+mstreal Matrix::determinant() const {
+  Matrix LU(0, 0); vector<int> perm;
+  int sign = luDecompose(LU, perm);
+  if (sign == 0) return 0;
+  mstreal det = sign;
+  for (int i = 0; i < size(1); i++) det *= LU(i, i);
+  return det;
+}
 
-    default:
-      MstUtils::error("this is a basic matrix class that does not know how to invert matrices of dimension " + MstUtils::toString(N), "Matrix::inverse");
-      break;
+void Matrix::eigenSymmetric(vector<mstreal>& vals, Matrix& vecs, mstreal tol, int maxSweeps) const {
+  if (size(1) != size(2)) MstUtils::error("eigen-decomposition of non-square matrix requested", "Matrix::eigenSymmetric");
+  int N = size(1);
+  Matrix A(N, N);
+  for (int i = 0; i < N; i++) {
+    for (int j = i; j < N; j++) A(i, j) = A(j, i) = (*this)(i, j);
+  }
+  Matrix V(N, N, 0.0);
+  for (int i = 0; i < N; i++) V(i, i) = 1;
+
+  // cyclic Jacobi: sweep over all off-diagonal elements, zeroing each with a
+  // plane rotation, until the off-diagonal norm is negligible
+  mstreal total = A.norm2();
+  for (int sweep = 0; sweep < maxSweeps; sweep++) {
+    mstreal off = 0;
+    for (int p = 0; p < N; p++) {
+      for (int q = p + 1; q < N; q++) off += A(p, q)*A(p, q);
+    }
+    if (off <= tol*tol*total) break;
+    for (int p = 0; p < N; p++) {
+      for (int q = p + 1; q < N; q++) {
+        mstreal apq = A(p, q);
+        if (apq == 0) continue;
+        mstreal theta = (A(q, q) - A(p, p))/(2*apq);
+        mstreal t = MstUtils::sign(theta)/(fabs(theta) + sqrt(theta*theta + 1));
+        if (theta == 0) t = 1;
+        mstreal c = 1/sqrt(t*t + 1), s = t*c;
+        for (int k = 0; k < N; k++) {
+          mstreal akp = A(k, p), akq = A(k, q);
+          A(k, p) = c*akp - s*akq;
+          A(k, q) = s*akp + c*akq;
+        }
+        for (int k = 0; k < N; k++) {
+          mstreal apk = A(p, k), aqk = A(q, k);
+          A(p, k) = c*apk - s*aqk;
+          A(q, k) = s*apk + c*aqk;
+        }
+        for (int k = 0; k < N; k++) {
+          mstreal vkp = V(k, p), vkq = V(k, q);
+          V(k, p) = c*vkp - s*vkq;
+          V(k, q) = s*vkp + c*vkq;
+        }
+      }
+    }
   }
 
-  return Mi;
+  // sort in ascending order of eigenvalues
+  vector<mstreal> diag(N);
+  for (int i = 0; i < N; i++) diag[i] = A(i, i);
+  vector<int> order = MstUtils::sortIndices(diag);
+  vals.resize(N);
+  vecs = Matrix(N, N);
+  for (int j = 0; j < N; j++) {
+    vals[j] = diag[order[j]];
+    for (int i = 0; i < N; i++) vecs(i, j) = V(i, order[j]);
+  }
 }
 
-Matrix Matrix::transpose() {
+Matrix Matrix::transpose() const {
   Matrix R(numCols(), numRows());
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) R(j,i) = *(M[i][j]);
+  const int bs = 32;
+  for (int ii = 0; ii < nr; ii += bs) {
+    for (int jj = 0; jj < nc; jj += bs) {
+      for (int i = ii; i < MstUtils::min(nr, ii + bs); i++) {
+        for (int j = jj; j < MstUtils::min(nc, jj + bs); j++) R(j, i) = (*this)(i, j);
+      }
+    }
   }
   return R;
 }
@@ -313,10 +415,10 @@ Matrix Matrix::sum(int dim, bool norm) const {
   switch(dim) {
     case 1: {
       Matrix S(1, numCols(), 0);
-      for (int i = 0; i < numCols(); i++) {
-        for (int j = 0; j < numRows(); j++) S(0, i) += (*this)(j, i);
-        if (norm) S(0, i) /= numRows();
+      for (int j = 0; j < numRows(); j++) {
+        for (int i = 0; i < numCols(); i++) S(0, i) += (*this)(j, i);
       }
+      if (norm) S /= numRows();
       return S;
     }
 
@@ -324,7 +426,7 @@ Matrix Matrix::sum(int dim, bool norm) const {
       Matrix S(numRows(), 1, 0);
       for (int i = 0; i < numRows(); i++) {
         for (int j = 0; j < numCols(); j++) S(i, 0) += (*this)(i, j);
-        if (norm) S(0, i) /= numCols();
+        if (norm) S(i, 0) /= numCols();
       }
       return S;
     }
@@ -336,27 +438,24 @@ Matrix Matrix::sum(int dim, bool norm) const {
 }
 
 mstreal Matrix::norm() const {
-  mstreal n = 0;
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) n += (*(M[i][j])) * (*(M[i][j]));
-  }
-  return sqrt(n);
+  return sqrt(norm2());
 }
 
 mstreal Matrix::norm2() const {
   mstreal n = 0;
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) n += (*(M[i][j])) * (*(M[i][j]));
+  for (int i = 0; i < nr; i++) {
+    const mstreal* r = data + (size_t) i*stride;
+    for (int j = 0; j < nc; j++) n += r[j] * r[j];
   }
   return n;
 }
 
 mstreal Matrix::min() const {
   if (length() == 0) MstUtils::error("called on an empty matrix", "Matrix::min()");
-  mstreal m = *(M[0][0]);
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      if (*(M[i][j]) < m) m = *(M[i][j]);
+  mstreal m = (*this)(0, 0);
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < nc; j++) {
+      if ((*this)(i, j) < m) m = (*this)(i, j);
     }
   }
   return m;
@@ -364,10 +463,10 @@ mstreal Matrix::min() const {
 
 mstreal Matrix::max() const {
   if (length() == 0) MstUtils::error("called on an empty matrix", "Matrix::max()");
-  mstreal m = *(M[0][0]);
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      if (*(M[i][j]) > m) m = *(M[i][j]);
+  mstreal m = (*this)(0, 0);
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < nc; j++) {
+      if ((*this)(i, j) > m) m = (*this)(i, j);
     }
   }
   return m;
@@ -375,16 +474,14 @@ mstreal Matrix::max() const {
 
 Matrix Matrix::abs() const {
   Matrix Ma(*this);
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      Ma(i, j) = fabs(*(M[i][j]));
-    }
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < nc; j++) Ma(i, j) = fabs(Ma(i, j));
   }
   return Ma;
 }
 
 Matrix Matrix::mult(const Matrix& other) const {
-  if ((this->size(1) != other.size(1)) || (this->size(2) != other.size(2))) {
+  if (!sameSize(other)) {
     MstUtils::error("matrix dimensions do not agree", "Matrix::mult");
   }
   Matrix M(*this);
@@ -397,7 +494,7 @@ Matrix Matrix::mult(const Matrix& other) const {
 }
 
 Matrix Matrix::div(const Matrix& other) const {
-  if ((this->size(1) != other.size(1)) || (this->size(2) != other.size(2))) {
+  if (!sameSize(other)) {
     MstUtils::error("matrix dimensions do not agree", "Matrix::div");
   }
   Matrix M(*this);
@@ -0,0 +1,122 @@
+#include "mstlocks.h"
+#include <fcntl.h>
+#include <errno.h>
+
+mutex MstLockManager::stateLock;
+condition_variable MstLockManager::stateChange;
+map<string, MstLockManager::lockState> MstLockManager::states;
+string MstLockManager::lockDir = (getenv("MST_LOCK_DIR") == NULL) ? "/tmp" : getenv("MST_LOCK_DIR");
+
+void MstLockManager::setLockDirectory(const string& dir) {
+  lock_guard<mutex> guard(stateLock);
+  lockDir = dir;
+}
+
+string MstLockManager::getLockDirectory() {
+  lock_guard<mutex> guard(stateLock);
+  return lockDir;
+}
+
+string MstLockManager::lockFilePath(const string& tag) {
+  // percent-escape '/' and '%', so that distinct tags never share a lock file
+  string name;
+  for (char c : tag) {
+    if (c == '/') name += "%2F";
+    else if (c == '%') name += "%25";
+    else name += c;
+  }
+  return getLockDirectory() + "/.mst-" + name + ".lock";
+}
+
+int MstLockManager::lockFile(const string& path, bool shared, bool wait, const chrono::steady_clock::time_point& deadline) {
+  int pause = 1; // ms, grows up to 100 ms between attempts
+  while (true) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) MstUtils::error("could not open lock file '" + path + "': " + strerror(errno), "MstLockManager::lockFile");
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = shared ? F_RDLCK : F_WRLCK;
+    fl.l_whence = SEEK_SET; fl.l_start = 0; fl.l_len = 0; // the whole file
+    if (fcntl(fd, F_SETLK, &fl) == 0) {
+      // make sure the file was not replaced between opening and locking it
+      struct stat locked, current;
+      if ((fstat(fd, &locked) == 0) && (stat(path.c_str(), &current) == 0) && (locked.st_dev == current.st_dev) && (locked.st_ino == current.st_ino)) return fd;
+      close(fd);
+      continue;
+    }
+    int err = errno;
+    close(fd);
+    if ((err != EACCES) && (err != EAGAIN)) MstUtils::error("could not lock file '" + path + "': " + strerror(err), "MstLockManager::lockFile");
+    if (!wait) return -1;
+    auto now = chrono::steady_clock::now();
+    if (now >= deadline) return -1;
+    auto sleepTime = min(chrono::duration_cast<chrono::steady_clock::duration>(chrono::milliseconds(pause)), deadline - now);
+    this_thread::sleep_for(sleepTime);
+    pause = min(2*pause, 100);
+  }
+}
+
+bool MstLockManager::acquire(const string& tag, bool shared, mstreal timeout) {
+  bool wait = (timeout != 0);
+  auto deadline = chrono::steady_clock::time_point::max();
+  if (timeout >= 0) deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(timeout));
+  string path = lockFilePath(tag);
+
+  // first, coordinate with other threads of this process
+  unique_lock<mutex> guard(stateLock);
+  lockState& state = states[tag];
+  auto available = [&]() { return !state.pending && !state.writer && (shared || (state.readers == 0)); };
+  if (timeout < 0) {
+    stateChange.wait(guard, available);
+  } else if (!stateChange.wait_until(guard, deadline, available)) {
+    return false;
+  }
+  if (shared && (state.readers > 0)) { // the lock file is already locked in shared mode
+    state.readers++;
+    return true;
+  }
+
+  // then with other processes, without blocking other locks meanwhile
+  state.pending = true;
+  guard.unlock();
+  int fd = -1;
+  try {
+    fd = lockFile(path, shared, wait, deadline);
+  } catch (...) {
+    guard.lock();
+    state.pending = false;
+    stateChange.notify_all();
+    throw;
+  }
+  guard.lock();
+  state.pending = false;
+  if (fd >= 0) {
+    state.fd = fd;
+    if (shared) state.readers = 1;
+    else state.writer = true;
+  }
+  stateChange.notify_all();
+  return (fd >= 0);
+}
+
+bool MstLockManager::release(const string& tag) {
+  lock_guard<mutex> guard(stateLock);
+  auto it = states.find(tag);
+  if (it == states.end()) return false;
+  lockState& state = it->second;
+  if (state.writer) state.writer = false;
+  else if (state.readers > 0) state.readers--;
+  else return false;
+  if (!state.writer && (state.readers == 0)) {
+    close(state.fd); // this drops the record lock
+    state.fd = -1;
+  }
+  stateChange.notify_all();
+  return true;
+}
+
+bool MstLockManager::isHeld(const string& tag) {
+  lock_guard<mutex> guard(stateLock);
+  auto it = states.find(tag);
+  return (it != states.end()) && (it->second.writer || (it->second.readers > 0));
+}
@@ -1,6 +1,7 @@
 #include "mstmagic.h"
+#include <bitset>
 
-vector<AtomPointerVector> TERMUtils::mostDesignableFragments(Structure& C, vector<Structure*>& TERMs, int n, CartesianPoint* cen, CartesianPoint* ext, string outBase, bool verb) {
+vector<AtomPointerVector> TERMUtils::mostDesignableFragments(Structure& C, vector<Structure*>& TERMs, int n, CartesianPoint* cen, CartesianPoint* ext, string outBase, bool verb, int numThreads) {
   int N = 1000;      // examine top this many most promissing points to expand into regions
   mstreal dcut = 2.0;   // inter-atomic distance cutoff for counting neighbors
 
@@ -18,84 +19,113 @@ vector<AtomPointerVector> TERMUtils::mostDesignableFragments(Structure& C, vecto
     PS = new ProximitySearch((*cen)[0] - (*ext)[0], (*cen)[1] - (*ext)[1], (*cen)[2] - (*ext)[2], (*cen)[0] + (*ext)[0], (*cen)[1] + (*ext)[1], (*cen)[2] + (*ext)[2]);
   }
 
-  // now add backbone atoms in all overlapping motifs to this ProximitySearch object
-  vector<vector<int> > pointSource;
+  // now add backbone atoms in all overlapping motifs to this ProximitySearch object. Every chain of every TERM
+  // gets a flat index, and resPoint[chainBeg[c] + j] is the point of residue j of flat chain c (-1 if none)
+  struct pointKey { int term, chain, res, flatChain; };
+  vector<pointKey> pointSource;
+  vector<vector<int> > flatChain(TERMs.size());
+  vector<int> chainBeg, resPoint;
   for (int k = 1; k < TERMs.size(); k++) {
     Structure& S = *(TERMs[k]);
     for (int i = 0; i < S.chainSize(); i++) {
       Chain& chain = S[i];
+      flatChain[k].push_back(chainBeg.size());
+      chainBeg.push_back(resPoint.size());
       for (int j = 0; j < chain.residueSize(); j++) {
         Residue& res = chain[j];
         Atom* a = res.findAtom("CA");
+        resPoint.push_back(-1);
         if (PS->isPointWithinGrid(a)) {
           if (centTERM.pointsWithin(a, 0, dcut)) continue; // don't want to find commonalities among residues in the overlap regions
+          resPoint.back() = pointSource.size();
           PS->addPoint(a, pointSource.size());
-          vector<int> source(3, 0); source[0] = k; source[1] = i; source[2] = j;
-          pointSource.push_back(source);
+          pointSource.push_back({k, i, j, flatChain[k][i]});
         }
       }
     }
   }
+  chainBeg.push_back(resPoint.size());
+  int numThr = MstUtils::numThreads(numThreads);
   if (verb) cout << "added a total of " << PS->pointSize() << " points to ProximitySearch\n";
 
-  // now find the number of close neighbors for each point
-  vector<int> nn(PS->pointSize(), 0);
-  for (int i = 0; i < PS->pointSize(); i++) {
-    vector<int> close;
-    PS->pointsWithin(PS->getPoint(i), 0.0, dcut, &close);
-    nn[i] = close.size();
+  // find the close neighbors of each point once, stored in compressed form: the neighbors
+  // of point i are nbrs[nbrBeg[i]] through nbrs[nbrBeg[i+1] - 1]
+  int P = PS->pointSize();
+  vector<vector<int> > closeLists(P);
+  MstUtils::parallelFor(0, P, [&](int i, int t) { PS->pointsWithin(PS->getPoint(i), 0.0, dcut, &(closeLists[i])); }, numThr, 256);
+  vector<int> nbrBeg(P + 1, 0), nbrs;
+  for (int i = 0; i < P; i++) nbrBeg[i+1] = nbrBeg[i] + closeLists[i].size();
+  nbrs.reserve(nbrBeg[P]);
+  for (int i = 0; i < P; i++) {
+    nbrs.insert(nbrs.end(), closeLists[i].begin(), closeLists[i].end());
+    vector<int>().swap(closeLists[i]);
   }
+  vector<int> nn(P, 0);
+  for (int i = 0; i < P; i++) nn[i] = nbrBeg[i+1] - nbrBeg[i];
 
   // sort points by the number of neighbors
   vector<int> sortedIndex = MstUtils::sortIndices(nn, true);
 
-  // for the most promising points, try to expand regions around them
+  // for the most promising points, try to expand regions around them. The points close to the seed point
+  // are tracked as a bitset over their positions in its neighbor list; one of them stays in register at a
+  // step if the point next to it in its chain (in the direction of the walk) is close to the walked residue
   N = min(N, (int) sortedIndex.size());
   if (verb) cout << "looking at the top " << N << " most promising points:\n";
   vector<double> regScores(N, 0); vector<AtomPointerVector> reg(N);
-  for (int i = 0; i < N; i++) {
-    vector<int> close;
-    PS->pointsWithin(PS->getPoint(sortedIndex[i]), 0.0, dcut, &close);
-    vector<int> source = pointSource[sortedIndex[i]];
+  vector<string> messages(N);
+  vector<vector<int> > closeIdx(numThr, vector<int>(P, -1)); // per thread: position of each point among the seed's neighbors
+  MstUtils::parallelFor(0, N, [&](int i, int t) {
+    int seed = sortedIndex[i];
+    int numClose = nn[seed];
+    const int* close = nbrs.data() + nbrBeg[seed];
+    vector<int>& closePos = closeIdx[t];
+    for (int c = 0; c < numClose; c++) closePos[close[c]] = c;
+    int W = (numClose + 63)/64;
+    vector<uint64_t> inRegister(W), hits(W);
+    vector<int> closeCur;
+    const pointKey& source = pointSource[seed];
 
     // walk in both directions from the central point
-    Structure& S = *(TERMs[source[0]]);
-    Chain& chain = S[source[1]];
+    Structure& S = *(TERMs[source.term]);
+    Chain& chain = S[source.chain];
     int L, U, ri;
     for (int s = -1; s <= 1; s += 2) {
-      vector<int> inRegister = close; // the set of points, whose corresponding structures continue to be in register with the structure of the current promising point
-      for (ri = source[2] + s; (ri >= 0) && (ri < chain.residueSize()); ri += s) {
-        Residue& res = chain[ri];
-        Atom* a = res.findAtom("CA");
-        vector<int> closeCur;
-        PS->pointsWithin(a, 0.0, dcut, &closeCur);
-        map<int, vector<int> > closeCurTERM;
-        for (int ii = 0; ii < closeCur.size(); ii++) {
-          int t = pointSource[closeCur[ii]][0]; // which TERM this point belongs to
-          closeCurTERM[t].push_back(closeCur[ii]);
+      for (int w = 0; w < W; w++) inRegister[w] = ~((uint64_t) 0);
+      if (numClose % 64) inRegister[W-1] = (((uint64_t) 1) << (numClose % 64)) - 1;
+      int numInRegister = numClose;
+      for (ri = source.res + s; (ri >= 0) && (ri < chain.residueSize()); ri += s) {
+        // points close to the CA of this residue (precomputed, unless the residue is not itself a point)
+        const int* cur; int numCur;
+        int rp = resPoint[chainBeg[source.flatChain] + ri];
+        if (rp >= 0) {
+          cur = nbrs.data() + nbrBeg[rp]; numCur = nn[rp];
+        } else {
+          PS->pointsWithin(chain[ri].findAtom("CA"), 0.0, dcut, &closeCur);
+          cur = closeCur.data(); numCur = closeCur.size();
         }
 
         // figure out how many of the previous are still in register at this point
-        vector<int> surviving;
-        for (int ii = 0; ii < inRegister.size(); ii++) {
-          int p = inRegister[ii];
-          int t = pointSource[p][0];
-          if (closeCurTERM.find(t) == closeCurTERM.end()) continue;
-          for (int k = 0; k < closeCurTERM[t].size(); k++) {
-            int p1 = closeCurTERM[t][k];
-            if ((pointSource[p][1] == pointSource[p1][1]) && (pointSource[p][2] + s == pointSource[p1][2])) {
-              surviving.push_back(p);
-            }
-          }
+        for (int w = 0; w < W; w++) hits[w] = 0;
+        for (int ii = 0; ii < numCur; ii++) {
+          const pointKey& q = pointSource[cur[ii]];
+          int pr = q.res - s, fc = q.flatChain;
+          if ((pr < 0) || (pr >= chainBeg[fc + 1] - chainBeg[fc])) continue;
+          int p = resPoint[chainBeg[fc] + pr];
+          if ((p < 0) || (closePos[p] < 0)) continue;
+          hits[closePos[p] / 64] |= ((uint64_t) 1) << (closePos[p] % 64);
         }
-        if (surviving.size() * 1.0 / close.size() < 0.1) break;
-        inRegister = surviving;
+        int numSurviving = 0;
+        for (int w = 0; w < W; w++) numSurviving += bitset<64>(inRegister[w] & hits[w]).count();
+        if (numSurviving * 1.0 / numClose < 0.1) break;
+        for (int w = 0; w < W; w++) inRegister[w] &= hits[w];
+        numInRegister = numSurviving;
       }
       if (s < 0) L = ri + 1;
       else U = ri - 1;
-      regScores[i] += fabs(1.0*(ri - source[2]))*inRegister.size()*1.0;
+      regScores[i] += fabs(1.0*(ri - source.res))*numInRegister*1.0;
     }
-    if (verb) cout << "promising point " << i << ", with " << close.size() << " close neighbors expanded to a region of " << U - L + 1 << " residues, score = " << regScores[i] << "..." << endl;
+    for (int c = 0; c < numClose; c++) closePos[close[c]] = -1;
+    if (verb) messages[i] = "promising point " + MstUtils::toString(i) + ", with " + MstUtils::toString(numClose) + " close neighbors expanded to a region of " + MstUtils::toString(U - L + 1) + " residues, score = " + MstUtils::toString(regScores[i]) + "...";
 
     // cut out and output promising region
     for (ri = L; ri <= U; ri++) {
@@ -104,21 +134,22 @@ vector<AtomPointerVector> TERMUtils::mostDesignableFragments(Structure& C, vecto
         reg[i].push_back(&(res[ai]));
       }
     }
+  }, numThr);
+  if (verb) {
+    for (int i = 0; i < N; i++) cout << messages[i] << endl;
   }
 
   // select the best of the promising regions, forcing diversity
   vector<int> bestRegs = MstUtils::sortIndices(regScores);
-  map<int, bool> chosen;
+  vector<bool> chosen(P, false);
   vector<AtomPointerVector> ret;
   int k = 0;
   for (int i = 0; i < N; i++) {
     int pi = sortedIndex[bestRegs[i]]; // index of the seed point
     // make sure the seed of this region is not too close to that of a previously chosen region
-    vector<int> close;
-    PS->pointsWithin(PS->getPoint(pi), 0.0, dcut, &close);
     bool redundant = false;
-    for (int ii = 0; ii < close.size(); ii++) {
-      if (chosen.find(close[ii]) != chosen.end()) {
+    for (int ii = nbrBeg[pi]; ii < nbrBeg[pi + 1]; ii++) {
+      if (chosen[nbrs[ii]]) {
         redundant = true; break;
       }
     }
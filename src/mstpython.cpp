@@ -99,6 +99,105 @@ public:
 
 
 
+/* Releases the GIL for the lifetime of the object, so that long-running C++
+ * calls (searches, database reads, contact calculations) do not block other
+ * Python threads. Nothing inside the guarded scope may touch Python objects. */
+class ReleaseGIL {
+public:
+    ReleaseGIL() { state = PyEval_SaveThread(); }
+    ~ReleaseGIL() { PyEval_RestoreThread(state); }
+private:
+    ReleaseGIL(const ReleaseGIL&);
+    ReleaseGIL& operator=(const ReleaseGIL&);
+    PyThreadState* state;
+};
+
+/* Wraps a freshly filled bytearray in a memoryview of the given item format
+ * and shape. The result supports the buffer protocol, so numpy.asarray() (or
+ * numpy.frombuffer) views it without another copy. */
+boost::python::object bufferView(PyObject* bytes, const char* format, int rows, int cols = 0) {
+    using namespace boost::python;
+    object arr{handle<>(bytes)};
+    object view{handle<>(PyMemoryView_FromObject(arr.ptr()))};
+    // memoryview.cast does not accept zero-length dimensions
+    if ((rows == 0) || (cols == 0)) return view.attr("cast")(format);
+    return view.attr("cast")(format, boost::python::make_tuple(rows, cols));
+}
+
+/* Atoms do not live in one contiguous block, so coordinates are gathered once
+ * into a single N x 3 buffer of doubles (C order). */
+boost::python::object coordinateView(const vector<Atom*>& atoms) {
+    int N = atoms.size();
+    PyObject* bytes = PyByteArray_FromStringAndSize(NULL, 3 * N * sizeof(double));
+    if (bytes == NULL) boost::python::throw_error_already_set();
+    double* xyz = (double*) PyByteArray_AsString(bytes);
+    for (int i = 0; i < N; i++) {
+        xyz[3*i] = atoms[i]->getX();
+        xyz[3*i + 1] = atoms[i]->getY();
+        xyz[3*i + 2] = atoms[i]->getZ();
+    }
+    return bufferView(bytes, "d", N, 3);
+}
+
+/* Sets atom coordinates from any C-contiguous buffer of doubles with 3*N
+ * elements (e.g., an N x 3 float64 NumPy array). */
+void setCoordinatesFromBuffer(const vector<Atom*>& atoms, boost::python::object obj) {
+    Py_buffer buf;
+    if (PyObject_GetBuffer(obj.ptr(), &buf, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) boost::python::throw_error_already_set();
+    string format = (buf.format == NULL) ? "B" : buf.format;
+    bool ok = (buf.itemsize == sizeof(double)) && ((format == "d") || (format == "=d") || (format == "<d") || (format == "@d"));
+    ok = ok && (buf.len == (Py_ssize_t) (3 * atoms.size() * sizeof(double)));
+    if (!ok) {
+        PyBuffer_Release(&buf);
+        PyErr_SetString(PyExc_ValueError, "expected a C-contiguous float64 buffer with three coordinates per atom");
+        boost::python::throw_error_already_set();
+    }
+    const double* xyz = (const double*) buf.buf;
+    for (int i = 0; i < atoms.size(); i++) atoms[i]->setCoor(xyz[3*i], xyz[3*i + 1], xyz[3*i + 2]);
+    PyBuffer_Release(&buf);
+}
+
+/* Bulk getters for search results, as 1D (RMSDs, target indices) or 2D
+ * (segment alignments) buffers, instead of element-by-element wrapping. */
+boost::python::object solutionRMSDs(fasstSolutionSet& sols) {
+    int N = sols.size();
+    PyObject* bytes = PyByteArray_FromStringAndSize(NULL, N * sizeof(double));
+    if (bytes == NULL) boost::python::throw_error_already_set();
+    double* r = (double*) PyByteArray_AsString(bytes);
+    int i = 0;
+    for (auto it = sols.begin(); it != sols.end(); ++it, ++i) r[i] = it->getRMSD();
+    return bufferView(bytes, "d", N);
+}
+
+boost::python::object solutionTargets(fasstSolutionSet& sols) {
+    int N = sols.size();
+    PyObject* bytes = PyByteArray_FromStringAndSize(NULL, N * sizeof(int));
+    if (bytes == NULL) boost::python::throw_error_already_set();
+    int* t = (int*) PyByteArray_AsString(bytes);
+    int i = 0;
+    for (auto it = sols.begin(); it != sols.end(); ++it, ++i) t[i] = it->getTargetIndex();
+    return bufferView(bytes, "i", N);
+}
+
+boost::python::object solutionAlignments(fasstSolutionSet& sols) {
+    int N = sols.size();
+    int L = (N > 0) ? sols.begin()->numSegments() : 0;
+    PyObject* bytes = PyByteArray_FromStringAndSize(NULL, N * L * sizeof(int));
+    if (bytes == NULL) boost::python::throw_error_already_set();
+    int* a = (int*) PyByteArray_AsString(bytes);
+    int i = 0;
+    for (auto it = sols.begin(); it != sols.end(); ++it, ++i) {
+        const vector<int>& al = it->getAlignment();
+        if (al.size() != L) {
+            Py_DECREF(bytes);
+            PyErr_SetString(PyExc_ValueError, "solutions have differing numbers of segments");
+            boost::python::throw_error_already_set();
+        }
+        for (int j = 0; j < L; j++) a[i*L + j] = al[j];
+    }
+    return bufferView(bytes, "i", N, L);
+}
+
 // Overloads for functions with optional arguments
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(addTargetsOverloads, FASST::addTargets, 1, 2)
 
@@ -145,7 +244,9 @@ BOOST_PYTHON_MODULE(mstpython) {
 
     class_<AtomPointerVector>("AtomPointerVector", init<const vector<Atom *> &>())
     .def("__getitem__", +[](const AtomPointerVector &a, int i) { return a[i]; }, return_value_policy<reference_existing_object>())
-    .def("__len__", &AtomPointerVector::size);
+    .def("__len__", &AtomPointerVector::size)
+    .def("getCoordinates", +[](const AtomPointerVector &a) { return coordinateView(a); })
+    .def("setCoordinates", +[](const AtomPointerVector &a, boost::python::object xyz) { setCoordinatesFromBuffer(a, xyz); });
 
     // expose classes
 
@@ -264,6 +365,8 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("__str__", &Py_Structure::structureToString)
     .add_property("name", &MST::Structure::getName, &MST::Structure::setName)
     .def("reassignChainsByConnectivity", static_cast<MST::Structure (MST::Structure::*) (MST::mstreal)> (&MST::Structure::reassignChainsByConnectivity))
+    .def("getCoordinates", +[](const MST::Structure& structure) { return coordinateView(structure.getAtoms()); })
+    .def("setCoordinates", +[](MST::Structure& structure, boost::python::object xyz) { setCoordinatesFromBuffer(structure.getAtoms(), xyz); })
     ;
 
     class_<RMSDCalculator>("RMSDCalculator", init<>())
@@ -299,6 +402,9 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("clear", &fasstSolutionSet::clear)
     .def("worstRMSD", &fasstSolutionSet::worstRMSD)
     .def("bestRMSD", &fasstSolutionSet::bestRMSD)
+    .def("rmsds", &solutionRMSDs)
+    .def("targetIndices", &solutionTargets)
+    .def("alignments", &solutionAlignments)
     ;
 
     class_<fasstSeqConstSimple>("fasstSeqConstSimple", init<int>())
@@ -350,8 +456,12 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("areInContact", &contactList::areInContact)
     ;
 
-    class_<ConFind, boost::noncopyable>("ConFind", init<string, Structure&>())
-    .def("cache", static_cast<void (ConFind::*) (const Structure&)>(&ConFind::cache))
+    class_<ConFind, boost::noncopyable>("ConFind", no_init)
+    .def("__init__", make_constructor(+[](string rotLibFile, const Structure& S) {
+        ReleaseGIL nogil;
+        return new ConFind(rotLibFile, S);
+    }))
+    .def("cache", +[](ConFind& C, const Structure& S) { ReleaseGIL nogil; C.cache(S); })
     .def("getNeighbors", static_cast<std::vector<Residue *> (ConFind::*) (Residue *)>(&ConFind::getNeighbors))
     .def("contactDegree", &ConFind::contactDegree)
     .def("getContacts", static_cast<contactList (ConFind::*) (Structure&, mstreal, contactList *)>(&ConFind::getContacts))
@@ -369,7 +479,7 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("addTargets", &FASST::addTargets, addTargetsOverloads())
     .add_property("options", make_function(&FASST::options, return_value_policy<reference_existing_object>()), &FASST::setOptions)
     .add_property("numTargets", &FASST::numTargets)
-    .def("search", &FASST::search)
+    .def("search", +[](FASST& F) { ReleaseGIL nogil; return F.search(); })
     .add_property("numMatches", &FASST::numMatches)
     .def("getMatches", &FASST::getMatches)
     .def("getTargetCopy",&FASST::getTargetCopy)
@@ -377,7 +487,8 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("getMatchResidueIndices", &FASST::getMatchResidueIndices)
     .def("getMatchSequence", &FASST::getMatchSequence)
     .def("getMatchSequences", &FASST::getMatchSequences)
-    .def("readDatabase", &FASST::readDatabase)
+    .def("readDatabase", +[](FASST& F, const string& dbFile) { ReleaseGIL nogil; F.readDatabase(dbFile); })
+    .def("readDatabase", +[](FASST& F, const string& dbFile, short memSave) { ReleaseGIL nogil; F.readDatabase(dbFile, memSave); })
     ;
 
     boost::python::enum_<FASST::matchType>("matchType")
@@ -421,7 +532,11 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("fuse", +[](const fusionTopology &topo) {
         fusionOutput output;
         fusionParams params;
-        Structure result = Fuser::fuse(topo, output, params);
+        Structure result;
+        {
+            ReleaseGIL nogil;
+            result = Fuser::fuse(topo, output, params);
+        }
         return boost::python::make_tuple(result, output);
     })
     .staticmethod("fuse")
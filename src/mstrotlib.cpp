@@ -239,11 +239,16 @@ void RotamerLibrary::transformRotamerAtoms(Transform& T, Residue& rots, int rotI
     if (a.numAlternatives() < rotIndex) {
       MstUtils::error("rotamer library contains " + MstUtils::toString(a.numAlternatives() + 1) + " rotamers for amino-acid, but rotamer number " + MstUtils::toString(rotIndex+1) + "was requested", "RotamerLibrary::placeRotamer");
     }
-    if (rotIndex > 0) a.swapWithAlternative(rotIndex-1);
+    // read the rotamer's coordinates without touching the library, so that it can be shared among threads
     Atom* newAtom = new Atom(a, false);
+    if (rotIndex > 0) {
+      newAtom->setCoor(a.getAltCoor(rotIndex-1));
+      newAtom->setOcc(a.getAltOcc(rotIndex-1));
+      newAtom->setB(a.getAltB(rotIndex-1));
+      newAtom->setAlt(a.getAltLocID(rotIndex-1));
+    }
     T.apply(newAtom);
     newAtoms[i] = newAtom;
-    if (rotIndex > 0) a.swapWithAlternative(rotIndex-1);
   }
 }
 
@@ -0,0 +1,230 @@
+#include "mstsecstruct.h"
+#include <array>
+#include <deque>
+
+const mstreal SecStructTools::maxHBondEnergy = -0.5;
+
+mstreal SecStructTools::hbondEnergy(const CartesianPoint& N, const CartesianPoint& H, const CartesianPoint& C, const CartesianPoint& O) {
+  const mstreal coupling = -27.888; // q1*q2*f, in kcal*Angstrom/mol
+  const mstreal minEnergy = -9.9;   // lower bound (also used for clashing atoms)
+  mstreal dHO = H.distance(O), dHC = H.distance(C), dNC = N.distance(C), dNO = N.distance(O);
+  if ((dHO < 0.5) || (dHC < 0.5) || (dNC < 0.5) || (dNO < 0.5)) return minEnergy;
+  mstreal E = coupling/dHO - coupling/dHC + coupling/dNC - coupling/dNO;
+  E = round(E * 1000) / 1000; // DSSP compatibility
+  return MstUtils::max(E, minEnergy);
+}
+
+namespace {
+  // backbone geometry and H-bonding state of one structure, indexed by residue
+  class ssState {
+    public:
+      ssState(const Structure& S);
+      int size() const { return n; }
+      // true if residues a through b (inclusive) exist, have backbones, and are consecutive
+      bool noBreak(int a, int b) const { return (a >= 0) && (b < n) && (a <= b) && hasBB[a] && (breaks[b] == breaks[a]); }
+      // true if the N-H of residue d is H-bonded to the C=O of residue a
+      bool bond(int d, int a) const {
+        if ((d < 0) || (d >= n) || (a < 0) || (a >= n)) return false;
+        return ((acc[d][0] == a) && (accE[d][0] < SecStructTools::maxHBondEnergy)) || ((acc[d][1] == a) && (accE[d][1] < SecStructTools::maxHBondEnergy));
+      }
+      void computeHBonds();
+      vector<string> assign();
+
+    private:
+      void consider(int d, int a); // donor d, acceptor a
+      enum bridgeType { noBridge = 0, parallel, antiparallel };
+      bridgeType testBridge(int i, int j) const;
+      struct ladder {
+        bridgeType type;
+        deque<int> i, j;
+      };
+
+      int n;
+      vector<CartesianPoint> N, H, CA, C, O;
+      vector<bool> hasBB, isDonor;
+      vector<int> breaks; // number of chain breaks at or before each residue
+      vector<array<int, 2> > acc; // two best acceptors for each donor
+      vector<array<mstreal, 2> > accE;
+  };
+}
+
+ssState::ssState(const Structure& S) {
+  n = S.residueSize();
+  N.resize(n); H.resize(n); CA.resize(n); C.resize(n); O.resize(n);
+  hasBB.resize(n, false); isDonor.resize(n, false); breaks.resize(n, 0);
+  acc.resize(n, {{-1, -1}}); accE.resize(n, {{0, 0}});
+  for (int i = 0; i < n; i++) {
+    Residue& res = S.getResidue(i);
+    Atom* aN = res.findAtom("N", false); Atom* aCA = res.findAtom("CA", false);
+    Atom* aC = res.findAtom("C", false); Atom* aO = res.findAtom("O", false);
+    if ((aN == NULL) || (aCA == NULL) || (aC == NULL) || (aO == NULL)) continue;
+    hasBB[i] = true;
+    N[i] = CartesianPoint(*aN); CA[i] = CartesianPoint(*aCA);
+    C[i] = CartesianPoint(*aC); O[i] = CartesianPoint(*aO);
+  }
+  for (int i = 0; i < n; i++) {
+    bool connected = (i > 0) && hasBB[i] && hasBB[i-1] && (S.getResidue(i).getChain() == S.getResidue(i-1).getChain()) && (C[i-1].distance(N[i]) <= 2.5);
+    breaks[i] = (i > 0 ? breaks[i-1] : 0) + (connected ? 0 : 1);
+    if (!hasBB[i]) continue;
+    // amide hydrogen placed 1 Angstrom from N, along the O->C direction of the previous carbonyl
+    H[i] = N[i];
+    if (connected) H[i] += (C[i-1] - O[i-1]).getUnit();
+    isDonor[i] = !S.getResidue(i).isNamed("PRO");
+  }
+}
+
+void ssState::consider(int d, int a) {
+  if (!isDonor[d]) return;
+  mstreal E = SecStructTools::hbondEnergy(N[d], H[d], C[a], O[a]);
+  if (E < accE[d][0]) {
+    acc[d][1] = acc[d][0]; accE[d][1] = accE[d][0];
+    acc[d][0] = a; accE[d][0] = E;
+  } else if (E < accE[d][1]) {
+    acc[d][1] = a; accE[d][1] = E;
+  }
+}
+
+void ssState::computeHBonds() {
+  vector<CartesianPoint> pts; vector<int> tags;
+  for (int i = 0; i < n; i++) {
+    if (hasBB[i]) { pts.push_back(CA[i]); tags.push_back(i); }
+  }
+  if (pts.size() < 2) return;
+  const mstreal maxCADist = 9.0;
+  ProximitySearch ps(pts, maxCADist, true, &tags);
+  vector<int> close;
+  for (int k = 0; k < pts.size(); k++) {
+    int i = tags[k];
+    close.clear();
+    ps.pointsWithin(CA[i], 0, maxCADist, &close, true);
+    sort(close.begin(), close.end());
+    for (int j : close) {
+      if (j <= i) continue;
+      consider(i, j);
+      if (j != i + 1) consider(j, i);
+    }
+  }
+}
+
+ssState::bridgeType ssState::testBridge(int i, int j) const {
+  int a = i - 1, b = i, c = i + 1, d = j - 1, e = j, f = j + 1;
+  if (!noBreak(a, c) || !noBreak(d, f)) return noBridge;
+  if ((bond(c, e) && bond(e, a)) || (bond(f, b) && bond(b, d))) return parallel;
+  if ((bond(c, d) && bond(f, a)) || (bond(e, b) && bond(b, e))) return antiparallel;
+  return noBridge;
+}
+
+vector<string> ssState::assign() {
+  vector<char> ss(n, 'C');
+
+  // bridges can only involve residues flanking an H-bond, so collect candidate pairs from those
+  vector<pair<int, int> > cand;
+  for (int d = 0; d < n; d++) {
+    for (int k = 0; k < 2; k++) {
+      if (!bond(d, acc[d][k])) continue;
+      for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+          int x = d + dx, y = acc[d][k] + dy;
+          int i = min(x, y), j = max(x, y);
+          if ((i >= 1) && (j - i >= 3) && (j + 1 < n)) cand.push_back(make_pair(i, j));
+        }
+      }
+    }
+  }
+  sort(cand.begin(), cand.end());
+  cand.erase(unique(cand.begin(), cand.end()), cand.end());
+
+  // bridges, joined into ladders
+  vector<ladder> ladders;
+  for (auto& p : cand) {
+    int i = p.first, j = p.second;
+    bridgeType type = testBridge(i, j);
+    if (type == noBridge) continue;
+    bool found = false;
+    for (ladder& L : ladders) {
+      if ((type != L.type) || (i != L.i.back() + 1)) continue;
+      if ((type == parallel) && (L.j.back() + 1 == j)) {
+        L.i.push_back(i); L.j.push_back(j); found = true; break;
+      }
+      if ((type == antiparallel) && (L.j.front() - 1 == j)) {
+        L.i.push_back(i); L.j.push_front(j); found = true; break;
+      }
+    }
+    if (!found) {
+      ladders.push_back(ladder());
+      ladders.back().type = type; ladders.back().i.push_back(i); ladders.back().j.push_back(j);
+    }
+  }
+
+  // merge ladders separated by beta bulges
+  stable_sort(ladders.begin(), ladders.end(), [](const ladder& A, const ladder& B) { return A.i.front() < B.i.front(); });
+  for (int li = 0; li < ladders.size(); li++) {
+    for (int lj = li + 1; lj < ladders.size(); lj++) {
+      ladder& A = ladders[li]; ladder& B = ladders[lj];
+      int ibi = A.i.front(), iei = A.i.back(), jbi = A.j.front(), jei = A.j.back();
+      int ibj = B.i.front(), iej = B.i.back(), jbj = B.j.front(), jej = B.j.back();
+      if ((A.type != B.type) || !noBreak(min(ibi, ibj), max(iei, iej)) || !noBreak(min(jbi, jbj), max(jei, jej)) ||
+          (ibj - iei >= 6) || ((iei >= ibj) && (ibi <= iej))) continue;
+      bool bulge;
+      if (A.type == parallel) bulge = ((jbj - jei < 6) && (ibj - iei < 3)) || (jbj - jei < 3);
+      else bulge = ((jbi - jej < 6) && (ibj - iei < 3)) || (jbi - jej < 3);
+      if (!bulge) continue;
+      A.i.insert(A.i.end(), B.i.begin(), B.i.end());
+      if (A.type == parallel) A.j.insert(A.j.end(), B.j.begin(), B.j.end());
+      else A.j.insert(A.j.begin(), B.j.begin(), B.j.end());
+      ladders.erase(ladders.begin() + lj);
+      lj--;
+    }
+  }
+  for (ladder& L : ladders) {
+    char c = (L.i.size() > 1) ? 'E' : 'B';
+    for (int k = L.i.front(); k <= L.i.back(); k++) if (ss[k] != 'E') ss[k] = c;
+    for (int k = L.j.front(); k <= L.j.back(); k++) if (ss[k] != 'E') ss[k] = c;
+  }
+
+  // helices: start[k][i] means the C=O of i accepts an H-bond from the N-H of i+k
+  vector<vector<bool> > start(6, vector<bool>(n, false));
+  for (int k = 3; k <= 5; k++) {
+    for (int i = 0; i + k < n; i++) start[k][i] = noBreak(i, i + k) && bond(i + k, i);
+  }
+  for (int i = 1; i + 4 < n; i++) {
+    if (start[4][i] && start[4][i-1]) {
+      for (int j = i; j <= i + 3; j++) ss[j] = 'H';
+    }
+  }
+  for (int k = 3; k <= 5; k += 2) {
+    char c = (k == 3) ? 'G' : 'I';
+    for (int i = 1; i + k < n; i++) {
+      if (!start[k][i] || !start[k][i-1]) continue;
+      bool empty = true;
+      for (int j = i; empty && (j < i + k); j++) empty = (ss[j] == 'C') || (ss[j] == c);
+      if (empty) for (int j = i; j < i + k; j++) ss[j] = c;
+    }
+  }
+
+  // turns
+  for (int i = 1; i < n; i++) {
+    if (ss[i] != 'C') continue;
+    bool turn = false;
+    for (int k = 3; !turn && (k <= 5); k++) {
+      for (int l = 1; !turn && (l < k); l++) turn = (i >= l) && start[k][i - l];
+    }
+    if (turn) ss[i] = 'T';
+  }
+
+  vector<string> ret(n);
+  for (int i = 0; i < n; i++) ret[i] = string(1, ss[i]);
+  return ret;
+}
+
+vector<string> SecStructTools::assign(const Structure& S) {
+  ssState state(S);
+  state.computeHBonds();
+  return state.assign();
+}
+
+vector<vector<string> > SecStructTools::assign(const vector<Structure*>& structs, int numThreads) {
+  vector<vector<string> > ret(structs.size());
+  MstUtils::parallelFor(0, structs.size(), [&](int i, int t) { ret[i] = assign(*structs[i]); }, numThreads);
+  return ret;
+}
@@ -1,4 +1,6 @@
 #include "mstsystem.h"
+#include "mstlocks.h"
+#include <errno.h>
 
 using namespace MST;
 
@@ -86,6 +88,11 @@ void MstSys::crm(const string& filePath) {
   MstUtils::assertCond(ret == 0, "failed to remove file '" + filePath + "'");
 }
 
+void MstSys::cmv(const string& from, const string& to) {
+  int ret = rename(from.c_str(), to.c_str());
+  MstUtils::assertCond(ret == 0, "failed to move '" + from + "' to '" + to + "': " + strerror(errno));
+}
+
 string MstSys::getMachineName() {
   int n = 1024;
   char hostname[n];
@@ -102,65 +109,21 @@ string MstSys::getUserName() {
   return string(username);
 }
 
-bool MstSys::getNetLock(const string& tag, bool shared, const string& linuxHost) {
-  int timeout = 60*5, waitTime = 10; // in seconds
-  string eQ = "\'\"\'\"\'";
-  string token = getMachineName() + "-" + MstUtils::toString((int) getpid());
-  string timeoutStr = MstUtils::toString(timeout);
-  string waitStr = MstUtils::toString(waitTime);
-  string base = "/tmp/.mst-" + tag;
-  string lockFile = base + ".lockfile";
-  string busyFileX = base + ".busyfile.X";
-  string busyFileS = base + ".busyfile.S";
-  string busyFiles = busyFileX + " " + busyFileS;
-  string notLockedCond = shared ? "[ ! -f " + busyFileX + " ]" : "[ ! -f " + busyFileX + " ] && [ ! -f " + busyFileS + " ] ";
-  string doLock = shared ? "echo " + token + " >> " + busyFileS : "echo " + token + " > " + busyFileX;
-  string timeCheck = "if ( [ ! -f " + busyFileX + " ] || [ $((`date +%s` - `stat -c %Y " + busyFileX + "`)) -gt " + timeoutStr + " ] ) && "
-                        "( [ ! -f " + busyFileS + " ] || [ $((`date +%s` - `stat -c %Y " + busyFileS + "`)) -gt " + timeoutStr + " ] ); then "
-                          "rm -f " + busyFiles + "; " + doLock + "; exit 3; else exit 2; fi";
-  string touchCmd = "if " + notLockedCond + "; then " + doLock + " ; exit 0; else " + timeCheck + "; fi";
-  string remoteCmd = "flock -w " + waitStr + " " + lockFile + " -c " + eQ + touchCmd + eQ;
-  string cmd = "ssh " + linuxHost + " '" + remoteCmd + "'";
-  for (int i = 0; i < int(1.0*timeout/waitTime + 1); i++) {
-    int ret = system(cmd.c_str());
-    ret = WEXITSTATUS(ret);    // this gets the exit status of the command
-    if (ret == 0) return true; // got lock fine
-    if (ret == 3) return true; // got lock, but got impatient and had to overwrite the old one
-    if (ret == 2) sleep(waitTime); // could not get lock, somebody else's lock is not yet released
-    // (ret == 1) means getting a lock failed; not clear how to recover from that
-  }
-  return false;
+bool MstSys::getNetLock(const string& tag, bool shared, int timeout) {
+  return MstLockManager::acquire(tag, shared, timeout);
 }
 
-bool MstSys::releaseNetLock(const string& tag, const string& linuxHost) {
-  int timeout = 60*5, waitTime = 10; // in seconds
-  string eQ = "\'\"\'\"\'";
-  string token = getMachineName() + "-" + MstUtils::toString((int) getpid());
-  string timeoutStr = MstUtils::toString(timeout);
-  string waitStr = MstUtils::toString(waitTime);
-  string base = "/tmp/.mst-" + tag;
-  string lockFile = base + ".lockfile";
-  string busyFileX = base + ".busyfile.X";
-  string busyFileS = base + ".busyfile.S";
-  string sed = "sed -i " + eQ + "/^" + token +"$/d" + eQ + " ";
-  string removeTokenX = "if [ -f " + busyFileX + " ]; then " + sed + busyFileX + "; fi; ";
-  string removeTokenS = "if [ -f " + busyFileS + " ]; then " + sed + busyFileS + "; fi; ";
-  string removeToken = removeTokenX + removeTokenS; // there should never be BOTH an exclusive and a shared lock
-  string cleanX = "if [ ! -s " + busyFileX + " ]; then rm -f " + busyFileX + "; fi; ";
-  string cleanS = "if [ ! -s " + busyFileS + " ]; then rm -f " + busyFileS + "; fi; ";
-  string clean = cleanX + cleanS;
-  string remoteCmd = "flock -w " + waitStr + " " + lockFile + " -c \"" + removeToken + clean + "\"; exit 0;";
-  string cmd = "ssh " + linuxHost + " '" + remoteCmd + "'";
-  for (int i = 0; i < int(1.0*timeout/waitTime + 1); i++) {
-    int ret = system(cmd.c_str());
-    ret = WEXITSTATUS(ret);    // this gets the exit status of the command
-    if (ret == 0) return true; // got lock fine
-    // (ret == 1) means getting a lock failed; not clear how to recover from that
-  }
-  return false;
+bool MstSys::releaseNetLock(const string& tag) {
+  return MstLockManager::release(tag);
 }
 
 int MstSys::memUsage() {
+  // resident pages are the second field of /proc/self/statm
+  ifstream ifs("/proc/self/statm");
+  long size, resident;
+  if (ifs >> size >> resident) return int(resident * (sysconf(_SC_PAGESIZE) / 1024));
+
+  // no /proc (e.g., not Linux), so ask ps
   string pid = MstUtils::toString((int) getpid());
   string tmpFile = "/tmp/mu.out." + pid;
   MstSys::csystem("ps -p " + pid + " -o rss | tail -1 > " + tmpFile);
@@ -169,3 +132,21 @@ int MstSys::memUsage() {
   MstSys::crm(tmpFile);
   return MstUtils::toInt(lines[0]);
 }
+
+int MstSys::peakMemUsage() {
+  ifstream ifs("/proc/self/status");
+  string line;
+  while (getline(ifs, line)) {
+    if (line.compare(0, 6, "VmHWM:") != 0) continue;
+    istringstream iss(line.substr(6));
+    long kb;
+    if (iss >> kb) return int(kb);
+  }
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) MstUtils::error("could not get peak memory usage", "MstSys::peakMemUsage");
+#ifdef __APPLE__
+  return int(ru.ru_maxrss / 1024); // reported in bytes on macOS
+#else
+  return int(ru.ru_maxrss);
+#endif
+}
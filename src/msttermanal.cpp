@@ -8,20 +8,61 @@ mstreal TERMANAL::structureScore(const Structure& term, const vector<Residue*>&
 }
 
 pair<mstreal, mstreal> TERMANAL::structureScoreParts(const Structure& term, const vector<Residue*>& central, bool verbose) {
-  if (F == NULL) MstUtils::error("FASST object not set", "TERMANAL::structureScoreParts");
-  if (verbose) {
-    cout << "\tvisiting TERM (" << MstUtils::vecPtrToString(central) << "): " << MstUtils::vecPtrToString(term.getResidues()) << endl;
-    // term.writePDB(cout);
+  vector<pair<mstreal, mstreal>> parts;
+  vector<string> logs;
+  scoreTERMs({&term}, {central}, parts, verbose ? &logs : NULL);
+  if (verbose) cout << logs[0];
+  return parts[0];
+}
+
+vector<pair<mstreal, mstreal>> TERMANAL::structureScoreParts(const vector<Structure*>& terms, const vector<vector<Residue*>>& centrals, bool verbose) {
+  vector<pair<mstreal, mstreal>> parts;
+  vector<string> logs;
+  scoreTERMs(vector<const Structure*>(terms.begin(), terms.end()), centrals, parts, verbose ? &logs : NULL);
+  if (verbose) for (const string& log : logs) cout << log;
+  return parts;
+}
+
+void TERMANAL::scoreTERMs(const vector<const Structure*>& terms, const vector<vector<Residue*>>& centrals, vector<pair<mstreal, mstreal>>& parts, vector<string>* logs) {
+  if (F == NULL) MstUtils::error("FASST object not set", "TERMANAL::scoreTERMs");
+  MstUtils::assertCond(terms.size() == centrals.size(), "expected one set of central residues per TERM", "TERMANAL::scoreTERMs");
+
+  // distinct TERMs that are not in the cache yet
+  vector<vector<mstreal>> keys(terms.size());
+  set<vector<mstreal>> pending;
+  vector<int> toSearch;
+  for (int i = 0; i < terms.size(); i++) {
+    keys[i] = termKey(*terms[i]);
+    if ((matchCache.find(keys[i]) == matchCache.end()) && (pending.insert(keys[i]).second)) toSearch.push_back(i);
   }
 
+  // search for them in parallel, each thread with its own FASST object
+  vector<FASST*> searchers(1, F);
+  searchers.insert(searchers.end(), workers.begin(), workers.end());
+  vector<termMatches> found(toSearch.size());
+  MstUtils::parallelFor(0, toSearch.size(), [&](int k, int t) {
+    found[k] = searchTERM(searchers[t], *terms[toSearch[k]]);
+  }, searchers.size());
+  for (int k = 0; k < toSearch.size(); k++) matchCache[keys[toSearch[k]]] = found[k];
+
+  parts.resize(terms.size());
+  if (logs != NULL) logs->resize(terms.size());
+  for (int i = 0; i < terms.size(); i++) {
+    stringstream log;
+    parts[i] = scoreParts(matchCache[keys[i]], *terms[i], centrals[i], logs != NULL, log);
+    if (logs != NULL) (*logs)[i] = log.str();
+  }
+}
+
+TERMANAL::termMatches TERMANAL::searchTERM(FASST* S, const Structure& term) {
   // get the top hits
-  fasstSearchOptions origOpts = setupSearch(term);
-  fasstSolutionSet matches = F->search();
+  fasstSearchOptions origOpts = setupSearch(S, term);
+  fasstSolutionSet matches = S->search();
   vector<fasstSolution*> topMatches;
   vector<mstreal> rmsds;
   if (compatMode) {
     vector<Atom*> termBB = RotamerLibrary::getBackbone(term);
-    topMatches = getTopMatches(F, matches, termBB, &rmsds);
+    topMatches = getTopMatches(S, matches, termBB, &rmsds);
   } else {
     int numMatches = matches.size();
     topMatches.resize(numMatches);
@@ -31,18 +72,43 @@ pair<mstreal, mstreal> TERMANAL::structureScoreParts(const Structure& term, cons
       rmsds[i] = matches[i].getRMSD();
     }
   }
-
-  // sequence likelihood = fraction of top hits that share the right amino acid
-  mstreal seqLikeComb = calcSeqLikelihood(topMatches, central, verbose);
+  termMatches tm;
+  tm.seqs.resize(topMatches.size());
+  for (int i = 0; i < topMatches.size(); i++) tm.seqs[i] = S->getMatchSequence(*topMatches[i]);
 
   // structure frequency = number of matches with RMSD below that of the Nth
   // match to the top native representative of the query, divided by N=matchCount
-  mstreal structFreq = calcStructFreq(topMatches, rmsds, verbose);
+  tm.structFreq = calcStructFreq(S, topMatches, rmsds);
 
   // recover original search options
-  F->setOptions(origOpts);
+  S->setOptions(origOpts);
+  return tm;
+}
+
+pair<mstreal, mstreal> TERMANAL::scoreParts(const termMatches& tm, const Structure& term, const vector<Residue*>& central, bool verbose, ostream& log) {
+  if (verbose) {
+    log << "\tvisiting TERM (" << MstUtils::vecPtrToString(central) << "): " << MstUtils::vecPtrToString(term.getResidues()) << endl;
+  }
+
+  // sequence likelihood = fraction of top hits that share the right amino acid
+  mstreal seqLikeComb = calcSeqLikelihood(tm.seqs, central, verbose, log);
+  if (verbose) log << "\tstructure frequency = " << tm.structFreq << endl;
+
+  return make_pair(seqLikeComb, tm.structFreq);
+}
 
-  return make_pair(seqLikeComb, structFreq);
+vector<mstreal> TERMANAL::termKey(const Structure& term) {
+  vector<mstreal> key;
+  for (int ci = 0; ci < term.chainSize(); ci++) {
+    Chain& C = term[ci];
+    key.push_back(C.residueSize());
+    for (int ri = 0; ri < C.residueSize(); ri++) {
+      vector<Atom*> bb = RotamerLibrary::getBackbone(C[ri]);
+      key.push_back(bb.size());
+      for (Atom* a : bb) { key.push_back(a->getX()); key.push_back(a->getY()); key.push_back(a->getZ()); }
+    }
+  }
+  return key;
 }
 
 mstreal TERMANAL::combineScoreParts(const pair<mstreal, mstreal>& parts) {
@@ -67,17 +133,41 @@ vector<mstreal> TERMANAL::scoreStructure(const Structure& S, const vector<Residu
   vector<vector<int>> resOverlaps;
   vector<Structure> terms = collectTERMs(C, S.getResidues(), centrals, resOverlaps);
 
+  // visit all TERMs necessary for computing the scores in the subregion at once,
+  // so that their searches can be done in parallel
+  vector<bool> needed(terms.size(), false);
+  for (int i = 0; i < subregion.size(); i++) {
+    for (int ti : resOverlaps[subregion[i]->getResidueIndex()]) needed[ti] = true;
+  }
+  vector<int> neededIdx;
+  vector<const Structure*> neededTerms;
+  vector<vector<Residue*>> neededCentrals;
+  for (int ti = 0; ti < terms.size(); ti++) {
+    if (!needed[ti]) continue;
+    neededIdx.push_back(ti);
+    neededTerms.push_back(&terms[ti]);
+    neededCentrals.push_back({centrals[ti]});
+  }
+  vector<pair<mstreal, mstreal>> neededParts;
+  vector<string> logs;
+  scoreTERMs(neededTerms, neededCentrals, neededParts, verbose ? &logs : NULL);
+  map<int, string> termLogs; // reported (and erased) as TERMs are first used below
+  for (int k = 0; k < neededIdx.size(); k++) {
+    structScoreParts[neededIdx[k]] = neededParts[k];
+    if (verbose) termLogs[neededIdx[k]] = logs[k];
+  }
+
   // Smooth and combine each pair of score parts by incorporating the scores from each TERM that a residue belongs to
   vector<mstreal> structScores(subregion.size());
   if (scoreParts != NULL) scoreParts->resize(subregion.size());
   for (int i = 0; i < subregion.size(); i++) {
     int idx = subregion[i]->getResidueIndex();
-    if (verbose) cout << "Scoring " << *(subregion[i]) << " ..." << endl;
-
-    // visit any TERMs necessary for computing the scores at residue index idx
-    for (int ti : resOverlaps[idx]) {
-      if (structScoreParts.find(ti) == structScoreParts.end()) {
-        structScoreParts[ti] = structureScoreParts(terms[ti], {centrals[ti]}, verbose);
+    if (verbose) {
+      cout << "Scoring " << *(subregion[i]) << " ..." << endl;
+      for (int ti : resOverlaps[idx]) {
+        if (termLogs.find(ti) == termLogs.end()) continue;
+        cout << termLogs[ti];
+        termLogs.erase(ti);
       }
     }
 
@@ -93,15 +183,15 @@ vector<mstreal> TERMANAL::scoreStructure(const Structure& S, const vector<Residu
   return structScores;
 }
 
-fasstSearchOptions TERMANAL::setupSearch(const Structure& S) {
-  fasstSearchOptions origOpts = F->options(); // in case the same FASST object is being shared by others
-  F->setOptions(fasstSearchOptions());
-  F->options().setRedundancyCut(0.7);
-  F->options().setRMSDCutoff(rmsdCut);
-  F->options().setMinNumMatches(0);
+fasstSearchOptions TERMANAL::setupSearch(FASST* S, const Structure& term) {
+  fasstSearchOptions origOpts = S->options(); // in case the same FASST object is being shared by others
+  S->setOptions(fasstSearchOptions());
+  S->options().setRedundancyCut(0.7);
+  S->options().setRMSDCutoff(rmsdCut);
+  S->options().setMinNumMatches(0);
   int maxNumMatches = compatMode ? compatSearchLimit : matchCount;
-  F->options().setMaxNumMatches(maxNumMatches);
-  F->setQuery(S);
+  S->options().setMaxNumMatches(maxNumMatches);
+  S->setQuery(term);
   return origOpts;
 }
 
@@ -109,11 +199,19 @@ vector<fasstSolution*> TERMANAL::getTopMatches(FASST* F, fasstSolutionSet& match
   RMSDCalculator RC;
   int numMatches = matches.size();
   vector<pair<mstreal, int>> rmsds(numMatches);
+  vector<mstreal> xyz; vector<int> offsets;
+  F->getMatchCoordinates(matches, xyz, offsets, FASST::matchType::REGION, true, workers.empty() ? 0 : 1); // TERMs are already searched in parallel with workers
+  AtomPointerVector matchA;
   for (int i = 0; i < numMatches; i++) {
-    Structure matchS = F->getMatchStructure(matches[i]);
-    AtomPointerVector matchA = matchS.getAtoms();
+    int n = offsets[i + 1] - offsets[i];
+    if (matchA.size() != n) { matchA.deletePointers(); matchA.resize(n); for (int k = 0; k < n; k++) matchA[k] = new Atom(); }
+    for (int k = 0; k < n; k++) {
+      const mstreal* p = &xyz[3*(offsets[i] + k)];
+      matchA[k]->setCoor(p[0], p[1], p[2]);
+    }
     rmsds[i] = make_pair(RC.bestRMSD(queryA, matchA), i);
   }
+  matchA.deletePointers();
   sort(rmsds.begin(), rmsds.end());
   int numToKeep = min(matchCount, numMatches);
   vector<fasstSolution*> topMatches(numToKeep);
@@ -125,18 +223,15 @@ vector<fasstSolution*> TERMANAL::getTopMatches(FASST* F, fasstSolutionSet& match
   return topMatches;
 }
 
-mstreal TERMANAL::calcSeqLikelihood(vector<fasstSolution*>& matches, const vector<Residue*>& central, bool verbose) {
-  int numMatches = matches.size();
-  vector<Sequence> matchSeqs(numMatches);
-  for (int i = 0; i < numMatches; i++) matchSeqs[i] = F->getMatchSequence(*matches[i]);
+mstreal TERMANAL::calcSeqLikelihood(const vector<Sequence>& matchSeqs, const vector<Residue*>& central, bool verbose, ostream& log) {
   vector<mstreal> seqLike(central.size(), 0);
   for (int i = 0; i < central.size(); i++) seqLike[i] = calcSeqFreq(central[i], matchSeqs);
   mstreal seqLikeComb = !central.empty() ? CartesianPoint(seqLike).mean() : 1.0;
-  if (verbose) cout << "\tsequence likelihood = [" << MstUtils::vecToString(seqLike) << "], overall = " << seqLikeComb << endl;
+  if (verbose) log << "\tsequence likelihood = [" << MstUtils::vecToString(seqLike) << "], overall = " << seqLikeComb << endl;
   return seqLikeComb;
 }
 
-mstreal TERMANAL::calcSeqFreq(Residue* res, vector<Sequence>& matchSeqs) {
+mstreal TERMANAL::calcSeqFreq(Residue* res, const vector<Sequence>& matchSeqs) {
   int idx = res->getResidueIndex();
   res_t aa = SeqTools::aaToIdx(res->getName());
   if (aa == SeqTools::unknownIdx()) MstUtils::error("unknown residue name in central residue " + MstUtils::toString(*res) + ", which is a problem for computing sequence likelihood", "TERMANAL::calcSeqFreq");
@@ -146,26 +241,24 @@ mstreal TERMANAL::calcSeqFreq(Residue* res, vector<Sequence>& matchSeqs) {
   return seqFreq;
 }
 
-mstreal TERMANAL::calcStructFreq(vector<fasstSolution*>& matches, vector<mstreal>& rmsds, bool verbose) {
+mstreal TERMANAL::calcStructFreq(FASST* S, vector<fasstSolution*>& matches, vector<mstreal>& rmsds) {
   int n;
   if (matches.size() >= 1) {
-    Structure firstMatch = F->getMatchStructure(*matches[0]);
-    F->setQuery(firstMatch);
-    fasstSolutionSet matchesToClosestNative = F->search();
+    Structure firstMatch = S->getMatchStructure(*matches[0]);
+    S->setQuery(firstMatch);
+    fasstSolutionSet matchesToClosestNative = S->search();
     mstreal r;
     if (compatMode) {
       vector<Atom*> firstMatchBB = RotamerLibrary::getBackbone(firstMatch);
       vector<mstreal> nativeRmsds;
-      getTopMatches(F, matchesToClosestNative, firstMatchBB, &nativeRmsds);
+      getTopMatches(S, matchesToClosestNative, firstMatchBB, &nativeRmsds);
       r = nativeRmsds.back();
     } else r = matchesToClosestNative.worstRMSD();
     for (n = 0; n < matches.size(); n++) {
       if (rmsds[n] > r) break;
     }
   } else n = 0;
-  mstreal structFreq = min(1.0, (1.0*n)/matchCount);
-  if (verbose) cout << "\tstructure frequency = " << structFreq << endl;
-  return structFreq;
+  return min(1.0, (1.0*n)/matchCount);
 }
 
 vector<Structure> TERMANAL::collectTERMs(ConFind& C, const vector<Residue*>& subregion, vector<Residue*>& centrals, vector<vector<int>>& resOverlaps) {
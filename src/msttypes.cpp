@@ -1,5 +1,6 @@
 #include "msttypes.h"
 mt19937 MstUtils::mt;
+thread_local mt19937* MstUtils::threadEngine = NULL;
 
 using namespace MST;
 
@@ -91,6 +92,20 @@ void Structure::reset() {
   numResidues = numAtoms = 0;
 }
 
+size_t Structure::memoryFootprint() const {
+  size_t bytes = sizeof(Structure) + MstUtils::heapBytes(chains) + MstUtils::heapBytes(name) + MstUtils::heapBytes(chainsByID) + MstUtils::heapBytes(chainsBySegID);
+  for (int i = 0; i < chains.size(); i++) {
+    Chain& C = *(chains[i]);
+    bytes += sizeof(Chain) + MstUtils::heapBytes(C.residues) + MstUtils::heapBytes(C.residueIndexInChain) + MstUtils::heapBytes(C.cid) + MstUtils::heapBytes(C.sid);
+    for (int j = 0; j < C.residues.size(); j++) {
+      Residue& R = *(C.residues[j]);
+      bytes += sizeof(Residue) + MstUtils::heapBytes(R.atoms) + MstUtils::heapBytes(R.resname);
+      for (int k = 0; k < R.atoms.size(); k++) bytes += R.atoms[k]->memoryFootprint();
+    }
+  }
+  return bytes;
+}
+
 Structure& Structure::operator=(const Structure& A) {
   reset();
   copy(A);
@@ -1073,7 +1088,7 @@ Atom::Atom(const Atom& A, bool copyAlt) {
   y = A.y;
   z = A.z;
   info = NULL;
-  if (A.hasInfo()) info = new atomInfo(*(A.info));
+  if (A.hasInfo()) info = new atomInfo(*(A.info), copyAlt);
 }
 
 Atom::Atom(int _index, const string& _name, mstreal _x, mstreal _y, mstreal _z, mstreal _B, mstreal _occ, bool _het, char _alt, Residue* _parent) {
@@ -1355,6 +1370,15 @@ void Atom::stripInfo() {
   }
 }
 
+size_t Atom::memoryFootprint() const {
+  size_t bytes = sizeof(Atom);
+  if (info == NULL) return bytes;
+  bytes += sizeof(atomInfo);
+  if (info->name != NULL) bytes += strlen(info->name) + 1;
+  if (info->alternatives != NULL) bytes += sizeof(vector<atomInfo::altInfo>) + MstUtils::heapBytes(*(info->alternatives));
+  return bytes;
+}
+
 /* --------- AtomPointerVector --------- */
 
 void AtomPointerVector::copyCoordinates(const AtomPointerVector& other) {
@@ -2813,6 +2837,48 @@ mstreal RMSDCalculator::rmsdCutoff(const vector<int>& J, const Structure& S, mst
 }
 
 // QCP algorithm from: http://onlinelibrary.wiley.com/doi/10.1002/jcc.21439/epdf
+mstreal RMSDCalculator::qcpLargestEigenvalue(const mstreal S[3][3], mstreal E0) {
+  int i, j;
+  // square of S
+  mstreal S2[3][3];
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) S2[i][j] = S[i][j]*S[i][j];
+  }
+
+  // calculate characteristic polynomial coefficients
+  // NOTE: though there are repeated terms in F, G, H, and I, it actually turns
+  // out to be better to let the compiler optimize this rathre than declare temp variables
+  mstreal C2 = -2*(S2[0][0] + S2[0][1] + S2[0][2] + S2[1][0] + S2[1][1] + S2[1][2] + S2[2][0] + S2[2][1] + S2[2][2]);
+  mstreal C1 = 8*(S[0][0]*S[1][2]*S[2][1] + S[1][1]*S[2][0]*S[0][2] + S[2][2]*S[0][1]*S[1][0] -
+                  S[0][0]*S[1][1]*S[2][2] - S[1][2]*S[2][0]*S[0][1] - S[2][1]*S[1][0]*S[0][2]);
+  mstreal D = (S2[0][1] + S2[0][2] - S2[1][0] - S2[2][0]); D = D*D;
+  mstreal E1 = -S2[0][0] + S2[1][1] + S2[2][2] + S2[1][2] + S2[2][1];
+  mstreal E2 = 2*(S[1][1]*S[2][2] - S[1][2]*S[2][1]);
+  mstreal E = (E1 - E2) * (E1 + E2);
+  mstreal F = (-(S[0][2] + S[2][0])*(S[1][2] - S[2][1]) + (S[0][1] - S[1][0])*(S[0][0] - S[1][1] - S[2][2])) *
+              (-(S[0][2] - S[2][0])*(S[1][2] + S[2][1]) + (S[0][1] - S[1][0])*(S[0][0] - S[1][1] + S[2][2]));
+  mstreal G = (-(S[0][2] + S[2][0])*(S[1][2] + S[2][1]) - (S[0][1] + S[1][0])*(S[0][0] + S[1][1] - S[2][2])) *
+              (-(S[0][2] - S[2][0])*(S[1][2] - S[2][1]) - (S[0][1] + S[1][0])*(S[0][0] + S[1][1] + S[2][2]));
+  mstreal H = ( (S[0][1] + S[1][0])*(S[1][2] + S[2][1]) + (S[0][2] + S[2][0])*(S[0][0] - S[1][1] + S[2][2])) *
+              (-(S[0][1] - S[1][0])*(S[1][2] - S[2][1]) + (S[0][2] + S[2][0])*(S[0][0] + S[1][1] + S[2][2]));
+  mstreal I = ( (S[0][1] + S[1][0])*(S[1][2] - S[2][1]) + (S[0][2] - S[2][0])*(S[0][0] - S[1][1] - S[2][2])) *
+              (-(S[0][1] - S[1][0])*(S[1][2] + S[2][1]) + (S[0][2] - S[2][0])*(S[0][0] + S[1][1] - S[2][2]));
+  mstreal C0 = D + E + F + G + H + I;
+
+  // now iterate Newton–Raphson method to find max eigenvalue
+  mstreal tol = 10E-11;
+  mstreal L = E0; // this initial guess is key (see http://journals.iucr.org/a/issues/2005/04/00/sh5029/sh5029.pdf)
+  mstreal Lold, L2, L3, L4, C22 = 2*C2;
+  do {
+    Lold = L;
+    L2 = L*L;
+    L3 = L2*L;
+    L4 = L3*L;
+    L = L - (L4 + C2*L2 + C1*L + C0)/(4*L3 + C22*L + C1);
+  } while (fabs(L - Lold) > tol*L);
+  return L;
+}
+
 template <class T>
 mstreal RMSDCalculator::qcpRMSD(const T& A, const T& B, bool setTransform, bool setResiduals) {
   int i, j;
@@ -2862,43 +2928,8 @@ mstreal RMSDCalculator::qcpRMSD(const T& A, const T& B, bool setTransform, bool
     S[2][2] += bz * az;
   }
 
-  // square of S
-  mstreal S2[3][3];
-  for (i = 0; i < 3; i++) {
-    for (j = 0; j < 3; j++) S2[i][j] = S[i][j]*S[i][j];
-  }
-
-  // calculate characteristic polynomial coefficients
-  // NOTE: though there are repeated terms in F, G, H, and I, it actually turns
-  // out to be better to let the compiler optimize this rathre than declare temp variables
-  mstreal C2 = -2*(S2[0][0] + S2[0][1] + S2[0][2] + S2[1][0] + S2[1][1] + S2[1][2] + S2[2][0] + S2[2][1] + S2[2][2]);
-  mstreal C1 = 8*(S[0][0]*S[1][2]*S[2][1] + S[1][1]*S[2][0]*S[0][2] + S[2][2]*S[0][1]*S[1][0] -
-                  S[0][0]*S[1][1]*S[2][2] - S[1][2]*S[2][0]*S[0][1] - S[2][1]*S[1][0]*S[0][2]);
-  mstreal D = (S2[0][1] + S2[0][2] - S2[1][0] - S2[2][0]); D = D*D;
-  mstreal E1 = -S2[0][0] + S2[1][1] + S2[2][2] + S2[1][2] + S2[2][1];
-  mstreal E2 = 2*(S[1][1]*S[2][2] - S[1][2]*S[2][1]);
-  mstreal E = (E1 - E2) * (E1 + E2);
-  mstreal F = (-(S[0][2] + S[2][0])*(S[1][2] - S[2][1]) + (S[0][1] - S[1][0])*(S[0][0] - S[1][1] - S[2][2])) *
-              (-(S[0][2] - S[2][0])*(S[1][2] + S[2][1]) + (S[0][1] - S[1][0])*(S[0][0] - S[1][1] + S[2][2]));
-  mstreal G = (-(S[0][2] + S[2][0])*(S[1][2] + S[2][1]) - (S[0][1] + S[1][0])*(S[0][0] + S[1][1] - S[2][2])) *
-              (-(S[0][2] - S[2][0])*(S[1][2] - S[2][1]) - (S[0][1] + S[1][0])*(S[0][0] + S[1][1] + S[2][2]));
-  mstreal H = ( (S[0][1] + S[1][0])*(S[1][2] + S[2][1]) + (S[0][2] + S[2][0])*(S[0][0] - S[1][1] + S[2][2])) *
-              (-(S[0][1] - S[1][0])*(S[1][2] - S[2][1]) + (S[0][2] + S[2][0])*(S[0][0] + S[1][1] + S[2][2]));
-  mstreal I = ( (S[0][1] + S[1][0])*(S[1][2] - S[2][1]) + (S[0][2] - S[2][0])*(S[0][0] - S[1][1] - S[2][2])) *
-              (-(S[0][1] - S[1][0])*(S[1][2] + S[2][1]) + (S[0][2] - S[2][0])*(S[0][0] + S[1][1] - S[2][2]));
-  mstreal C0 = D + E + F + G + H + I;
-
-  // now iterate Newton–Raphson method to find max eigenvalue
-  mstreal tol = 10E-11;
-  mstreal L = (GA + GB)/2; // this initial guess is key (see http://journals.iucr.org/a/issues/2005/04/00/sh5029/sh5029.pdf)
-  mstreal Lold, L2, L3, L4, C22 = 2*C2;
-  do {
-    Lold = L;
-    L2 = L*L;
-    L3 = L2*L;
-    L4 = L3*L;
-    L = L - (L4 + C2*L2 + C1*L + C0)/(4*L3 + C22*L + C1);
-  } while (fabs(L - Lold) > tol*L);
+  // largest eigenvalue of the key matrix
+  mstreal L = qcpLargestEigenvalue(S, (GA + GB)/2);
 
   // compute optimal rotation matrix
   if (setTransform) {
@@ -3094,6 +3125,246 @@ template mstreal RMSDCalculator::qcpRMSD<vector<CartesianPoint*> >(const vector<
 template mstreal RMSDCalculator::qcpRMSDGrad<vector<CartesianPoint*> >(const vector<CartesianPoint*>& A, const vector<CartesianPoint*>& B, vector<mstreal>& grad);
 
 
+/* --------- RMSDMatrixCalculator --------- */
+
+template <class T>
+int RMSDMatrixCalculator::addCentered(const T& x, const T& y, const T& z) {
+  const int W = laneWidth;
+  if (N == 0) L = x.size();
+  if ((x.size() != L) || (L == 0)) MstUtils::error("all coordinate sets must be of the same non-zero length (expected " + MstUtils::toString(L) + ", got " + MstUtils::toString(x.size()) + ")", "RMSDMatrixCalculator::addSet");
+  int gi = N / W, l = N % W;
+  if (l == 0) {
+    coords.resize((size_t) (gi + 1) * L * 3 * W, 0.0);
+    G.resize((gi + 1) * W, 0.0);
+  }
+  mstreal cx = 0, cy = 0, cz = 0;
+  for (int k = 0; k < L; k++) { cx += x[k]; cy += y[k]; cz += z[k]; }
+  cx /= L; cy /= L; cz /= L;
+  mstreal g = 0;
+  mstreal* b = &(coords[(size_t) gi * L * 3 * W]);
+  for (int k = 0; k < L; k++) {
+    mstreal dx = x[k] - cx, dy = y[k] - cy, dz = z[k] - cz;
+    b[(k*3 + 0)*W + l] = dx;
+    b[(k*3 + 1)*W + l] = dy;
+    b[(k*3 + 2)*W + l] = dz;
+    g += dx*dx + dy*dy + dz*dz;
+  }
+  G[N] = g;
+  return N++;
+}
+
+int RMSDMatrixCalculator::addSet(const vector<Atom*>& atoms) {
+  vector<mstreal> x(atoms.size()), y(atoms.size()), z(atoms.size());
+  for (int k = 0; k < atoms.size(); k++) {
+    x[k] = atoms[k]->getX(); y[k] = atoms[k]->getY(); z[k] = atoms[k]->getZ();
+  }
+  return addCentered(x, y, z);
+}
+
+int RMSDMatrixCalculator::addSet(const vector<CartesianPoint>& points) {
+  vector<mstreal> x(points.size()), y(points.size()), z(points.size());
+  for (int k = 0; k < points.size(); k++) {
+    x[k] = points[k].getX(); y[k] = points[k].getY(); z[k] = points[k].getZ();
+  }
+  return addCentered(x, y, z);
+}
+
+void RMSDMatrixCalculator::addSets(const vector<vector<Atom*> >& sets) {
+  for (int i = 0; i < sets.size(); i++) addSet(sets[i]);
+}
+
+void RMSDMatrixCalculator::getSet(int i, vector<mstreal>& xyz) const {
+  const int W = laneWidth;
+  xyz.resize(3*L);
+  const mstreal* b = &(coords[(size_t) (i / W) * L * 3 * W]);
+  int l = i % W;
+  for (int k = 0; k < L; k++) {
+    xyz[k] = b[(k*3 + 0)*W + l];
+    xyz[L + k] = b[(k*3 + 1)*W + l];
+    xyz[2*L + k] = b[(k*3 + 2)*W + l];
+  }
+}
+
+void RMSDMatrixCalculator::groupRMSDs(const mstreal* x, const mstreal* y, const mstreal* z, mstreal g, int gi, mstreal* out) const {
+  const int W = laneWidth;
+
+  // covariance matrices with every set in the group, one lane per set; the
+  // inner loop runs over lanes, so it vectorizes with independent accumulators
+  mstreal S[9][W];
+  for (int c = 0; c < 9; c++) {
+    for (int l = 0; l < W; l++) S[c][l] = 0;
+  }
+  const mstreal* b = &(coords[(size_t) gi * L * 3 * W]);
+  for (int k = 0; k < L; k++) {
+    const mstreal ax = x[k], ay = y[k], az = z[k];
+    const mstreal* bx = b + (k*3)*W;
+    const mstreal* by = bx + W;
+    const mstreal* bz = by + W;
+    for (int l = 0; l < W; l++) {
+      S[0][l] += bx[l] * ax; S[1][l] += bx[l] * ay; S[2][l] += bx[l] * az;
+      S[3][l] += by[l] * ax; S[4][l] += by[l] * ay; S[5][l] += by[l] * az;
+      S[6][l] += bz[l] * ax; S[7][l] += bz[l] * ay; S[8][l] += bz[l] * az;
+    }
+  }
+
+  // characteristic polynomial coefficients (see RMSDCalculator::qcpRMSD)
+  mstreal C0[W], C1[W], C2[W], E0[W], Lm[W];
+  for (int l = 0; l < W; l++) {
+    mstreal Sxx = S[0][l], Sxy = S[1][l], Sxz = S[2][l];
+    mstreal Syx = S[3][l], Syy = S[4][l], Syz = S[5][l];
+    mstreal Szx = S[6][l], Szy = S[7][l], Szz = S[8][l];
+    mstreal Sxx2 = Sxx*Sxx, Syy2 = Syy*Syy, Szz2 = Szz*Szz;
+    mstreal Sxy2 = Sxy*Sxy, Syz2 = Syz*Syz, Sxz2 = Sxz*Sxz;
+    mstreal Syx2 = Syx*Syx, Szy2 = Szy*Szy, Szx2 = Szx*Szx;
+    C2[l] = -2*(Sxx2 + Sxy2 + Sxz2 + Syx2 + Syy2 + Syz2 + Szx2 + Szy2 + Szz2);
+    C1[l] = 8*(Sxx*Syz*Szy + Syy*Szx*Sxz + Szz*Sxy*Syx - Sxx*Syy*Szz - Syz*Szx*Sxy - Szy*Syx*Sxz);
+    mstreal D = (Sxy2 + Sxz2 - Syx2 - Szx2); D = D*D;
+    mstreal E1 = -Sxx2 + Syy2 + Szz2 + Syz2 + Szy2;
+    mstreal E2 = 2*(Syy*Szz - Syz*Szy);
+    mstreal E = (E1 - E2) * (E1 + E2);
+    mstreal F = (-(Sxz + Szx)*(Syz - Szy) + (Sxy - Syx)*(Sxx - Syy - Szz)) *
+                (-(Sxz - Szx)*(Syz + Szy) + (Sxy - Syx)*(Sxx - Syy + Szz));
+    mstreal GG = (-(Sxz + Szx)*(Syz + Szy) - (Sxy + Syx)*(Sxx + Syy - Szz)) *
+                 (-(Sxz - Szx)*(Syz - Szy) - (Sxy + Syx)*(Sxx + Syy + Szz));
+    mstreal H = ( (Sxy + Syx)*(Syz + Szy) + (Sxz + Szx)*(Sxx - Syy + Szz)) *
+                (-(Sxy - Syx)*(Syz - Szy) + (Sxz + Szx)*(Sxx + Syy + Szz));
+    mstreal I = ( (Sxy + Syx)*(Syz - Szy) + (Sxz - Szx)*(Sxx - Syy - Szz)) *
+                (-(Sxy - Syx)*(Syz + Szy) + (Sxz - Szx)*(Sxx + Syy - Szz));
+    C0[l] = D + E + F + GG + H + I;
+    E0[l] = g + G[gi*W + l];
+    Lm[l] = E0[l]/2;
+  }
+
+  // Newton-Raphson for the largest eigenvalue, iterating all lanes in lock step
+  // until every lane has converged (extra steps leave converged lanes in place)
+  const mstreal tol = 10E-11;
+  for (int it = 0; it < 100; it++) {
+    bool converged = true;
+    for (int l = 0; l < W; l++) {
+      mstreal Lold = Lm[l], L2 = Lold*Lold, L3 = L2*Lold, L4 = L3*Lold;
+      mstreal den = 4*L3 + 2*C2[l]*Lold + C1[l];
+      Lm[l] = (den != 0) ? Lold - (L4 + C2[l]*L2 + C1[l]*Lold + C0[l])/den : Lold;
+      converged = converged && !(fabs(Lm[l] - Lold) > tol*Lm[l]);
+    }
+    if (converged) break;
+  }
+  for (int l = 0; l < W; l++) out[l] = sqrt(fabs(E0[l] - 2*Lm[l])/L);
+}
+
+mstreal RMSDMatrixCalculator::rmsd(int i, int j) const {
+  if ((i < 0) || (i >= N) || (j < 0) || (j >= N)) MstUtils::error("set index out of range", "RMSDMatrixCalculator::rmsd");
+  if (i == j) return 0.0;
+  vector<mstreal> xyz; getSet(i, xyz);
+  mstreal out[laneWidth];
+  groupRMSDs(&(xyz[0]), &(xyz[L]), &(xyz[2*L]), G[i], j / laneWidth, out);
+  return out[j % laneWidth];
+}
+
+vector<mstreal> RMSDMatrixCalculator::rmsds(const vector<Atom*>& ref) const {
+  vector<mstreal> ret(N, 0.0);
+  if (N == 0) return ret;
+  if (ref.size() != L) MstUtils::error("reference set of length " + MstUtils::toString(ref.size()) + " does not match stored sets of length " + MstUtils::toString(L), "RMSDMatrixCalculator::rmsds");
+  vector<mstreal> xyz(3*L);
+  mstreal cx = 0, cy = 0, cz = 0, g = 0;
+  for (int k = 0; k < L; k++) { cx += ref[k]->getX(); cy += ref[k]->getY(); cz += ref[k]->getZ(); }
+  cx /= L; cy /= L; cz /= L;
+  for (int k = 0; k < L; k++) {
+    xyz[k] = ref[k]->getX() - cx; xyz[L + k] = ref[k]->getY() - cy; xyz[2*L + k] = ref[k]->getZ() - cz;
+    g += xyz[k]*xyz[k] + xyz[L + k]*xyz[L + k] + xyz[2*L + k]*xyz[2*L + k];
+  }
+  MstUtils::parallelFor(0, numGroups(), [&](int gi, int t) {
+    mstreal out[laneWidth];
+    groupRMSDs(&(xyz[0]), &(xyz[L]), &(xyz[2*L]), g, gi, out);
+    for (int l = 0; (l < laneWidth) && (gi*laneWidth + l < N); l++) ret[gi*laneWidth + l] = out[l];
+  }, numThreads, 16);
+  return ret;
+}
+
+void RMSDMatrixCalculator::rmsdMatrix(vector<vector<mstreal> >& M) const {
+  M.assign(N, vector<mstreal>(N, 0.0));
+  if (N == 0) return;
+  const int W = laneWidth, rowsPerTile = 32, groupsPerTile = 16;
+  int nRowBlocks = (N + rowsPerTile - 1)/rowsPerTile;
+  int nColBlocks = (numGroups() + groupsPerTile - 1)/groupsPerTile;
+
+  // upper-triangular tiles of (row block, column block of groups); every pair
+  // (i, j) with i < j belongs to exactly one tile, so tiles can be filled in
+  // parallel without synchronization
+  vector<pair<int, int> > tiles;
+  for (int rb = 0; rb < nRowBlocks; rb++) {
+    for (int cb = 0; cb < nColBlocks; cb++) {
+      if (MstUtils::min((cb + 1)*groupsPerTile*W, N) - 1 > rb*rowsPerTile) tiles.push_back(pair<int, int>(rb, cb));
+    }
+  }
+  MstUtils::parallelFor(0, tiles.size(), [&](int ti, int t) {
+    vector<mstreal> xyz; mstreal out[laneWidth];
+    int ib = tiles[ti].first*rowsPerTile, ie = MstUtils::min(ib + rowsPerTile, N);
+    int gb = tiles[ti].second*groupsPerTile, ge = MstUtils::min(gb + groupsPerTile, numGroups());
+    for (int i = ib; i < ie; i++) {
+      getSet(i, xyz);
+      for (int gi = MstUtils::max(gb, (i + 1)/W); gi < ge; gi++) {
+        groupRMSDs(&(xyz[0]), &(xyz[L]), &(xyz[2*L]), G[i], gi, out);
+        for (int l = 0; l < W; l++) {
+          int j = gi*W + l;
+          if ((j <= i) || (j >= N)) continue;
+          M[i][j] = M[j][i] = out[l];
+        }
+      }
+    }
+  }, numThreads);
+}
+
+vector<vector<pair<int, mstreal> > > RMSDMatrixCalculator::neighborLists(mstreal rmsdCut) const {
+  vector<vector<pair<int, mstreal> > > lists(N);
+  if (N == 0) return lists;
+  const int W = laneWidth, rowsPerTile = 32;
+  int nRowBlocks = (N + rowsPerTile - 1)/rowsPerTile;
+
+  // RMSD >= |Rg(i) - Rg(j)|, where Rg is the radius of gyration
+  vector<mstreal> rg(N);
+  for (int i = 0; i < N; i++) rg[i] = sqrt(G[i]/L);
+
+  vector<vector<pair<pair<int, int>, mstreal> > > found(nRowBlocks);
+  MstUtils::parallelFor(0, nRowBlocks, [&](int rb, int t) {
+    vector<mstreal> xyz; mstreal out[laneWidth];
+    int ib = rb*rowsPerTile, ie = MstUtils::min(ib + rowsPerTile, N);
+    for (int i = ib; i < ie; i++) {
+      bool extracted = false;
+      for (int gi = (i + 1)/W; gi < numGroups(); gi++) {
+        bool possible = false;
+        for (int l = 0; l < W; l++) {
+          int j = gi*W + l;
+          if ((j > i) && (j < N) && (fabs(rg[i] - rg[j]) <= rmsdCut)) { possible = true; break; }
+        }
+        if (!possible) continue;
+        if (!extracted) { getSet(i, xyz); extracted = true; }
+        groupRMSDs(&(xyz[0]), &(xyz[L]), &(xyz[2*L]), G[i], gi, out);
+        for (int l = 0; l < W; l++) {
+          int j = gi*W + l;
+          if ((j <= i) || (j >= N) || (out[l] > rmsdCut)) continue;
+          found[rb].push_back(pair<pair<int, int>, mstreal>(pair<int, int>(i, j), out[l]));
+        }
+      }
+    }
+  }, numThreads);
+
+  // pairs were found in row-major order, so walking blocks in order produces
+  // lists sorted by index
+  for (int rb = 0; rb < nRowBlocks; rb++) {
+    for (int k = 0; k < found[rb].size(); k++) {
+      int i = found[rb][k].first.first, j = found[rb][k].first.second;
+      lists[j].push_back(pair<int, mstreal>(i, found[rb][k].second));
+    }
+  }
+  for (int rb = 0; rb < nRowBlocks; rb++) {
+    for (int k = 0; k < found[rb].size(); k++) {
+      int i = found[rb][k].first.first, j = found[rb][k].first.second;
+      lists[i].push_back(pair<int, mstreal>(j, found[rb][k].second));
+    }
+  }
+  return lists;
+}
+
 /* --------- ProximitySearch --------- */
 
 ProximitySearch::ProximitySearch(mstreal _xlo, mstreal _ylo, mstreal _zlo, mstreal _xhi, mstreal _yhi, mstreal _zhi, int _N) {
@@ -3239,6 +3510,12 @@ void ProximitySearch::addPoint(const CartesianPoint& _p, int tag) {
   pointTags.push_back(tag);
 }
 
+size_t ProximitySearch::memoryFootprint() const {
+  size_t bytes = sizeof(ProximitySearch) + MstUtils::heapBytes(buckets) + MstUtils::heapBytes(pointList) + MstUtils::heapBytes(pointTags) + MstUtils::heapBytes(fullBuckets);
+  for (int i = 0; i < pointList.size(); i++) bytes += sizeof(CartesianPoint) + pointList[i]->capacity() * sizeof(mstreal);
+  return bytes;
+}
+
 void ProximitySearch::addPoint(mstreal xc, mstreal yc, mstreal zc, int tag) {
   int i, j, k;
   pointBucket(xc, yc, zc, &i, &j, &k);
@@ -3379,7 +3656,7 @@ vector<vector<int>> Clusterer::greedyCluster(const vector<vector<Atom*>>& units,
   for (int i = 0; i < units.size(); i++) remIndices.insert(i);
   if (remIndices.size() <= Nmax) return Clusterer::greedyClusterBruteForce(units, remIndices, rmsdCut);
   
-  cout << "There are " << units.size() << " total points to cluster, will continue until " << floor(units.size()*coverage) << " (" << coverage << ") or " << maxClusters << " are covered" << endl;
+  if (verbose) cout << "There are " << units.size() << " total points to cluster, will continue until " << floor(units.size()*coverage) << " (" << coverage << ") or " << maxClusters << " are covered" << endl;
 
   // create some dummy storage vectors
   int L = units[0].size();
@@ -3510,63 +3787,205 @@ set<int> Clusterer::randomSubsample(set<int>& indices, int N) {
   return sub;
 }
 
-vector<vector<int> > Clusterer::kmeans(const vector<CartesianPoint>& points, int k, int Ntrials, int Niter) {
+vector<vector<int> > Clusterer::kmeans(const vector<CartesianPoint>& points, int k, int Ntrials, int Niter, mstreal tol) {
   if (k > points.size()) MstUtils::error("asked for " + MstUtils::toString(k) + " means, but there are only " + MstUtils::toString(points.size()) + " points in the cloud!", "Clusterer::kmeans");
   if (k == 0) return vector<vector<int> >(); // could also error
-  mstreal dist, bestDist, err, bestWCSS, wcss;
+  if (Ntrials < 1) Ntrials = 1;
+  if (Niter < 1) Niter = 1;
+
+  // contiguous row-major copy of the point cloud
+  int n = points.size(), d = points[0].size();
+  vector<mstreal> X((size_t) n * d);
+  for (int i = 0; i < n; i++) {
+    if (points[i].size() != d) MstUtils::error("points of different dimension in the cloud", "Clusterer::kmeans");
+    for (int c = 0; c < d; c++) X[(size_t) i*d + c] = points[i][c];
+  }
+
+  // seed trials serially so that the outcome depends only on the random seed;
+  // run trials in parallel and split any remaining threads among assignments
+  vector<unsigned> seeds(Ntrials);
+  for (int t = 0; t < Ntrials; t++) seeds[t] = MstUtils::randEngine()();
+  int nt = MstUtils::numThreads(numThreads);
+  int trialThreads = MstUtils::min(nt, Ntrials);
+  int innerThreads = MstUtils::max(1, nt / trialThreads);
+  vector<vector<int> > assigns(Ntrials);
+  vector<mstreal> wcss(Ntrials);
+  MstUtils::parallelFor(0, Ntrials, [&](int t, int w) {
+    wcss[t] = kmeansTrial(X, n, d, k, Niter, tol, seeds[t], assigns[t], innerThreads);
+  }, trialThreads);
+
+  int best = 0;
+  for (int t = 1; t < Ntrials; t++) {
+    if (wcss[t] < wcss[best]) best = t;
+  }
   vector<vector<int> > bestClusts(k);
-  int best;
-
-  for (int t = 0; t < Ntrials; t++) {
-    vector<vector<int> > clusts(k);
-
-    // randomly permute and take the first k as initial means
-    vector<CartesianPoint> shuffledPoints = points;
-    MstUtils::shuffle(shuffledPoints);
-    vector<CartesianPoint> means(k);
-    for (int i = 0; i < k; i++) means[i] = shuffledPoints[i];
-
-    // now cycle to update according to the Lloyd's algorithm
-    bool ok = true;
-    for (int c = 0; c < Niter; c++) {
-      for (int j = 0; j < k; j++) clusts[j].resize(0);
-      wcss = 0; // within-cluster sum of squares
-      // assign each point to the cluster with closest mean
-      for (int i = 0; i < points.size(); i++) {
-        const CartesianPoint& p = points[i];
-        best = 0; bestDist = p.distance(means[0]);
-        for (int j = 1; j < means.size(); j++) {
-          dist = p.distance(means[j]);
-          if (dist < bestDist) {
-            bestDist = dist; best = j;
-          }
+  for (int i = 0; i < n; i++) bestClusts[assigns[best][i]].push_back(i);
+  return bestClusts;
+}
+
+void Clusterer::kmeansSeed(const vector<mstreal>& X, int n, int d, int k, mt19937& rng, vector<mstreal>& C, int nThreads) {
+  auto dist2 = [d](const mstreal* a, const mstreal* b) {
+    mstreal s = 0;
+    for (int c = 0; c < d; c++) { mstreal e = a[c] - b[c]; s += e*e; }
+    return s;
+  };
+  const mstreal* x = &(X[0]);
+  int chunk = (n + 63)/64; // updates of D2 are independent, so chunking only affects scheduling
+
+  // k-means++ seeding: each next mean is picked with probability proportional
+  // to the squared distance to the closest mean picked so far
+  C.assign((size_t) k * d, 0.0);
+  vector<mstreal> D2(n);
+  int first = uniform_int_distribution<int>(0, n - 1)(rng);
+  copy(x + (size_t) first*d, x + (size_t) (first + 1)*d, C.begin());
+  MstUtils::parallelFor(0, n, [&](int i, int t) { D2[i] = dist2(x + (size_t) i*d, &(C[0])); }, nThreads, chunk);
+  for (int j = 1; j < k; j++) {
+    mstreal total = 0;
+    for (int i = 0; i < n; i++) total += D2[i];
+    int pick = n - 1;
+    if (total > 0) {
+      mstreal r = uniform_real_distribution<mstreal>(0, total)(rng), cum = 0;
+      for (int i = 0; i < n; i++) {
+        cum += D2[i];
+        if ((cum >= r) && (D2[i] > 0)) { pick = i; break; }
+      }
+    } else {
+      pick = uniform_int_distribution<int>(0, n - 1)(rng);
+    }
+    mstreal* cj = &(C[(size_t) j*d]);
+    copy(x + (size_t) pick*d, x + (size_t) (pick + 1)*d, cj);
+    MstUtils::parallelFor(0, n, [&](int i, int t) { D2[i] = MstUtils::min(D2[i], dist2(x + (size_t) i*d, cj)); }, nThreads, chunk);
+  }
+}
+
+mstreal Clusterer::kmeansTrial(const vector<mstreal>& X, int n, int d, int k, int Niter, mstreal tol, unsigned seed, vector<int>& assign, int nThreads) {
+  mt19937 rng(seed);
+  auto dist2 = [d](const mstreal* a, const mstreal* b) {
+    mstreal s = 0;
+    for (int c = 0; c < d; c++) { mstreal e = a[c] - b[c]; s += e*e; }
+    return s;
+  };
+  const mstreal* x = &(X[0]);
+
+  // points are processed in fixed blocks, so that partial sums are reduced in
+  // the same order (and thus give the same result) for any number of threads
+  int numBlocks = MstUtils::min(64, (n + 1023)/1024);
+  int blockSize = (n + numBlocks - 1)/numBlocks;
+
+  vector<mstreal> C;
+  kmeansSeed(X, n, d, k, rng, C, nThreads);
+
+  // Hamerly's algorithm: for each point keep an upper bound on the distance to
+  // its assigned mean and a lower bound on the distance to any other mean; the
+  // point can't change clusters while the upper bound is below both the lower
+  // bound and half the distance from its mean to the closest other mean
+  assign.assign(n, 0);
+  vector<mstreal> upper(n), lower(n), s(k), p(k), newC((size_t) k * d);
+  vector<int> counts(k);
+  auto fullAssign = [&](int i) {
+    const mstreal* xi = x + (size_t) i*d;
+    mstreal d1 = numeric_limits<mstreal>::max(), d2 = numeric_limits<mstreal>::max();
+    int b = 0;
+    for (int j = 0; j < k; j++) {
+      mstreal dd = dist2(xi, &(C[(size_t) j*d]));
+      if (dd < d1) { d2 = d1; d1 = dd; b = j; }
+      else if (dd < d2) d2 = dd;
+    }
+    assign[i] = b; upper[i] = sqrt(d1); lower[i] = (k > 1) ? sqrt(d2) : numeric_limits<mstreal>::max();
+  };
+  bool fullPass = true;
+  for (int c = 0; c < Niter; c++) {
+    // assignment step
+    if (fullPass) {
+      MstUtils::parallelFor(0, n, [&](int i, int t) { fullAssign(i); }, nThreads, blockSize);
+      fullPass = false;
+    } else {
+      for (int j = 0; j < k; j++) {
+        mstreal m = numeric_limits<mstreal>::max();
+        for (int jj = 0; jj < k; jj++) {
+          if (jj != j) m = MstUtils::min(m, dist2(&(C[(size_t) j*d]), &(C[(size_t) jj*d])));
         }
-        clusts[best].push_back(i);
-        wcss += bestDist*bestDist;
+        s[j] = sqrt(m)/2;
+      }
+      MstUtils::parallelFor(0, n, [&](int i, int t) {
+        mstreal m = MstUtils::max(s[assign[i]], lower[i]);
+        if (upper[i] <= m) return;
+        upper[i] = sqrt(dist2(x + (size_t) i*d, &(C[(size_t) assign[i]*d])));
+        if (upper[i] <= m) return;
+        fullAssign(i);
+      }, nThreads, blockSize);
+    }
+
+    // update step, with per-block partial sums
+    vector<vector<mstreal> > partSums(numBlocks, vector<mstreal>((size_t) k * d, 0.0));
+    vector<vector<int> > partCounts(numBlocks, vector<int>(k, 0));
+    MstUtils::parallelFor(0, numBlocks, [&](int bi, int t) {
+      vector<mstreal>& sums = partSums[bi];
+      for (int i = bi*blockSize; i < MstUtils::min(n, (bi + 1)*blockSize); i++) {
+        const mstreal* xi = x + (size_t) i*d;
+        mstreal* sj = &(sums[(size_t) assign[i]*d]);
+        for (int cc = 0; cc < d; cc++) sj[cc] += xi[cc];
+        partCounts[bi][assign[i]]++;
       }
+    }, nThreads);
+    fill(newC.begin(), newC.end(), 0.0);
+    fill(counts.begin(), counts.end(), 0);
+    for (int bi = 0; bi < numBlocks; bi++) {
+      for (size_t e = 0; e < newC.size(); e++) newC[e] += partSums[bi][e];
+      for (int j = 0; j < k; j++) counts[j] += partCounts[bi][j];
+    }
+
+    // an emptied cluster takes over the point farthest from its current mean
+    // (among clusters with more than one point); bounds are then recomputed
+    for (int j = 0; j < k; j++) {
+      if (counts[j] > 0) continue;
+      int far = -1; mstreal farDist = -1;
+      for (int i = 0; i < n; i++) {
+        if (counts[assign[i]] < 2) continue;
+        mstreal dd = dist2(x + (size_t) i*d, &(C[(size_t) assign[i]*d]));
+        if (dd > farDist) { farDist = dd; far = i; }
+      }
+      if (far < 0) break; // can only happen if k > n
+      const mstreal* xf = x + (size_t) far*d;
+      for (int cc = 0; cc < d; cc++) { newC[(size_t) assign[far]*d + cc] -= xf[cc]; newC[(size_t) j*d + cc] = xf[cc]; }
+      counts[assign[far]]--; counts[j] = 1;
+      assign[far] = j;
+      fullPass = true;
+    }
 
-      // recompute means
-      err = 0;
-      for (int i = 0; i < clusts.size(); i++) {
-        vector<int>& clust = clusts[i];
-        if (clust.empty()) { ok = false; break; }
-        CartesianPoint o = means[i];
-        CartesianPoint& m = means[i]; m = CartesianPoint(m.size(), 0.0);
-        for (int j = 0; j < clust.size(); j++) m += points[clust[j]];
-        m /= clust.size();
-        err += (m - o).norm2();
+    mstreal err = 0;
+    for (int j = 0; j < k; j++) {
+      mstreal move = 0;
+      for (int cc = 0; cc < d; cc++) {
+        mstreal v = newC[(size_t) j*d + cc] / counts[j];
+        mstreal e = v - C[(size_t) j*d + cc];
+        move += e*e;
+        C[(size_t) j*d + cc] = v;
       }
-      if (!ok) break;
-      if (err < 10E-8) break;
+      p[j] = sqrt(move);
+      err += move;
     }
-    if (!ok) { // if one of the clusters ended up empty, try again
-      t--;
-    } else if ((t == 0) || (wcss < bestWCSS)) {
-      bestWCSS = wcss;
-      bestClusts = clusts;
+    if ((err < tol) && !fullPass) break;
+
+    // means moved, so loosen bounds accordingly
+    int r = 0;
+    for (int j = 1; j < k; j++) if (p[j] > p[r]) r = j;
+    mstreal pr = 0;
+    for (int j = 0; j < k; j++) if ((j != r) && (p[j] > pr)) pr = p[j];
+    for (int i = 0; i < n; i++) {
+      upper[i] += p[assign[i]];
+      lower[i] -= (assign[i] == r) ? pr : p[r];
     }
   }
-  return bestClusts;
+
+  // within-cluster sum of squares with respect to the final means
+  vector<mstreal> blockWCSS(numBlocks, 0.0);
+  MstUtils::parallelFor(0, numBlocks, [&](int bi, int t) {
+    for (int i = bi*blockSize; i < MstUtils::min(n, (bi + 1)*blockSize); i++) blockWCSS[bi] += dist2(x + (size_t) i*d, &(C[(size_t) assign[i]*d]));
+  }, nThreads);
+  mstreal wcss = 0;
+  for (int bi = 0; bi < numBlocks; bi++) wcss += blockWCSS[bi];
+  return wcss;
 }
 
 void MstUtils::fileToArray(const string& _filename, vector<string>& lines) {
@@ -3927,3 +4346,11 @@ vector<pair<int, int> > MstUtils::splitTasks(int numTasks, int numJobs) {
   if (k != numTasks) MstUtils::error("something went very wrong!", "MstUtils::splitTasks(int, int)");
   return division;
 }
+
+int MstUtils::numThreads(int requested) {
+  if (requested > 0) return requested;
+  const char* env = getenv("MST_NUM_THREADS");
+  if ((env != NULL) && MstUtils::isInt(env) && (MstUtils::toInt(env) > 0)) return MstUtils::toInt(env);
+  int hw = thread::hardware_concurrency();
+  return (hw > 0) ? hw : 1;
+}
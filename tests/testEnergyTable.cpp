@@ -0,0 +1,101 @@
+#include "msttypes.h"
+#include "dtermen.h"
+#include "mstoptions.h"
+#include "mstsystem.h"
+
+// a random table over the 20 standard amino acids, with some pair interactions
+EnergyTable randomTable(int L, mstreal pairFraction) {
+  vector<string> alpha;
+  for (string aa : {"A", "C", "D", "E", "F", "G", "H", "I", "K", "L", "M", "N", "P", "Q", "R", "S", "T", "V", "W", "Y"}) alpha.push_back(SeqTools::toTriple(aa));
+  EnergyTable E;
+  for (int si = 0; si < L; si++) {
+    E.addSite("A," + MstUtils::toString(si + 1));
+    E.setSiteAlphabet(si, alpha);
+    for (int aa = 0; aa < alpha.size(); aa++) E.setSelfEnergy(si, aa, MstUtils::randUnit() - 0.5);
+  }
+  for (int si = 0; si < L; si++) {
+    for (int sj = si + 1; sj < L; sj++) {
+      if (MstUtils::randUnit() > pairFraction) continue;
+      for (int ai = 0; ai < alpha.size(); ai++) {
+        for (int aj = 0; aj < alpha.size(); aj++) E.setPairEnergy(si, sj, ai, aj, 0.1*(MstUtils::randUnit() - 0.5));
+      }
+    }
+  }
+  return E;
+}
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Tests batch scoring with EnergyTable::scoreSolutions() against EnergyTable::scoreSolution(). Options:");
+  op.addOption("L", "number of sites in the random energy table (default 40).");
+  op.addOption("N", "number of random sequences to score (default 200000).");
+  op.addOption("nt", "number of threads for batch scoring; defaults to MST_NUM_THREADS if set, or else the number of hardware threads.");
+  op.setOptions(argc, argv);
+  MstUtils::seedRandEngine(42);
+  int L = op.getInt("L", 40), N = op.getInt("N", 200000);
+
+  EnergyTable E = randomTable(L, 0.2);
+  vector<pair<int, int> > pairs = E.interactingPairs();
+  cout << "table with " << L << " sites and " << pairs.size() << " interacting pairs" << endl;
+  vector<res_t> sols((size_t) N * L);
+  vector<vector<int> > solVecs(N);
+  for (int n = 0; n < N; n++) {
+    solVecs[n] = E.randomSolution();
+    for (int si = 0; si < L; si++) sols[(size_t) n * L + si] = solVecs[n][si];
+  }
+
+  // one at a time versus in batch
+  MstTimer timer; timer.start();
+  vector<mstreal> single(N);
+  for (int n = 0; n < N; n++) single[n] = E.scoreSolution(solVecs[n]);
+  timer.stop();
+  cout << "scoreSolution: " << timer.getDuration(MstTimer::msec) << " ms for " << N << " solutions" << endl;
+  timer.start();
+  vector<mstreal> batch = E.scoreSolutions(sols, NULL, NULL, op.getInt("nt", 0));
+  timer.stop();
+  cout << "scoreSolutions: " << timer.getDuration(MstTimer::msec) << " ms for " << N << " solutions" << endl;
+  MstUtils::assertCond(batch == single, "batch energies differ from those of scoreSolution");
+
+  // decompositions, on a subset
+  int M = MstUtils::min(N, 1000);
+  vector<res_t> sub(sols.begin(), sols.begin() + (size_t) M * L);
+  vector<mstreal> selfDecomp, pairDecomp;
+  vector<mstreal> subE = E.scoreSolutions(sub, &selfDecomp, &pairDecomp, op.getInt("nt", 0));
+  for (int n = 0; n < M; n++) {
+    MstUtils::assertCond(subE[n] == single[n], "energies with decomposition differ");
+    mstreal tot = 0;
+    for (int si = 0; si < L; si++) {
+      MstUtils::assertCond(selfDecomp[n*L + si] == E.selfEnergy(si, solVecs[n][si]), "wrong self energy in decomposition");
+      tot += selfDecomp[n*L + si];
+    }
+    for (int p = 0; p < pairs.size(); p++) {
+      int si = pairs[p].first, sj = pairs[p].second;
+      MstUtils::assertCond(pairDecomp[n*pairs.size() + p] == E.pairEnergy(si, sj, solVecs[n][si], solVecs[n][sj]), "wrong pair energy in decomposition");
+      tot += pairDecomp[n*pairs.size() + p];
+    }
+    MstUtils::assertCond(fabs(tot - single[n]) < 1e-9, "decomposition does not add up to the total");
+  }
+
+  // reading sequences from FASTA and flat files
+  string fastaFile = "/tmp/testEnergyTable." + MstUtils::toString((int) getpid()) + ".fasta", flatFile = fastaFile + ".txt";
+  fstream fasta, flat;
+  MstUtils::openFile(fasta, fastaFile, ios::out);
+  MstUtils::openFile(flat, flatFile, ios::out);
+  vector<Sequence> seqs(M);
+  for (int n = 0; n < M; n++) {
+    seqs[n] = E.solutionToSequence(solVecs[n]);
+    string seq = seqs[n].toString();
+    fasta << ">seq" << n << endl << seq.substr(0, L/2) << endl << seq.substr(L/2) << endl; // in two lines
+    flat << seq << endl;
+  }
+  fasta.close(); flat.close();
+  vector<string> names;
+  MstUtils::assertCond(E.readSolutions(fastaFile, &names) == sub, "solutions read from a FASTA file differ");
+  MstUtils::assertCond((names.size() == M) && (names.back() == "seq" + MstUtils::toString(M - 1)), "wrong FASTA identifiers");
+  MstUtils::assertCond(E.readSolutions(flatFile) == sub, "solutions read from a flat file differ");
+  MstUtils::assertCond(E.scoreSequences(seqs) == subE, "energies of sequences differ");
+  MstSys::crm(fastaFile); MstSys::crm(flatFile);
+
+  cout << "all energy table tests passed" << endl;
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "mstfasst.h"
+
+using namespace MST;
+
+// inserts the same stream of random solutions, with planted near-duplicates
+// and chain-terminal gaps in their contexts, into two sets with and without
+// redundancy indexing, and checks that the accepted solutions and alignment
+// redundancy barriers end up identical
+bool testRedundancyFilter(int numSols, int numSegs, mstreal redundancyCut, bool verbose) {
+  int contLen = 30, targetLen = 500, numTargets = 200, numFamilies = 40, numAA = 20;
+  res_t gap = SeqTools::gapIdx();
+  vector<int> segLengths(numSegs);
+  for (int i = 0; i < numSegs; i++) segLengths[i] = 5 + (9*i) % 28; // includes segments longer than the context
+  auto randomContext = [&](int i) {
+    int L = segLengths[i], P = max(0, contLen - L);
+    vector<Sequence> ctx(3); // segment, N-terminal padding, C-terminal padding
+    ctx[0] = Sequence(L); ctx[1] = Sequence(P); ctx[2] = Sequence(P);
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < ctx[j].size(); k++) ctx[j][k] = MstUtils::randInt(numAA);
+    }
+    return ctx;
+  };
+
+  // families of related contexts, from which many solutions are derived by a few
+  // mutations, so that many of them are redundant with each other
+  vector<vector<vector<Sequence>>> families(numFamilies, vector<vector<Sequence>>(numSegs));
+  for (int f = 0; f < numFamilies; f++) {
+    for (int i = 0; i < numSegs; i++) families[f][i] = randomContext(i);
+  }
+
+  fasstSolutionSet indexed, brute;
+  brute.setRedundancyIndexing(false);
+  indexed.init(numSegs); indexed.resetAlignRedBarrierData(targetLen);
+  brute.init(numSegs); brute.resetAlignRedBarrierData(targetLen);
+  MstTimer timer; mstreal tIndexed = 0, tBrute = 0;
+  bool failed = false;
+  for (int n = 0; n < numSols; n++) {
+    vector<int> alignment(numSegs);
+    vector<Sequence> segs(numSegs), nPad(numSegs), cPad(numSegs);
+    int f = (MstUtils::randUnit() < 0.8) ? MstUtils::randInt(numFamilies) : -1;
+    for (int i = 0; i < numSegs; i++) {
+      alignment[i] = MstUtils::randInt(0, targetLen - segLengths[i]);
+      vector<Sequence> ctx = (f < 0) ? randomContext(i) : families[f][i];
+      int numMut = MstUtils::randInt(0, (ctx[0].size() + ctx[1].size())/2);
+      for (int m = 0; m < numMut; m++) {
+        int j = MstUtils::randInt(3);
+        if (ctx[j].size() > 0) ctx[j][MstUtils::randInt(ctx[j].size())] = MstUtils::randInt(numAA);
+      }
+      // contexts that run into a chain terminus
+      int P = ctx[1].size();
+      if ((P > 0) && (MstUtils::randUnit() < 0.15)) {
+        int g = MstUtils::randInt(1, P);
+        if (MstUtils::randUnit() < 0.5) { for (int k = 0; k < g; k++) ctx[1][k] = gap; }
+        else { for (int k = P - g; k < P; k++) ctx[2][k] = gap; }
+      }
+      segs[i] = ctx[0]; nPad[i] = ctx[1]; cPad[i] = ctx[2];
+    }
+    // coarse RMSDs, so that there are many ties
+    fasstSolution sol(alignment, MstUtils::randInt(0, 60)*0.05, MstUtils::randInt(numTargets), Transform(), segLengths);
+    sol.setSeqContext(segs, nPad, cPad);
+
+    timer.start(); bool insI = indexed.insert(sol, redundancyCut); timer.stop(); tIndexed += timer.getDuration(MstTimer::usec);
+    timer.start(); bool insB = brute.insert(sol, redundancyCut); timer.stop(); tBrute += timer.getDuration(MstTimer::usec);
+    if (insI != insB) {
+      failed = true;
+      if (verbose) cout << "insert " << n << " was " << (insI ? "accepted" : "rejected") << " with indexing but " << (insB ? "accepted" : "rejected") << " without" << endl;
+    }
+    // occasionally drop the worst solution, as search does when capping the number of matches
+    if ((n % 50 == 49) && (indexed.size() > 0)) {
+      indexed.erase(--indexed.end());
+      brute.erase(--brute.end());
+    }
+  }
+
+  if (indexed.size() != brute.size()) {
+    failed = true;
+    if (verbose) cout << "indexed set has " << indexed.size() << " solutions, brute-force set has " << brute.size() << endl;
+  } else {
+    for (auto iti = indexed.begin(), itb = brute.begin(); iti != indexed.end(); ++iti, ++itb) {
+      if (!(*iti == *itb)) {
+        failed = true;
+        if (verbose) cout << "solution sets differ: " << *iti << " vs. " << *itb << endl;
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < numSegs; i++) {
+    for (int ri = 0; ri < targetLen; ri++) {
+      if (indexed.alignRedBarrier(i, ri) != brute.alignRedBarrier(i, ri)) {
+        failed = true;
+        if (verbose) cout << "alignment redundancy barriers differ for segment " << i << ", residue " << ri << ": " << indexed.alignRedBarrier(i, ri) << " vs. " << brute.alignRedBarrier(i, ri) << endl;
+      }
+    }
+  }
+  if (verbose) {
+    cout << numSols << " insertions, " << indexed.size() << " solutions accepted; " << tIndexed/1000 << " ms with indexing, " << tBrute/1000 << " ms without" << endl;
+  }
+  return !failed;
+}
+
+int main(int argc, char** argv) {
+  int numSols = (argc > 1) ? MstUtils::toInt(argv[1]) : 3000;
+  int numSegs = (argc > 2) ? MstUtils::toInt(argv[2]) : 2;
+  mstreal cut = (argc > 3) ? MstUtils::toReal(argv[3]) : 0.7;
+  MstUtils::seedRandEngine(1);
+  if (!testRedundancyFilter(numSols, numSegs, cut, true)) {
+    cout << "fasstSolutionSet redundancy filter test FAILED" << endl;
+    return 1;
+  }
+  cout << "fasstSolutionSet redundancy filter test PASSED" << endl;
+  return 0;
+}
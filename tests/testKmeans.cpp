@@ -0,0 +1,147 @@
+#include "msttypes.h"
+
+using namespace MST;
+
+// exposes the seeding and single-trial steps of k-means for checking
+class testClusterer : public Clusterer {
+  public:
+    using Clusterer::kmeansSeed;
+    using Clusterer::kmeansTrial;
+};
+
+// clusters n random points in d dimensions, drawn around k centers, with
+// kmeans() and with a brute-force Lloyd's algorithm started from the same
+// k-means++ seeding, and checks that assignments and within-cluster sums of
+// squares agree, and that kmeans() gives the same result with one and with
+// numThreads threads
+bool testKmeans(int n, int d, int k, int Ntrials, int numThreads, bool verbose) {
+  int Niter = 50; mstreal tol = 10E-8;
+  // points scattered around k random centers
+  vector<CartesianPoint> centers(k, CartesianPoint(d)), points(n, CartesianPoint(d));
+  for (int j = 0; j < k; j++) {
+    for (int c = 0; c < d; c++) centers[j][c] = MstUtils::randUnit(0, 10);
+  }
+  for (int i = 0; i < n; i++) {
+    CartesianPoint& cen = centers[MstUtils::randInt(k)];
+    for (int c = 0; c < d; c++) points[i][c] = MstUtils::randNormal(cen[c], 1.0);
+  }
+  vector<mstreal> X((size_t) n * d);
+  for (int i = 0; i < n; i++) {
+    for (int c = 0; c < d; c++) X[(size_t) i*d + c] = points[i][c];
+  }
+  auto dist2 = [&](int i, const vector<mstreal>& C, int j) {
+    mstreal s = 0;
+    for (int c = 0; c < d; c++) { mstreal e = X[(size_t) i*d + c] - C[(size_t) j*d + c]; s += e*e; }
+    return s;
+  };
+
+  // plain Lloyd's algorithm, with every distance computed in every iteration,
+  // the same convergence criterion, and the same handling of emptied clusters
+  auto lloyd = [&](vector<mstreal> C, vector<int>& assign) {
+    assign.assign(n, 0);
+    vector<mstreal> newC((size_t) k * d);
+    vector<int> counts(k);
+    for (int it = 0; it < Niter; it++) {
+      fill(newC.begin(), newC.end(), 0.0);
+      fill(counts.begin(), counts.end(), 0);
+      for (int i = 0; i < n; i++) {
+        int b = 0;
+        for (int j = 1; j < k; j++) {
+          if (dist2(i, C, j) < dist2(i, C, b)) b = j;
+        }
+        assign[i] = b; counts[b]++;
+        for (int c = 0; c < d; c++) newC[(size_t) b*d + c] += X[(size_t) i*d + c];
+      }
+      bool reseeded = false;
+      for (int j = 0; j < k; j++) {
+        if (counts[j] > 0) continue;
+        int far = -1; mstreal farDist = -1;
+        for (int i = 0; i < n; i++) {
+          if ((counts[assign[i]] >= 2) && (dist2(i, C, assign[i]) > farDist)) { farDist = dist2(i, C, assign[i]); far = i; }
+        }
+        if (far < 0) break;
+        for (int c = 0; c < d; c++) { newC[(size_t) assign[far]*d + c] -= X[(size_t) far*d + c]; newC[(size_t) j*d + c] = X[(size_t) far*d + c]; }
+        counts[assign[far]]--; counts[j] = 1;
+        assign[far] = j;
+        reseeded = true;
+      }
+      mstreal err = 0;
+      for (size_t e = 0; e < newC.size(); e++) {
+        mstreal v = newC[e] / counts[e / d];
+        err += (v - C[e])*(v - C[e]);
+        C[e] = v;
+      }
+      if ((err < tol) && !reseeded) break;
+    }
+    mstreal wcss = 0;
+    for (int i = 0; i < n; i++) wcss += dist2(i, C, assign[i]);
+    return wcss;
+  };
+
+  // each trial against Lloyd's algorithm from the same seeding, with one and with several threads
+  bool failed = false;
+  unsigned seed = MstUtils::randEngine()();
+  MstUtils::seedRandEngine(seed);
+  vector<unsigned> seeds(Ntrials);
+  for (int t = 0; t < Ntrials; t++) seeds[t] = MstUtils::randEngine()(); // as kmeans() seeds its trials
+  testClusterer CL;
+  MstTimer timer; mstreal tHamerly = 0, tLloyd = 0;
+  vector<mstreal> lloydWCSS(Ntrials);
+  vector<vector<int> > lloydAssign(Ntrials);
+  for (int t = 0; t < Ntrials; t++) {
+    mt19937 rng(seeds[t]);
+    vector<mstreal> C0;
+    CL.kmeansSeed(X, n, d, k, rng, C0, 1);
+    timer.start(); lloydWCSS[t] = lloyd(C0, lloydAssign[t]); timer.stop(); tLloyd += timer.getDuration(MstTimer::msec);
+    for (int nt : {1, numThreads}) {
+      vector<int> assign;
+      timer.start(); mstreal wcss = CL.kmeansTrial(X, n, d, k, Niter, tol, seeds[t], assign, nt); timer.stop();
+      if (nt == 1) tHamerly += timer.getDuration(MstTimer::msec);
+      if (assign != lloydAssign[t]) {
+        failed = true;
+        int numDiff = 0;
+        for (int i = 0; i < n; i++) numDiff += (assign[i] != lloydAssign[t][i]);
+        if (verbose) cout << "trial " << t << " with " << nt << " thread(s): " << numDiff << " points assigned differently than by Lloyd's algorithm" << endl;
+      }
+      if (fabs(wcss - lloydWCSS[t]) > 10E-9 * lloydWCSS[t]) {
+        failed = true;
+        if (verbose) cout << "trial " << t << " with " << nt << " thread(s): within-cluster sum of squares " << wcss << " vs. " << lloydWCSS[t] << " by Lloyd's algorithm" << endl;
+      }
+    }
+  }
+
+  // kmeans() returns the best trial, the same for any number of threads
+  int best = 0;
+  for (int t = 1; t < Ntrials; t++) {
+    if (lloydWCSS[t] < lloydWCSS[best]) best = t;
+  }
+  vector<vector<int> > expected(k);
+  for (int i = 0; i < n; i++) expected[lloydAssign[best][i]].push_back(i);
+  for (int nt : {1, numThreads}) {
+    MstUtils::seedRandEngine(seed);
+    CL.setNumThreads(nt);
+    if (CL.kmeans(points, k, Ntrials, Niter, tol) != expected) {
+      failed = true;
+      if (verbose) cout << "kmeans() with " << nt << " thread(s) did not return the best of the Lloyd's algorithm trials" << endl;
+    }
+  }
+  if (verbose) {
+    cout << n << " points in " << d << " dimensions, " << k << " clusters, " << Ntrials << " trials; best within-cluster sum of squares " << lloydWCSS[best] << "; "
+         << tHamerly << " ms with bounds, " << tLloyd << " ms without" << endl;
+  }
+  return !failed;
+}
+
+int main(int argc, char** argv) {
+  int n = (argc > 1) ? MstUtils::toInt(argv[1]) : 5000;
+  int d = (argc > 2) ? MstUtils::toInt(argv[2]) : 3;
+  int k = (argc > 3) ? MstUtils::toInt(argv[3]) : 8;
+  int nt = (argc > 4) ? MstUtils::toInt(argv[4]) : 4;
+  MstUtils::seedRandEngine(1);
+  if (!testKmeans(n, d, k, 4, nt, true)) {
+    cout << "Clusterer k-means test FAILED" << endl;
+    return 1;
+  }
+  cout << "Clusterer k-means test PASSED" << endl;
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include "msttypes.h"
+#include "mstlinalg.h"
+
+using namespace MST;
+
+// checks blocked multiplication, inverse, linear solves, and symmetric
+// eigen-decomposition against reference computations on random matrices
+bool testMatrix(int n, bool verbose = true) {
+  bool ok = true;
+  auto randMat = [](int r, int c) {
+    Matrix R(r, c);
+    for (int i = 0; i < r; i++) {
+      for (int j = 0; j < c; j++) R(i, j) = MstUtils::randUnit(-1, 1);
+    }
+    return R;
+  };
+  auto report = [&](const string& what, mstreal err, mstreal tol) {
+    if (verbose) cout << what << ": error " << err << (err > tol ? " FAILED" : "") << endl;
+    if (err > tol) ok = false;
+  };
+
+  // blocked product against the straightforward triple loop (odd sizes exercise block edges)
+  Matrix A = randMat(n + 3, n - 1), B = randMat(n - 1, n + 7);
+  MstTimer timer; timer.start();
+  Matrix C = A * B;
+  timer.stop();
+  Matrix Cref(A.numRows(), B.numCols(), 0.0);
+  for (int i = 0; i < A.numRows(); i++) {
+    for (int j = 0; j < B.numCols(); j++) {
+      for (int k = 0; k < A.numCols(); k++) Cref(i, j) += A(i, k) * B(k, j);
+    }
+  }
+  report("multiply (" + MstUtils::toString(timer.getDuration(MstTimer::msec)) + " ms)", (C - Cref).abs().max(), 10E-12);
+
+  // products of views, and writing through views
+  Matrix At = A.transpose();
+  report("transpose", (At.transpose() - A).abs().max(), 0);
+  Matrix blk = A.block(2, 5, 1, 3);
+  Matrix blkProd = blk * B.block(1, 3, 0, 1);
+  Matrix blkRef = Matrix(blk) * Matrix(B.block(1, 3, 0, 1));
+  report("multiply views", (blkProd - blkRef).abs().max(), 10E-12);
+  A.row(0) = A.row(1);
+  report("assign to view", (A.row(0) - A.row(1)).abs().max(), 0);
+
+  // inverse and linear solve
+  Matrix S = randMat(n, n);
+  for (int i = 0; i < n; i++) S(i, i) += n/4.0;
+  Matrix I(n, n, 0.0);
+  for (int i = 0; i < n; i++) I(i, i) = 1;
+  report("inverse", (S * S.inverse() - I).abs().max(), 10E-10);
+  Matrix rhs = randMat(n, 3);
+  report("solve", (S * S.solve(rhs) - rhs).abs().max(), 10E-10);
+  Matrix small = randMat(3, 3);
+  mstreal det3 = small(0,0)*(small(1,1)*small(2,2) - small(1,2)*small(2,1)) - small(0,1)*(small(1,0)*small(2,2) - small(1,2)*small(2,0)) + small(0,2)*(small(1,0)*small(2,1) - small(1,1)*small(2,0));
+  report("determinant", fabs(small.determinant() - det3), 10E-12);
+
+  // symmetric eigen-decomposition: A V = V diag(vals), with orthonormal V
+  Matrix Y = randMat(n, n);
+  Matrix Sym = Y + Y.transpose();
+  vector<mstreal> vals; Matrix V(0, 0);
+  Sym.eigenSymmetric(vals, V);
+  Matrix D(n, n, 0.0);
+  for (int i = 0; i < n; i++) D(i, i) = vals[i];
+  report("eigen-decomposition", (Sym * V - V * D).abs().max(), 10E-9);
+  report("eigenvector orthonormality", (V.transpose() * V - I).abs().max(), 10E-10);
+  bool sorted = true;
+  for (int i = 1; i < n; i++) sorted = sorted && (vals[i - 1] <= vals[i]);
+  report("eigenvalue order", sorted ? 0 : 1, 0);
+
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int n = (argc > 1) ? MstUtils::toInt(argv[1]) : 200;
+  if (!testMatrix(n)) {
+    cout << "Matrix test FAILED" << endl;
+    return 1;
+  }
+  cout << "Matrix test PASSED" << endl;
+  return 0;
+}
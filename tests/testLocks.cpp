@@ -0,0 +1,110 @@
+#include "msttypes.h"
+#include "mstsystem.h"
+#include "mstlocks.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// counters shared among the processes of the test
+struct sharedCounters {
+  int exclusiveInside, sharedInside, maxExclusiveInside, maxSharedInside, overlaps, total;
+};
+
+void updateMax(int* maxVal, int val) {
+  int cur = __sync_fetch_and_add(maxVal, 0);
+  while ((val > cur) && !__sync_bool_compare_and_swap(maxVal, cur, val)) cur = __sync_fetch_and_add(maxVal, 0);
+}
+
+// each worker process alternates between exclusive and shared holds of the lock
+void worker(sharedCounters* C, const string& tag, int id, int numIters) {
+  for (int i = 0; i < numIters; i++) {
+    bool shared = ((i + id) % 3 == 0);
+    MstUtils::assertCond(MstSys::getNetLock(tag, shared), "could not get lock", "worker");
+    if (shared) {
+      int n = __sync_add_and_fetch(&(C->sharedInside), 1);
+      updateMax(&(C->maxSharedInside), n);
+      if (__sync_fetch_and_add(&(C->exclusiveInside), 0) != 0) __sync_add_and_fetch(&(C->overlaps), 1);
+      usleep(2000);
+      __sync_sub_and_fetch(&(C->sharedInside), 1);
+    } else {
+      int n = __sync_add_and_fetch(&(C->exclusiveInside), 1);
+      updateMax(&(C->maxExclusiveInside), n);
+      if (__sync_fetch_and_add(&(C->sharedInside), 0) != 0) __sync_add_and_fetch(&(C->overlaps), 1);
+      int val = C->total; // non-atomic read-modify-write, only safe under the lock
+      usleep(500);
+      C->total = val + 1;
+      __sync_sub_and_fetch(&(C->exclusiveInside), 1);
+    }
+    MstUtils::assertCond(MstSys::releaseNetLock(tag), "could not release lock", "worker");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  string tag = "testLocks-" + MstUtils::toString((int) getpid());
+  int numProcs = 6, numIters = 30;
+  cout << "lock file: " << MstLockManager::lockFilePath(tag) << endl;
+
+  // contention among processes
+  sharedCounters* C = (sharedCounters*) mmap(NULL, sizeof(sharedCounters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  MstUtils::assertCond(C != MAP_FAILED, "mmap failed");
+  memset(C, 0, sizeof(sharedCounters));
+  for (int p = 0; p < numProcs; p++) {
+    if (fork() == 0) { worker(C, tag, p, numIters); _exit(0); }
+  }
+  int numExclusive = 0;
+  for (int p = 0; p < numProcs; p++) {
+    for (int i = 0; i < numIters; i++) numExclusive += ((i + p) % 3 != 0);
+  }
+  int status; bool childFailed = false;
+  for (int p = 0; p < numProcs; p++) { wait(&status); childFailed = childFailed || !WIFEXITED(status) || (WEXITSTATUS(status) != 0); }
+  cout << numProcs << " processes: " << C->total << " exclusive updates (expected " << numExclusive << "), at most " << C->maxExclusiveInside
+       << " exclusive and " << C->maxSharedInside << " shared holders at once, " << C->overlaps << " overlaps" << endl;
+  MstUtils::assertCond(!childFailed, "a worker process failed");
+  MstUtils::assertCond(C->total == numExclusive, "exclusive updates were lost");
+  MstUtils::assertCond((C->maxExclusiveInside == 1) && (C->overlaps == 0), "exclusive lock was not exclusive");
+
+  // contention among threads of one process, which share the process's lock file
+  memset(C, 0, sizeof(sharedCounters));
+  vector<thread> threads;
+  for (int t = 0; t < 4; t++) threads.push_back(thread(worker, C, tag, t, numIters));
+  for (int t = 0; t < threads.size(); t++) threads[t].join();
+  cout << "4 threads: " << C->total << " exclusive updates, at most " << C->maxExclusiveInside << " exclusive and " << C->maxSharedInside << " shared holders at once, " << C->overlaps << " overlaps" << endl;
+  MstUtils::assertCond((C->maxExclusiveInside == 1) && (C->overlaps == 0), "exclusive lock was not exclusive among threads");
+
+  // timeouts: a held exclusive lock cannot be had by another process
+  MstUtils::assertCond(MstLockManager::acquire(tag), "could not get free lock");
+  if (fork() == 0) _exit(MstLockManager::acquire(tag, true, 0.2) ? 1 : 0);
+  wait(&status);
+  MstUtils::assertCond(WIFEXITED(status) && (WEXITSTATUS(status) == 0), "got a lock held exclusively by another process");
+  MstLockManager::release(tag);
+  cout << "timeout: ok" << endl;
+
+  // stale locks: a lock held by a process that dies is recovered
+  pid_t pid = fork();
+  if (pid == 0) { MstLockManager::acquire(tag); pause(); _exit(0); }
+  while (true) { // wait for the child to take the lock
+    if (!MstLockManager::acquire(tag, false, 0)) break;
+    MstLockManager::release(tag);
+    usleep(1000);
+  }
+  kill(pid, SIGKILL);
+  waitpid(pid, &status, 0);
+  MstUtils::assertCond(MstLockManager::acquire(tag, false, 1.0), "lock of a killed process was not recovered");
+  MstLockManager::release(tag);
+  cout << "stale lock recovery: ok" << endl;
+
+  // distinct tags have distinct lock files, so releasing one does not drop the other
+  string tagA = tag + "/a_b", tagB = tag + "_a/b", tagC = tag + "%2Fa_b";
+  MstUtils::assertCond((MstLockManager::lockFilePath(tagA) != MstLockManager::lockFilePath(tagB)) && (MstLockManager::lockFilePath(tagA) != MstLockManager::lockFilePath(tagC)), "distinct tags share a lock file");
+  MstUtils::assertCond(MstLockManager::acquire(tagA) && MstLockManager::acquire(tagB), "could not get free locks");
+  MstLockManager::release(tagB);
+  if (fork() == 0) _exit(MstLockManager::acquire(tagA, true, 0.2) ? 1 : 0);
+  wait(&status);
+  MstUtils::assertCond(WIFEXITED(status) && (WEXITSTATUS(status) == 0), "releasing one lock dropped another");
+  MstLockManager::release(tagA);
+  cout << "distinct tags: ok" << endl;
+
+  munmap(C, sizeof(sharedCounters));
+  for (string t : {tag, tagA, tagB}) MstSys::crm(MstLockManager::lockFilePath(t));
+  cout << "all lock tests passed" << endl;
+  return 0;
+}
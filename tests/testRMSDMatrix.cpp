@@ -0,0 +1,100 @@
+#include "msttypes.h"
+
+using namespace MST;
+
+// compares RMSDMatrixCalculator to RMSDCalculator::bestRMSD over random point sets,
+// returning false (and reporting) on any difference above tol
+bool testRMSDMatrix(int numSets, int numPoints, mstreal tol = 1E-6) {
+  RMSDCalculator rc;
+  bool failed = false;
+
+  // random sets, half of which are perturbed copies of others to produce a range of RMSDs
+  vector<AtomPointerVector> sets(numSets);
+  mstreal Lscale = 20;
+  for (int i = 0; i < numSets; i++) {
+    sets[i].resize(numPoints);
+    for (int k = 0; k < numPoints; k++) {
+      if ((i % 2 == 1) && (MstUtils::randUnit() < 0.9)) {
+        Atom* A = sets[i-1][k];
+        mstreal d = MstUtils::randUnit()*2;
+        sets[i][k] = new Atom(0, "X", A->getX() + MstUtils::randUnit(-d, d), A->getY() + MstUtils::randUnit(-d, d), A->getZ() + MstUtils::randUnit(-d, d), 0, 0, false);
+      } else {
+        sets[i][k] = new Atom(0, "X", MstUtils::randUnit()*Lscale, MstUtils::randUnit()*Lscale, MstUtils::randUnit()*Lscale, 0, 0, false);
+      }
+    }
+  }
+  vector<vector<Atom*> > units(sets.begin(), sets.end());
+  RMSDMatrixCalculator calc;
+  calc.addSets(units);
+
+  // full matrix
+  MstTimer timer; timer.start();
+  vector<vector<mstreal> > M = calc.rmsdMatrix();
+  timer.stop();
+  int Tbatch = timer.getDuration(MstTimer::usec);
+  vector<vector<mstreal> > R(numSets, vector<mstreal>(numSets, 0.0));
+  timer.start();
+  for (int i = 0; i < numSets; i++) {
+    for (int j = i + 1; j < numSets; j++) R[i][j] = R[j][i] = rc.bestRMSD(units[i], units[j]);
+  }
+  timer.stop();
+  int Tpair = timer.getDuration(MstTimer::usec);
+  for (int i = 0; i < numSets; i++) {
+    for (int j = 0; j < numSets; j++) {
+      if (fabs(M[i][j] - R[i][j]) > tol) {
+        failed = true;
+        cout << "test FAILED for RMSD matrix element (" << i << ", " << j << "): " << M[i][j] << " vs. " << R[i][j] << endl;
+      }
+    }
+  }
+
+  // single pairs and one-to-all
+  for (int k = 0; k < 10; k++) {
+    int i = MstUtils::randInt(numSets), j = MstUtils::randInt(numSets);
+    if (fabs(calc.rmsd(i, j) - R[i][j]) > tol) {
+      failed = true;
+      cout << "test FAILED for single RMSD (" << i << ", " << j << "): " << calc.rmsd(i, j) << " vs. " << R[i][j] << endl;
+    }
+  }
+  vector<mstreal> toFirst = calc.rmsds(units[0]);
+  for (int j = 0; j < numSets; j++) {
+    if (fabs(toFirst[j] - R[0][j]) > tol) {
+      failed = true;
+      cout << "test FAILED for one-to-all RMSD (0, " << j << "): " << toFirst[j] << " vs. " << R[0][j] << endl;
+    }
+  }
+
+  // thresholded neighbor lists
+  mstreal cut = 1.0;
+  vector<vector<pair<int, mstreal> > > lists = calc.neighborLists(cut);
+  for (int i = 0; i < numSets; i++) {
+    vector<int> expected;
+    for (int j = 0; j < numSets; j++) {
+      if ((j != i) && (R[i][j] <= cut - tol)) expected.push_back(j);
+    }
+    int k = 0;
+    for (int e = 0; e < expected.size(); e++) {
+      while ((k < lists[i].size()) && (lists[i][k].first < expected[e])) k++;
+      if ((k == lists[i].size()) || (lists[i][k].first != expected[e])) {
+        failed = true;
+        cout << "test FAILED for neighbor lists: " << expected[e] << " missing from the list of " << i << endl;
+      }
+    }
+  }
+
+  for (int i = 0; i < numSets; i++) sets[i].deletePointers();
+  if (failed) return false;
+  cout << "all-by-all RMSD matrix of " << numSets << " sets of " << numPoints << " points: " << Tbatch << " us batched, " << Tpair << " us pairwise" << endl;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int numSets = (argc > 1) ? MstUtils::toInt(argv[1]) : 200;
+  int numPoints = (argc > 2) ? MstUtils::toInt(argv[2]) : 40;
+  if (!testRMSDMatrix(numSets, numPoints)) {
+    cout << "RMSDMatrixCalculator test FAILED" << endl;
+    return 1;
+  }
+  cout << "RMSDMatrixCalculator test PASSED" << endl;
+  return 0;
+}
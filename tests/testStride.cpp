@@ -1,25 +1,66 @@
 #include "msttypes.h"
 #include "mstexternal.h"
+#include "mstsecstruct.h"
+#include "mstoptions.h"
 #include "mstsystem.h"
 
+// reduces a classification to three states: helix (H), strand (E), or other (C)
+char threeState(const string& ss) {
+  if ((ss == "H") || (ss == "G") || (ss == "I")) return 'H';
+  if ((ss == "E") || (ss == "B") || (ss == "b")) return 'E';
+  return 'C';
+}
+
 int main(int argc, char *argv[]) {
-  string strideBin = "/scratch/users/swans/STRIDE_repo/stride";
-//  Structure P("/scratch/users/swans/MST_workspace/MST/testfiles/1DC7.pdb");
-//  Structure P("/scratch/users/swans/databases/singlechain_sim30/PDB/mr/4MR0_A.pdb");
-  Structure P("/scratch/users/swans/databases/singlechain_sim30/PDB/zy/4ZYS_A.pdb");
+  MstOptions op;
+  op.setTitle("Assigns secondary structure natively (see SecStructTools) and, if a STRIDE binary is given, compares the result against STRIDE. Options:");
+  op.addOption("p", "a PDB file.");
+  op.addOption("pL", "a file with a list of PDB files.");
+  op.addOption("stride", "path to a STRIDE binary. If given, per-structure and overall agreement with STRIDE is reported.");
+  op.addOption("nt", "number of threads for native assignment; defaults to MST_NUM_THREADS if set, or else the number of hardware threads");
+  op.setOptions(argc, argv);
+  if (!op.isGiven("p") && !op.isGiven("pL")) MstUtils::error("either --p or --pL must be given!");
+  vector<string> pdbFiles;
+  if (op.isGiven("p")) pdbFiles.push_back(op.getString("p"));
+  if (op.isGiven("pL")) {
+    vector<string> files = MstUtils::fileToArray(op.getString("pL"));
+    pdbFiles.insert(pdbFiles.end(), files.begin(), files.end());
+  }
 
-  strideInterface strideObj(strideBin,&P);
-  strideObj.computeSTRIDEClassifications();
-  vector<string> strideSSType = strideObj.getSTRIDEClassifications();
-  
-  cout << "Num residues in structure: " << P.residueSize() << ", Num classified: " << strideSSType.size() << endl;
-  for (string ssType : strideSSType) {
-    cout << ssType << endl;
+  vector<Structure*> structs(pdbFiles.size());
+  for (int i = 0; i < pdbFiles.size(); i++) structs[i] = new Structure(pdbFiles[i]);
+  vector<vector<string> > native = SecStructTools::assign(structs, op.getInt("nt", 0));
+
+  int totN = 0, totExact = 0, totThree = 0;
+  for (int i = 0; i < structs.size(); i++) {
+    Structure& P = *(structs[i]);
+    string nat;
+    for (const string& ss : native[i]) nat += ss;
+    cout << pdbFiles[i] << ": " << P.residueSize() << " residues" << endl;
+    cout << "\tnative " << nat << endl;
+    if (!op.isGiven("stride")) continue;
+
+    strideInterface strideObj(op.getString("stride"), &P);
+    strideObj.computeSTRIDEClassifications();
+    vector<string> stride = strideObj.getSTRIDEClassifications();
+    if (stride.size() != native[i].size()) {
+      cout << "\tSTRIDE classified " << stride.size() << " residues, skipping comparison..." << endl;
+      continue;
+    }
+    string str;
+    int exact = 0, three = 0;
+    for (int k = 0; k < stride.size(); k++) {
+      str += stride[k];
+      if (stride[k] == native[i][k]) exact++;
+      if (threeState(stride[k]) == threeState(native[i][k])) three++;
+    }
+    cout << "\tSTRIDE " << str << endl;
+    cout << "\tagreement: " << exact << "/" << stride.size() << " exact, " << three << "/" << stride.size() << " three-state" << endl;
+    totN += stride.size(); totExact += exact; totThree += three;
+  }
+  if (totN > 0) {
+    cout << "overall agreement over " << totN << " residues: " << 100.0*totExact/totN << "% exact, " << 100.0*totThree/totN << "% three-state" << endl;
   }
-  
-  // test
-  vector<string> test;
-  test.resize(10,"X");
-  test.resize(0,"X");
+  for (int i = 0; i < structs.size(); i++) delete structs[i];
   return 0;
 }
@@ -12,6 +12,7 @@ int main(int argc, char *argv[]) {
   op.setTitle("Tests MST::TERMANAL. Options:");
   op.addOption("t", "path to MST test directory.", true);
   op.addOption("b", "path to a binary FASST database.", true);
+  op.addOption("nt", "number of threads to search for TERMs with (default 1).");
   op.setOptions(argc, argv);
 
   MstUtils::setSignalHandlers();
@@ -27,6 +28,13 @@ int main(int argc, char *argv[]) {
   F.readDatabase(op.getString("b"));
   TERMANAL T(&F); T.readRotamerLibrary("testfiles/rotlib.bin");
   T.setCompatMode(true);
+  vector<FASST*> workers;
+  for (int t = 1; t < op.getInt("nt", 1); t++) {
+    workers.push_back(new FASST());
+    workers.back()->setSearchType(FASST::searchType::CA);
+    workers.back()->readDatabase(op.getString("b"));
+  }
+  T.setWorkerFASSTs(workers);
 
   auto begin = chrono::high_resolution_clock::now();
   cout << "scoring..." << endl;
@@ -35,4 +43,14 @@ int main(int argc, char *argv[]) {
   for (int i = 0; i < subR.size(); i++) cout << "structure score for " << *(subR[i]) << " = " << structScores[i] << endl;
   auto end = chrono::high_resolution_clock::now();
   cout << "scoring took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+
+  // scoring the same backbone again only needs TERM matches from the cache
+  begin = chrono::high_resolution_clock::now();
+  int numCached = T.matchCacheSize();
+  vector<mstreal> rescored = T.scoreStructure(subS);
+  end = chrono::high_resolution_clock::now();
+  MstUtils::assertCond(rescored == structScores, "re-scoring the structure gave different scores");
+  MstUtils::assertCond(T.matchCacheSize() == numCached, "re-scoring the structure searched for new TERMs");
+  cout << "re-scoring from " << numCached << " cached TERMs took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+  for (FASST* worker : workers) delete worker;
 }